@@ -0,0 +1,60 @@
+#ifndef COMMAND_TRACE_H
+#define COMMAND_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// End-to-end command tracing. Every command gets a 16-bit trace id when it
+// is created: the web page numbers its own 1..0x7FFF, the ESP takes ids from
+// 0x8000 up for commands it makes itself (REQ_ODOM polling). The ESP sends
+// "#<id> <cmd>", the Mega replies as usual and then sends
+//   TR <id> <rx us> <actuation> <ack>
+// with rx on its own micros() clock and the other two in us after it
+// (actuation -1 if the motors weren't written). With the ESP's timestamps
+// around it, that splits the round trip into the stages below. The page adds its own
+// round trip less the ESP's time as the "wifi" stage (metricsRecordWifi).
+//
+// The Mega clock is mapped onto the ESP's NTP-style: each round trip gives
+// an offset estimate good to half its network delay, a bound that grows with
+// its age by the worst-case clock drift, and the recent round trip with the
+// tightest bound is used. The reply line's own transmission time is taken
+// out first, so the two link directions look alike. Plain C++ without Arduino calls, so the
+// simulator (sim/scenario_trace.cpp) runs the same code.
+
+enum TraceStage {
+  TRACE_ESP = 0,        // ESP receive -> last byte of the command sent
+  TRACE_UART_OUT,       // -> Mega read the line
+  TRACE_MEGA_EXEC,      // -> motors written; 0 if the command didn't drive them
+  TRACE_MEGA_REPLY,     // actuation (or read) -> reply queued on the Mega
+  TRACE_UART_BACK,      // -> reply line read by the ESP
+  TRACE_TOTAL,          // ESP receive -> reply read
+  TRACE_STAGE_COUNT
+};
+
+#define TRACE_ESP_ID_BASE 0x8000
+
+struct TraceResult {
+  uint16_t id;
+  bool actuated;
+  uint32_t stageUs[TRACE_STAGE_COUNT];
+};
+
+struct TraceClock {
+  int32_t offsetUs;         // Mega micros() minus ESP micros()
+  uint32_t uncertaintyUs;   // bound on the offset error, see above
+  uint8_t samples;          // round trips available, 0 = no estimate yet
+  uint32_t completed;       // traces with a TR line
+  uint32_t lost;            // traced commands whose TR line never came
+};
+
+uint16_t traceNextId();
+// After the command's last byte has left the ESP
+void traceCommandSent(uint16_t id, uint32_t receivedUs, uint32_t sentUs);
+// Every OK/ERR line; lineBytes includes the line ending
+void traceReplyReceived(uint32_t nowUs, size_t lineBytes);
+// A "TR ..." line; true with out filled in if it matched a sent command
+bool traceMegaReport(const char* line, uint32_t nowUs, TraceResult& out);
+void traceGetClock(TraceClock& out);
+const char* traceStageName(uint8_t stage);
+
+#endif // COMMAND_TRACE_H
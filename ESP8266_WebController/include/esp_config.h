@@ -19,9 +19,33 @@
 #define HEARTBEAT_INTERVAL_MS 1000
 #define STATUS_UPDATE_INTERVAL_MS 500
 
+// Link bring-up (link_handshake.h): HELLO probes until the Mega's READY
+#define LINK_PROBE_FIRST_MS 20         // first retry; the gap doubles each time
+#define LINK_PROBE_MAX_MS 1000
+#define LINK_RESTART_SLACK_MS 100      // a READY's up_ms this far short of the expected still counts as the same boot
+#define LINK_HOLD_MS 1000              // a page command waits this long for the link
+
 // Maximum command length
 #define MAX_COMMAND_LENGTH 200
 
+// Log every line sent to and received from the robot on Serial. That is the
+// Mega link itself: the Mega answers each log line with ERR UNKNOWN_CMD,
+// which gets logged in turn, so only turn this on with no Mega attached.
+#define LOG_ROBOT_TRAFFIC 0
+
+// Command tracing (command_trace.h): commands go out as "#<id> <cmd>" and
+// the Mega answers with a TR timestamp line. Set to 0 for older Mega firmware.
+#define TRACE_COMMANDS 1
+#define TRACE_PENDING 8                // traced commands awaiting their TR line
+#define TRACE_SYNC_SAMPLES 16          // recent round trips kept for the clock offset
+#define TRACE_DRIFT_PPM 100            // worst-case ESP/Mega clock rate difference assumed
+
+// Telemetry history (10 bytes per sample, ~11.7 KB total)
+#define HISTORY_RAW_SAMPLES 512        // ~100 s of ODOM at 5 Hz
+#define HISTORY_1S_SAMPLES 300         // 5 minutes
+#define HISTORY_10S_SAMPLES 360        // 1 hour
+#define HISTORY_MAX_GAP_MS 30000       // longer ODOM gaps start a new history
+
 // Robot control constants
 #define DEFAULT_SPEED 150
 #define MAX_SPEED 255
@@ -0,0 +1,57 @@
+#ifndef LINK_HANDSHAKE_H
+#define LINK_HANDSHAKE_H
+
+#include <stdint.h>
+
+// Bring-up of the Mega link, driven by what arrives instead of fixed waits.
+// The Mega announces itself as soon as its setup() is done,
+//   READY proto=<n> up_ms=<ms> <capability>...
+// and answers HELLO with the same line. From boot the ESP sends HELLO, at
+// once and then with exponential backoff (LINK_PROBE_FIRST_MS doubling up
+// to LINK_PROBE_MAX_MS), and the link is up at the first READY, or at any
+// other line from firmware that predates the handshake. No line for
+// COMMAND_TIMEOUT_MS takes it back to probing. A READY whose up_ms is
+// short of the previous one plus the time since (less LINK_RESTART_SLACK_MS)
+// means the Mega restarted and lost its state, even when it came back
+// before the link timed out. Plain C++ without
+// Arduino calls, so the simulator (sim/scenario_bringup.cpp) runs the same
+// code.
+
+enum LinkState {
+  LINK_PROBING = 0,
+  LINK_UP
+};
+
+// What a line from the Mega did to the link
+enum LinkEvent {
+  LINK_NO_CHANGE = 0,
+  LINK_CAME_UP,          // first contact, or the Mega restarted and lost its state
+  LINK_RESUMED           // back after a silence, same Mega boot
+};
+
+#define LINK_CAPS_MAX 64
+
+struct LinkStatus {
+  LinkState state;
+  uint32_t sinceMs;          // ESP millis() the current state was entered
+  uint32_t firstUpMs;        // ESP millis() the link first came up (bringUps > 0)
+  uint32_t probes;           // HELLOs sent
+  uint32_t bringUps;         // LINK_CAME_UP and LINK_RESUMED events
+  uint32_t megaRestarts;
+  uint8_t protocol;          // from READY; 0 without one
+  uint32_t megaUpMs;         // up_ms of the latest READY
+  char caps[LINK_CAPS_MAX];  // capability words of the latest READY
+};
+
+void linkBegin(uint32_t nowMs);
+// True when a HELLO is due now; the caller sends it
+bool linkProbeDue(uint32_t nowMs);
+// Every line from the Mega
+LinkEvent linkLineReceived(const char* line, uint32_t nowMs);
+// Called after COMMAND_TIMEOUT_MS without a line
+void linkLost(uint32_t nowMs);
+bool linkUp();
+void linkGetStatus(LinkStatus& s);
+const char* linkStateName(LinkState s);
+
+#endif // LINK_HANDSHAKE_H
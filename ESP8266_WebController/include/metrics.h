@@ -0,0 +1,49 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include "command_trace.h"
+
+// Runtime counters for /metrics. Everything is a fixed-size global, so
+// recording and rendering never touch the heap.
+
+enum MetricsRoute {
+  ROUTE_ROOT = 0,
+  ROUTE_COMMAND,
+  ROUTE_STATUS,
+  ROUTE_HISTORY,
+  ROUTE_METRICS,
+  ROUTE_OTHER,
+  ROUTE_COUNT
+};
+
+#define METRICS_BUCKETS 11
+
+struct LatencyHistogram {
+  uint32_t buckets[METRICS_BUCKETS + 1];   // last one is +Inf
+  uint32_t count;
+  uint64_t sumUs;
+};
+
+struct LinkCounters {
+  uint32_t rxBytes;
+  uint32_t txBytes;
+  uint32_t framingErrors;
+  uint32_t overruns;
+  uint32_t lineOverflows;      // lines longer than MAX_COMMAND_LENGTH
+  uint32_t unanswered;         // commands with no OK/ERR within COMMAND_TIMEOUT_MS
+};
+
+extern LinkCounters linkCounters;
+
+typedef void (*MetricsWriter)(const char* text, size_t len, void* ctx);
+
+void metricsRecordRequest(MetricsRoute route, unsigned long durationUs);
+void metricsCommandSent(unsigned long nowUs);
+void metricsReplyReceived(unsigned long nowUs);
+void metricsCountTx(size_t bytes);
+void metricsRecordTrace(const TraceResult& trace);
+void metricsRecordWifi(unsigned long us);   // page RTT less ESP time, reported by the page
+void metricsRender(MetricsWriter write, void* ctx);
+
+#endif // METRICS_H
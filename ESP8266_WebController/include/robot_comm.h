@@ -7,6 +7,8 @@ struct RobotStatus {
   bool connected;
   unsigned long lastResponse;
   String lastOdometry;
+  String lastSensors;
+  String lastTrip;          // latest safety cutoff report from the Mega
   bool motorsEnabled;
   int currentSpeed;
 };
@@ -15,6 +17,8 @@ extern RobotStatus robotStatus;
 
 void setupRobotCommunication();
 void sendCommandToRobot(String command);
+// Traced command from the web page: its trace id and when the ESP got it
+void sendCommandToRobot(String command, uint16_t traceId, unsigned long receivedUs);
 void processRobotResponse();
 void handleRobotMessage(String message);
 bool waitForRobotResponse(unsigned long timeout = 1000);
@@ -0,0 +1,33 @@
+#ifndef TELEMETRY_HISTORY_H
+#define TELEMETRY_HISTORY_H
+
+#include <Arduino.h>
+
+// On-device odometry history in three resolutions: every ODOM sample, and
+// 1 s / 10 s sums of them. Times are ESP millis() at arrival.
+
+enum HistoryRes {
+  HISTORY_RAW = 0,
+  HISTORY_1S = 1,
+  HISTORY_10S = 2,
+  HISTORY_LEVELS = 3
+};
+
+// Delta-encoded sample: time since the previous sample in the same level
+// and encoder ticks accumulated over that time.
+struct HistorySample {
+  uint16_t dtMs;
+  int16_t ticks[4];    // M1..M4
+};
+
+typedef void (*HistoryVisitor)(unsigned long timeMs, const HistorySample& sample, void* ctx);
+
+void historyRecordOdometry(const String& odomLine, unsigned long nowMs);
+void historyAdd(unsigned long nowMs, unsigned long megaDtMs, const long ticks[4]);
+void historyClear();
+size_t historyQuery(HistoryRes res, unsigned long fromMs, unsigned long toMs,
+                    HistoryVisitor visit, void* ctx);
+size_t historyCount(HistoryRes res);
+bool historyParseRes(const String& name, HistoryRes& res);
+
+#endif // TELEMETRY_HISTORY_H
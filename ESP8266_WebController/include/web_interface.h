@@ -10,6 +10,8 @@ void handleWebRequests();
 void handleRoot();
 void handleCommand();
 void handleStatus();
+void handleHistory();
+void handleMetrics();
 void handleNotFound();
 String generateControlPage();
 String generateJavaScript();
@@ -0,0 +1,142 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Native stand-in for the ESP8266 Arduino core: enough of it for the
+// controller in src/ to run on Linux (see esp_native.h). Time is the wall
+// clock; Serial is a file descriptor native_main.cpp opens, normally a
+// pseudo terminal with the simulated Mega on the other side.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <functional>
+
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// ---------------- Print / Stream ----------------
+class Print;
+
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n) {
+    size_t sent = 0;
+    while (n-- && write(*buf++)) sent++;
+    return sent;
+  }
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+  size_t write(const char *buf, size_t n) { return write((const uint8_t *)buf, n); }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(double v, int digits = 2) { return print(String(v, (unsigned char)digits)); }
+  size_t print(const Printable &p) { return p.printTo(*this); }
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[64];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) return 0;
+    if ((size_t)n < sizeof(buf)) return write(buf, n);
+    // Like the core: longer output takes a heap buffer
+    char *big = (char *)malloc(n + 1);
+    if (!big) return 0;
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    size_t sent = write(big, n);
+    free(big);
+    return sent;
+  }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(const T &v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(char *buf, size_t n) {
+    size_t got = 0;
+    while (got < n && available()) buf[got++] = (char)read();
+    return got;
+  }
+};
+
+class HardwareSerial : public Stream {
+public:
+  HardwareSerial() : rxFd_(-1), txFd_(-1), baud_(0), rxHead_(0), rxLen_(0), overrun_(false) {}
+  void begin(unsigned long baud) { baud_ = baud; }
+  void end() {}
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  void flush() override {}           // writes go straight to the descriptor
+  bool hasRxError() { return false; }
+  bool hasOverrun() { bool o = overrun_; overrun_ = false; return o; }
+  operator bool() { return txFd_ >= 0; }
+
+  // Host side
+  void nativeAttach(int rxFd, int txFd) { rxFd_ = rxFd; txFd_ = txFd; }
+  unsigned long nativeBaud() const { return baud_; }
+
+private:
+  void fill(bool dropOverflow);
+
+  int rxFd_, txFd_;
+  unsigned long baud_;
+  uint8_t rx_[256];                  // the core's default receive buffer
+  size_t rxHead_, rxLen_;
+  bool overrun_;
+};
+
+extern HardwareSerial Serial;
+
+// ---------------- ESP ----------------
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMaxFreeBlockSize();
+  uint8_t getHeapFragmentation();
+  void restart();
+};
+
+extern EspClass ESP;
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,318 @@
+#include "ESP8266WebServer.h"
+#include "esp_native.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char *const methodNames[] = {
+  "ANY", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"
+};
+
+ESP8266WebServer::ESP8266WebServer(int port)
+  : port_(port), listenFd_(-1), clientFd_(-1), clientSince_(0), requestLength_(0),
+    routeCount_(0), method_(HTTP_ANY), args_(nullptr), argCount_(0),
+    contentLength_(CONTENT_LENGTH_NOT_SET), chunked_(false), headerSent_(false),
+    contentEnded_(false) {}
+
+ESP8266WebServer::~ESP8266WebServer() {
+  close();
+}
+
+void ESP8266WebServer::begin() {
+  int port = nativeHttpPort(port_);
+  listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int one = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listenFd_, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd_, 4) < 0) {
+    fprintf(stderr, "web server: can't listen on 127.0.0.1:%d: %s\n", port, strerror(errno));
+    exit(1);
+  }
+  fprintf(stderr, "web server on http://127.0.0.1:%d/\n", port);
+}
+
+void ESP8266WebServer::close() {
+  closeClient();
+  if (listenFd_ >= 0) ::close(listenFd_);
+  listenFd_ = -1;
+}
+
+void ESP8266WebServer::on(const String &uri, HTTPMethod method, THandlerFunction handler) {
+  if (routeCount_ == MAX_ROUTES) return;
+  Route &r = routes_[routeCount_++];
+  r.uri = uri;
+  r.method = method;
+  r.handler = handler;
+}
+
+// ---------------- Receiving ----------------
+void ESP8266WebServer::handleClient() {
+  if (clientFd_ < 0) {
+    if (listenFd_ < 0) return;
+    clientFd_ = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK);
+    if (clientFd_ < 0) return;
+    clientSince_ = millis();
+    requestLength_ = 0;
+  }
+
+  bool closed = false;
+  while (requestLength_ < REQUEST_MAX - 1) {
+    ssize_t n = recv(clientFd_, request_ + requestLength_, REQUEST_MAX - 1 - requestLength_, 0);
+    if (n > 0) {
+      requestLength_ += n;
+    } else {
+      closed = n == 0;
+      break;
+    }
+  }
+  request_[requestLength_] = '\0';
+
+  size_t headerEnd, bodyLength;
+  if (requestComplete(headerEnd, bodyLength)) {
+    handleRequest(headerEnd, bodyLength);
+    closeClient();
+  } else if (closed || millis() - clientSince_ > HTTP_MAX_DATA_WAIT) {
+    closeClient();
+  } else if (requestLength_ == REQUEST_MAX - 1) {
+    static const char tooLarge[] = "HTTP/1.1 413 Payload Too Large\r\nConnection: close\r\n\r\n";
+    writeAll(tooLarge, sizeof(tooLarge) - 1);
+    closeClient();
+  }
+}
+
+bool ESP8266WebServer::requestComplete(size_t &headerEnd, size_t &bodyLength) {
+  const char *end = strstr(request_, "\r\n\r\n");
+  if (!end) return false;
+  headerEnd = end - request_ + 4;
+  bodyLength = 0;
+  for (const char *line = strstr(request_, "\r\n"); line && line < end; line = strstr(line + 2, "\r\n")) {
+    if (strncasecmp(line + 2, "Content-Length:", 15) == 0) bodyLength = strtoul(line + 17, nullptr, 10);
+  }
+  return requestLength_ >= headerEnd + bodyLength;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Form decoding: + is a space, %XX a byte
+static String urlDecode(const char *text, size_t length) {
+  String out;
+  out.reserve(length);
+  for (size_t i = 0; i < length; i++) {
+    char c = text[i];
+    if (c == '+') {
+      c = ' ';
+    } else if (c == '%' && i + 2 < length && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+      c = (char)(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+      i += 2;
+    }
+    out += c;
+  }
+  return out;
+}
+
+static int countParams(const char *text, size_t length) {
+  if (length == 0) return 0;
+  int n = 1;
+  for (size_t i = 0; i < length; i++) n += text[i] == '&';
+  return n;
+}
+
+// Query parameters, then the form fields of a form body; any other body
+// becomes the "plain" argument, as in the core
+void ESP8266WebServer::parseArguments(const char *query, size_t queryLength,
+                                      const char *body, size_t bodyLength, bool form) {
+  bool plain = !form && bodyLength > 0;
+  argCount_ = countParams(query, queryLength) + (form ? countParams(body, bodyLength) : plain);
+  args_ = argCount_ ? new RequestArgument[argCount_] : nullptr;
+  int i = 0;
+  const char *parts[2] = {query, form ? body : ""};
+  size_t lengths[2] = {queryLength, form ? bodyLength : 0};
+  for (int p = 0; p < 2; p++) {
+    const char *s = parts[p], *end = parts[p] + lengths[p];
+    while (s < end) {
+      const char *amp = (const char *)memchr(s, '&', end - s);
+      if (!amp) amp = end;
+      const char *eq = (const char *)memchr(s, '=', amp - s);
+      if (!eq) eq = amp;
+      args_[i].key = urlDecode(s, eq - s);
+      if (eq < amp) args_[i].value = urlDecode(eq + 1, amp - eq - 1);
+      i++;
+      s = amp + 1;
+    }
+  }
+  if (plain) {
+    args_[i].key = "plain";
+    args_[i].value = String(body, bodyLength);
+  }
+}
+
+void ESP8266WebServer::handleRequest(size_t headerEnd, size_t bodyLength) {
+  // "METHOD /path?query HTTP/1.1"
+  char *methodEnd = strchr(request_, ' ');
+  char *urlEnd = methodEnd ? strchr(methodEnd + 1, ' ') : nullptr;
+  if (!methodEnd || !urlEnd) return;
+  *methodEnd = '\0';
+  *urlEnd = '\0';
+  const char *url = methodEnd + 1;
+  const char *query = strchr(url, '?');
+  size_t pathLength = query ? (size_t)(query - url) : strlen(url);
+
+  method_ = HTTP_ANY;
+  for (uint8_t m = HTTP_GET; m <= HTTP_OPTIONS; m++) {
+    if (strcmp(request_, methodNames[m]) == 0) method_ = (HTTPMethod)m;
+  }
+  char scopeName[32];
+  snprintf(scopeName, sizeof(scopeName), "%.*s", (int)pathLength, url);
+  heapRequestBegin(request_, scopeName);
+
+  uri_ = String(url, pathLength);
+  const char *body = request_ + headerEnd;
+  bool form = false;
+  for (const char *line = strstr(urlEnd + 1, "\r\n"); line && line < body; line = strstr(line + 2, "\r\n")) {
+    if (strncasecmp(line + 2, "Content-Type:", 13) != 0) continue;
+    const char *type = strstr(line + 2, "application/x-www-form-urlencoded");
+    form = type && type < strstr(line + 2, "\r\n");
+  }
+  parseArguments(query ? query + 1 : "", query ? strlen(query + 1) : 0, body, bodyLength, form);
+
+  contentLength_ = CONTENT_LENGTH_NOT_SET;
+  chunked_ = headerSent_ = contentEnded_ = false;
+  Route *route = nullptr;
+  for (uint8_t i = 0; i < routeCount_ && !route; i++) {
+    Route &r = routes_[i];
+    if (r.uri == uri_ && (r.method == HTTP_ANY || r.method == method_)) route = &r;
+  }
+  if (route) {
+    route->handler();
+  } else if (notFound_) {
+    notFound_();
+  } else {
+    send(404, "text/plain", String("Not found: ") + uri_);
+  }
+  if (chunked_ && !contentEnded_) sendContent("", 0);
+
+  delete[] args_;
+  args_ = nullptr;
+  argCount_ = 0;
+  uri_ = String();
+  heapRequestEnd();
+}
+
+String ESP8266WebServer::arg(const String &name) const {
+  for (int i = 0; i < argCount_; i++) {
+    if (args_[i].key == name) return args_[i].value;
+  }
+  return String();
+}
+
+String ESP8266WebServer::arg(int i) const {
+  return i >= 0 && i < argCount_ ? args_[i].value : String();
+}
+
+String ESP8266WebServer::argName(int i) const {
+  return i >= 0 && i < argCount_ ? args_[i].key : String();
+}
+
+bool ESP8266WebServer::hasArg(const String &name) const {
+  for (int i = 0; i < argCount_; i++) {
+    if (args_[i].key == name) return true;
+  }
+  return false;
+}
+
+// ---------------- Sending ----------------
+static const char *reason(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    default: return "";
+  }
+}
+
+// Built in a String, as the core's _prepareHeader does
+void ESP8266WebServer::sendHeader(int code, const char *contentType, size_t length) {
+  String header = "HTTP/1.1 ";
+  header += code;
+  header += ' ';
+  header += reason(code);
+  header += "\r\nContent-Type: ";
+  header += contentType ? contentType : "text/html";
+  if (contentLength_ != CONTENT_LENGTH_NOT_SET) length = contentLength_;
+  if (length == CONTENT_LENGTH_UNKNOWN) {
+    chunked_ = true;
+    header += "\r\nTransfer-Encoding: chunked";
+  } else {
+    header += "\r\nContent-Length: ";
+    header += (unsigned long)length;
+  }
+  header += "\r\nConnection: close\r\n\r\n";
+  contentLength_ = CONTENT_LENGTH_NOT_SET;
+  headerSent_ = true;
+  writeAll(header.c_str(), header.length());
+}
+
+void ESP8266WebServer::send(int code, const char *contentType, const String &content) {
+  sendHeader(code, contentType, content.length());
+  if (content.length()) sendContent(content);
+}
+
+void ESP8266WebServer::send(int code, const char *contentType, const char *content) {
+  size_t length = content ? strlen(content) : 0;
+  sendHeader(code, contentType, length);
+  if (length) sendContent(content, length);
+}
+
+void ESP8266WebServer::sendContent(const char *content, size_t length) {
+  if (clientFd_ < 0 || contentEnded_) return;
+  if (!chunked_) {
+    writeAll(content, length);
+    return;
+  }
+  char size[12];
+  int n = snprintf(size, sizeof(size), "%zx\r\n", length);
+  writeAll(size, n);
+  writeAll(content, length);
+  writeAll("\r\n", 2);
+  if (length == 0) contentEnded_ = true;
+}
+
+bool ESP8266WebServer::writeAll(const char *data, size_t length) {
+  while (length > 0 && clientFd_ >= 0) {
+    ssize_t n = ::send(clientFd_, data, length, MSG_NOSIGNAL);
+    if (n > 0) {
+      data += n;
+      length -= n;
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      struct pollfd pfd = {clientFd_, POLLOUT, 0};
+      if (poll(&pfd, 1, HTTP_MAX_DATA_WAIT) > 0) continue;
+    }
+    closeClient();
+    return false;
+  }
+  return length == 0;
+}
+
+void ESP8266WebServer::closeClient() {
+  if (clientFd_ >= 0) ::close(clientFd_);
+  clientFd_ = -1;
+  requestLength_ = 0;
+}
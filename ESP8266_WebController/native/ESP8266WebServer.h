@@ -0,0 +1,95 @@
+#ifndef NATIVE_ESP8266WEBSERVER_H
+#define NATIVE_ESP8266WEBSERVER_H
+
+// The ESP8266WebServer API on a local TCP socket. Like the core's, it
+// serves one client at a time from handleClient(), keeps the request's
+// URI and arguments in Strings, builds the response header in a String and
+// closes the connection after each response, so the heap model charges a
+// request what it would cost on the ESP. Each request is reported to the
+// model as "<method> <path>".
+
+#include <Arduino.h>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+#define HTTP_MAX_DATA_WAIT 5000        // ms for the whole request to arrive
+
+class ESP8266WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit ESP8266WebServer(int port = 80);
+  ~ESP8266WebServer();
+
+  void begin();
+  void close();
+  void handleClient();
+
+  void on(const String &uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+  void on(const String &uri, HTTPMethod method, THandlerFunction handler);
+  void onNotFound(THandlerFunction handler) { notFound_ = handler; }
+
+  const String &uri() const { return uri_; }
+  HTTPMethod method() const { return method_; }
+  String arg(const String &name) const;
+  String arg(int i) const;
+  String argName(int i) const;
+  int args() const { return argCount_; }
+  bool hasArg(const String &name) const;
+
+  void send(int code, const char *contentType = NULL, const String &content = String(""));
+  void send(int code, const char *contentType, const char *content);
+  void send(int code, const String &contentType, const String &content) {
+    send(code, contentType.c_str(), content);
+  }
+  void setContentLength(size_t length) { contentLength_ = length; }
+  void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char *content, size_t length);
+
+private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+  };
+  struct RequestArgument {
+    String key;
+    String value;
+  };
+
+  static const uint8_t MAX_ROUTES = 16;
+  static const size_t REQUEST_MAX = 2048;
+
+  bool requestComplete(size_t &headerEnd, size_t &bodyLength);
+  void handleRequest(size_t headerEnd, size_t bodyLength);
+  void parseArguments(const char *query, size_t queryLength, const char *body, size_t bodyLength,
+                      bool form);
+  void sendHeader(int code, const char *contentType, size_t length);
+  bool writeAll(const char *data, size_t length);
+  void closeClient();
+
+  int port_;
+  int listenFd_;
+  int clientFd_;
+  unsigned long clientSince_;
+  char request_[REQUEST_MAX];        // lwIP's buffers on the ESP, so not on the model heap
+  size_t requestLength_;
+
+  Route routes_[MAX_ROUTES];
+  uint8_t routeCount_;
+  THandlerFunction notFound_;
+
+  String uri_;
+  HTTPMethod method_;
+  RequestArgument *args_;
+  int argCount_;
+
+  size_t contentLength_;
+  bool chunked_;
+  bool headerSent_;
+  bool contentEnded_;
+};
+
+#endif // NATIVE_ESP8266WEBSERVER_H
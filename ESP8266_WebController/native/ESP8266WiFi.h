@@ -0,0 +1,54 @@
+#ifndef NATIVE_ESP8266WIFI_H
+#define NATIVE_ESP8266WIFI_H
+
+// No radio on the host: the access point calls succeed and report the
+// configured address, and the web server listens on the host's loopback.
+
+#include <Arduino.h>
+
+class IPAddress : public Printable {
+public:
+  IPAddress() : addr_{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr_{a, b, c, d} {}
+  uint8_t operator[](int i) const { return addr_[i]; }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", addr_[0], addr_[1], addr_[2], addr_[3]);
+    return String(buf);
+  }
+  size_t printTo(Print &p) const override { return p.print(toString()); }
+
+private:
+  uint8_t addr_[4];
+};
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+
+enum wl_status_t { WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL = 1, WL_CONNECTED = 3, WL_DISCONNECTED = 6 };
+
+class ESP8266WiFiClass {
+public:
+  ESP8266WiFiClass() : mode_(WIFI_OFF) {}
+  bool mode(WiFiMode_t m) { mode_ = m; return true; }
+  WiFiMode_t getMode() const { return mode_; }
+  bool softAPConfig(IPAddress local, IPAddress gateway, IPAddress subnet) {
+    (void)gateway;
+    (void)subnet;
+    apIp_ = local;
+    return true;
+  }
+  bool softAP(const char *ssid, const char *password) { (void)ssid; (void)password; return true; }
+  IPAddress softAPIP() const { return apIp_; }
+  String softAPmacAddress() const { return String("02:00:00:00:00:01"); }
+  uint8_t softAPgetStationNum() const { return 0; }
+  wl_status_t status() const { return WL_DISCONNECTED; }
+  int32_t RSSI() const { return 0; }
+
+private:
+  WiFiMode_t mode_;
+  IPAddress apIp_;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif // NATIVE_ESP8266WIFI_H
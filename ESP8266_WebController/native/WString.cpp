@@ -0,0 +1,360 @@
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------- Buffer ----------------
+String::String(const char *cstr) : ptr_(nullptr), cap_(SSO_SIZE), len_(0), sso_(true) {
+  inline_[0] = '\0';
+  if (cstr) copy(cstr, strlen(cstr));
+}
+
+String::String(const char *cstr, unsigned int length) : String() {
+  if (cstr) copy(cstr, length);
+}
+
+String::String(const String &str) : String() {
+  *this = str;
+}
+
+String::String(String &&rval) : String() {
+  move(rval);
+}
+
+String::String(StringSumHelper &&rval) : String() {
+  move(rval);
+}
+
+String::String(char c) : String() {
+  char buf[2] = {c, '\0'};
+  *this = buf;
+}
+
+String::String(unsigned char value, unsigned char base) : String((unsigned long)value, base) {}
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base) : String() {
+  if (base == DEC) concatNumber("%ld", value);
+  else concatNumber(base == HEX ? "%lx" : "%lo", (unsigned long)value);
+}
+
+String::String(unsigned long value, unsigned char base) : String() {
+  concatNumber(base == HEX ? "%lx" : base == OCT ? "%lo" : "%lu", value);
+}
+
+String::String(float value, unsigned char decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, unsigned char decimalPlaces) : String() {
+  concatNumber("%.*f", decimalPlaces, value);
+}
+
+String::~String() {
+  if (!sso_) free(ptr_);
+}
+
+void String::invalidate() {
+  if (!sso_) free(ptr_);
+  ptr_ = nullptr;
+  sso_ = true;
+  cap_ = SSO_SIZE;
+  len_ = 0;
+  inline_[0] = '\0';
+}
+
+bool String::reserve(unsigned int size) {
+  if (cap_ >= size) return true;
+  return changeBuffer(size);
+}
+
+// Rounded up to 16 bytes like the ESP core, so appending a char at a time
+// reallocates every 16th char
+bool String::changeBuffer(unsigned int maxStrLen) {
+  if (maxStrLen <= SSO_SIZE && sso_) return true;
+  size_t newSize = (maxStrLen + 16) & ~(size_t)0xf;
+  char *newBuffer = (char *)realloc(sso_ ? nullptr : ptr_, newSize);
+  if (!newBuffer) {
+    invalidate();
+    return false;
+  }
+  if (sso_) memcpy(newBuffer, inline_, len_ + 1);
+  ptr_ = newBuffer;
+  sso_ = false;
+  cap_ = newSize - 1;
+  return true;
+}
+
+String &String::copy(const char *cstr, unsigned int length) {
+  if (!reserve(length)) return *this;
+  len_ = length;
+  memmove(wbuffer(), cstr, length);
+  wbuffer()[length] = '\0';
+  return *this;
+}
+
+void String::move(String &rhs) {
+  if (this == &rhs) return;
+  if (!sso_) free(ptr_);
+  ptr_ = rhs.ptr_;
+  cap_ = rhs.cap_;
+  len_ = rhs.len_;
+  sso_ = rhs.sso_;
+  memcpy(inline_, rhs.inline_, sizeof(inline_));
+  rhs.ptr_ = nullptr;
+  rhs.sso_ = true;
+  rhs.cap_ = SSO_SIZE;
+  rhs.len_ = 0;
+  rhs.inline_[0] = '\0';
+}
+
+String &String::operator=(const String &rhs) {
+  if (this == &rhs) return *this;
+  return copy(rhs.buffer(), rhs.len_);
+}
+
+String &String::operator=(const char *cstr) {
+  if (!cstr) {
+    invalidate();
+    return *this;
+  }
+  return copy(cstr, strlen(cstr));
+}
+
+String &String::operator=(String &&rval) {
+  move(rval);
+  return *this;
+}
+
+String &String::operator=(StringSumHelper &&rval) {
+  move(rval);
+  return *this;
+}
+
+// ---------------- Concatenation ----------------
+bool String::concat(const String &str) {
+  // Appending to itself must not read the buffer after it moved
+  if (&str == this) {
+    unsigned int n = len_;
+    if (!reserve(2 * n)) return false;
+    memcpy(wbuffer() + n, buffer(), n);
+    len_ = 2 * n;
+    wbuffer()[len_] = '\0';
+    return true;
+  }
+  return concat(str.buffer(), str.len_);
+}
+
+bool String::concat(const char *cstr) {
+  return cstr && concat(cstr, strlen(cstr));
+}
+
+bool String::concat(const char *cstr, unsigned int length) {
+  if (!cstr) return false;
+  if (length == 0) return true;
+  if (!reserve(len_ + length)) return false;
+  memmove(wbuffer() + len_, cstr, length);
+  len_ += length;
+  wbuffer()[len_] = '\0';
+  return true;
+}
+
+bool String::concat(char c) {
+  return concat(&c, 1);
+}
+
+bool String::concatNumber(const char *fmt, ...) {
+  char buf[40];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n < 0) return false;
+  return concat(buf, (unsigned int)n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+bool String::concat(unsigned char num) { return concatNumber("%u", num); }
+bool String::concat(int num) { return concatNumber("%d", num); }
+bool String::concat(unsigned int num) { return concatNumber("%u", num); }
+bool String::concat(long num) { return concatNumber("%ld", num); }
+bool String::concat(unsigned long num) { return concatNumber("%lu", num); }
+bool String::concat(float num) { return concatNumber("%.2f", num); }
+bool String::concat(double num) { return concatNumber("%.2f", num); }
+
+StringSumHelper &operator+(const StringSumHelper &lhs, const String &rhs) {
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  if (!a.concat(rhs)) a.invalidate();
+  return a;
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, const char *cstr) {
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  if (!a.concat(cstr)) a.invalidate();
+  return a;
+}
+
+template <typename T> static StringSumHelper &sumNumber(const StringSumHelper &lhs, T num) {
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(num);
+  return a;
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, char c) { return sumNumber(lhs, c); }
+StringSumHelper &operator+(const StringSumHelper &lhs, int num) { return sumNumber(lhs, num); }
+StringSumHelper &operator+(const StringSumHelper &lhs, unsigned int num) { return sumNumber(lhs, num); }
+StringSumHelper &operator+(const StringSumHelper &lhs, long num) { return sumNumber(lhs, num); }
+StringSumHelper &operator+(const StringSumHelper &lhs, unsigned long num) { return sumNumber(lhs, num); }
+StringSumHelper &operator+(const StringSumHelper &lhs, float num) { return sumNumber(lhs, num); }
+StringSumHelper &operator+(const StringSumHelper &lhs, double num) { return sumNumber(lhs, num); }
+
+// ---------------- Comparison ----------------
+int String::compareTo(const String &s) const {
+  return strcmp(buffer(), s.buffer());
+}
+
+bool String::equals(const String &s) const {
+  return len_ == s.len_ && memcmp(buffer(), s.buffer(), len_) == 0;
+}
+
+bool String::equals(const char *cstr) const {
+  if (!cstr) return len_ == 0;
+  return strcmp(buffer(), cstr) == 0;
+}
+
+bool String::equalsIgnoreCase(const String &s) const {
+  return len_ == s.len_ && strncasecmp(buffer(), s.buffer(), len_) == 0;
+}
+
+bool String::startsWith(const String &prefix, unsigned int offset) const {
+  if (offset > len_ || prefix.len_ > len_ - offset) return false;
+  return memcmp(buffer() + offset, prefix.buffer(), prefix.len_) == 0;
+}
+
+bool String::endsWith(const String &suffix) const {
+  if (suffix.len_ > len_) return false;
+  return memcmp(buffer() + len_ - suffix.len_, suffix.buffer(), suffix.len_) == 0;
+}
+
+// ---------------- Access and search ----------------
+char &String::operator[](unsigned int index) {
+  static char dummy;
+  if (index >= len_) {
+    dummy = '\0';
+    return dummy;
+  }
+  return wbuffer()[index];
+}
+
+void String::toCharArray(char *buf, unsigned int bufsize, unsigned int index) const {
+  if (!bufsize || !buf) return;
+  if (index >= len_) {
+    buf[0] = '\0';
+    return;
+  }
+  unsigned int n = bufsize - 1;
+  if (n > len_ - index) n = len_ - index;
+  memcpy(buf, buffer() + index, n);
+  buf[n] = '\0';
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+  if (fromIndex >= len_) return -1;
+  const char *p = (const char *)memchr(buffer() + fromIndex, ch, len_ - fromIndex);
+  return p ? p - buffer() : -1;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const {
+  if (fromIndex >= len_) return -1;
+  const char *p = strstr(buffer() + fromIndex, str.buffer());
+  return p ? p - buffer() : -1;
+}
+
+int String::lastIndexOf(char ch) const {
+  return len_ ? lastIndexOf(ch, len_ - 1) : -1;
+}
+
+int String::lastIndexOf(char ch, unsigned int fromIndex) const {
+  if (fromIndex >= len_) return -1;
+  for (int i = fromIndex; i >= 0; i--) {
+    if (buffer()[i] == ch) return i;
+  }
+  return -1;
+}
+
+String String::substring(unsigned int left, unsigned int right) const {
+  if (left > right) {
+    unsigned int t = left;
+    left = right;
+    right = t;
+  }
+  if (left >= len_) return String();
+  if (right > len_) right = len_;
+  return String(buffer() + left, right - left);
+}
+
+// ---------------- Modification ----------------
+void String::replace(char find, char replace) {
+  for (char *p = wbuffer(); *p; p++) {
+    if (*p == find) *p = replace;
+  }
+}
+
+void String::replace(const String &find, const String &replace) {
+  if (len_ == 0 || find.len_ == 0) return;
+  String out;
+  const char *s = buffer();
+  const char *hit;
+  while ((hit = strstr(s, find.buffer())) != nullptr) {
+    out.concat(s, hit - s);
+    out.concat(replace);
+    s = hit + find.len_;
+  }
+  out.concat(s);
+  *this = static_cast<String &&>(out);
+}
+
+void String::remove(unsigned int index) {
+  remove(index, (unsigned int)-1);
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if (index >= len_ || count == 0) return;
+  if (count > len_ - index) count = len_ - index;
+  char *p = wbuffer();
+  memmove(p + index, p + index + count, len_ - index - count + 1);
+  len_ -= count;
+}
+
+void String::toLowerCase() {
+  for (char *p = wbuffer(); *p; p++) *p = tolower((unsigned char)*p);
+}
+
+void String::toUpperCase() {
+  for (char *p = wbuffer(); *p; p++) *p = toupper((unsigned char)*p);
+}
+
+void String::trim() {
+  if (len_ == 0) return;
+  char *p = wbuffer();
+  unsigned int b = 0, e = len_;
+  while (b < e && isspace((unsigned char)p[b])) b++;
+  while (e > b && isspace((unsigned char)p[e - 1])) e--;
+  len_ = e - b;
+  if (b > 0) memmove(p, p + b, len_);
+  p[len_] = '\0';
+}
+
+// ---------------- Conversion ----------------
+long String::toInt() const {
+  return atol(buffer());
+}
+
+float String::toFloat() const {
+  return (float)atof(buffer());
+}
+
+double String::toDouble() const {
+  return atof(buffer());
+}
@@ -0,0 +1,142 @@
+#ifndef NATIVE_WSTRING_H
+#define NATIVE_WSTRING_H
+
+// The ESP8266 core's String, allocation for allocation: up to 11 chars
+// inline, longer ones in a malloc'd buffer grown by realloc to the next
+// multiple of 16, and a + b + c built up in a StringSumHelper copy of a.
+// The heap model (esp_native.h) sees the same calls the ESP would make.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+
+class StringSumHelper;
+
+class String {
+public:
+  String(const char *cstr = "");
+  String(const char *cstr, unsigned int length);
+  String(const String &str);
+  String(String &&rval);
+  String(StringSumHelper &&rval);
+  explicit String(char c);
+  explicit String(unsigned char value, unsigned char base = DEC);
+  explicit String(int value, unsigned char base = DEC);
+  explicit String(unsigned int value, unsigned char base = DEC);
+  explicit String(long value, unsigned char base = DEC);
+  explicit String(unsigned long value, unsigned char base = DEC);
+  explicit String(float value, unsigned char decimalPlaces = 2);
+  explicit String(double value, unsigned char decimalPlaces = 2);
+  ~String();
+
+  // false if the buffer couldn't be had; the string is then invalid (empty)
+  bool reserve(unsigned int size);
+  unsigned int length() const { return len_; }
+  bool isEmpty() const { return len_ == 0; }
+
+  String &operator=(const String &rhs);
+  String &operator=(const char *cstr);
+  String &operator=(String &&rval);
+  String &operator=(StringSumHelper &&rval);
+
+  bool concat(const String &str);
+  bool concat(const char *cstr);
+  bool concat(const char *cstr, unsigned int length);
+  bool concat(char c);
+  bool concat(unsigned char num);
+  bool concat(int num);
+  bool concat(unsigned int num);
+  bool concat(long num);
+  bool concat(unsigned long num);
+  bool concat(float num);
+  bool concat(double num);
+
+  template <typename T> String &operator+=(const T &rhs) { concat(rhs); return *this; }
+  String &operator+=(const char *cstr) { concat(cstr); return *this; }
+
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, const String &rhs);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, const char *cstr);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, char c);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, int num);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, unsigned int num);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, long num);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, unsigned long num);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, float num);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, double num);
+
+  int compareTo(const String &s) const;
+  bool equals(const String &s) const;
+  bool equals(const char *cstr) const;
+  bool operator==(const String &rhs) const { return equals(rhs); }
+  bool operator==(const char *cstr) const { return equals(cstr); }
+  bool operator!=(const String &rhs) const { return !equals(rhs); }
+  bool operator!=(const char *cstr) const { return !equals(cstr); }
+  bool operator<(const String &rhs) const { return compareTo(rhs) < 0; }
+  bool equalsIgnoreCase(const String &s) const;
+  bool startsWith(const String &prefix) const { return startsWith(prefix, 0); }
+  bool startsWith(const String &prefix, unsigned int offset) const;
+  bool endsWith(const String &suffix) const;
+
+  char charAt(unsigned int index) const { return index < len_ ? buffer()[index] : 0; }
+  void setCharAt(unsigned int index, char c) { if (index < len_) wbuffer()[index] = c; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char &operator[](unsigned int index);
+  void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const;
+  const char *c_str() const { return buffer(); }
+  const char *begin() const { return buffer(); }
+  const char *end() const { return buffer() + len_; }
+
+  int indexOf(char ch, unsigned int fromIndex = 0) const;
+  int indexOf(const String &str, unsigned int fromIndex = 0) const;
+  int lastIndexOf(char ch) const;
+  int lastIndexOf(char ch, unsigned int fromIndex) const;
+  String substring(unsigned int beginIndex) const { return substring(beginIndex, len_); }
+  String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+  void replace(char find, char replace);
+  void replace(const String &find, const String &replace);
+  void remove(unsigned int index);
+  void remove(unsigned int index, unsigned int count);
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  long toInt() const;
+  float toFloat() const;
+  double toDouble() const;
+
+private:
+  static const unsigned int SSO_SIZE = 11;   // chars held inline, as on the ESP
+
+  const char *buffer() const { return sso_ ? inline_ : ptr_; }
+  char *wbuffer() { return sso_ ? inline_ : ptr_; }
+  bool changeBuffer(unsigned int maxStrLen);
+  void invalidate();
+  String &copy(const char *cstr, unsigned int length);
+  void move(String &rhs);
+  bool concatNumber(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  char *ptr_;
+  unsigned int cap_;     // chars, not counting the NUL
+  unsigned int len_;
+  bool sso_;
+  char inline_[SSO_SIZE + 1];
+};
+
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String &s) : String(s) {}
+  StringSumHelper(const char *p) : String(p) {}
+  StringSumHelper(char c) : String(c) {}
+  StringSumHelper(int num) : String(num) {}
+  StringSumHelper(unsigned int num) : String(num) {}
+  StringSumHelper(long num) : String(num) {}
+  StringSumHelper(unsigned long num) : String(num) {}
+  StringSumHelper(float num) : String(num) {}
+  StringSumHelper(double num) : String(num) {}
+};
+
+#endif // NATIVE_WSTRING_H
@@ -0,0 +1,355 @@
+#include "esp_native.h"
+
+#include <malloc.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// glibc's own allocator, under the malloc we replace below
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+// ---------------- Blocks ----------------
+// One byte per 8-byte block, and nothing here may allocate: this runs
+// inside malloc. The program is single-threaded.
+const uint32_t BLOCK = 8;
+const uint32_t HEADER = 4;
+const uint32_t MAX_BLOCKS = HEAP_MODEL_MAX_BYTES / BLOCK;
+
+static uint8_t used[MAX_BLOCKS];
+static uint32_t blockCount = 0;
+static bool enabled = false;
+static bool strict = false;
+static bool logRequests = false;
+
+static uint32_t blocksFor(size_t size) {
+  return size <= BLOCK - HEADER ? 1 : 1 + (uint32_t)((size - (BLOCK - HEADER) + BLOCK - 1) / BLOCK);
+}
+
+// Best fit: the smallest free run that holds need blocks, -1 if none does
+static int32_t findRun(uint32_t need) {
+  int32_t best = -1;
+  uint32_t bestLen = 0;
+  uint32_t i = 0;
+  while (i < blockCount) {
+    if (used[i]) {
+      i++;
+      continue;
+    }
+    uint32_t start = i;
+    while (i < blockCount && !used[i]) i++;
+    uint32_t len = i - start;
+    if (len >= need && (best < 0 || len < bestLen)) {
+      best = start;
+      bestLen = len;
+      if (len == need) break;
+    }
+  }
+  return best;
+}
+
+void heapModelInfo(HeapInfo &out) {
+  uint32_t freeBlocks = 0, maxRun = 0;
+  double sumSquares = 0;
+  uint32_t i = 0;
+  while (i < blockCount) {
+    if (used[i]) {
+      i++;
+      continue;
+    }
+    uint32_t start = i;
+    while (i < blockCount && !used[i]) i++;
+    uint32_t len = i - start;
+    freeBlocks += len;
+    sumSquares += (double)len * len;
+    if (len > maxRun) maxRun = len;
+  }
+  out.freeBytes = freeBlocks * BLOCK;
+  out.maxBlock = maxRun ? maxRun * BLOCK - HEADER : 0;
+  // 100 - sqrt(sum of squared free run sizes) / free blocks, in percent
+  out.fragmentation = freeBlocks ? (uint8_t)(100 - (uint32_t)(sqrt(sumSquares) * 100 / freeBlocks)) : 0;
+}
+
+// ---------------- Live allocations ----------------
+// Open addressing on the host pointer, linear probing, backward-shift delete
+struct Allocation {
+  void *ptr;
+  uint32_t start;
+  uint32_t blocks;
+  uint32_t bytes;
+};
+
+const uint32_t TABLE_SIZE = 16384;
+static Allocation table[TABLE_SIZE];
+static uint32_t untracked = 0;      // the table was full
+
+static uint32_t slotOf(void *ptr) {
+  return (uint32_t)(((uintptr_t)ptr >> 4) * 2654435761u) % TABLE_SIZE;
+}
+
+static Allocation *findAllocation(void *ptr) {
+  for (uint32_t i = slotOf(ptr);; i = (i + 1) % TABLE_SIZE) {
+    if (table[i].ptr == ptr) return &table[i];
+    if (!table[i].ptr) return nullptr;
+  }
+}
+
+static bool addAllocation(void *ptr, uint32_t start, uint32_t blocks, uint32_t bytes) {
+  uint32_t i = slotOf(ptr);
+  for (uint32_t probes = 0; table[i].ptr; probes++, i = (i + 1) % TABLE_SIZE) {
+    if (probes == TABLE_SIZE / 2) return false;
+  }
+  table[i] = Allocation{ptr, start, blocks, bytes};
+  return true;
+}
+
+static void removeAllocation(Allocation *a) {
+  uint32_t hole = a - table;
+  table[hole].ptr = nullptr;
+  for (uint32_t i = (hole + 1) % TABLE_SIZE; table[i].ptr; i = (i + 1) % TABLE_SIZE) {
+    uint32_t home = slotOf(table[i].ptr);
+    // Move it into the hole unless its home lies between the hole and it
+    bool between = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+    if (between) continue;
+    table[hole] = table[i];
+    table[i].ptr = nullptr;
+    hole = i;
+  }
+}
+
+// ---------------- Accounting ----------------
+struct Scope {
+  char name[40];
+  uint32_t requests;
+  uint32_t allocs;
+  uint64_t bytes;
+  uint32_t largest;          // single allocation
+  uint32_t peak;             // most in use at once above the request's start
+  int32_t retained;          // most left allocated after a request
+  uint32_t lowestBlock;      // smallest largest-free-block seen
+  uint8_t fragmentation;     // highest after a request
+  uint32_t failed;
+};
+
+const uint8_t MAX_SCOPES = 24;
+static Scope scopes[MAX_SCOPES];    // [0] is "(loop)", the last one takes the overflow
+static uint8_t scopeCount = 0;
+static Scope *scope = nullptr;
+
+static uint32_t inUse = 0;          // bytes asked for, live
+static uint32_t lowestFree = 0;
+static uint32_t totalFailed = 0;
+
+// The open request
+static uint32_t startInUse = 0;
+static uint32_t requestPeak = 0;
+static uint32_t requestAllocs = 0;
+static uint64_t requestBytes = 0;
+static uint32_t requestLowestBlock = 0;
+
+static Scope *scopeNamed(const char *name) {
+  for (uint8_t i = 0; i < scopeCount; i++) {
+    if (strcmp(scopes[i].name, name) == 0) return &scopes[i];
+  }
+  if (scopeCount == MAX_SCOPES) return &scopes[MAX_SCOPES - 1];
+  Scope &s = scopes[scopeCount++];
+  memset(&s, 0, sizeof(s));
+  snprintf(s.name, sizeof(s.name), "%s", scopeCount == MAX_SCOPES ? "(other)" : name);
+  s.lowestBlock = UINT32_MAX;
+  return &s;
+}
+
+static void noteLowWater() {
+  HeapInfo info;
+  heapModelInfo(info);
+  if (info.freeBytes < lowestFree) lowestFree = info.freeBytes;
+  if (info.maxBlock < scope->lowestBlock) scope->lowestBlock = info.maxBlock;
+  if (info.maxBlock < requestLowestBlock) requestLowestBlock = info.maxBlock;
+}
+
+static void countAllocation(uint32_t bytes) {
+  scope->allocs++;
+  scope->bytes += bytes;
+  if (bytes > scope->largest) scope->largest = bytes;
+  requestAllocs++;
+  requestBytes += bytes;
+  if (inUse > startInUse && inUse - startInUse > requestPeak) requestPeak = inUse - startInUse;
+}
+
+static void countFailure() {
+  scope->failed++;
+  totalFailed++;
+}
+
+// ---------------- Model operations ----------------
+static void modelCommit(void *ptr, int32_t start, uint32_t need, size_t size) {
+  if (!addAllocation(ptr, start, need, size)) {
+    untracked++;
+    return;
+  }
+  memset(used + start, 1, need);
+  inUse += size;
+  countAllocation(size);
+  noteLowWater();
+}
+
+static void modelFree(void *ptr) {
+  Allocation *a = findAllocation(ptr);
+  if (!a) return;                   // from before the model started
+  memset(used + a->start, 0, a->blocks);
+  inUse -= a->bytes;
+  removeAllocation(a);
+}
+
+// Where umm_realloc would put it: in place when it shrinks or the blocks
+// after it are free, else a new run (-1 if there is none)
+static int32_t reallocRun(const Allocation &old, uint32_t need) {
+  if (need <= old.blocks) return old.start;
+  uint32_t end = old.start + old.blocks;
+  uint32_t room = 0;
+  while (end + room < blockCount && !used[end + room] && old.blocks + room < need) room++;
+  if (old.blocks + room >= need) return old.start;
+  return findRun(need);
+}
+
+extern "C" {
+
+void *malloc(size_t size) {
+  if (!enabled) return __libc_malloc(size);
+  enabled = false;                  // glibc may call back in
+  uint32_t need = blocksFor(size);
+  int32_t start = findRun(need);
+  if (start < 0) countFailure();
+  void *ptr = start >= 0 || !strict ? __libc_malloc(size) : nullptr;
+  if (ptr && start >= 0) modelCommit(ptr, start, need, size);
+  enabled = true;
+  return ptr;
+}
+
+void *calloc(size_t n, size_t size) {
+  if (!enabled) return __libc_calloc(n, size);
+  if (size && n > SIZE_MAX / size) return nullptr;
+  void *ptr = malloc(n * size);
+  if (ptr) memset(ptr, 0, n * size);
+  return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (!enabled) return __libc_realloc(ptr, size);
+  if (!ptr) return malloc(size);
+  if (size == 0) {
+    free(ptr);
+    return nullptr;
+  }
+  Allocation *a = findAllocation(ptr);
+  if (!a) {
+    // Not in the model: from now on it is
+    void *newPtr = malloc(size);
+    if (newPtr) {
+      memcpy(newPtr, ptr, size < malloc_usable_size(ptr) ? size : malloc_usable_size(ptr));
+      __libc_free(ptr);
+    }
+    return newPtr;
+  }
+
+  enabled = false;
+  Allocation old = *a;
+  uint32_t need = blocksFor(size);
+  int32_t start = reallocRun(old, need);
+  void *newPtr = nullptr;
+  if (start < 0) {
+    countFailure();
+    if (!strict) {
+      newPtr = __libc_realloc(ptr, size);
+      if (newPtr) modelFree(ptr);
+    }
+  } else if ((newPtr = __libc_realloc(ptr, size)) != nullptr) {
+    removeAllocation(a);
+    if ((uint32_t)start == old.start) {
+      memset(used + old.start, 0, old.blocks);
+      inUse -= old.bytes;
+      modelCommit(newPtr, start, need, size);
+    } else {
+      // Both runs are held while the data is copied
+      modelCommit(newPtr, start, need, size);
+      memset(used + old.start, 0, old.blocks);
+      inUse -= old.bytes;
+    }
+  }
+  enabled = true;
+  return newPtr;
+}
+
+void free(void *ptr) {
+  if (!ptr) return;
+  if (enabled) modelFree(ptr);
+  __libc_free(ptr);
+}
+
+}  // extern "C"
+
+// ---------------- Requests and report ----------------
+void heapModelStart(uint32_t bytes, bool strictFit, bool log) {
+  if (bytes > HEAP_MODEL_MAX_BYTES) bytes = HEAP_MODEL_MAX_BYTES;
+  blockCount = bytes / BLOCK;
+  strict = strictFit;
+  logRequests = log;
+  scope = scopeNamed("(loop)");
+  lowestFree = blockCount * BLOCK;
+  requestLowestBlock = UINT32_MAX;
+  enabled = true;
+}
+
+void heapRequestBegin(const char *method, const char *uri) {
+  if (!scope) return;
+  char name[40];
+  snprintf(name, sizeof(name), "%s %s", method, uri);
+  scope = scopeNamed(name);
+  scope->requests++;
+  startInUse = inUse;
+  requestPeak = 0;
+  requestAllocs = 0;
+  requestBytes = 0;
+  requestLowestBlock = UINT32_MAX;
+}
+
+void heapRequestEnd() {
+  if (!scope || scope == &scopes[0]) return;
+  HeapInfo info;
+  heapModelInfo(info);
+  int32_t retained = (int32_t)(inUse - startInUse);
+  if (requestPeak > scope->peak) scope->peak = requestPeak;
+  if (retained > scope->retained) scope->retained = retained;
+  if (info.fragmentation > scope->fragmentation) scope->fragmentation = info.fragmentation;
+  if (logRequests) {
+    fprintf(stderr, "heap %s: %u allocs %llu bytes peak %u retained %d | free %u block %u frag %u%%\n",
+            scope->name, requestAllocs, (unsigned long long)requestBytes, requestPeak, retained,
+            info.freeBytes, requestLowestBlock == UINT32_MAX ? info.maxBlock : requestLowestBlock,
+            info.fragmentation);
+  }
+  scope = &scopes[0];
+}
+
+bool heapModelReport(FILE *out) {
+  if (!scope) return true;
+  HeapInfo info;
+  heapModelInfo(info);
+  fprintf(out, "heap model: %u bytes, %u free now (lowest %u), largest block %u, fragmentation %u%%\n",
+          blockCount * BLOCK, info.freeBytes, lowestFree, info.maxBlock, info.fragmentation);
+  fprintf(out, "%-24s %6s %9s %9s %8s %8s %8s %9s %5s %6s\n", "route", "reqs", "allocs/rq",
+          "bytes/rq", "largest", "peak", "retained", "min block", "frag", "failed");
+  for (uint8_t i = 0; i < scopeCount; i++) {
+    const Scope &s = scopes[i];
+    double n = s.requests ? s.requests : 1;
+    fprintf(out, "%-24s %6u %9.1f %9.0f %8u %8u %8d %9u %4u%% %6u\n", s.name, s.requests,
+            s.allocs / n, s.bytes / n, s.largest, s.peak, s.retained,
+            s.lowestBlock == UINT32_MAX ? info.maxBlock : s.lowestBlock, s.fragmentation, s.failed);
+  }
+  fprintf(out, "(loop) counts are totals; peak, retained and frag are per request\n");
+  if (untracked) fprintf(out, "%u allocations not tracked (table full)\n", untracked);
+  return totalFailed == 0;
+}
@@ -0,0 +1,41 @@
+#ifndef ESP_NATIVE_H
+#define ESP_NATIVE_H
+
+// Host side of the native build: what the Arduino stand-ins in this
+// directory need from native_main.cpp, and the heap model.
+//
+// Every malloc/realloc/free of the process is mirrored into a model of the
+// ESP8266's umm_malloc heap: 8-byte blocks, a 4-byte header per
+// allocation, best fit, realloc in place when the next blocks are free. So
+// ESP.getFreeHeap(), getMaxFreeBlockSize() and getHeapFragmentation() (and
+// /metrics) report what the controller would see with that much heap, and
+// the web server charges every allocation to the request that made it.
+// Allocations outside a request go to "(loop)". Sizes are the ones asked
+// for, so a 64-bit host allocates the same as the ESP for String and
+// ArduinoJson buffers; lwIP's packet buffers are not modelled.
+
+#include <stdint.h>
+#include <stdio.h>
+
+const uint32_t HEAP_MODEL_MAX_BYTES = 80 * 1024;   // all of the ESP's data RAM
+
+struct HeapInfo {
+  uint32_t freeBytes;
+  uint32_t maxBlock;         // largest allocation that would succeed
+  uint8_t fragmentation;     // percent, as the ESP core computes it
+};
+
+// Starts mirroring allocations into a heap of the given size. strict makes
+// allocations that don't fit fail as they would on the ESP; otherwise they
+// succeed and are only counted.
+void heapModelStart(uint32_t bytes, bool strict, bool logRequests);
+void heapModelInfo(HeapInfo &out);
+void heapRequestBegin(const char *method, const char *uri);
+void heapRequestEnd();
+// Per-route table; false if any allocation didn't fit
+bool heapModelReport(FILE *out);
+
+// The port the web server listens on instead of the sketch's
+int nativeHttpPort(int sketchPort);
+
+#endif // ESP_NATIVE_H
@@ -0,0 +1,278 @@
+/* Native build of the ESP controller
+   Runs the sketch in src/ on Linux: the web server on a local port, Serial
+   on a pseudo terminal or a serial port, and every allocation mirrored into
+   a model of the ESP8266 heap (esp_native.h).
+
+   Usage: program [--mega "cmd" | --serial /dev/ttyUSB0] [--port 8080]
+                  [--heap-bytes 40000] [--heap-strict] [--heap-log] [--seconds 0]
+
+   --mega runs a command on a pseudo terminal as the robot, e.g.
+   --mega "../.pio/build/native/program --stdio" for the simulated Mega.
+   --serial opens a port at MEGA_SERIAL_BAUD instead. With neither, Serial
+   is stdin/stdout.
+
+   --heap-bytes is the heap the model starts with, what an ESP-01 has left
+   with the access point up and this sketch's globals in RAM. --heap-strict
+   makes allocations that don't fit fail as on the ESP. --heap-log prints a
+   line per request. On exit (--seconds, Ctrl-C, or the robot's end of the
+   link closing) the per-route allocation table goes to stderr, and the exit
+   status is 1 if any allocation didn't fit.
+*/
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "esp_config.h"
+#include "esp_native.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+HardwareSerial Serial;
+EspClass ESP;
+ESP8266WiFiClass WiFi;
+
+// ---------------- Options ----------------
+static const char *megaCommand = nullptr;
+static const char *serialDevice = nullptr;
+static int httpPort = 8080;
+static uint32_t heapBytes = 40000;
+static bool heapStrict = false;
+static bool heapLog = false;
+static double seconds = 0;
+
+static void usage() {
+  fprintf(stderr,
+          "usage: program [--mega \"cmd\" | --serial /dev/ttyUSB0] [--port 8080]\n"
+          "               [--heap-bytes 40000] [--heap-strict] [--heap-log] [--seconds 0]\n");
+  exit(2);
+}
+
+static void parseOptions(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *opt = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(opt, "--mega") == 0 && hasValue) megaCommand = argv[++i];
+    else if (strcmp(opt, "--serial") == 0 && hasValue) serialDevice = argv[++i];
+    else if (strcmp(opt, "--port") == 0 && hasValue) httpPort = atoi(argv[++i]);
+    else if (strcmp(opt, "--heap-bytes") == 0 && hasValue) heapBytes = strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(opt, "--seconds") == 0 && hasValue) seconds = atof(argv[++i]);
+    else if (strcmp(opt, "--heap-strict") == 0) heapStrict = true;
+    else if (strcmp(opt, "--heap-log") == 0) heapLog = true;
+    else usage();
+  }
+  if (megaCommand && serialDevice) usage();
+}
+
+int nativeHttpPort(int sketchPort) {
+  (void)sketchPort;                  // 80 would need root
+  return httpPort;
+}
+
+// ---------------- Time ----------------
+static uint64_t monotonicUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t bootUs = monotonicUs();
+
+unsigned long millis() {
+  return (unsigned long)((monotonicUs() - bootUs) / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)(monotonicUs() - bootUs);
+}
+
+void delay(unsigned long ms) {
+  struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000};
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {}
+}
+
+void delayMicroseconds(unsigned int us) {
+  struct timespec ts = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {}
+}
+
+void yield() {}
+
+// ---------------- Serial ----------------
+static bool linkClosed = false;
+
+// dropOverflow: the receive buffer is full and bytes keep arriving, as
+// while a write blocks; they are lost like in a UART overrun
+void HardwareSerial::fill(bool dropOverflow) {
+  if (rxFd_ < 0) return;
+  if (rxHead_ > 0) {
+    memmove(rx_, rx_ + rxHead_, rxLen_);
+    rxHead_ = 0;
+  }
+  uint8_t scratch[64];
+  bool full = rxLen_ == sizeof(rx_);
+  if (full && !dropOverflow) return;
+  ssize_t n = full ? ::read(rxFd_, scratch, sizeof(scratch)) : ::read(rxFd_, rx_ + rxLen_, sizeof(rx_) - rxLen_);
+  if (n > 0 && full) overrun_ = true;
+  else if (n > 0) rxLen_ += n;
+  else if (n == 0 || (errno != EAGAIN && errno != EINTR)) linkClosed = true;
+}
+
+int HardwareSerial::available() {
+  if (rxLen_ == 0) fill(false);
+  return (int)rxLen_;
+}
+
+int HardwareSerial::read() {
+  if (!available()) return -1;
+  rxLen_--;
+  return rx_[rxHead_++];
+}
+
+int HardwareSerial::peek() {
+  return available() ? rx_[rxHead_] : -1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+  size_t sent = 0;
+  while (txFd_ >= 0 && sent < n) {
+    ssize_t w = ::write(txFd_, buf + sent, n - sent);
+    if (w > 0) {
+      sent += w;
+    } else if (w < 0 && errno == EAGAIN) {
+      // The other end may be blocked writing to us: keep receiving
+      fill(true);
+      struct pollfd pfd = {txFd_, POLLOUT, 0};
+      poll(&pfd, 1, 10);
+    } else if (w < 0 && errno != EINTR) {
+      linkClosed = true;
+      break;
+    }
+  }
+  return sent;
+}
+
+static void makeRaw(int fd, speed_t speed) {
+  struct termios tio;
+  if (tcgetattr(fd, &tio) < 0) return;
+  cfmakeraw(&tio);
+  if (speed) {
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+  }
+  tcsetattr(fd, TCSANOW, &tio);
+}
+
+static pid_t megaPid = -1;
+
+// Runs cmd with a pseudo terminal as its stdin and stdout; returns the
+// master side
+static int spawnOnPty(const char *cmd) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("posix_openpt");
+    return -1;
+  }
+  char slaveName[64];
+  snprintf(slaveName, sizeof(slaveName), "%s", ptsname(master));
+  megaPid = fork();
+  if (megaPid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (megaPid == 0) {
+    setsid();
+    int slave = open(slaveName, O_RDWR);
+    if (slave < 0) _exit(127);
+    makeRaw(slave, 0);
+    dup2(slave, 0);
+    dup2(slave, 1);
+    if (slave > 1) close(slave);
+    close(master);
+    execl("/bin/sh", "sh", "-c", cmd, (char *)nullptr);
+    _exit(127);
+  }
+  makeRaw(master, 0);
+  return master;
+}
+
+static int openSerial(const char *path) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  makeRaw(fd, MEGA_SERIAL_BAUD == 115200 ? B115200 : B9600);
+  return fd;
+}
+
+// ---------------- ESP ----------------
+uint32_t EspClass::getFreeHeap() {
+  HeapInfo info;
+  heapModelInfo(info);
+  return info.freeBytes;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+  HeapInfo info;
+  heapModelInfo(info);
+  return info.maxBlock;
+}
+
+uint8_t EspClass::getHeapFragmentation() {
+  HeapInfo info;
+  heapModelInfo(info);
+  return info.fragmentation;
+}
+
+static void finish(int status);
+
+void EspClass::restart() {
+  fprintf(stderr, "ESP.restart()\n");
+  finish(1);
+}
+
+// ---------------- Main ----------------
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+  stopRequested = 1;
+}
+
+static void finish(int status) {
+  bool fit = heapModelReport(stderr);
+  if (megaPid > 0) {
+    kill(megaPid, SIGTERM);
+    waitpid(megaPid, nullptr, 0);
+  }
+  exit(status ? status : fit ? 0 : 1);
+}
+
+int main(int argc, char **argv) {
+  parseOptions(argc, argv);
+  int rxFd = STDIN_FILENO, txFd = STDOUT_FILENO;
+  if (megaCommand) rxFd = txFd = spawnOnPty(megaCommand);
+  else if (serialDevice) rxFd = txFd = openSerial(serialDevice);
+  if (rxFd < 0) return 1;
+  fcntl(rxFd, F_SETFL, fcntl(rxFd, F_GETFL) | O_NONBLOCK);
+  Serial.nativeAttach(rxFd, txFd);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  heapModelStart(heapBytes, heapStrict, heapLog);
+  setup();
+  uint64_t endUs = seconds > 0 ? (uint64_t)(seconds * 1e6) : 0;
+  while (!stopRequested && !linkClosed && (!endUs || micros() < endUs)) loop();
+  if (linkClosed) fprintf(stderr, "serial link closed\n");
+  finish(0);
+}
@@ -0,0 +1,147 @@
+#include "command_trace.h"
+#include "esp_config.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct PendingTrace {
+  uint16_t id;
+  uint32_t receivedUs;
+  uint32_t sentUs;
+};
+
+struct SyncSample {
+  uint32_t offsetUs;        // Mega - ESP, modulo 2^32
+  uint32_t delayUs;         // round trip less the Mega's own time
+  uint32_t atUs;            // ESP time it was taken
+};
+
+// Sent commands in order; the Mega answers in order too, so a TR line
+// that skips entries means those never got one
+static PendingTrace pending[TRACE_PENDING];
+static uint8_t pendingHead = 0;
+static uint8_t pendingCount = 0;
+
+static SyncSample sync[TRACE_SYNC_SAMPLES];
+static uint8_t syncNext = 0;
+static uint8_t syncCount = 0;
+
+static uint16_t nextId = 0;
+static uint32_t lastReplyUs = 0;
+static uint32_t lastReplyWireUs = 0;
+static bool haveReply = false;
+static uint32_t lastReportUs = 0;
+static uint32_t completed = 0;
+static uint32_t lost = 0;
+
+static const char* const stageNames[TRACE_STAGE_COUNT] = {
+  "esp", "uart_out", "mega_exec", "mega_reply", "uart_back", "total"
+};
+
+uint16_t traceNextId() {
+  nextId = (nextId + 1) & 0x7FFF;
+  return TRACE_ESP_ID_BASE | nextId;
+}
+
+const char* traceStageName(uint8_t stage) {
+  return stage < TRACE_STAGE_COUNT ? stageNames[stage] : "?";
+}
+
+void traceCommandSent(uint16_t id, uint32_t receivedUs, uint32_t sentUs) {
+  if (pendingCount == TRACE_PENDING) {
+    pendingHead = (pendingHead + 1) % TRACE_PENDING;
+    pendingCount--;
+    lost++;
+  }
+  PendingTrace& p = pending[(pendingHead + pendingCount) % TRACE_PENDING];
+  p.id = id;
+  p.receivedUs = receivedUs;
+  p.sentUs = sentUs;
+  pendingCount++;
+}
+
+void traceReplyReceived(uint32_t nowUs, size_t lineBytes) {
+  lastReplyUs = nowUs;
+  // 10 bits per byte on the wire
+  lastReplyWireUs = (uint32_t)((uint64_t)lineBytes * 10000000UL / MEGA_SERIAL_BAUD);
+  haveReply = true;
+}
+
+// Each round trip bounds the offset to within half its delay, and that
+// bound widens by TRACE_DRIFT_PPM of its age; the tightest one wins
+static uint32_t syncBound(const SyncSample& s, uint32_t nowUs) {
+  uint32_t age = nowUs - s.atUs;
+  return s.delayUs / 2 + (uint32_t)((uint64_t)age * TRACE_DRIFT_PPM / 1000000UL);
+}
+
+static const SyncSample* bestSync(uint32_t nowUs) {
+  const SyncSample* best = NULL;
+  for (uint8_t i = 0; i < syncCount; i++) {
+    if (!best || syncBound(sync[i], nowUs) < syncBound(*best, nowUs)) best = &sync[i];
+  }
+  return best;
+}
+
+static uint32_t positive(int32_t us) {
+  return us > 0 ? (uint32_t)us : 0;
+}
+
+bool traceMegaReport(const char* line, uint32_t nowUs, TraceResult& out) {
+  // TR <id> <rx us> <us to actuation, -1 if none> <us to ack>
+  if (strncmp(line, "TR ", 3) != 0) return false;
+  lastReportUs = nowUs;
+  char* end;
+  unsigned long id = strtoul(line + 3, &end, 10);
+  uint32_t rxUs = strtoul(end, &end, 10);
+  long toAct = strtol(end, &end, 10);
+  uint32_t toAck = strtoul(end, &end, 10);
+  uint32_t ackUs = rxUs + toAck;
+
+  uint8_t skipped = 0;
+  while (skipped < pendingCount && pending[(pendingHead + skipped) % TRACE_PENDING].id != id) skipped++;
+  if (skipped == pendingCount) return false;
+  PendingTrace p = pending[(pendingHead + skipped) % TRACE_PENDING];
+  pendingHead = (pendingHead + skipped + 1) % TRACE_PENDING;
+  pendingCount -= skipped + 1;
+  lost += skipped;
+  completed++;
+
+  // The OK/ERR just before this line is the command's reply; without one
+  // (a command that doesn't answer) the TR line itself stands in
+  uint32_t replyUs = nowUs, replyWireUs = 0;
+  if (haveReply && (int32_t)(lastReplyUs - p.sentUs) >= 0) {
+    replyUs = lastReplyUs;
+    replyWireUs = lastReplyWireUs;
+  }
+  haveReply = false;
+
+  // NTP: offset = ((t2 - t1) + (t3 - t4)) / 2, delay = (t4 - t1) - (t3 - t2)
+  uint32_t t4 = replyUs - replyWireUs;
+  int32_t delay = (int32_t)((t4 - p.sentUs) - toAck);
+  if (delay < 0) delay = 0;
+  SyncSample& s = sync[syncNext];
+  s.offsetUs = (rxUs - p.sentUs) - (uint32_t)(delay / 2);
+  s.delayUs = delay;
+  s.atUs = t4;
+  syncNext = (syncNext + 1) % TRACE_SYNC_SAMPLES;
+  if (syncCount < TRACE_SYNC_SAMPLES) syncCount++;
+  uint32_t offset = bestSync(nowUs)->offsetUs;
+
+  out.id = id;
+  out.actuated = toAct >= 0;
+  out.stageUs[TRACE_ESP] = p.sentUs - p.receivedUs;
+  out.stageUs[TRACE_UART_OUT] = positive((int32_t)(rxUs - offset - p.sentUs));
+  out.stageUs[TRACE_MEGA_EXEC] = out.actuated ? toAct : 0;
+  out.stageUs[TRACE_MEGA_REPLY] = toAck - out.stageUs[TRACE_MEGA_EXEC];
+  out.stageUs[TRACE_UART_BACK] = positive((int32_t)(replyUs - (ackUs - offset)));
+  out.stageUs[TRACE_TOTAL] = replyUs - p.receivedUs;
+  return true;
+}
+
+void traceGetClock(TraceClock& out) {
+  const SyncSample* best = syncCount ? bestSync(lastReportUs) : NULL;
+  out.offsetUs = best ? (int32_t)best->offsetUs : 0;
+  out.uncertaintyUs = best ? syncBound(*best, lastReportUs) : 0;
+  out.samples = syncCount;
+  out.completed = completed;
+  out.lost = lost;
+}
@@ -0,0 +1,104 @@
+#include "link_handshake.h"
+#include "esp_config.h"
+#include <stdlib.h>
+#include <string.h>
+
+static LinkStatus status;
+static uint32_t nextProbeMs = 0;
+static uint32_t probeEveryMs = LINK_PROBE_FIRST_MS;
+static uint32_t readyAtMs = 0;   // ESP millis() of the latest READY
+
+static const char* const stateNames[] = { "probing", "up" };
+
+static void enter(LinkState state, uint32_t nowMs) {
+  status.state = state;
+  status.sinceMs = nowMs;
+}
+
+void linkBegin(uint32_t nowMs) {
+  enter(LINK_PROBING, nowMs);
+  nextProbeMs = nowMs;
+  probeEveryMs = LINK_PROBE_FIRST_MS;
+}
+
+bool linkProbeDue(uint32_t nowMs) {
+  if (status.state != LINK_PROBING || (int32_t)(nowMs - nextProbeMs) < 0) return false;
+  status.probes++;
+  nextProbeMs = nowMs + probeEveryMs;
+  probeEveryMs = probeEveryMs * 2 > LINK_PROBE_MAX_MS ? LINK_PROBE_MAX_MS : probeEveryMs * 2;
+  return true;
+}
+
+// "READY proto=1 up_ms=412 trace json ...": the key=value words, then the
+// rest are capabilities
+static void parseReady(const char* line, uint32_t& upMs) {
+  status.protocol = 0;
+  status.caps[0] = '\0';
+  upMs = 0;
+  size_t capsLength = 0;
+  const char* word = line + 5;
+  while (*word) {
+    while (*word == ' ') word++;
+    size_t length = strcspn(word, " ");
+    if (length == 0) break;
+    if (strncmp(word, "proto=", 6) == 0) {
+      status.protocol = (uint8_t)strtoul(word + 6, NULL, 10);
+    } else if (strncmp(word, "up_ms=", 6) == 0) {
+      upMs = strtoul(word + 6, NULL, 10);
+    } else if (capsLength + length + 1 < LINK_CAPS_MAX) {
+      if (capsLength) status.caps[capsLength++] = ' ';
+      memcpy(status.caps + capsLength, word, length);
+      capsLength += length;
+      status.caps[capsLength] = '\0';
+    }
+    word += length;
+  }
+}
+
+LinkEvent linkLineReceived(const char* line, uint32_t nowMs) {
+  bool restarted = false;
+  if (strncmp(line, "READY", 5) == 0 && (line[5] == ' ' || line[5] == '\0')) {
+    uint32_t previousUpMs = status.megaUpMs;
+    bool hadReady = status.protocol != 0;
+    uint32_t upMs;
+    parseReady(line, upMs);
+    // Still the same boot, its uptime has gone up by as much as ours. The
+    // slack covers line latency, and 1/64 of the gap the drift between the
+    // two clocks (the Mega's ceramic resonator is good to about 0.5%).
+    uint32_t elapsedMs = nowMs - readyAtMs;
+    uint32_t expectedUpMs = previousUpMs + elapsedMs;
+    restarted = hadReady && upMs + LINK_RESTART_SLACK_MS + elapsedMs / 64 < expectedUpMs;
+    status.megaUpMs = upMs;
+    readyAtMs = nowMs;
+  }
+
+  LinkEvent event;
+  if (restarted) {
+    status.megaRestarts++;
+    event = LINK_CAME_UP;
+  } else if (status.state == LINK_UP) {
+    return LINK_NO_CHANGE;
+  } else {
+    event = status.bringUps == 0 ? LINK_CAME_UP : LINK_RESUMED;
+  }
+  if (status.bringUps == 0) status.firstUpMs = nowMs;
+  status.bringUps++;
+  enter(LINK_UP, nowMs);
+  return event;
+}
+
+void linkLost(uint32_t nowMs) {
+  if (status.state == LINK_UP) linkBegin(nowMs);
+}
+
+bool linkUp() {
+  return status.state == LINK_UP;
+}
+
+void linkGetStatus(LinkStatus& s) {
+  s = status;
+}
+
+const char* linkStateName(LinkState s) {
+  return s <= LINK_UP ? stateNames[s] : "?";
+}
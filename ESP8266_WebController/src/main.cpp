@@ -13,8 +13,11 @@
 #include "web_interface.h"
 #include "robot_comm.h"
 
+void setupWiFiAP();
+
 void setup() {
-  // Initialize serial communication with robot
+  // Serial to the robot. Doesn't wait for the Mega: the link handshake
+  // runs from loop(), so the access point and web server come up meanwhile.
   setupRobotCommunication();
   
   // Configure WiFi Access Point
@@ -39,8 +42,9 @@ void loop() {
   // Update robot connection status
   updateRobotStatus();
   
-  // Small delay to prevent watchdog issues
-  delay(10);
+  // Yield to the WiFi stack. Kept short: replies wait here before they are
+  // read, which would show up in every traced round trip.
+  delay(1);
 }
 
 void setupWiFiAP() {
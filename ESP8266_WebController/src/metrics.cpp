@@ -0,0 +1,197 @@
+#include "metrics.h"
+#include "esp_config.h"
+#include "link_handshake.h"
+#include <ESP8266WiFi.h>
+#include <stdarg.h>
+
+// Upper bounds in microseconds, rendered as seconds in the "le" label
+static const uint32_t bucketBoundsUs[METRICS_BUCKETS] = {
+  500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000
+};
+
+// Trace stages on the Mega and the UART are far shorter than HTTP handlers
+static const uint32_t traceBoundsUs[METRICS_BUCKETS] = {
+  20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 50000, 200000
+};
+
+static const char* const routeNames[ROUTE_COUNT] = {
+  "/", "/command", "/status", "/history", "/metrics", "other"
+};
+
+static LatencyHistogram requestLatency[ROUTE_COUNT];
+static LatencyHistogram commandRtt;
+static LatencyHistogram traceLatency[TRACE_STAGE_COUNT];
+static LatencyHistogram wifiLatency;
+LinkCounters linkCounters;
+
+// The Mega answers commands in order, so a small FIFO of send times is
+// enough to pair each OK/ERR with its command.
+#define RTT_PENDING 8
+static unsigned long pendingSentUs[RTT_PENDING];
+static uint8_t pendingHead = 0;
+static uint8_t pendingCount = 0;
+
+static void histogramRecord(LatencyHistogram& h, const uint32_t* bounds, unsigned long us) {
+  uint8_t i = 0;
+  while (i < METRICS_BUCKETS && us > bounds[i]) i++;
+  h.buckets[i]++;
+  h.count++;
+  h.sumUs += us;
+}
+
+void metricsRecordRequest(MetricsRoute route, unsigned long durationUs) {
+  histogramRecord(requestLatency[route], bucketBoundsUs, durationUs);
+}
+
+void metricsCountTx(size_t bytes) {
+  linkCounters.txBytes += bytes;
+}
+
+void metricsCommandSent(unsigned long nowUs) {
+  if (pendingCount == RTT_PENDING) {
+    // Oldest never got an answer
+    pendingHead = (pendingHead + 1) % RTT_PENDING;
+    pendingCount--;
+    linkCounters.unanswered++;
+  }
+  pendingSentUs[(pendingHead + pendingCount) % RTT_PENDING] = nowUs;
+  pendingCount++;
+}
+
+void metricsReplyReceived(unsigned long nowUs) {
+  const unsigned long timeoutUs = COMMAND_TIMEOUT_MS * 1000UL;
+  while (pendingCount > 0) {
+    unsigned long rtt = nowUs - pendingSentUs[pendingHead];
+    pendingHead = (pendingHead + 1) % RTT_PENDING;
+    pendingCount--;
+    if (rtt <= timeoutUs) {
+      histogramRecord(commandRtt, bucketBoundsUs, rtt);
+      return;
+    }
+    linkCounters.unanswered++;
+  }
+}
+
+void metricsRecordTrace(const TraceResult& trace) {
+  for (uint8_t s = 0; s < TRACE_STAGE_COUNT; s++) {
+    // Commands that don't drive the motors have no execution stage
+    if (s == TRACE_MEGA_EXEC && !trace.actuated) continue;
+    histogramRecord(traceLatency[s], traceBoundsUs, trace.stageUs[s]);
+  }
+}
+
+void metricsRecordWifi(unsigned long us) {
+  histogramRecord(wifiLatency, traceBoundsUs, us);
+}
+
+// ---------------- Prometheus text rendering ----------------
+struct LineWriter {
+  MetricsWriter write;
+  void* ctx;
+  char line[128];
+};
+
+static void emit(LineWriter& w, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(w.line, sizeof(w.line), fmt, args);
+  va_end(args);
+  if (n < 0) return;
+  if ((size_t)n >= sizeof(w.line)) n = sizeof(w.line) - 1;
+  w.write(w.line, n, w.ctx);
+}
+
+static void emitHeader(LineWriter& w, const char* name, const char* help, const char* type) {
+  emit(w, "# HELP %s %s\n", name, help);
+  emit(w, "# TYPE %s %s\n", name, type);
+}
+
+static void emitHistogram(LineWriter& w, const char* name, const char* labels,
+                          const LatencyHistogram& h, const uint32_t* bounds) {
+  const char* sep = labels[0] ? "," : "";
+  const char* open = labels[0] ? "{" : "";
+  const char* close = labels[0] ? "}" : "";
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < METRICS_BUCKETS; i++) {
+    cumulative += h.buckets[i];
+    emit(w, "%s_bucket{%s%sle=\"%lu.%06lu\"} %lu\n", name, labels, sep,
+         (unsigned long)(bounds[i] / 1000000), (unsigned long)(bounds[i] % 1000000),
+         (unsigned long)cumulative);
+  }
+  emit(w, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep, (unsigned long)h.count);
+  emit(w, "%s_sum%s%s%s %lu.%06lu\n", name, open, labels, close,
+       (unsigned long)(h.sumUs / 1000000), (unsigned long)(h.sumUs % 1000000));
+  emit(w, "%s_count%s%s%s %lu\n", name, open, labels, close, (unsigned long)h.count);
+}
+
+static void emitCounter(LineWriter& w, const char* name, const char* help, uint32_t value) {
+  emitHeader(w, name, help, "counter");
+  emit(w, "%s %lu\n", name, (unsigned long)value);
+}
+
+static void emitGauge(LineWriter& w, const char* name, const char* help, long value) {
+  emitHeader(w, name, help, "gauge");
+  emit(w, "%s %ld\n", name, value);
+}
+
+void metricsRender(MetricsWriter write, void* ctx) {
+  LineWriter w;
+  w.write = write;
+  w.ctx = ctx;
+  char labels[32];
+
+  emitHeader(w, "esp_http_requests_total", "HTTP requests handled, by route.", "counter");
+  for (uint8_t r = 0; r < ROUTE_COUNT; r++) {
+    emit(w, "esp_http_requests_total{route=\"%s\"} %lu\n", routeNames[r],
+         (unsigned long)requestLatency[r].count);
+  }
+
+  emitHeader(w, "esp_http_request_duration_seconds", "Time spent in the route handler.", "histogram");
+  for (uint8_t r = 0; r < ROUTE_COUNT; r++) {
+    snprintf(labels, sizeof(labels), "route=\"%s\"", routeNames[r]);
+    emitHistogram(w, "esp_http_request_duration_seconds", labels, requestLatency[r], bucketBoundsUs);
+  }
+
+  emitGauge(w, "esp_heap_free_bytes", "Free heap.", ESP.getFreeHeap());
+  emitGauge(w, "esp_heap_max_free_block_bytes", "Largest allocatable block.", ESP.getMaxFreeBlockSize());
+  emitGauge(w, "esp_heap_fragmentation_percent", "Heap fragmentation, 0 = none.", ESP.getHeapFragmentation());
+
+  emitGauge(w, "esp_wifi_stations", "Clients associated with the access point.", WiFi.softAPgetStationNum());
+  if ((WiFi.getMode() & WIFI_STA) && WiFi.status() == WL_CONNECTED) {
+    emitGauge(w, "esp_wifi_rssi_dbm", "Signal strength of the upstream access point.", WiFi.RSSI());
+  }
+
+  emitCounter(w, "esp_uart_rx_bytes_total", "Bytes read from the Mega link.", linkCounters.rxBytes);
+  emitCounter(w, "esp_uart_tx_bytes_total", "Bytes written to the Mega link.", linkCounters.txBytes);
+  emitCounter(w, "esp_uart_framing_errors_total", "UART receive framing or parity errors.", linkCounters.framingErrors);
+  emitCounter(w, "esp_uart_overruns_total", "UART receive FIFO overruns.", linkCounters.overruns);
+  emitCounter(w, "esp_uart_line_overflows_total", "Received lines dropped for exceeding MAX_COMMAND_LENGTH.", linkCounters.lineOverflows);
+  emitCounter(w, "esp_mega_commands_unanswered_total", "Commands the Mega never acknowledged.", linkCounters.unanswered);
+
+  LinkStatus link;
+  linkGetStatus(link);
+  emitGauge(w, "esp_link_up", "1 while the Mega link is up (see link_handshake.h).", link.state == LINK_UP);
+  if (link.bringUps) {
+    emitGauge(w, "esp_link_first_up_ms", "ESP uptime when the Mega link first came up.", link.firstUpMs);
+  }
+  emitCounter(w, "esp_link_probes_total", "HELLO probes sent to the Mega.", link.probes);
+  emitCounter(w, "esp_link_bringups_total", "Times the Mega link came up.", link.bringUps);
+  emitCounter(w, "esp_mega_restarts_total", "Mega restarts seen from its READY line.", link.megaRestarts);
+
+  emitHeader(w, "esp_mega_command_rtt_seconds", "Command send to OK/ERR reply from the Mega.", "histogram");
+  emitHistogram(w, "esp_mega_command_rtt_seconds", "", commandRtt, bucketBoundsUs);
+
+  emitHeader(w, "esp_trace_stage_seconds", "Traced command latency by stage (see command_trace.h).", "histogram");
+  emitHistogram(w, "esp_trace_stage_seconds", "stage=\"wifi\"", wifiLatency, traceBoundsUs);
+  for (uint8_t s = 0; s < TRACE_STAGE_COUNT; s++) {
+    snprintf(labels, sizeof(labels), "stage=\"%s\"", traceStageName(s));
+    emitHistogram(w, "esp_trace_stage_seconds", labels, traceLatency[s], traceBoundsUs);
+  }
+  TraceClock clock;
+  traceGetClock(clock);
+  emitGauge(w, "esp_trace_clock_offset_us", "Mega micros() minus ESP micros(), as estimated.", clock.offsetUs);
+  emitGauge(w, "esp_trace_clock_uncertainty_us", "Bound on the clock offset error.", clock.uncertaintyUs);
+  emitCounter(w, "esp_trace_lost_total", "Traced commands the Mega never sent a TR line for.", clock.lost);
+
+  emitGauge(w, "esp_uptime_seconds", "Seconds since boot.", millis() / 1000);
+}
@@ -1,28 +1,77 @@
 #include "robot_comm.h"
 #include "esp_config.h"
+#include "telemetry_history.h"
+#include "metrics.h"
+#include "command_trace.h"
+#include "link_handshake.h"
 
 RobotStatus robotStatus = {
   .connected = false,
   .lastResponse = 0,
   .lastOdometry = "",
+  .lastSensors = "",
+  .lastTrip = "",
   .motorsEnabled = true,
   .currentSpeed = DEFAULT_SPEED
 };
 
 String rxBuffer = "";
 
+// The latest command from the page while the link was coming up
+static String heldCommand = "";
+static uint16_t heldTraceId = 0;
+static unsigned long heldReceivedUs = 0;
+static unsigned long heldAtMs = 0;
+
+#if LOG_ROBOT_TRAFFIC
+#define logTraffic(...) metricsCountTx(Serial.printf(__VA_ARGS__))
+#else
+#define logTraffic(...)
+#endif
+
 void setupRobotCommunication() {
   Serial.begin(MEGA_SERIAL_BAUD);
-  Serial.println("ESP8266 Robot Controller Initialized");
+  logTraffic("ESP8266 Robot Controller Initialized\n");
   
-  // Send initial enable command to robot
-  delay(2000); // Wait for Mega to boot
-  sendCommandToRobot("ENABLE");
+  // No waiting for the Mega to boot: the link comes up on its READY, to
+  // this first probe or on its own, while the access point starts.
+  // updateRobotStatus() probes again as long as it stays quiet.
+  linkBegin(millis());
+  if (linkProbeDue(millis())) metricsCountTx(Serial.println("HELLO"));
+}
+
+static void onLinkUp(LinkEvent event) {
+  // The Mega's setup() enables the motors, so on a fresh boot this only
+  // resyncs robotStatus.motorsEnabled through its OK ENABLE
+  if (event == LINK_CAME_UP) sendCommandToRobot("ENABLE");
+  if (heldCommand.length() > 0 && millis() - heldAtMs <= LINK_HOLD_MS) {
+    sendCommandToRobot(heldCommand, heldTraceId, heldReceivedUs);
+  }
+  heldCommand = "";
 }
 
 void sendCommandToRobot(String command) {
-  Serial.println(command);
+  sendCommandToRobot(command, traceNextId(), micros());
+}
+
+void sendCommandToRobot(String command, uint16_t traceId, unsigned long receivedUs) {
+  if (!linkUp()) {
+    // Anything sent now could reach a Mega that isn't listening yet
+    heldCommand = command;
+    heldTraceId = traceId;
+    heldReceivedUs = receivedUs;
+    heldAtMs = millis();
+    return;
+  }
+  metricsCommandSent(micros());
+#if TRACE_COMMANDS
+  metricsCountTx(Serial.printf("#%u %s\r\n", traceId, command.c_str()));
+  Serial.flush();
+  traceCommandSent(traceId, receivedUs, micros());
+#else
+  metricsCountTx(Serial.println(command));
   Serial.flush();
+#endif
   
   // Only update speed tracking locally, motor status will come from robot response
   if (command == "STOP") {
@@ -36,12 +85,16 @@ void sendCommandToRobot(String command) {
     }
   }
   
-  Serial.printf("Sent to robot: %s\n", command.c_str());
+  logTraffic("Sent to robot: %s\n", command.c_str());
 }
 
 void processRobotResponse() {
+  if (Serial.hasRxError()) linkCounters.framingErrors++;
+  if (Serial.hasOverrun()) linkCounters.overruns++;
+
   while (Serial.available()) {
     char c = Serial.read();
+    linkCounters.rxBytes++;
     
     if (c == '\r') continue;
     
@@ -56,32 +109,49 @@ void processRobotResponse() {
       // Prevent buffer overflow
       if (rxBuffer.length() > MAX_COMMAND_LENGTH) {
         rxBuffer = "";
+        linkCounters.lineOverflows++;
       }
     }
   }
 }
 
 void handleRobotMessage(String message) {
+  unsigned long nowUs = micros();
   robotStatus.lastResponse = millis();
   robotStatus.connected = true;
   
-  Serial.printf("Received from robot: %s\n", message.c_str());
+  logTraffic("Received from robot: %s\n", message.c_str());
+
+  LinkEvent event = linkLineReceived(message.c_str(), robotStatus.lastResponse);
+  if (event != LINK_NO_CHANGE) onLinkUp(event);
   
   if (message.startsWith("ODOM")) {
     robotStatus.lastOdometry = message;
+    historyRecordOdometry(message, robotStatus.lastResponse);
+  } else if (message.startsWith("SENS")) {
+    robotStatus.lastSensors = message;
+  } else if (message.startsWith("TRIP")) {
+    robotStatus.lastTrip = message;
+  } else if (message.startsWith("TR ")) {
+    TraceResult trace;
+    if (traceMegaReport(message.c_str(), nowUs, trace)) metricsRecordTrace(trace);
   } else if (message.startsWith("OK")) {
+    metricsReplyReceived(nowUs);
+    traceReplyReceived(nowUs, message.length() + 2);
     // Command acknowledged - update status based on response
     if (message.indexOf("ENABLE") >= 0) {
       robotStatus.motorsEnabled = true;
-      Serial.println("Motors enabled confirmed by robot");
+      logTraffic("Motors enabled confirmed by robot\n");
     } else if (message.indexOf("DISABLE") >= 0) {
       robotStatus.motorsEnabled = false;
-      Serial.println("Motors disabled confirmed by robot");
+      logTraffic("Motors disabled confirmed by robot\n");
     }
-    Serial.printf("Robot acknowledged: %s\n", message.c_str());
+    logTraffic("Robot acknowledged: %s\n", message.c_str());
   } else if (message.startsWith("ERR")) {
+    metricsReplyReceived(nowUs);
+    traceReplyReceived(nowUs, message.length() + 2);
     // Command error
-    Serial.printf("Robot error: %s\n", message.c_str());
+    logTraffic("Robot error: %s\n", message.c_str());
   }
 }
 
@@ -108,13 +178,17 @@ void updateRobotStatus() {
   if (now - robotStatus.lastResponse > COMMAND_TIMEOUT_MS) {
     if (robotStatus.connected) {
       robotStatus.connected = false;
-      Serial.println("Robot connection lost");
+      logTraffic("Robot connection lost\n");
+      linkLost(now);
     }
   }
+
+  // Not an OK/ERR command: the Mega answers with READY
+  if (linkProbeDue(now)) metricsCountTx(Serial.println("HELLO"));
   
   // Request odometry periodically
   static unsigned long lastOdomRequest = 0;
-  if (now - lastOdomRequest > STATUS_UPDATE_INTERVAL_MS) {
+  if (linkUp() && now - lastOdomRequest > STATUS_UPDATE_INTERVAL_MS) {
     requestOdometry();
     lastOdomRequest = now;
   }
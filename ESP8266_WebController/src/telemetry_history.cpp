@@ -0,0 +1,133 @@
+#include "telemetry_history.h"
+#include "esp_config.h"
+
+// One ring per resolution. The oldest sample's absolute time is kept and
+// each following sample adds its dtMs, so times cost 2 bytes per sample.
+struct HistoryLevel {
+  HistorySample* buf;
+  uint16_t capacity;
+  uint16_t periodMs;       // 0 for raw, bucket length for the summaries
+  uint16_t head;           // next write slot
+  uint16_t count;
+  unsigned long oldestMs;  // absolute time of the oldest sample
+  unsigned long newestMs;  // absolute time of the newest sample
+  long pendingTicks[4];    // bucket being summed for this level
+  unsigned long pendingMs;
+};
+
+static HistorySample rawSamples[HISTORY_RAW_SAMPLES];
+static HistorySample oneSecSamples[HISTORY_1S_SAMPLES];
+static HistorySample tenSecSamples[HISTORY_10S_SAMPLES];
+
+static HistoryLevel levels[HISTORY_LEVELS] = {
+  { rawSamples, HISTORY_RAW_SAMPLES, 0 },
+  { oneSecSamples, HISTORY_1S_SAMPLES, 1000 },
+  { tenSecSamples, HISTORY_10S_SAMPLES, 10000 }
+};
+
+static int16_t clamp16(long v) {
+  if (v > 32767) return 32767;
+  if (v < -32768) return -32768;
+  return (int16_t)v;
+}
+
+static void levelPush(HistoryLevel& lv, unsigned long nowMs, uint16_t dtMs, const long ticks[4]) {
+  if (lv.count == lv.capacity) {
+    // Drop the oldest; the next one's dt moves the time origin forward
+    uint16_t oldest = (lv.head + lv.capacity - lv.count) % lv.capacity;
+    lv.count--;
+    lv.oldestMs += lv.buf[(oldest + 1) % lv.capacity].dtMs;
+  }
+
+  HistorySample& s = lv.buf[lv.head];
+  s.dtMs = dtMs;
+  for (int i = 0; i < 4; i++) s.ticks[i] = clamp16(ticks[i]);
+
+  if (lv.count == 0) lv.oldestMs = nowMs;
+  lv.newestMs = nowMs;
+  lv.head = (lv.head + 1) % lv.capacity;
+  lv.count++;
+}
+
+// Sum a sample into the level's open bucket and emit it once it spans periodMs
+static void levelAccumulate(int index, unsigned long nowMs, unsigned long dtMs, const long ticks[4]) {
+  HistoryLevel& lv = levels[index];
+  for (int i = 0; i < 4; i++) lv.pendingTicks[i] += ticks[i];
+  lv.pendingMs += dtMs;
+  if (lv.pendingMs < lv.periodMs) return;
+
+  levelPush(lv, nowMs, (uint16_t)lv.pendingMs, lv.pendingTicks);
+  if (index + 1 < HISTORY_LEVELS) {
+    levelAccumulate(index + 1, nowMs, lv.pendingMs, lv.pendingTicks);
+  }
+  for (int i = 0; i < 4; i++) lv.pendingTicks[i] = 0;
+  lv.pendingMs = 0;
+}
+
+void historyClear() {
+  for (int l = 0; l < HISTORY_LEVELS; l++) {
+    HistoryLevel& lv = levels[l];
+    lv.head = lv.count = 0;
+    lv.oldestMs = lv.newestMs = 0;
+    for (int i = 0; i < 4; i++) lv.pendingTicks[i] = 0;
+    lv.pendingMs = 0;
+  }
+}
+
+void historyAdd(unsigned long nowMs, unsigned long megaDtMs, const long ticks[4]) {
+  HistoryLevel& raw = levels[HISTORY_RAW];
+  unsigned long dtMs = megaDtMs;
+  if (raw.count > 0) {
+    dtMs = nowMs - raw.newestMs;
+    if (dtMs > HISTORY_MAX_GAP_MS) {
+      // Link was down for a long time; the 16-bit deltas can't span it
+      historyClear();
+      dtMs = megaDtMs;
+    }
+  }
+  if (dtMs > HISTORY_MAX_GAP_MS) dtMs = HISTORY_MAX_GAP_MS;
+
+  levelPush(raw, nowMs, (uint16_t)dtMs, ticks);
+  levelAccumulate(HISTORY_1S, nowMs, dtMs, ticks);
+}
+
+// "ODOM now dt d1 d2 d3 d4 distL distR vL vR" from odometry.cpp on the Mega
+void historyRecordOdometry(const String& odomLine, unsigned long nowMs) {
+  unsigned long megaNow, megaDt;
+  long ticks[4];
+  if (sscanf(odomLine.c_str(), "ODOM %lu %lu %ld %ld %ld %ld", &megaNow, &megaDt,
+             &ticks[0], &ticks[1], &ticks[2], &ticks[3]) == 6) {
+    historyAdd(nowMs, megaDt, ticks);
+  }
+}
+
+size_t historyQuery(HistoryRes res, unsigned long fromMs, unsigned long toMs,
+                    HistoryVisitor visit, void* ctx) {
+  const HistoryLevel& lv = levels[res];
+  uint16_t idx = (lv.head + lv.capacity - lv.count) % lv.capacity;
+  unsigned long t = lv.oldestMs;
+  size_t matched = 0;
+
+  for (uint16_t n = 0; n < lv.count; n++) {
+    if (n > 0) t += lv.buf[idx].dtMs;
+    if (t > toMs) break;
+    if (t >= fromMs) {
+      if (visit) visit(t, lv.buf[idx], ctx);
+      matched++;
+    }
+    idx = (idx + 1) % lv.capacity;
+  }
+  return matched;
+}
+
+size_t historyCount(HistoryRes res) {
+  return levels[res].count;
+}
+
+bool historyParseRes(const String& name, HistoryRes& res) {
+  if (name.length() == 0 || name == "raw") res = HISTORY_RAW;
+  else if (name == "1s") res = HISTORY_1S;
+  else if (name == "10s") res = HISTORY_10S;
+  else return false;
+  return true;
+}
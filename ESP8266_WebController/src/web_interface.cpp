@@ -1,15 +1,28 @@
 #include "web_interface.h"
 #include "robot_comm.h"
 #include "esp_config.h"
+#include "telemetry_history.h"
+#include "metrics.h"
+#include "command_trace.h"
+#include "link_handshake.h"
 #include <ArduinoJson.h>
 
 ESP8266WebServer server(WEB_SERVER_PORT);
 
+// Run a route handler and record how long it took
+static void timed(MetricsRoute route, void (*handler)()) {
+  unsigned long start = micros();
+  handler();
+  metricsRecordRequest(route, micros() - start);
+}
+
 void setupWebServer() {
-  server.on("/", handleRoot);
-  server.on("/command", HTTP_POST, handleCommand);
-  server.on("/status", HTTP_GET, handleStatus);
-  server.onNotFound(handleNotFound);
+  server.on("/", []() { timed(ROUTE_ROOT, handleRoot); });
+  server.on("/command", HTTP_POST, []() { timed(ROUTE_COMMAND, handleCommand); });
+  server.on("/status", HTTP_GET, []() { timed(ROUTE_STATUS, handleStatus); });
+  server.on("/history", HTTP_GET, []() { timed(ROUTE_HISTORY, handleHistory); });
+  server.on("/metrics", HTTP_GET, []() { timed(ROUTE_METRICS, handleMetrics); });
+  server.onNotFound([]() { timed(ROUTE_OTHER, handleNotFound); });
   
   server.begin();
   Serial.println("Web server started on port " + String(WEB_SERVER_PORT));
@@ -24,15 +37,28 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
+// cmd=<command>[&trace=<id>][&wifi_us=<us>]: the page numbers its commands
+// and reports how long its previous request spent outside the ESP
 void handleCommand() {
+  unsigned long receivedUs = micros();
+  if (server.hasArg("wifi_us")) metricsRecordWifi(server.arg("wifi_us").toInt());
+
   if (server.hasArg("cmd")) {
     String command = server.arg("cmd");
-    sendCommandToRobot(command);
+    long traceId = server.arg("trace").toInt();
+    if (traceId <= 0 || traceId >= TRACE_ESP_ID_BASE) traceId = traceNextId();
+    sendCommandToRobot(command, traceId, receivedUs);
+    LinkStatus link;
+    linkGetStatus(link);
     
     DynamicJsonDocument doc(200);
     doc["status"] = "success";
     doc["command"] = command;
     doc["robot_connected"] = robotStatus.connected;
+    // Not up yet: the command is held and goes out once it is
+    doc["link"] = linkStateName(link.state);
+    doc["trace"] = traceId;
+    doc["esp_us"] = micros() - receivedUs;
     
     String response;
     serializeJson(doc, response);
@@ -43,12 +69,18 @@ void handleCommand() {
 }
 
 void handleStatus() {
-  DynamicJsonDocument doc(500);
+  LinkStatus link;
+  linkGetStatus(link);
+  DynamicJsonDocument doc(768);
   doc["connected"] = robotStatus.connected;
+  doc["link"] = linkStateName(link.state);
+  doc["mega_caps"] = (const char*)link.caps;
   doc["last_response"] = robotStatus.lastResponse;
   doc["motors_enabled"] = robotStatus.motorsEnabled;
   doc["current_speed"] = robotStatus.currentSpeed;
   doc["odometry"] = robotStatus.lastOdometry;
+  doc["sensors"] = robotStatus.lastSensors;
+  doc["last_trip"] = robotStatus.lastTrip;
   doc["uptime"] = millis();
   
   String response;
@@ -56,19 +88,123 @@ void handleStatus() {
   server.send(200, "application/json", response);
 }
 
+// Samples are streamed out in small chunks so a full ring never has to be
+// formatted into one String on the heap.
+struct HistoryStream {
+  char buf[256];
+  size_t len;
+  bool binary;
+};
+
+static void historyFlush(HistoryStream& out) {
+  if (out.len > 0) server.sendContent(out.buf, out.len);
+  out.len = 0;
+}
+
+static void historyWriteSample(unsigned long timeMs, const HistorySample& sample, void* ctx) {
+  HistoryStream& out = *(HistoryStream*)ctx;
+  if (out.len + 64 > sizeof(out.buf)) historyFlush(out);
+
+  if (out.binary) {
+    memcpy(out.buf + out.len, &sample, sizeof(sample));
+    out.len += sizeof(sample);
+  } else {
+    out.len += snprintf(out.buf + out.len, sizeof(out.buf) - out.len,
+                        "%lu,%u,%d,%d,%d,%d\n", timeMs, sample.dtMs,
+                        sample.ticks[0], sample.ticks[1], sample.ticks[2], sample.ticks[3]);
+  }
+}
+
+// GET /history?from=<ms>&to=<ms>&res=raw|1s|10s&fmt=csv|bin
+// Times are ESP uptime (same clock as "uptime" in /status). CSV rows are
+// "t_ms,dt_ms,d1,d2,d3,d4" where d1..d4 are encoder ticks over dt_ms.
+// Binary is a 12-byte header ('T','H', version 1, res, uint32 count,
+// uint32 time of the first sample) followed by count 10-byte samples
+// (uint16 dt_ms, int16 d1..d4); each sample's time is the previous plus
+// its dt_ms. All fields little-endian.
+void handleHistory() {
+  HistoryRes res;
+  if (!historyParseRes(server.arg("res"), res)) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"res must be raw, 1s or 10s\"}");
+    return;
+  }
+  unsigned long fromMs = server.hasArg("from") ? strtoul(server.arg("from").c_str(), NULL, 10) : 0;
+  unsigned long toMs = server.hasArg("to") ? strtoul(server.arg("to").c_str(), NULL, 10) : millis();
+
+  HistoryStream out;
+  out.len = 0;
+  out.binary = server.arg("fmt") == "bin";
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  if (out.binary) {
+    uint32_t count = historyQuery(res, fromMs, toMs, NULL, NULL);
+    uint32_t firstMs = 0;
+    struct FirstTime {
+      static void visit(unsigned long timeMs, const HistorySample&, void* ctx) {
+        uint32_t& first = *(uint32_t*)ctx;
+        if (first == 0) first = timeMs;
+      }
+    };
+    if (count > 0) historyQuery(res, fromMs, toMs, FirstTime::visit, &firstMs);
+
+    server.send(200, "application/octet-stream", "");
+    out.buf[0] = 'T';
+    out.buf[1] = 'H';
+    out.buf[2] = 1;
+    out.buf[3] = (uint8_t)res;
+    memcpy(out.buf + 4, &count, 4);
+    memcpy(out.buf + 8, &firstMs, 4);
+    out.len = 12;
+  } else {
+    server.send(200, "text/csv", "");
+    out.len = snprintf(out.buf, sizeof(out.buf), "t_ms,dt_ms,d1,d2,d3,d4\n");
+  }
+
+  historyQuery(res, fromMs, toMs, historyWriteSample, &out);
+  historyFlush(out);
+  server.sendContent("");
+}
+
+struct MetricsReply {
+  char buf[256];
+  size_t len;
+};
+
+static void metricsWriteText(const char* text, size_t len, void* ctx) {
+  MetricsReply& out = *(MetricsReply*)ctx;
+  if (out.len + len > sizeof(out.buf)) {
+    server.sendContent(out.buf, out.len);
+    out.len = 0;
+  }
+  memcpy(out.buf + out.len, text, len);
+  out.len += len;
+}
+
+// GET /metrics in Prometheus text exposition format
+void handleMetrics() {
+  MetricsReply out;
+  out.len = 0;
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+  metricsRender(metricsWriteText, &out);
+  if (out.len > 0) server.sendContent(out.buf, out.len);
+  server.sendContent("");
+}
+
 void handleNotFound() {
   server.send(404, "text/plain", "File not found");
 }
 
+// The page has )" in its onclick attributes, hence the html delimiter
 String generateControlPage() {
-  return R"(
+  return R"html(
 <!DOCTYPE html>
 <html>
 <head>
     <meta charset="UTF-8">
     <meta name="viewport" content="width=device-width, initial-scale=1.0">
     <title>Robot Controller</title>
-    <style>)" + generateCSS() + R"(</style>
+    <style>)html" + generateCSS() + R"html(</style>
 </head>
 <body>
     <div class="container">
@@ -118,10 +254,10 @@ String generateControlPage() {
         </div>
     </div>
     
-    <script>)" + generateJavaScript() + R"(</script>
+    <script>)html" + generateJavaScript() + R"html(</script>
 </body>
 </html>
-)";
+)html";
 }
 
 String generateCSS() {
@@ -287,6 +423,8 @@ String generateJavaScript() {
   return R"(
 let currentSpeed = 150;
 let isConnected = false;
+let traceId = Math.floor(Math.random() * 0x7FFF);
+let lastWifiUs = -1;
 
 function updateSpeed(value) {
     currentSpeed = value;
@@ -301,15 +439,28 @@ function sendCommand(baseCmd) {
         command = baseCmd.replace('150', currentSpeed.toString());
     }
     
+    // Trace id for the ESP/Mega latency breakdown; the time this request
+    // spends outside the ESP goes along with the next one
+    traceId = traceId % 0x7FFF + 1;
+    let body = 'cmd=' + encodeURIComponent(command) + '&trace=' + traceId;
+    if (lastWifiUs >= 0) body += '&wifi_us=' + lastWifiUs;
+    lastWifiUs = -1;
+    const sentAt = performance.now();
+    let rttUs = 0;
+    
     fetch('/command', {
         method: 'POST',
         headers: {
             'Content-Type': 'application/x-www-form-urlencoded',
         },
-        body: 'cmd=' + encodeURIComponent(command)
+        body: body
+    })
+    .then(response => {
+        rttUs = Math.round((performance.now() - sentAt) * 1000);
+        return response.json();
     })
-    .then(response => response.json())
     .then(data => {
+        lastWifiUs = Math.max(0, rttUs - data.esp_us);
         console.log('Command sent:', data);
     })
     .catch(error => {
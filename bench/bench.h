@@ -0,0 +1,36 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+
+// Microbenchmarks of the firmware's hot paths. The same cases build for two
+// targets: env:bench runs them on the Linux host and times them in
+// nanoseconds of wall clock, env:bench_avr runs them on an ATmega2560 under
+// simavr and counts CPU cycles with Timer1. scripts/bench.py runs either
+// one and checks the results against bench/baseline_<env>.json.
+//
+// Each case runs BENCH_REPS times, with its untimed prepare() before every
+// run, and prints one line of JSON:
+//   BENCH {"target":"avr","unit":"cycles","reps":15,"overhead":12}
+//   BENCH {"name":"processLine/SET_V","min":1234,"median":1240,"max":1302}
+//   BENCH {"end":1}
+// The clock's own cost (an empty case) is already taken off.
+
+typedef void (*BenchFn)();
+
+struct BenchCase {
+  const char *name;      // "<function>/<variant>"
+  BenchFn run;           // timed
+  BenchFn prepare;       // untimed, before every run; may be null
+};
+
+extern const BenchCase benchCases[];
+extern const size_t benchCaseCount;
+
+// Brings up the modules the cases use, the way setup() does
+void benchSetup();
+
+// Runs the cases whose name starts with filter (all if null)
+void benchRunAll(Print &out, const char *filter);
+
+#endif // BENCH_H
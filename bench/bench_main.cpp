@@ -0,0 +1,168 @@
+// Benchmark runner: the clock for each target, the timing loop and the
+// entry point (main() on the host, setup() on the AVR).
+
+#include "bench.h"
+#include "bench_sink.h"
+
+#if defined(SIM_NATIVE)
+#include "sim.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#else
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#endif
+
+BenchSink benchSink;
+
+// ---------------- Clock ----------------
+#if defined(SIM_NATIVE)
+
+static const char BENCH_TARGET[] = "native";
+static const char BENCH_UNIT[] = "ns";
+static const uint16_t BENCH_REPS = 301;
+
+static void clockBegin() {}
+
+static uint32_t clockNow() {
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#else
+
+static const char BENCH_TARGET[] = "avr";
+static const char BENCH_UNIT[] = "cycles";
+static const uint16_t BENCH_REPS = 15;   // simavr is deterministic; more only repeats itself
+
+static volatile uint16_t timer1Overflows;
+
+ISR(TIMER1_OVF_vect) { timer1Overflows++; }
+
+// Timer1 is free (no motor PWM on pins 11/12): normal mode at clk/1
+static void clockBegin() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+}
+
+// Cycles since clockBegin(), like micros(): counts an overflow that is
+// pending but not yet serviced
+static uint32_t clockNow() {
+  uint16_t high, low;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    low = TCNT1;
+    high = timer1Overflows;
+    if ((TIFR1 & _BV(TOV1)) && low < 0x8000) high++;
+  }
+  return ((uint32_t)high << 16) | low;
+}
+
+#endif
+
+// ---------------- Timing ----------------
+static uint32_t samples[BENCH_REPS];
+
+static void sortSamples() {
+  for (uint16_t i = 1; i < BENCH_REPS; i++) {
+    uint32_t v = samples[i];
+    uint16_t j = i;
+    for (; j > 0 && samples[j - 1] > v; j--) samples[j] = samples[j - 1];
+    samples[j] = v;
+  }
+}
+
+static void emptyCase() {}
+
+static void timeCase(const BenchCase &c, uint32_t overhead) {
+  for (uint16_t i = 0; i < BENCH_REPS; i++) {
+    if (c.prepare) c.prepare();
+    uint32_t start = clockNow();
+    c.run();
+    uint32_t t = clockNow() - start;
+    samples[i] = t > overhead ? t - overhead : 0;
+  }
+  sortSamples();
+}
+
+static bool matches(const char *name, const char *filter) {
+  return !filter || strncmp(name, filter, strlen(filter)) == 0;
+}
+
+void benchRunAll(Print &out, const char *filter) {
+  clockBegin();
+  BenchCase empty = {"empty", emptyCase, nullptr};
+  timeCase(empty, 0);
+  uint32_t overhead = samples[0];
+
+  out.print("BENCH {\"target\":\"");
+  out.print(BENCH_TARGET);
+  out.print("\",\"unit\":\"");
+  out.print(BENCH_UNIT);
+  out.print("\",\"reps\":");
+  out.print(BENCH_REPS);
+  out.print(",\"overhead\":");
+  out.print(overhead);
+  out.println("}");
+
+  for (size_t i = 0; i < benchCaseCount; i++) {
+    const BenchCase &c = benchCases[i];
+    if (!matches(c.name, filter)) continue;
+    timeCase(c, overhead);
+    out.print("BENCH {\"name\":\"");
+    out.print(c.name);
+    out.print("\",\"min\":");
+    out.print(samples[0]);
+    out.print(",\"median\":");
+    out.print(samples[BENCH_REPS / 2]);
+    out.print(",\"max\":");
+    out.print(samples[BENCH_REPS - 1]);
+    out.println("}");
+  }
+  out.println("BENCH {\"end\":1}");
+}
+
+// ---------------- Entry ----------------
+#if defined(SIM_NATIVE)
+
+// The sim's peripheral models read their settings through these; the
+// benchmarks run them with the defaults (sim_main.cpp isn't linked)
+const char *simOption(const char *, const char *def) { return def; }
+double simOptionF(const char *, double def) { return def; }
+
+class StdoutPrint : public Print {
+public:
+  size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+  using Print::write;
+};
+
+// program [case-prefix]
+int main(int argc, char **argv) {
+  StdoutPrint out;
+  benchSetup();
+  benchRunAll(out, argc > 1 ? argv[1] : nullptr);
+  return 0;
+}
+
+#else
+
+void setup() {
+  Serial.begin(115200);
+  benchSetup();
+  benchRunAll(Serial, nullptr);
+  Serial.flush();
+  // simavr ends the run when the CPU sleeps with interrupts off
+  cli();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sleep_cpu();
+}
+
+void loop() {}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef BENCH_SINK_H
+#define BENCH_SINK_H
+
+#include <Arduino.h>
+
+// Stands in for RADIO_SERIAL and DEBUG_SERIAL in bench builds (config.h):
+// takes everything, sends nothing, so a benchmark that prints measures the
+// formatting and never waits for the UART.
+class BenchSink : public Print {
+public:
+  void begin(unsigned long) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  void flush() {}
+  int availableForWrite() { return 63; }
+  operator bool() { return true; }
+
+  size_t write(uint8_t) override {
+    bytes++;
+    return 1;
+  }
+  using Print::write;
+
+  unsigned long bytes = 0;
+};
+
+extern BenchSink benchSink;
+
+#endif // BENCH_SINK_H
@@ -0,0 +1,204 @@
+// The benchmark cases. Commands that start something long-running
+// (Q_RUN, WP_RUN, CAL_MOTORS, REC_ARM, REC_DUMP) are left out: what they
+// cost shows up in loop(), not in processLine().
+
+#include "bench.h"
+#include "config.h"
+#include "command_parser.h"
+#include "encoder.h"
+#include "json_command.h"
+#include "motion_queue.h"
+#include "motor_calibration.h"
+#include "motor_control.h"
+#include "mpu_dmp.h"
+#include "odometry.h"
+#include "pose_ekf.h"
+#include "pursuit.h"
+#include "safety.h"
+#include "twist.h"
+
+void benchSetup() {
+  initializeMotors();
+  initializeMotorCalibration();
+  initializeEncoders();
+  initializePoseEkf();
+  initializeSafety();
+  enableMotors();
+}
+
+// ---------------- processLine() ----------------
+#define LINE_CASE(fn, text) \
+  static void fn() { processLine(text); }
+
+LINE_CASE(lineSetV, "SET_V 120 -80")
+LINE_CASE(lineMall, "MALL 100 -100 100 -100")
+LINE_CASE(lineM1, "M1 150")
+LINE_CASE(lineFwd, "FWD 150")
+LINE_CASE(lineBack, "BACK 150")
+LINE_CASE(lineLeft, "LEFT 120")
+LINE_CASE(lineRight, "RIGHT 120")
+LINE_CASE(lineStop, "STOP")
+LINE_CASE(lineEnable, "ENABLE")
+LINE_CASE(lineReqOdom, "REQ_ODOM")
+LINE_CASE(lineReqImu, "REQ_IMU")
+LINE_CASE(lineReqEkf, "REQ_EKF")
+LINE_CASE(lineReqSens, "REQ_SENS")
+LINE_CASE(lineReqSafe, "REQ_SAFE")
+LINE_CASE(lineReqQ, "REQ_Q")
+LINE_CASE(lineReqWp, "REQ_WP")
+LINE_CASE(lineReqCal, "REQ_CAL")
+LINE_CASE(lineReqRec, "REQ_REC")
+LINE_CASE(lineReqMem, "REQ_MEM")
+LINE_CASE(lineSafeRange, "SAFE_RANGE 0")
+LINE_CASE(lineQAdd, "Q_ADD 0 500 VEL 120 120")
+LINE_CASE(lineQClear, "Q_CLEAR")
+LINE_CASE(lineWpAdd, "WP_ADD 1000 -250")
+LINE_CASE(lineWpClear, "WP_CLEAR")
+LINE_CASE(lineTwist, "TWIST 300 1500")
+LINE_CASE(lineTraced, "#4711 SET_V 120 -80")
+LINE_CASE(lineUnknown, "NOT_A_COMMAND 1 2")
+LINE_CASE(lineJsonSetV, "{\"cmd\":\"SET_V\",\"args\":[120,-80]}")
+LINE_CASE(lineJsonReqEkf, "{\"cmd\":\"REQ_EKF\"}")
+LINE_CASE(lineJsonTraced, "{\"cmd\":\"SET_V\",\"args\":[120,-80],\"id\":4711}")
+
+static void emptyQueues() {
+  motionQueueClear();
+  pursuitClear();
+}
+
+// ---------------- Parsing ----------------
+// SET_V both ways, from the received text to its arguments: what
+// processLine() does before runCommand(), without the String around it
+static char parseBuf[64];
+
+static void parseAscii() {
+  strcpy(parseBuf, "SET_V 120 -80");
+  char *tok = strtok(parseBuf, " ");
+  while (tok) tok = strtok(NULL, " ");
+}
+
+static void parseJson(const char *text) {
+  strcpy(parseBuf, text);
+  JsonToken tokens[JSON_MAX_TOKENS];
+  int8_t n = jsonTokenize(parseBuf, tokens, JSON_MAX_TOKENS);
+  if (n <= 0 || jsonFind(parseBuf, tokens, n, "cmd") < 0) return;
+  JsonArgs args;
+  jsonArgsBegin(args, parseBuf, tokens, n, jsonFind(parseBuf, tokens, n, "args"));
+  while (jsonArgsNext(args)) {}
+}
+
+static void parseJsonArray() { parseJson("{\"cmd\":\"SET_V\",\"args\":[120,-80]}"); }
+static void parseJsonString() { parseJson("{\"cmd\":\"SET_V\",\"args\":\"120 -80\"}"); }
+
+// ---------------- Twist ----------------
+static void twistKinematics() {
+  WheelSpeeds w;
+  twistToWheels(1200, 4000, 190, 900, w);   // saturates
+}
+
+static void twistClosedLoop() { processTwist(); }
+
+static void twistClosedPrepare() {
+  twistSetMode(TWIST_CLOSED_LOOP);
+  twistSet(300, 1500);
+}
+
+// ---------------- Odometry ----------------
+static void odomPacket() {
+  PoseEstimate pose = {1.2345f, -0.5678f, 2.3456f, 0.4321f, -0.8765f, 0};
+  sendOdomPacket(123456UL, 200, 412, -398, 415, -401, 0.098765f, -0.095432f, 0.493825f, -0.477160f, pose);
+}
+
+static unsigned long lastOdomMillis;
+
+// Due now, with a full interval of encoder ticks to turn into distance
+static void odomDue() {
+  lastOdomMillis = millis() - ODOM_MS;
+  encCount1 += 412;
+  encCount2 += 398;
+  encCount3 += 415;
+  encCount4 += 401;
+}
+
+static void odomProcess() { processOdometry(lastOdomMillis); }
+
+// ---------------- Pose filter ----------------
+// A step due now, with a step's worth of ticks on each wheel and of gyro
+// samples turning at ~10 deg/s, so all five measurements run
+static void ekfDue() {
+  delay(EKF_MS);
+  encCount1 += 8;
+  encCount2 += 8;
+  encCount3 += 9;
+  encCount4 += 7;
+  ImuSample s = {0, {0, 0, 16384}, {0, 0, 655}};
+  for (uint8_t i = 0; i < EKF_MS * IMU_SAMPLE_HZ / 1000; i++) {
+    s.timeUs = micros() + i * (1000000UL / IMU_SAMPLE_HZ);
+    imuBenchSample(s);
+  }
+}
+
+static void ekfStep() { updatePoseEkf(); }
+
+// ---------------- Encoders ----------------
+static void encoderIsr1() { ISR_enc1(); }
+static void encoderIsr4() { ISR_enc4(); }
+
+static void encoderRead() {
+  long c1, c2, c3, c4;
+  readEncoderCounts(c1, c2, c3, c4);
+}
+
+// ---------------- Motors ----------------
+static void motorRaw() { setMotorRaw(M1_PWM, M1_IN1, M1_IN2, 150); }
+static void motorRawReverse() { setMotorRaw(M1_PWM, M1_IN1, M1_IN2, -150); }
+static void motorDriveAll() { driveAll(120, -120, 120, -120); }
+
+const BenchCase benchCases[] = {
+  {"processLine/SET_V", lineSetV, nullptr},
+  {"processLine/MALL", lineMall, nullptr},
+  {"processLine/M1", lineM1, nullptr},
+  {"processLine/FWD", lineFwd, nullptr},
+  {"processLine/BACK", lineBack, nullptr},
+  {"processLine/LEFT", lineLeft, nullptr},
+  {"processLine/RIGHT", lineRight, nullptr},
+  {"processLine/STOP", lineStop, nullptr},
+  {"processLine/ENABLE", lineEnable, nullptr},
+  {"processLine/REQ_ODOM", lineReqOdom, nullptr},
+  {"processLine/REQ_IMU", lineReqImu, nullptr},
+  {"processLine/REQ_EKF", lineReqEkf, nullptr},
+  {"processLine/REQ_SENS", lineReqSens, nullptr},
+  {"processLine/REQ_SAFE", lineReqSafe, nullptr},
+  {"processLine/REQ_Q", lineReqQ, nullptr},
+  {"processLine/REQ_WP", lineReqWp, nullptr},
+  {"processLine/REQ_CAL", lineReqCal, nullptr},
+  {"processLine/REQ_REC", lineReqRec, nullptr},
+  {"processLine/REQ_MEM", lineReqMem, nullptr},
+  {"processLine/SAFE_RANGE", lineSafeRange, nullptr},
+  {"processLine/Q_ADD", lineQAdd, emptyQueues},
+  {"processLine/Q_CLEAR", lineQClear, nullptr},
+  {"processLine/WP_ADD", lineWpAdd, emptyQueues},
+  {"processLine/WP_CLEAR", lineWpClear, nullptr},
+  {"processLine/TWIST", lineTwist, nullptr},
+  {"processLine/traced", lineTraced, nullptr},
+  {"processLine/unknown", lineUnknown, nullptr},
+  {"processLine/json_SET_V", lineJsonSetV, nullptr},
+  {"processLine/json_REQ_EKF", lineJsonReqEkf, nullptr},
+  {"processLine/json_traced", lineJsonTraced, nullptr},
+  {"parse/ascii_SET_V", parseAscii, nullptr},
+  {"parse/json_SET_V", parseJsonArray, nullptr},
+  {"parse/json_SET_V_string", parseJsonString, nullptr},
+  {"twistToWheels/saturated", twistKinematics, nullptr},
+  {"processTwist/closed", twistClosedLoop, twistClosedPrepare},
+  {"sendOdomPacket/moving", odomPacket, nullptr},
+  {"processOdometry/due", odomProcess, odomDue},
+  {"updatePoseEkf/step", ekfStep, ekfDue},
+  {"encoder/ISR_enc1", encoderIsr1, nullptr},
+  {"encoder/ISR_enc4", encoderIsr4, nullptr},
+  {"encoder/readEncoderCounts", encoderRead, nullptr},
+  {"setMotorRaw/forward", motorRaw, nullptr},
+  {"setMotorRaw/reverse", motorRawReverse, nullptr},
+  {"driveAll/spin", motorDriveAll, nullptr},
+};
+
+const size_t benchCaseCount = sizeof(benchCases) / sizeof(benchCases[0]);
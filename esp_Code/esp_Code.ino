@@ -6,6 +6,7 @@
 
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
+#include <WiFiUdp.h>
 #include <ArduinoJson.h>
 
 // ================ CONFIGURATION ================
@@ -18,28 +19,93 @@ const unsigned long COMMAND_TIMEOUT = 1200;
 const int MAX_COMMAND_LENGTH = 500;
 const unsigned long CONNECTION_TIMEOUT = 8000;
 const unsigned long RESPONSE_TIMEOUT = 2000;
+const unsigned long LINK_PROBE_FIRST = 20;       // HELLO retry gap until the Mega answers; doubles
+const unsigned long LINK_PROBE_MAX = 1000;
+
+const uint16_t UDP_CONTROL_PORT = 4210;
+const unsigned long UDP_CONTROL_TIMEOUT = 300;   // stop motors if no packet for this long (ms)
+const unsigned long UDP_MAX_PACKET_AGE = 150;    // drop packets delayed more than this (ms)
 
 ESP8266WebServer server(80);
+WiFiUDP controlUdp;
 
 // Global state variables
 String rxBuffer = "";
 String lastStatusData = "System Starting";
 String lastSensorData = "No Data";
-String debugBuffer = "";
 unsigned long lastStatusUpdate = 0;
 unsigned long lastRobotResponse = 0;
 bool robotConnected = false;
+bool linkUp = false;               // the Mega has answered since boot or since the link was lost
+unsigned long nextLinkProbe = 0;
+unsigned long linkProbeGap = LINK_PROBE_FIRST;
 bool motorsEnabled = false;
 bool debugMode = true;
 bool systemInitialized = false;
 int commandCounter = 0;
 
+// The /command request waiting for its reply: the Mega follows the reply
+// with {"resp":"TR","v":[<id>,...]} for a command sent with "id"
+unsigned long pendingCommandId = 0;
+String commandReply = "";
+bool commandDone = false;
+
 // Individual motor PWM values
 int motor1PWM = 0;
 int motor2PWM = 0;
 int motor3PWM = 0;
 int motor4PWM = 0;
 
+// ================ DEBUG LOG RING ================
+// DEBUG messages from the Mega go into a fixed byte ring with a small line
+// index, so appending never allocates or copies the older lines. Every line
+// gets a sequence number; /log?since=<seq> returns only the lines after it.
+const uint16_t DEBUG_LOG_BYTES = 2048;
+const uint8_t DEBUG_LOG_MAX_LINES = 32;
+const uint16_t DEBUG_LOG_MAX_LINE_LEN = 160;
+
+struct DebugLogLine {
+  uint16_t offset;   // start position in debugLogData
+  uint16_t length;   // bytes, no terminator
+};
+
+char debugLogData[DEBUG_LOG_BYTES];
+DebugLogLine debugLogLines[DEBUG_LOG_MAX_LINES];
+uint16_t debugLogHead = 0;        // next byte write position
+uint16_t debugLogUsed = 0;        // bytes held by live lines
+uint32_t debugLogFirstSeq = 0;    // oldest line still stored
+uint32_t debugLogNextSeq = 0;     // sequence number of the next line
+
+void debugLogDropOldest() {
+  DebugLogLine &old = debugLogLines[debugLogFirstSeq % DEBUG_LOG_MAX_LINES];
+  debugLogUsed -= old.length;
+  debugLogFirstSeq++;
+}
+
+void debugLogAppend(const char* msg) {
+  size_t len = strlen(msg);
+  if (len > DEBUG_LOG_MAX_LINE_LEN) len = DEBUG_LOG_MAX_LINE_LEN;
+
+  while (debugLogNextSeq - debugLogFirstSeq >= DEBUG_LOG_MAX_LINES ||
+         debugLogUsed + len > DEBUG_LOG_BYTES) {
+    debugLogDropOldest();
+  }
+
+  DebugLogLine &line = debugLogLines[debugLogNextSeq % DEBUG_LOG_MAX_LINES];
+  line.offset = debugLogHead;
+  line.length = len;
+
+  // Copy in at most two pieces when the line wraps the end of the ring
+  size_t first = DEBUG_LOG_BYTES - debugLogHead;
+  if (first > len) first = len;
+  memcpy(debugLogData + debugLogHead, msg, first);
+  memcpy(debugLogData, msg + first, len - first);
+
+  debugLogHead = (debugLogHead + len) % DEBUG_LOG_BYTES;
+  debugLogUsed += len;
+  debugLogNextSeq++;
+}
+
 // ================ ROBOT COMMUNICATION ================
 // Send raw JSON command to Arduino (no processing)
 void sendToRobot(const String& jsonCommand) {
@@ -65,9 +131,47 @@ void sendCommandToRobot(const String& cmd, const String& args = "") {
   }
 }
 
+// ================ LINK BRING-UP ================
+// No fixed waits for the Mega: it announces "READY proto=.. up_ms=.." in
+// text as soon as its setup() is done and answers HELLO with the same (in
+// JSON then). Until something arrives, HELLO goes out with backoff.
+void processLink(unsigned long now) {
+  if (linkUp || (long)(now - nextLinkProbe) < 0) return;
+  sendCommandToRobot("HELLO", "\"ESP8266\"");
+  nextLinkProbe = now + linkProbeGap;
+  linkProbeGap = min(linkProbeGap * 2, LINK_PROBE_MAX);
+}
+
+void onLinkUp() {
+  if (linkUp) return;
+  linkUp = true;
+  sendCommandToRobot("STATUS");    // motors and system state for the page right away
+  lastStatusUpdate = millis();
+}
+
+void onLinkLost() {
+  linkUp = false;
+  robotConnected = false;
+  nextLinkProbe = millis();
+  linkProbeGap = LINK_PROBE_FIRST;
+}
+
 void handleRobotMessage(const String& message) {
   lastRobotResponse = millis();
   robotConnected = true;
+  onLinkUp();
+
+  // Only replies to our commands come back as JSON. What the Mega sends on
+  // its own (READY, ODOM every 200 ms, SENS, TRIP, Q DONE, WP, CAL, REC)
+  // is text, and must not stand in for a command's reply.
+  if (!message.startsWith("{")) {
+    if (message.startsWith("ODOM ") || message.startsWith("SENS ")) {
+      lastSensorData = message;
+    } else if (!message.startsWith("READY")) {
+      debugLogAppend(message.c_str());
+    }
+    return;
+  }
 
   StaticJsonDocument<300> doc;
   DeserializationError error = deserializeJson(doc, message);
@@ -83,9 +187,22 @@ if (error) {
 }
 
   const char* resp = doc["resp"] | "";
+  if (strcmp(resp, "TR") == 0) {
+    if (pendingCommandId && doc["v"][0].as<unsigned long>() == pendingCommandId) commandDone = true;
+    return;
+  }
+  if (pendingCommandId && strcmp(resp, "DEBUG") != 0) {
+    commandReply = message;
+    // A command the Mega couldn't parse gets no TR line
+    if (strcmp(resp, "ERROR") == 0 && strncmp(doc["msg"] | "", "JSON", 4) == 0) commandDone = true;
+  }
+
   if (strcmp(resp, "PONG") == 0) {
     lastStatusData = "PONG";
   }
+  else if (strcmp(resp, "READY") == 0) {
+    lastStatusData = "READY";
+  }
   else if (strcmp(resp, "STATUS") == 0) {
     lastStatusData = "STATUS";
     motorsEnabled = doc["motors"] | 0;
@@ -105,16 +222,7 @@ if (error) {
     return;
   }
   else if (strcmp(resp, "DEBUG") == 0) {
-    // Append debug messages to debugBuffer (keep last N lines)
-    String dbg = String((const char*)doc["msg"]);
-    debugBuffer += dbg + "\n";
-    const int maxDebugLines = 20;
-    int lines = 0, idx = debugBuffer.length();
-    while (idx > 0 && lines < maxDebugLines) {
-      idx = debugBuffer.lastIndexOf('\n', idx - 1);
-      lines++;
-    }
-    if (idx > 0) debugBuffer = debugBuffer.substring(idx + 1);
+    debugLogAppend(doc["msg"] | "");
     return; // Do NOT set lastStatusData for debug messages!
   }
   else {
@@ -157,6 +265,124 @@ bool requestStatus() {
   return robotConnected;
 }
 
+// ================ UDP JOYSTICK CONTROL ================
+// Binary teleop packets on UDP_CONTROL_PORT skip the TCP setup, HTTP parsing
+// and JSON validation of /command. Little-endian and packed; keep in sync
+// with host/include/joy_protocol.h.
+const uint8_t JOY_MAGIC = 'J';
+const uint8_t JOY_ACK_MAGIC = 'A';
+const uint8_t JOY_FLAG_DEADMAN = 0x01;
+
+enum JoyStatus : uint8_t {
+  JOY_ACCEPTED = 0,
+  JOY_DROP_ORDER = 1,   // sequence number not newer than the last accepted one
+  JOY_DROP_STALE = 2    // delayed more than UDP_MAX_PACKET_AGE in transit
+};
+
+struct __attribute__((packed)) JoyPacket {
+  uint8_t magic;
+  uint8_t flags;
+  uint16_t seq;
+  uint32_t sentMs;      // sender clock
+  int16_t left;         // -255..255, same units as the M command
+  int16_t right;
+};
+
+struct __attribute__((packed)) JoyAck {
+  uint8_t magic;
+  uint8_t status;       // JoyStatus
+  uint16_t seq;
+  uint32_t sentMs;      // echoed so the sender can measure round trip time
+};
+
+bool joyActive = false;
+uint16_t joyLastSeq = 0;
+int32_t joyClockOffset = 0;       // smallest (arrival - sentMs) seen this session
+unsigned long joyLastPacket = 0;
+unsigned long joyOffsetAged = 0;
+int joyLeft = 0, joyRight = 0;
+uint32_t joyDroppedOrder = 0, joyDroppedStale = 0, joyTimeouts = 0;
+
+void joyDrive(int left, int right) {
+  if (left == joyLeft && right == joyRight) return;
+  joyLeft = left;
+  joyRight = right;
+  motor1PWM = motor3PWM = left;
+  motor2PWM = motor4PWM = right;
+
+  char json[64];
+  snprintf(json, sizeof(json), "{\"cmd\":\"M\",\"args\":[%d,%d,%d,%d,1]}",
+           left, right, left, right);
+  Serial.println(json);
+}
+
+uint8_t joyAccept(const JoyPacket& pkt, unsigned long now) {
+  int32_t offset = (int32_t)(now - pkt.sentMs);
+
+  // A new session (first packet, or after a timeout) re-learns sequence and clock
+  if (!joyActive) {
+    joyLastSeq = pkt.seq - 1;
+    joyClockOffset = offset;
+    joyOffsetAged = now;
+  }
+
+  if ((int16_t)(pkt.seq - joyLastSeq) <= 0) {
+    joyDroppedOrder++;
+    return JOY_DROP_ORDER;
+  }
+
+  // The smallest offset is the best one-way-delay baseline; let it creep up
+  // 1 ms per second so sender clock drift can't make everything look stale
+  if (offset < joyClockOffset) joyClockOffset = offset;
+  if (now - joyOffsetAged >= 1000) {
+    joyClockOffset++;
+    joyOffsetAged = now;
+  }
+  if (offset - joyClockOffset > (int32_t)UDP_MAX_PACKET_AGE) {
+    joyDroppedStale++;
+    return JOY_DROP_STALE;
+  }
+
+  joyLastSeq = pkt.seq;
+  joyLastPacket = now;
+  joyActive = true;
+
+  if (pkt.flags & JOY_FLAG_DEADMAN) {
+    joyDrive(constrain((int)pkt.left, -255, 255), constrain((int)pkt.right, -255, 255));
+  } else {
+    joyDrive(0, 0);
+  }
+  return JOY_ACCEPTED;
+}
+
+void processUdpControl() {
+  int size;
+  while ((size = controlUdp.parsePacket()) > 0) {
+    JoyPacket pkt;
+    if (size != sizeof(pkt) ||
+        controlUdp.read((uint8_t*)&pkt, sizeof(pkt)) != sizeof(pkt) ||
+        pkt.magic != JOY_MAGIC) {
+      continue;
+    }
+
+    JoyAck ack;
+    ack.magic = JOY_ACK_MAGIC;
+    ack.status = joyAccept(pkt, millis());
+    ack.seq = pkt.seq;
+    ack.sentMs = pkt.sentMs;
+    controlUdp.beginPacket(controlUdp.remoteIP(), controlUdp.remotePort());
+    controlUdp.write((const uint8_t*)&ack, sizeof(ack));
+    controlUdp.endPacket();
+  }
+
+  // Link went quiet: stop the robot instead of coasting on the last command
+  if (joyActive && millis() - joyLastPacket > UDP_CONTROL_TIMEOUT) {
+    joyActive = false;
+    joyTimeouts++;
+    joyDrive(0, 0);
+  }
+}
+
 // ================ WEB INTERFACE ================
 const char* getWebPage() {
   static const char webpage[] PROGMEM = R"rawliteral(
@@ -553,7 +779,7 @@ function updateElementText(elementId, text) {
             const timestamp = new Date().toLocaleTimeString();
             const prefixMap = {
                 'tx': '📤 TX: ', 'rx': '📥 RX: ', 'error': '❌ ERR: ',
-                'success': '✅ OK: ', 'info': 'ℹ️  '
+                'success': '✅ OK: ', 'info': 'ℹ️  ', 'debug': '🐞 DBG: '
             };
             const prefix = prefixMap[type] || 'ℹ️  ';
             const lines = logDisplay.textContent.split('\n');
@@ -758,6 +984,24 @@ function postJsonCommand(payload, onSuccess) {
             });
         }
         
+        // Incremental debug log: only lines newer than the last poll come back
+        let debugLogNext = 0;
+        function pollDebugLog() {
+            fetch('/log?since=' + debugLogNext)
+            .then(response => {
+                const next = parseInt(response.headers.get('X-Log-Next'));
+                if (!isNaN(next)) debugLogNext = next;
+                return response.text();
+            })
+            .then(text => {
+                text.split('\n').forEach(line => {
+                    const sp = line.indexOf(' ');
+                    if (sp > 0) addToLog(line.substring(sp + 1), 'debug');
+                });
+            })
+            .catch(err => {});
+        }
+
         // Boot sequence
         setTimeout(() => {
             addToLog('ESP8266 Millis-Compatible Controller Ready', 'success');
@@ -771,6 +1015,7 @@ function postJsonCommand(payload, onSuccess) {
         }, 1500);
 
         setInterval(updateStatus, 3000);
+        setInterval(pollDebugLog, 1000);
         setInterval(() => {
             if (!isConnected) sendCommand('PING');
         }, 5000);
@@ -807,37 +1052,46 @@ void handleCommand() {
     return;
   }
 
-  // Validate JSON
-  StaticJsonDocument<256> testDoc;
+  // Validate JSON; room left for the "id" added below
+  StaticJsonDocument<384> testDoc;
   DeserializationError error = deserializeJson(testDoc, body);
   if (error) {
     server.send(400, "application/json", "{\"error\":\"INVALID_JSON\"}");
     return;
   }
 
-  // Send to Arduino
-  sendToRobot(body);
+  if (!linkUp) {
+    server.send(200, "application/json", "{\"resp\":\"LINK_DOWN\"}");
+    return;
+  }
+
+  // Replies to a STATUS poll or an earlier command may still be on the way
+  processRobotResponse();
+
+  // Send to Arduino with an id, so its reply is the last JSON object
+  // before the TR line carrying that id
   commandCounter++;
+  if (!testDoc.containsKey("id")) testDoc["id"] = commandCounter;
+  pendingCommandId = testDoc["id"];
+  commandReply = "";
+  commandDone = false;
+  String line;
+  serializeJson(testDoc, line);
+  sendToRobot(line);
 
-  // Clear previous response and wait for new one
-  String previousStatus = lastStatusData;
-  lastStatusData = "TIMEOUT"; // Reset
-  
   unsigned long startTime = millis();
-  while (millis() - startTime < COMMAND_TIMEOUT) {
+  while (!commandDone && millis() - startTime < COMMAND_TIMEOUT) {
     processRobotResponse();
-    if (lastStatusData != "TIMEOUT" && lastStatusData != previousStatus) {
-      break; // Got new response
-    }
-    delay(10);
+    delay(1);
     yield();
   }
+  pendingCommandId = 0;
 
-  // Send the response (make sure it's valid JSON)
-  if (lastStatusData == "TIMEOUT" || lastStatusData == previousStatus) {
+  // Send the Mega's reply object itself
+  if (!commandDone || commandReply.length() == 0) {
     server.send(200, "application/json", "{\"resp\":\"TIMEOUT\"}");
   } else {
-    server.send(200, "application/json", lastStatusData);
+    server.send(200, "application/json", commandReply);
   }
 }
 
@@ -853,7 +1107,6 @@ void handleStatus() {
   doc["systemInitialized"] = systemInitialized;
   doc["robotData"] = lastStatusData;
   doc["sensorData"] = lastSensorData;
-  doc["debugData"] = debugBuffer;
   doc["motor1PWM"] = motor1PWM;
   doc["motor2PWM"] = motor2PWM;
   doc["motor3PWM"] = motor3PWM;
@@ -862,12 +1115,50 @@ void handleStatus() {
   doc["lastResponse"] = millis() - lastRobotResponse;
   doc["uptime"] = millis();
   doc["debugMode"] = debugMode;
+  doc["udpActive"] = joyActive;
+  doc["udpDroppedOrder"] = joyDroppedOrder;
+  doc["udpDroppedStale"] = joyDroppedStale;
+  doc["udpTimeouts"] = joyTimeouts;
 
   String jsonOut;
   serializeJson(doc, jsonOut);
   server.send(200, "application/json", jsonOut);
 }
 
+// GET /log?since=<seq> -> "<seq> <message>" lines numbered <seq> and up.
+// X-Log-Next carries the value to pass as since= on the next poll; a first
+// line numbered above since means older lines were already overwritten.
+void handleLog() {
+  uint32_t seq = debugLogFirstSeq;
+  if (server.hasArg("since")) {
+    seq = strtoul(server.arg("since").c_str(), NULL, 10);
+    if (seq < debugLogFirstSeq) seq = debugLogFirstSeq;
+    if (seq > debugLogNextSeq) seq = debugLogNextSeq;
+  }
+
+  server.sendHeader("X-Log-Next", String(debugLogNextSeq));
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+
+  char chunk[256];
+  size_t n = 0;
+  for (; seq < debugLogNextSeq; seq++) {
+    const DebugLogLine &line = debugLogLines[seq % DEBUG_LOG_MAX_LINES];
+    // Worst case per line: 10 digits + space + text + newline
+    if (n + 12 + line.length > sizeof(chunk)) {
+      server.sendContent(chunk, n);
+      n = 0;
+    }
+    n += snprintf(chunk + n, sizeof(chunk) - n, "%lu ", (unsigned long)seq);
+    for (uint16_t i = 0; i < line.length; i++) {
+      chunk[n++] = debugLogData[(line.offset + i) % DEBUG_LOG_BYTES];
+    }
+    chunk[n++] = '\n';
+  }
+  if (n > 0) server.sendContent(chunk, n);
+  server.sendContent("");
+}
+
 void handleNotFound() {
   server.send(404, "text/plain", "404: Page Not Found");
 }
@@ -875,42 +1166,36 @@ void handleNotFound() {
 // ================ MAIN FUNCTIONS ================
 void setup() {
   Serial.begin(SERIAL_BAUD);
-  delay(1000);
-  while (Serial.available()) Serial.read();
+
+  // First probe before the access point takes its time; the answer waits
+  // in the UART buffer for loop()
+  processLink(millis());
 
   WiFi.mode(WIFI_AP);
   WiFi.softAP(AP_SSID, AP_PASSWORD);
 
-  delay(2000);
   server.on("/", handleRoot);
   server.on("/command", HTTP_POST, handleCommand);
   server.on("/status", HTTP_GET, handleStatus);
+  server.on("/log", HTTP_GET, handleLog);
   server.onNotFound(handleNotFound);
   server.begin();
+  controlUdp.begin(UDP_CONTROL_PORT);
 
   lastRobotResponse = millis();
   lastStatusUpdate = millis();
-
-  delay(3000);
-  sendCommandToRobot("ESP8266", "\"READY\"");
-  delay(500);
-  sendCommandToRobot("PING");
-  sendCommandToRobot("HELLO", "\"ESP8266_READY\"");
-  delay(500);
-  sendCommandToRobot("PING");
 }
 
 
 void loop() {
   server.handleClient();
+  processUdpControl();
   processRobotResponse();
   unsigned long now = millis();
-  if (now - lastStatusUpdate >= STATUS_UPDATE_INTERVAL) {
-    if (robotConnected) {
-      sendCommandToRobot("STATUS");
-    } else {
-      sendCommandToRobot("PING");
-    }
+  if (linkUp && now - lastRobotResponse > CONNECTION_TIMEOUT) onLinkLost();
+  processLink(now);
+  if (linkUp && now - lastStatusUpdate >= STATUS_UPDATE_INTERVAL) {
+    sendCommandToRobot("STATUS");
     lastStatusUpdate = now;
   }
   yield();
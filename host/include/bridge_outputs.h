@@ -0,0 +1,212 @@
+#ifndef BRIDGE_OUTPUTS_H
+#define BRIDGE_OUTPUTS_H
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bridge_telemetry.h"
+#include "ros_adapter.h"
+
+// Where serial_bridge publishes each decoded ODOM line. Pick one or more
+// with --out:
+//   udp:<host>:<port>   one BridgePacket per ODOM line
+//   ros:<host>:<port>   ROS 1 serialized /odom and /joint_states datagrams,
+//                       each prefixed with its RosTopic byte
+//   shm:<name>          latest state in POSIX shared memory (ShmTelemetry)
+//   text                one line per ODOM on stdout
+
+const uint8_t BRIDGE_MAGIC0 = 'B';
+const uint8_t BRIDGE_MAGIC1 = 'R';
+const uint8_t BRIDGE_VERSION = 1;
+
+// Little-endian and packed, like the joystick packets
+struct __attribute__((packed)) BridgePacket {
+  uint8_t magic[2];
+  uint8_t version;
+  uint8_t slipMask;
+  uint32_t seq;
+  double hostTime;           // CLOCK_REALTIME seconds
+  uint32_t megaMs;
+  float x, y, theta;         // meters, radians
+  float v, w;                // m/s, rad/s
+  float wheelPosition[4];    // radians, M1..M4
+  float wheelVelocity[4];    // rad/s
+  int16_t currentMa[4];
+  uint16_t batteryMv;
+};
+
+// Seqlock: the writer makes seq odd while it copies. A reader retries
+// until it sees the same even seq before and after its copy.
+struct ShmTelemetry {
+  std::atomic<uint32_t> seq;
+  BridgeState state;
+};
+
+inline bool shmTelemetryRead(const ShmTelemetry *shm, BridgeState &out) {
+  for (int tries = 0; tries < 100; tries++) {
+    uint32_t before = shm->seq.load(std::memory_order_acquire);
+    if (before & 1) continue;
+    memcpy(&out, (const void *)&shm->state, sizeof(out));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shm->seq.load(std::memory_order_relaxed) == before) return true;
+  }
+  return false;
+}
+
+class BridgeOutput {
+public:
+  virtual ~BridgeOutput() {}
+  virtual void publish(const BridgeState &s) = 0;
+};
+
+class UdpSender {
+protected:
+  bool openUdp(const std::string &hostPort, std::string &error) {
+    size_t colon = hostPort.rfind(':');
+    if (colon == std::string::npos) {
+      error = "expected <host>:<port>";
+      return false;
+    }
+    memset(&dst_, 0, sizeof(dst_));
+    dst_.sin_family = AF_INET;
+    dst_.sin_port = htons(atoi(hostPort.c_str() + colon + 1));
+    if (inet_pton(AF_INET, hostPort.substr(0, colon).c_str(), &dst_.sin_addr) != 1) {
+      error = "bad address " + hostPort.substr(0, colon);
+      return false;
+    }
+    fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd_ < 0) error = strerror(errno);
+    return fd_ >= 0;
+  }
+  // Dropped when the socket buffer is full: the next ODOM supersedes it
+  void sendDatagram(const void *p, size_t n) {
+    sendto(fd_, p, n, 0, (const sockaddr *)&dst_, sizeof(dst_));
+  }
+  ~UdpSender() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+private:
+  int fd_ = -1;
+  sockaddr_in dst_;
+};
+
+class UdpOutput : public BridgeOutput, UdpSender {
+public:
+  bool open(const std::string &hostPort, std::string &error) { return openUdp(hostPort, error); }
+  void publish(const BridgeState &s) override {
+    BridgePacket p;
+    p.magic[0] = BRIDGE_MAGIC0;
+    p.magic[1] = BRIDGE_MAGIC1;
+    p.version = BRIDGE_VERSION;
+    p.slipMask = s.slipMask;
+    p.seq = (uint32_t)s.seq;
+    p.hostTime = s.hostTime;
+    p.megaMs = s.megaMs;
+    p.x = s.x; p.y = s.y; p.theta = s.theta;
+    p.v = s.v; p.w = s.w;
+    for (int i = 0; i < 4; i++) {
+      p.wheelPosition[i] = s.wheelPosition[i];
+      p.wheelVelocity[i] = s.wheelVelocity[i];
+      p.currentMa[i] = s.currentMa[i];
+    }
+    p.batteryMv = s.batteryMv;
+    sendDatagram(&p, sizeof(p));
+  }
+};
+
+class RosOutput : public BridgeOutput, UdpSender {
+public:
+  bool open(const std::string &hostPort, std::string &error) { return openUdp(hostPort, error); }
+  void publish(const BridgeState &s) override {
+    buf_.assign(1, ROS_TOPIC_ODOM);
+    rosOdometry(s, buf_);
+    sendDatagram(buf_.data(), buf_.size());
+    buf_.assign(1, ROS_TOPIC_JOINT_STATES);
+    rosJointStates(s, buf_);
+    sendDatagram(buf_.data(), buf_.size());
+  }
+
+private:
+  std::vector<uint8_t> buf_;
+};
+
+class ShmOutput : public BridgeOutput {
+public:
+  bool open(const std::string &name, std::string &error) {
+    name_ = name[0] == '/' ? name : "/" + name;
+    int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(ShmTelemetry)) < 0) {
+      error = name_ + ": " + strerror(errno);
+      if (fd >= 0) close(fd);
+      return false;
+    }
+    void *p = mmap(nullptr, sizeof(ShmTelemetry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+      error = name_ + ": " + strerror(errno);
+      return false;
+    }
+    shm_ = (ShmTelemetry *)p;
+    return true;
+  }
+  ~ShmOutput() {
+    if (shm_) munmap(shm_, sizeof(ShmTelemetry));
+    if (!name_.empty()) shm_unlink(name_.c_str());
+  }
+  void publish(const BridgeState &s) override {
+    uint32_t seq = shm_->seq.load(std::memory_order_relaxed);
+    shm_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy((void *)&shm_->state, &s, sizeof(s));
+    shm_->seq.store(seq + 2, std::memory_order_release);
+  }
+
+private:
+  std::string name_;
+  ShmTelemetry *shm_ = nullptr;
+};
+
+class TextOutput : public BridgeOutput {
+public:
+  void publish(const BridgeState &s) override {
+    printf("%lu %.3f x %.4f y %.4f th %.4f v %.3f w %.3f wheels %.2f %.2f %.2f %.2f rad/s slip %u\n",
+           (unsigned long)s.seq, s.hostTime, s.x, s.y, s.theta, s.v, s.w,
+           s.wheelVelocity[0], s.wheelVelocity[1], s.wheelVelocity[2], s.wheelVelocity[3], s.slipMask);
+    fflush(stdout);
+  }
+};
+
+// "udp:127.0.0.1:5600", "ros:...", "shm:robot_bridge" or "text"
+inline std::unique_ptr<BridgeOutput> bridgeOutputOpen(const std::string &spec, std::string &error) {
+  std::string kind = spec.substr(0, spec.find(':'));
+  std::string arg = spec.find(':') == std::string::npos ? "" : spec.substr(spec.find(':') + 1);
+  if (kind == "udp") {
+    std::unique_ptr<UdpOutput> out(new UdpOutput);
+    if (out->open(arg, error)) return std::move(out);
+  } else if (kind == "ros") {
+    std::unique_ptr<RosOutput> out(new RosOutput);
+    if (out->open(arg, error)) return std::move(out);
+  } else if (kind == "shm") {
+    std::unique_ptr<ShmOutput> out(new ShmOutput);
+    if (out->open(arg.empty() ? "robot_bridge" : arg, error)) return std::move(out);
+  } else if (kind == "text") {
+    return std::unique_ptr<BridgeOutput>(new TextOutput);
+  } else {
+    error = "unknown output " + kind;
+  }
+  return nullptr;
+}
+
+#endif // BRIDGE_OUTPUTS_H
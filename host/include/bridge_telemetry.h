@@ -0,0 +1,119 @@
+#ifndef BRIDGE_TELEMETRY_H
+#define BRIDGE_TELEMETRY_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Decoding of the Mega's telemetry lines (README "Odometry Output") into
+// the pose and wheel states the bridge publishes. Lines are parsed where
+// they lie in the receive ring; they must be NUL-terminated.
+// Keep in sync with sendOdomPacket() in src/odometry.cpp and the physical
+// constants in include/config.h.
+
+const int ODOM_FIELDS = 16;
+const double BRIDGE_TICKS_PER_REV = 11;      // PULSES_PER_REV * GEAR_RATIO
+const double BRIDGE_WHEEL_RADIUS = 0.0425;   // meters
+
+// ODOM <now> <dt> <d1> <d2> <d3> <d4> <distL> <distR> <vL> <vR> <x> <y> <theta> <v> <w> <slip>
+struct OdomLine {
+  uint32_t megaMs;
+  uint32_t dtMs;
+  int32_t ticks[4];          // encoder ticks over dtMs, M1..M4
+  double distL, distR;       // meters over dtMs
+  double vL, vR;             // m/s
+  double x, y, theta;        // fused pose, meters and radians
+  double v, w;               // m/s, rad/s
+  uint8_t slipMask;
+};
+
+// SENS <battery_mV> <m1_mA> <m2_mA> <m3_mA> <m4_mA> <range_mm>
+struct SensLine {
+  int32_t batteryMv;
+  int32_t currentMa[4];
+  int32_t rangeMm;           // 0: no echo, 65535: nothing in range
+};
+
+// Returns false unless every field is there and numeric
+inline bool parseOdom(const char *line, OdomLine &out) {
+  if (strncmp(line, "ODOM ", 5) != 0) return false;
+  const char *p = line + 5;
+  char *end;
+  double f[ODOM_FIELDS];
+  for (int i = 0; i < ODOM_FIELDS; i++) {
+    f[i] = strtod(p, &end);
+    if (end == p) return false;
+    p = end;
+  }
+  out.megaMs = (uint32_t)f[0];
+  out.dtMs = (uint32_t)f[1];
+  for (int w = 0; w < 4; w++) out.ticks[w] = (int32_t)f[2 + w];
+  out.distL = f[6];
+  out.distR = f[7];
+  out.vL = f[8];
+  out.vR = f[9];
+  out.x = f[10];
+  out.y = f[11];
+  out.theta = f[12];
+  out.v = f[13];
+  out.w = f[14];
+  out.slipMask = (uint8_t)f[15];
+  return true;
+}
+
+inline bool parseSens(const char *line, SensLine &out) {
+  if (strncmp(line, "SENS ", 5) != 0) return false;
+  const char *p = line + 5;
+  char *end;
+  long f[6];
+  for (int i = 0; i < 6; i++) {
+    f[i] = strtol(p, &end, 10);
+    if (end == p) return false;
+    p = end;
+  }
+  out.batteryMv = f[0];
+  for (int m = 0; m < 4; m++) out.currentMa[m] = f[1 + m];
+  out.rangeMm = f[5];
+  return true;
+}
+
+// What every output publishes: the latest pose, and wheel joint states
+// integrated from the encoder deltas since the bridge started
+struct BridgeState {
+  uint64_t seq;              // ODOM lines decoded
+  double hostTime;           // CLOCK_REALTIME seconds the ODOM line was read
+  uint32_t megaMs;
+  double x, y, theta;        // meters, radians
+  double v, w;               // m/s, rad/s
+  uint8_t slipMask;
+  double wheelPosition[4];   // radians, M1..M4
+  double wheelVelocity[4];   // rad/s over the last ODOM interval
+  int32_t currentMa[4];      // from the latest SENS line
+  int32_t batteryMv;
+};
+
+inline void bridgeApplyOdom(BridgeState &s, const OdomLine &o, double hostTime, double ticksPerRev) {
+  const double radPerTick = 2 * M_PI / ticksPerRev;
+  double dt = o.dtMs > 0 ? o.dtMs / 1000.0 : 0;
+  for (int w = 0; w < 4; w++) {
+    s.wheelPosition[w] += o.ticks[w] * radPerTick;
+    s.wheelVelocity[w] = dt > 0 ? o.ticks[w] * radPerTick / dt : 0;
+  }
+  s.seq++;
+  s.hostTime = hostTime;
+  s.megaMs = o.megaMs;
+  s.x = o.x;
+  s.y = o.y;
+  s.theta = o.theta;
+  s.v = o.v;
+  s.w = o.w;
+  s.slipMask = o.slipMask;
+}
+
+inline void bridgeApplySens(BridgeState &s, const SensLine &l) {
+  for (int m = 0; m < 4; m++) s.currentMa[m] = l.currentMa[m];
+  s.batteryMv = l.batteryMv;
+}
+
+#endif // BRIDGE_TELEMETRY_H
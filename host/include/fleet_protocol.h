@@ -0,0 +1,56 @@
+#ifndef FLEET_PROTOCOL_H
+#define FLEET_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What fleet_gateway sends to its subscribers. A subscriber sends the text
+// datagram "SUB" to the gateway's --sub-port (and again at least every
+// FLEET_SUB_TIMEOUT_S to stay subscribed), then receives datagrams of a
+// FleetHeader and up to FLEET_MAX_ENTRIES FleetEntry records: the robots
+// that changed since the previous update. Right after "SUB" it gets every robot once.
+//
+// Other requests, each answered with one text datagram:
+//   "UNSUB"   stop sending updates
+//   "NAMES"   "NAMES <index>=<name> ..." in --robot order
+//   "STATS"   "STATS <key> <value> ..." counters since start
+//
+// Little-endian and packed, like the joystick and bridge packets.
+
+const uint16_t FLEET_SUB_PORT = 5620;
+const uint8_t FLEET_MAGIC0 = 'F';
+const uint8_t FLEET_MAGIC1 = 'L';
+const uint8_t FLEET_VERSION = 1;
+const double FLEET_SUB_TIMEOUT_S = 10;
+
+const uint8_t FLEET_FLAG_STALE = 0x01;      // nothing from the robot for --stale seconds
+const uint8_t FLEET_FLAG_LINK_DOWN = 0x02;  // port closed, or HTTP polls failing
+const uint8_t FLEET_FLAG_NO_MEGA = 0x04;    // the ESP reports no Mega on its UART
+
+struct __attribute__((packed)) FleetHeader {
+  uint8_t magic[2];
+  uint8_t version;
+  uint8_t count;             // FleetEntry records that follow
+  uint32_t seq;              // datagrams sent to this subscriber
+  uint16_t robots;           // fleet size
+  uint16_t reserved;
+  double hostTime;           // CLOCK_REALTIME seconds at send
+};
+
+struct __attribute__((packed)) FleetEntry {
+  uint16_t robot;            // index in --robot order
+  uint8_t flags;             // FLEET_FLAG_*
+  uint8_t slipMask;
+  uint32_t seq;              // ODOM lines decoded from this robot
+  uint32_t megaMs;
+  uint32_t ageUs;            // from reading the ODOM line to sending this
+  float x, y, theta;         // meters, radians
+  float v, w;                // m/s, rad/s
+  int16_t currentMa[4];
+  uint16_t batteryMv;
+};
+
+const size_t FLEET_MAX_DATAGRAM = 1400;
+const size_t FLEET_MAX_ENTRIES = (FLEET_MAX_DATAGRAM - sizeof(FleetHeader)) / sizeof(FleetEntry);
+
+#endif // FLEET_PROTOCOL_H
@@ -0,0 +1,119 @@
+#ifndef FLEET_TABLE_H
+#define FLEET_TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "bridge_telemetry.h"
+
+// fleet_gateway's shared state. The I/O thread frames what arrives from a
+// robot and hands it to that robot's worker through a FleetQueue; the
+// worker parses it and publishes the result to the robot's FleetSlot,
+// which the fan-out thread reads. A robot belongs to one worker (index
+// modulo workers), so each queue has one producer and one consumer and
+// each slot one writer: nothing takes a lock.
+
+enum FleetItemKind : uint8_t {
+  FLEET_ITEM_LINE,           // one telemetry line from a serial port
+  FLEET_ITEM_DATAGRAM,       // a BridgePacket, or text lines, from UDP
+  FLEET_ITEM_STATUS,         // the JSON body of an ESP /status reply
+  FLEET_ITEM_LINK            // the link went up or down (linkUp)
+};
+
+const size_t FLEET_ITEM_BYTES = 496;
+
+struct FleetItem {
+  uint16_t robot;
+  uint8_t kind;              // FleetItemKind
+  uint8_t linkUp;
+  uint16_t len;              // of data, which is also NUL-terminated
+  uint64_t recvNs;           // CLOCK_MONOTONIC when the I/O thread read it
+  char data[FLEET_ITEM_BYTES];
+};
+
+// Bounded single-producer single-consumer ring. capacity is rounded up to a
+// power of two. The indices sit on their own cache lines so the two threads
+// don't keep stealing one line from each other.
+template <typename T>
+class SpscQueue {
+public:
+  explicit SpscQueue(size_t capacity) {
+    size_t n = 1;
+    while (n < capacity) n <<= 1;
+    mask_ = n - 1;
+    // Zeroed, so the pages are resident from the start and not as traffic grows
+    items_.reset(new T[n]());
+  }
+
+  // Producer: the slot to fill, or null when full. push() publishes it.
+  T *claim() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tailCache_ > mask_) {
+      tailCache_ = tail_.load(std::memory_order_acquire);
+      if (head - tailCache_ > mask_) return nullptr;
+    }
+    return &items_[head & mask_];
+  }
+  void push() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // Consumer: the oldest item, or null when empty. pop() releases it.
+  T *front() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == headCache_) {
+      headCache_ = head_.load(std::memory_order_acquire);
+      if (tail == headCache_) return nullptr;
+    }
+    return &items_[tail & mask_];
+  }
+  void pop() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+private:
+  std::unique_ptr<T[]> items_;
+  size_t mask_;
+  char pad0_[64];
+  std::atomic<size_t> head_{0};
+  size_t tailCache_ = 0;     // producer's copy
+  char pad1_[64];
+  std::atomic<size_t> tail_{0};
+  size_t headCache_ = 0;     // consumer's copy
+  char pad2_[64];
+};
+
+// The latest of everything from one robot
+struct FleetRobotState {
+  BridgeState bridge;
+  uint64_t version;          // bumped on every change, ODOM or not
+  uint64_t recvNs;           // when the newest ODOM was read; 0 before the first
+  uint8_t flags;             // FLEET_FLAG_LINK_DOWN, FLEET_FLAG_NO_MEGA
+};
+
+// Seqlock, as in ShmTelemetry: odd seq while the worker copies in
+struct FleetSlot {
+  std::atomic<uint32_t> seq;
+  FleetRobotState state;
+};
+
+inline void fleetSlotWrite(FleetSlot &slot, const FleetRobotState &s) {
+  uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy((void *)&slot.state, &s, sizeof(s));
+  slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+// False if the writer was mid-copy on every one of 100 tries
+inline bool fleetSlotRead(const FleetSlot &slot, FleetRobotState &out) {
+  for (int tries = 0; tries < 100; tries++) {
+    uint32_t before = slot.seq.load(std::memory_order_acquire);
+    if (before & 1) continue;
+    memcpy(&out, (const void *)&slot.state, sizeof(out));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) == before) return true;
+  }
+  return false;
+}
+
+#endif // FLEET_TABLE_H
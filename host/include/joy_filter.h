@@ -0,0 +1,82 @@
+#ifndef JOY_FILTER_H
+#define JOY_FILTER_H
+
+#include "joy_protocol.h"
+
+// Same acceptance rules as joyAccept()/processUdpControl() on the ESP, so the
+// loopback stand-in drops and times out exactly like the robot does.
+class JoyFilter {
+public:
+  JoyFilter(unsigned long timeoutMs, unsigned long maxAgeMs)
+    : timeoutMs_(timeoutMs), maxAgeMs_(maxAgeMs) {}
+
+  // Returns JOY_ACCEPTED and fills left/right with the drive command
+  // (zero when the deadman is released), or the reason it was dropped.
+  uint8_t accept(const JoyPacket &pkt, unsigned long now, int &left, int &right) {
+    // 32-bit math, matching the ESP's unsigned long wrap-around
+    int32_t offset = (int32_t)((uint32_t)now - pkt.sentMs);
+
+    if (!active_) {
+      lastSeq_ = pkt.seq - 1;
+      clockOffset_ = offset;
+      offsetAged_ = now;
+    }
+
+    if ((int16_t)(pkt.seq - lastSeq_) <= 0) {
+      droppedOrder++;
+      return JOY_DROP_ORDER;
+    }
+
+    if (offset < clockOffset_) clockOffset_ = offset;
+    if (now - offsetAged_ >= 1000) {
+      clockOffset_++;
+      offsetAged_ = now;
+    }
+    if (offset - clockOffset_ > (int32_t)maxAgeMs_) {
+      droppedStale++;
+      return JOY_DROP_STALE;
+    }
+
+    lastSeq_ = pkt.seq;
+    lastPacket_ = now;
+    active_ = true;
+
+    if (pkt.flags & JOY_FLAG_DEADMAN) {
+      left = clamp(pkt.left);
+      right = clamp(pkt.right);
+    } else {
+      left = right = 0;
+    }
+    return JOY_ACCEPTED;
+  }
+
+  // True once when the link has been quiet for longer than the timeout;
+  // the caller should stop the motors.
+  bool expired(unsigned long now) {
+    if (active_ && now - lastPacket_ > timeoutMs_) {
+      active_ = false;
+      timeouts++;
+      return true;
+    }
+    return false;
+  }
+
+  bool active() const { return active_; }
+
+  unsigned long droppedOrder = 0;
+  unsigned long droppedStale = 0;
+  unsigned long timeouts = 0;
+
+private:
+  static int clamp(int v) { return v > 255 ? 255 : (v < -255 ? -255 : v); }
+
+  unsigned long timeoutMs_;
+  unsigned long maxAgeMs_;
+  bool active_ = false;
+  uint16_t lastSeq_ = 0;
+  int32_t clockOffset_ = 0;
+  unsigned long lastPacket_ = 0;
+  unsigned long offsetAged_ = 0;
+};
+
+#endif // JOY_FILTER_H
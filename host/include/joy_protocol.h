@@ -0,0 +1,37 @@
+#ifndef JOY_PROTOCOL_H
+#define JOY_PROTOCOL_H
+
+#include <stdint.h>
+
+// UDP joystick packets for the ESP control port. Little-endian and packed,
+// so the structs can go straight onto the wire from x86/ARM hosts.
+// Keep in sync with the UDP JOYSTICK CONTROL section of esp_Code/esp_Code.ino.
+
+const uint16_t JOY_UDP_PORT = 4210;
+const uint8_t JOY_MAGIC = 'J';
+const uint8_t JOY_ACK_MAGIC = 'A';
+const uint8_t JOY_FLAG_DEADMAN = 0x01;
+
+enum JoyStatus : uint8_t {
+  JOY_ACCEPTED = 0,
+  JOY_DROP_ORDER = 1,   // sequence number not newer than the last accepted one
+  JOY_DROP_STALE = 2    // delayed more than the max packet age in transit
+};
+
+struct __attribute__((packed)) JoyPacket {
+  uint8_t magic;
+  uint8_t flags;
+  uint16_t seq;
+  uint32_t sentMs;      // sender clock
+  int16_t left;         // -255..255, same units as the M command
+  int16_t right;
+};
+
+struct __attribute__((packed)) JoyAck {
+  uint8_t magic;
+  uint8_t status;       // JoyStatus
+  uint16_t seq;
+  uint32_t sentMs;      // echoed from the packet
+};
+
+#endif // JOY_PROTOCOL_H
@@ -0,0 +1,50 @@
+#ifndef REC_FORMAT_H
+#define REC_FORMAT_H
+
+#include <stdint.h>
+
+// Flight recorder dump blocks sent by REC_DUMP. Little-endian and packed,
+// as the AVR lays them out, so x86/ARM hosts can read them straight in.
+// Keep in sync with include/flight_recorder.h in the Mega firmware.
+//
+// Block: RecHeader, count RecSamples (oldest first), then the Fletcher-16
+// of everything before it as two bytes, sum1 then sum2.
+
+const uint8_t REC_MAGIC0 = 'F';
+const uint8_t REC_MAGIC1 = 'R';
+const uint8_t REC_VERSION = 1;
+
+enum RecTrigger : uint8_t {
+  REC_TRIG_COMMAND = 0x01,
+  REC_TRIG_FAULT = 0x02,
+  REC_TRIG_SAFETY = 0x04
+};
+
+enum RecFlags : uint8_t {
+  REC_FLAG_FWD_BLOCKED = 0x01,
+  REC_FLAG_ENC_CLIPPED = 0x02,
+  REC_FLAG_TRIGGER = 0x04
+};
+
+struct __attribute__((packed)) RecHeader {
+  uint8_t magic[2];
+  uint8_t version;
+  uint8_t sampleBytes;
+  uint16_t count;
+  uint16_t triggerIndex;     // count if stopped without a trigger
+  uint16_t periodUs;
+  uint8_t triggerSource;     // RecTrigger, 0 if none
+  uint8_t reserved;
+  uint32_t triggerMs;        // Mega millis() at the trigger
+};
+
+struct __attribute__((packed)) RecSample {
+  uint16_t loopUs;           // longest loop() pass since the previous sample
+  uint16_t lateUs;           // sample taken this long after it was due
+  int8_t dEnc[4];            // encoder ticks since the previous sample, M1..M4
+  uint8_t pwm[4];            // applied PWM magnitude
+  uint8_t dir;               // bits 0..3 reverse, bits 4..7 held by safety
+  uint8_t flags;             // RecFlags
+};
+
+#endif // REC_FORMAT_H
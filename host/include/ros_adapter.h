@@ -0,0 +1,99 @@
+#ifndef ROS_ADAPTER_H
+#define ROS_ADAPTER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bridge_telemetry.h"
+
+// BridgeState as ROS 1 messages in their wire serialization, without a ROS
+// dependency: nav_msgs/Odometry and sensor_msgs/JointState. A relay node
+// can hand the bytes to msg.deserialize() (rospy) or ros::serialization
+// unchanged. Also reads geometry_msgs/Twist for cmd_vel.
+//
+// ROS 1 serialization: little-endian, strings and variable arrays prefixed
+// with a uint32 count, fixed arrays (the covariances) without one.
+
+enum RosTopic : uint8_t {
+  ROS_TOPIC_ODOM = 1,          // nav_msgs/Odometry on /odom
+  ROS_TOPIC_JOINT_STATES = 2   // sensor_msgs/JointState on /joint_states
+};
+
+const size_t ROS_TWIST_BYTES = 6 * sizeof(double);
+
+static const char *const rosWheelNames[4] = {
+  "front_left_wheel", "front_right_wheel", "rear_left_wheel", "rear_right_wheel"
+};
+
+class Ros1Writer {
+public:
+  explicit Ros1Writer(std::vector<uint8_t> &out) : out_(out) {}
+
+  void u32(uint32_t v) { raw(&v, sizeof(v)); }
+  void f64(double v) { raw(&v, sizeof(v)); }
+  void str(const char *s) {
+    uint32_t n = strlen(s);
+    u32(n);
+    raw(s, n);
+  }
+  // std_msgs/Header
+  void header(uint32_t seq, double stamp, const char *frameId) {
+    u32(seq);
+    u32((uint32_t)stamp);
+    u32((uint32_t)((stamp - floor(stamp)) * 1e9));
+    str(frameId);
+  }
+  void covariance(double diagonal) {
+    for (int i = 0; i < 36; i++) f64(i % 7 == 0 ? diagonal : 0);
+  }
+
+private:
+  void raw(const void *p, size_t n) {
+    const uint8_t *b = (const uint8_t *)p;
+    out_.insert(out_.end(), b, b + n);
+  }
+  std::vector<uint8_t> &out_;
+};
+
+inline void rosOdometry(const BridgeState &s, std::vector<uint8_t> &out) {
+  Ros1Writer w(out);
+  w.header((uint32_t)s.seq, s.hostTime, "odom");
+  w.str("base_link");
+  // pose: position, orientation as a quaternion about z
+  w.f64(s.x); w.f64(s.y); w.f64(0);
+  w.f64(0); w.f64(0); w.f64(sin(s.theta / 2)); w.f64(cos(s.theta / 2));
+  w.covariance(0);
+  // twist in base_link
+  w.f64(s.v); w.f64(0); w.f64(0);
+  w.f64(0); w.f64(0); w.f64(s.w);
+  w.covariance(0);
+}
+
+inline void rosJointStates(const BridgeState &s, std::vector<uint8_t> &out) {
+  Ros1Writer w(out);
+  w.header((uint32_t)s.seq, s.hostTime, "");
+  w.u32(4);
+  for (int i = 0; i < 4; i++) w.str(rosWheelNames[i]);
+  w.u32(4);
+  for (int i = 0; i < 4; i++) w.f64(s.wheelPosition[i]);
+  w.u32(4);
+  for (int i = 0; i < 4; i++) w.f64(s.wheelVelocity[i]);
+  w.u32(0);   // no effort
+}
+
+// geometry_msgs/Twist: linear xyz, angular xyz. Only linear.x and angular.z
+// mean anything to a skid-steer base.
+inline bool rosParseTwist(const uint8_t *p, size_t n, double &linearX, double &angularZ) {
+  if (n != ROS_TWIST_BYTES) return false;
+  double f[6];
+  memcpy(f, p, sizeof(f));
+  if (!std::isfinite(f[0]) || !std::isfinite(f[5])) return false;
+  linearX = f[0];
+  angularZ = f[5];
+  return true;
+}
+
+#endif // ROS_ADAPTER_H
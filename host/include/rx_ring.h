@@ -0,0 +1,71 @@
+#ifndef RX_RING_H
+#define RX_RING_H
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Receive ring for a serial port. The same pages are mapped twice, back to
+// back, so any span of up to size() bytes starting anywhere in the ring is
+// contiguous in memory: read() lands straight in the ring, and a line that
+// wraps past the end is still one run of bytes for the parser. Nothing is
+// copied between the kernel and the telemetry decoder.
+class RxRing {
+public:
+  // size is rounded up to whole pages
+  explicit RxRing(size_t size) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_ = (size + page - 1) / page * page;
+    int fd = memfd_create("rx_ring", 0);
+    if (fd < 0) return;
+    if (ftruncate(fd, size_) == 0) {
+      void *area = mmap(nullptr, 2 * size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (area != MAP_FAILED) {
+        char *b = (char *)area;
+        if (mmap(b, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == b &&
+            mmap(b + size_, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == b + size_) {
+          base_ = b;
+        } else {
+          munmap(area, 2 * size_);
+        }
+      }
+    }
+    close(fd);
+  }
+
+  ~RxRing() {
+    if (base_) munmap(base_, 2 * size_);
+  }
+
+  RxRing(const RxRing &) = delete;
+  RxRing &operator=(const RxRing &) = delete;
+
+  bool ok() const { return base_ != nullptr; }
+  size_t size() const { return size_; }
+
+  // One read() into the free space: bytes read, 0 at end of file or when
+  // the ring is full, -1 with errno set
+  ssize_t fill(int fd) {
+    size_t free = size_ - available();
+    if (free == 0) return 0;
+    ssize_t n = read(fd, base_ + head_ % size_, free);
+    if (n > 0) head_ += n;
+    return n;
+  }
+
+  // Unread bytes, contiguous for available() bytes
+  char *data() const { return base_ + tail_ % size_; }
+  size_t available() const { return (size_t)(head_ - tail_); }
+  void consume(size_t n) { tail_ += n; }
+
+private:
+  char *base_ = nullptr;
+  size_t size_ = 0;
+  uint64_t head_ = 0;     // bytes ever written
+  uint64_t tail_ = 0;     // bytes ever consumed
+};
+
+#endif // RX_RING_H
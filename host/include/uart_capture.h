@@ -0,0 +1,157 @@
+#ifndef UART_CAPTURE_H
+#define UART_CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Capture of the Mega <-> ESP (or host) UART: timestamped, direction-tagged
+// runs of bytes. Written by serial_bridge --capture and the simulator's
+// --uart-capture, replayed by the simulator's replay scenario and listed by
+// ucap_dump.
+//
+// File: UcapHeader, then records until end of file. A record is
+//   tag      bit 7: direction (UcapDir), bits 0-6: length - 1
+//   delta    microseconds since the previous record (since the start of the
+//            capture for the first), unsigned LEB128
+//   bytes    1..128 of them
+// so a one-line reply costs three bytes on top of its text. Bytes that go
+// the same way at the same microsecond share a record.
+
+const uint8_t UCAP_MAGIC[4] = {'U', 'C', 'A', 'P'};
+const uint8_t UCAP_VERSION = 1;
+const size_t UCAP_MAX_RUN = 128;
+
+enum UcapDir : uint8_t {
+  UCAP_TO_MEGA = 0,      // what the ESP or host sent
+  UCAP_FROM_MEGA = 1     // what the Mega sent back
+};
+
+enum UcapClock : uint8_t {
+  UCAP_CLOCK_SIM = 0,    // simulated time since the firmware booted
+  UCAP_CLOCK_HOST = 1    // CLOCK_MONOTONIC since the capture started
+};
+
+struct __attribute__((packed)) UcapHeader {
+  uint8_t magic[4];
+  uint8_t version;
+  uint8_t clock;         // UcapClock
+  uint16_t reserved;
+  uint32_t baud;
+  uint32_t startUnix;    // wall clock seconds at the start, 0 if unknown
+};
+
+struct UcapRecord {
+  uint64_t us;           // since the start of the capture
+  UcapDir dir;
+  uint8_t len;
+  uint8_t data[UCAP_MAX_RUN];
+};
+
+class UcapWriter {
+public:
+  ~UcapWriter() { close(); }
+
+  bool open(const char *path, UcapClock clock, uint32_t baud, uint32_t startUnix) {
+    f_ = fopen(path, "wb");
+    if (!f_) return false;
+    UcapHeader h;
+    memcpy(h.magic, UCAP_MAGIC, 4);
+    h.version = UCAP_VERSION;
+    h.clock = clock;
+    h.reserved = 0;
+    h.baud = baud;
+    h.startUnix = startUnix;
+    return fwrite(&h, sizeof(h), 1, f_) == 1;
+  }
+
+  bool isOpen() const { return f_ != nullptr; }
+
+  void add(uint64_t us, UcapDir dir, const void *p, size_t n) {
+    const uint8_t *b = (const uint8_t *)p;
+    while (n > 0) {
+      if (pending_.len == 0 || pending_.us != us || pending_.dir != dir || pending_.len == UCAP_MAX_RUN) {
+        flush();
+        pending_.us = us;
+        pending_.dir = dir;
+      }
+      size_t take = UCAP_MAX_RUN - pending_.len;
+      if (take > n) take = n;
+      memcpy(pending_.data + pending_.len, b, take);
+      pending_.len += take;
+      b += take;
+      n -= take;
+    }
+  }
+
+  void close() {
+    if (!f_) return;
+    flush();
+    fclose(f_);
+    f_ = nullptr;
+  }
+
+private:
+  void flush() {
+    if (!f_ || pending_.len == 0) return;
+    uint8_t head[11];
+    size_t n = 0;
+    head[n++] = (uint8_t)((pending_.dir << 7) | (pending_.len - 1));
+    uint64_t delta = pending_.us - lastUs_;
+    do {
+      uint8_t b = delta & 0x7F;
+      delta >>= 7;
+      head[n++] = delta ? (b | 0x80) : b;
+    } while (delta);
+    fwrite(head, 1, n, f_);
+    fwrite(pending_.data, 1, pending_.len, f_);
+    lastUs_ = pending_.us;
+    pending_.len = 0;
+  }
+
+  FILE *f_ = nullptr;
+  uint64_t lastUs_ = 0;
+  UcapRecord pending_ = {};
+};
+
+class UcapReader {
+public:
+  ~UcapReader() {
+    if (f_) fclose(f_);
+  }
+
+  // False if the file is missing or not a capture this reader understands
+  bool open(const char *path) {
+    f_ = fopen(path, "rb");
+    if (!f_) return false;
+    return fread(&header_, sizeof(header_), 1, f_) == 1 && memcmp(header_.magic, UCAP_MAGIC, 4) == 0 &&
+           header_.version == UCAP_VERSION;
+  }
+
+  const UcapHeader &header() const { return header_; }
+
+  // False at the end of the file or at a record cut short
+  bool next(UcapRecord &r) {
+    int tag = fgetc(f_);
+    if (tag == EOF) return false;
+    uint64_t delta = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      int b = fgetc(f_);
+      if (b == EOF) return false;
+      delta |= (uint64_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+    }
+    us_ += delta;
+    r.us = us_;
+    r.dir = (UcapDir)(tag >> 7);
+    r.len = (tag & 0x7F) + 1;
+    return fread(r.data, 1, r.len, f_) == r.len;
+  }
+
+private:
+  FILE *f_ = nullptr;
+  UcapHeader header_ = {};
+  uint64_t us_ = 0;
+};
+
+#endif // UART_CAPTURE_H
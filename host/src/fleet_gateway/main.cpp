@@ -0,0 +1,1069 @@
+/* fleet_gateway
+   Collects the telemetry of every robot in the shop in one place. Each
+   --robot is a source: a serial port (a Mega's Serial2 link), a UDP port
+   (serial_bridge --out udp:, or plain ODOM/SENS lines), or an ESP's
+   /status page polled over HTTP. The I/O thread only frames what arrives;
+   a pool of worker threads parses it into a per-robot latest-state table
+   (include/fleet_table.h), and a fan-out thread sends the robots that
+   changed to every subscriber each --publish-ms (include/fleet_protocol.h).
+
+   Usage: fleet_gateway [--robot [NAME=]SPEC]... [--robots FILE]
+                        [--workers 2] [--queue 1024] [--publish-ms 10]
+                        [--sub-port 5620] [--listen 127.0.0.1]
+                        [--poll-ms 200] [--http-timeout 1] [--stale 1]
+                        [--duration 0]
+
+   SPEC is one of
+     serial:/dev/ttyUSB0[@115200]     a USB-UART adapter on the Mega's Serial2
+     udp:[ADDR:]PORT                 listens; ADDR defaults to 0.0.0.0
+     http://HOST[:PORT][/PATH]       GET every --poll-ms; PATH defaults to /status
+   --robots reads one "NAME SPEC" per line; # starts a comment.
+
+   /status carries the ESP's newest ODOM and SENS lines, so the same ODOM
+   line polled twice is only counted once. A robot is flagged stale after
+   --stale seconds without ODOM, and link down while its port is closed or
+   after three failed polls in a row. Closed serial ports are reopened
+   every second. The Mega's own USB port (/dev/ttyACM0) only carries its
+   debug output; see serial_bridge for wiring the adapter.
+
+   The gateway prints its counters on exit; "STATS" on the subscriber port
+   returns the same while it runs. host/src/fleet_load drives it with
+   simulated robots.
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bridge_outputs.h"
+#include "bridge_telemetry.h"
+#include "fleet_protocol.h"
+#include "fleet_table.h"
+
+static const size_t MAX_LINE = 256;           // longer runs without '\n' are noise
+static const size_t MAX_HTTP_RESPONSE = 8192;
+static const int HTTP_FAILS_DOWN = 3;
+static const double SERIAL_RETRY_S = 1.0;
+static const size_t MAX_SUBSCRIBERS = 64;
+static const uint64_t TIMER_EVENT = ~0ULL;
+
+enum Transport { SERIAL_SOURCE, UDP_SOURCE, HTTP_SOURCE, TRANSPORTS };
+static const char *const transportNames[TRANSPORTS] = {"serial", "udp", "http"};
+
+struct RobotConfig {
+  std::string name;
+  std::string spec;
+};
+
+struct Options {
+  std::vector<RobotConfig> robots;
+  int workers = 2;
+  int queue = 1024;
+  int publishMs = 10;
+  int subPort = FLEET_SUB_PORT;
+  const char *listen = "127.0.0.1";
+  int pollMs = 200;
+  double httpTimeout = 1;
+  double stale = 1;
+  double duration = 0;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+static std::atomic<bool> running(true);
+
+static void onSignal(int) { stopRequested = 1; }
+
+static uint64_t monoNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double monoSeconds() { return monoNs() * 1e-9; }
+
+static double realSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long rssKb() {
+  std::ifstream status("/proc/self/status");
+  std::string key;
+  long kb = 0;
+  while (status >> key) {
+    if (key == "VmRSS:") {
+      status >> kb;
+      break;
+    }
+    status.ignore(1 << 16, '\n');
+  }
+  return kb;
+}
+
+// "NAME=SPEC" or just "SPEC"
+static RobotConfig robotArg(const std::string &arg, size_t index) {
+  size_t eq = arg.find('=');
+  size_t colon = arg.find(':');
+  if (eq != std::string::npos && (colon == std::string::npos || eq < colon)) {
+    return RobotConfig{arg.substr(0, eq), arg.substr(eq + 1)};
+  }
+  return RobotConfig{"robot" + std::to_string(index), arg};
+}
+
+static bool readRobotsFile(const char *path, std::vector<RobotConfig> &robots) {
+  std::ifstream in(path);
+  if (!in) {
+    perror(path);
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string name, spec;
+    if (!(fields >> name)) continue;
+    if (!(fields >> spec)) {
+      fprintf(stderr, "%s: no source for robot %s\n", path, name.c_str());
+      return false;
+    }
+    robots.push_back(RobotConfig{name, spec});
+  }
+  return true;
+}
+
+static bool parseArgs(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (!v) return false;
+    if (!strcmp(a, "--robot")) o.robots.push_back(robotArg(v, o.robots.size()));
+    else if (!strcmp(a, "--robots")) {
+      if (!readRobotsFile(v, o.robots)) return false;
+    } else if (!strcmp(a, "--workers")) o.workers = atoi(v);
+    else if (!strcmp(a, "--queue")) o.queue = atoi(v);
+    else if (!strcmp(a, "--publish-ms")) o.publishMs = atoi(v);
+    else if (!strcmp(a, "--sub-port")) o.subPort = atoi(v);
+    else if (!strcmp(a, "--listen")) o.listen = v;
+    else if (!strcmp(a, "--poll-ms")) o.pollMs = atoi(v);
+    else if (!strcmp(a, "--http-timeout")) o.httpTimeout = atof(v);
+    else if (!strcmp(a, "--stale")) o.stale = atof(v);
+    else if (!strcmp(a, "--duration")) o.duration = atof(v);
+    else return false;
+    i++;
+  }
+  return o.workers > 0 && o.queue > 0 && o.publishMs > 0 && o.pollMs > 0 && o.robots.size() < 65535;
+}
+
+// ---------------- Counters ----------------
+
+// Each counter has one writing thread and is read by the fan-out thread
+// for STATS, so a relaxed load and store is enough to count
+struct Counter {
+  std::atomic<uint64_t> n{0};
+  void add(uint64_t k = 1) { n.store(n.load(std::memory_order_relaxed) + k, std::memory_order_relaxed); }
+  void set(uint64_t v) { n.store(v, std::memory_order_relaxed); }
+  uint64_t get() const { return n.load(std::memory_order_relaxed); }
+};
+
+struct IoCounters {
+  Counter rxBytes, items, dropped, overlong, httpOk, httpFail, reopens;
+};
+
+struct WorkerCounters {
+  Counter lines, odom[TRANSPORTS], sens, repeats, packets, statuses, bad;
+};
+
+// Quarter-octave buckets of microseconds, so quantiles are within 25%
+struct LatencyHistogram {
+  static const int BUCKETS = 256;
+  uint64_t counts[BUCKETS];
+  uint64_t total = 0;
+  uint64_t maxUs = 0;
+
+  LatencyHistogram() { memset(counts, 0, sizeof(counts)); }
+
+  static int bucketOf(uint64_t us) {
+    if (us < 4) return (int)us;
+    int msb = 63 - __builtin_clzll(us);
+    return msb * 4 + (int)((us >> (msb - 2)) & 3);
+  }
+
+  static uint64_t upperEdge(int b) {
+    if (b < 4) return b;
+    return ((uint64_t)(4 + b % 4 + 1) << (b / 4 - 2)) - 1;
+  }
+
+  void add(uint64_t us) {
+    counts[bucketOf(us)]++;
+    total++;
+    if (us > maxUs) maxUs = us;
+  }
+
+  uint64_t quantileUs(double q) const {
+    uint64_t rank = (uint64_t)(q * total + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+      seen += counts[b];
+      if (seen >= rank) return std::min(upperEdge(b), maxUs);
+    }
+    return maxUs;
+  }
+};
+
+// ---------------- Robots (I/O thread) ----------------
+
+struct Robot {
+  uint16_t index = 0;
+  std::string name;
+  Transport transport = SERIAL_SOURCE;
+  int fd = -1;
+  bool linkUp = false;
+
+  // serial
+  std::string path;
+  int baud = 115200;
+  double retryAt = 0;
+  char line[MAX_LINE];
+  size_t lineLen = 0;
+  bool overlong = false;
+
+  // udp: the address to bind; http: the server
+  sockaddr_in addr;
+
+  // http
+  std::string request;
+  size_t requestSent = 0;
+  std::string response;
+  double pollAt = 0;
+  double requestStart = 0;
+  int failures = 0;
+};
+
+static bool resolve(const std::string &host, int port, sockaddr_in &addr, std::string &error) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1) return true;
+  addrinfo hints, *found = nullptr;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  int rc = getaddrinfo(host.c_str(), nullptr, &hints, &found);
+  if (rc != 0 || !found) {
+    error = "cannot resolve " + host + ": " + gai_strerror(rc);
+    return false;
+  }
+  addr.sin_addr = ((sockaddr_in *)found->ai_addr)->sin_addr;
+  freeaddrinfo(found);
+  return true;
+}
+
+static bool parseSource(const std::string &spec, Robot &r, std::string &error) {
+  if (spec.compare(0, 7, "serial:") == 0) {
+    r.transport = SERIAL_SOURCE;
+    r.path = spec.substr(7);
+    size_t at = r.path.rfind('@');
+    if (at != std::string::npos) {
+      r.baud = atoi(r.path.c_str() + at + 1);
+      r.path.erase(at);
+    }
+    if (r.path.empty()) error = "no device path";
+    return !r.path.empty();
+  }
+  if (spec.compare(0, 4, "udp:") == 0) {
+    r.transport = UDP_SOURCE;
+    std::string rest = spec.substr(4);
+    size_t colon = rest.rfind(':');
+    std::string host = colon == std::string::npos ? "0.0.0.0" : rest.substr(0, colon);
+    int port = atoi(rest.c_str() + (colon == std::string::npos ? 0 : colon + 1));
+    if (port <= 0 || port > 65535) {
+      error = "bad port in " + spec;
+      return false;
+    }
+    return resolve(host, port, r.addr, error);
+  }
+  if (spec.compare(0, 7, "http://") == 0) {
+    r.transport = HTTP_SOURCE;
+    std::string rest = spec.substr(7);
+    size_t slash = rest.find('/');
+    std::string path = slash == std::string::npos ? "/status" : rest.substr(slash);
+    std::string hostPort = rest.substr(0, slash);
+    size_t colon = hostPort.rfind(':');
+    std::string host = hostPort.substr(0, colon);
+    int port = colon == std::string::npos ? 80 : atoi(hostPort.c_str() + colon + 1);
+    r.request = "GET " + path + " HTTP/1.0\r\nHost: " + hostPort + "\r\nConnection: close\r\n\r\n";
+    return resolve(host, port, r.addr, error);
+  }
+  error = "unknown source " + spec;
+  return false;
+}
+
+static speed_t baudConstant(int baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return 0;
+  }
+}
+
+static bool makeRaw(int fd, speed_t speed) {
+  termios t;
+  if (tcgetattr(fd, &t) < 0) return false;
+  cfmakeraw(&t);
+  t.c_cflag |= CLOCAL | CREAD;
+  t.c_cc[VMIN] = 1;
+  t.c_cc[VTIME] = 0;
+  cfsetispeed(&t, speed);
+  cfsetospeed(&t, speed);
+  return tcsetattr(fd, TCSANOW, &t) == 0;
+}
+
+// ---------------- Gateway ----------------
+
+struct Worker {
+  std::unique_ptr<SpscQueue<FleetItem>> queue;
+  int wakeFd = -1;
+  bool wakePending = false;  // I/O thread only
+  WorkerCounters counters;
+  std::thread thread;
+};
+
+static Options opt;
+static std::vector<Robot> robots;
+static std::unique_ptr<FleetSlot[]> slots;
+static std::vector<FleetRobotState> working;   // written only by the robot's worker
+static std::vector<std::unique_ptr<Worker>> workers;
+static IoCounters io;
+static LatencyHistogram publishLatency;        // fan-out thread only
+static Counter entriesSent, packetsSent, subscriberCount, staleCount;
+static double startSeconds;
+static int epfd = -1;
+
+static Worker &workerFor(const Robot &r) { return *workers[r.index % workers.size()]; }
+
+static void enqueue(Robot &r, FleetItemKind kind, const char *data, size_t len, uint64_t recvNs,
+                    bool linkUp = true) {
+  if (len >= FLEET_ITEM_BYTES) {
+    io.overlong.add();
+    return;
+  }
+  Worker &w = workerFor(r);
+  FleetItem *item = w.queue->claim();
+  if (!item) {
+    io.dropped.add();
+    return;
+  }
+  item->robot = r.index;
+  item->kind = kind;
+  item->linkUp = linkUp;
+  item->len = len;
+  item->recvNs = recvNs;
+  memcpy(item->data, data, len);
+  item->data[len] = '\0';
+  w.queue->push();
+  w.wakePending = true;
+  io.items.add();
+}
+
+// One eventfd write per worker per epoll round, however many items it got
+static void wakeWorkers() {
+  for (auto &w : workers) {
+    if (!w->wakePending) continue;
+    uint64_t one = 1;
+    if (write(w->wakeFd, &one, sizeof(one)) < 0) perror("eventfd");
+    w->wakePending = false;
+  }
+}
+
+static void setLink(Robot &r, bool up) {
+  if (r.linkUp == up) return;
+  r.linkUp = up;
+  enqueue(r, FLEET_ITEM_LINK, "", 0, monoNs(), up);
+}
+
+static void watch(Robot &r, uint32_t events, int op) {
+  epoll_event ev;
+  ev.events = events;
+  ev.data.u64 = r.index;
+  epoll_ctl(epfd, op, r.fd, &ev);
+}
+
+static void closeSource(Robot &r) {
+  if (r.fd < 0) return;
+  epoll_ctl(epfd, EPOLL_CTL_DEL, r.fd, nullptr);
+  close(r.fd);
+  r.fd = -1;
+}
+
+static void openSerial(Robot &r, double now) {
+  speed_t speed = baudConstant(r.baud);
+  r.fd = open(r.path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (r.fd >= 0 && (!speed || !makeRaw(r.fd, speed))) {
+    close(r.fd);
+    r.fd = -1;
+  }
+  if (r.fd < 0) {
+    r.retryAt = now + SERIAL_RETRY_S;
+    return;
+  }
+  r.lineLen = 0;
+  r.overlong = false;
+  watch(r, EPOLLIN, EPOLL_CTL_ADD);
+  setLink(r, true);
+}
+
+static void onSerialReadable(Robot &r, double now) {
+  char buf[4096];
+  ssize_t got;
+  while ((got = read(r.fd, buf, sizeof(buf))) > 0) {
+    io.rxBytes.add(got);
+    uint64_t recvNs = monoNs();
+    for (ssize_t i = 0; i < got; i++) {
+      char c = buf[i];
+      if (c == '\n') {
+        if (r.lineLen > 0 && r.line[r.lineLen - 1] == '\r') r.lineLen--;
+        if (!r.overlong && r.lineLen > 0) enqueue(r, FLEET_ITEM_LINE, r.line, r.lineLen, recvNs);
+        r.lineLen = 0;
+        r.overlong = false;
+      } else if (r.lineLen < MAX_LINE - 1) {
+        r.line[r.lineLen++] = c;
+      } else if (!r.overlong) {
+        r.overlong = true;
+        io.overlong.add();
+      }
+    }
+  }
+  // 0 or EIO: the device went away (a pty master closed, a USB unplug)
+  if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) {
+    closeSource(r);
+    setLink(r, false);
+    r.retryAt = now + SERIAL_RETRY_S;
+    io.reopens.add();
+  }
+}
+
+static bool openUdp(Robot &r, std::string &error) {
+  r.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  int one = 1;
+  setsockopt(r.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (r.fd < 0 || bind(r.fd, (sockaddr *)&r.addr, sizeof(r.addr)) < 0) {
+    error = strerror(errno);
+    return false;
+  }
+  watch(r, EPOLLIN, EPOLL_CTL_ADD);
+  setLink(r, true);
+  return true;
+}
+
+static void onUdpReadable(Robot &r) {
+  char buf[2048];
+  ssize_t got;
+  while ((got = recv(r.fd, buf, sizeof(buf), 0)) > 0) {
+    io.rxBytes.add(got);
+    enqueue(r, FLEET_ITEM_DATAGRAM, buf, got, monoNs());
+  }
+}
+
+static void failPoll(Robot &r) {
+  closeSource(r);
+  io.httpFail.add();
+  if (++r.failures >= HTTP_FAILS_DOWN) setLink(r, false);
+}
+
+static void startPoll(Robot &r, double now) {
+  r.pollAt += opt.pollMs / 1000.0;
+  if (r.pollAt < now) r.pollAt = now + opt.pollMs / 1000.0;
+  r.requestStart = now;
+  r.requestSent = 0;
+  r.response.clear();
+  r.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (r.fd < 0 || (connect(r.fd, (sockaddr *)&r.addr, sizeof(r.addr)) < 0 && errno != EINPROGRESS)) {
+    failPoll(r);
+    return;
+  }
+  watch(r, EPOLLOUT, EPOLL_CTL_ADD);
+}
+
+// HTTP/1.0 with Connection: close, so the reply ends where the socket does
+static void finishPoll(Robot &r) {
+  size_t bodyAt = r.response.find("\r\n\r\n");
+  if (r.response.compare(0, 9, "HTTP/1.1 ") != 0 && r.response.compare(0, 9, "HTTP/1.0 ") != 0) {
+    bodyAt = std::string::npos;
+  }
+  if (bodyAt == std::string::npos || r.response.compare(9, 3, "200") != 0) {
+    failPoll(r);
+    return;
+  }
+  closeSource(r);
+  io.httpOk.add();
+  r.failures = 0;
+  setLink(r, true);
+  enqueue(r, FLEET_ITEM_STATUS, r.response.data() + bodyAt + 4, r.response.size() - bodyAt - 4, monoNs());
+}
+
+static void onHttpEvent(Robot &r, uint32_t events) {
+  if (r.requestSent < r.request.size()) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if ((events & (EPOLLERR | EPOLLHUP)) || getsockopt(r.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+      failPoll(r);
+      return;
+    }
+    ssize_t n = send(r.fd, r.request.data() + r.requestSent, r.request.size() - r.requestSent, MSG_NOSIGNAL);
+    if (n < 0 && errno != EAGAIN) {
+      failPoll(r);
+      return;
+    }
+    if (n > 0) r.requestSent += n;
+    if (r.requestSent == r.request.size()) watch(r, EPOLLIN, EPOLL_CTL_MOD);
+    return;
+  }
+  char buf[2048];
+  ssize_t got;
+  while ((got = recv(r.fd, buf, sizeof(buf), 0)) > 0) {
+    io.rxBytes.add(got);
+    r.response.append(buf, got);
+    if (r.response.size() > MAX_HTTP_RESPONSE) {
+      io.overlong.add();
+      failPoll(r);
+      return;
+    }
+  }
+  if (got == 0) finishPoll(r);
+  else if (errno != EAGAIN && errno != EINTR) failPoll(r);
+}
+
+// Every 10 ms: HTTP polls that are due or overdue, serial ports to reopen
+static void onTick(double now) {
+  for (Robot &r : robots) {
+    if (r.transport == HTTP_SOURCE) {
+      if (r.fd >= 0 && now - r.requestStart > opt.httpTimeout) failPoll(r);
+      if (r.fd < 0 && now >= r.pollAt) startPoll(r, now);
+    } else if (r.transport == SERIAL_SOURCE && r.fd < 0 && now >= r.retryAt) {
+      openSerial(r, now);
+    }
+  }
+}
+
+// ---------------- Workers ----------------
+
+// The string value of "key" in the ESP's flat /status object. Its lines
+// carry no quotes or escapes, so a quote ends the value.
+static bool jsonString(const char *json, const char *key, char *out, size_t outSize) {
+  char pattern[32];
+  snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+  const char *p = strstr(json, pattern);
+  if (!p) return false;
+  p += strlen(pattern);
+  const char *end = strchr(p, '"');
+  if (!end || (size_t)(end - p) >= outSize) return false;
+  memcpy(out, p, end - p);
+  out[end - p] = '\0';
+  return true;
+}
+
+// 1 or 0, or -1 when the key is missing
+static int jsonBool(const char *json, const char *key) {
+  char pattern[32];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char *p = strstr(json, pattern);
+  if (!p) return -1;
+  p += strlen(pattern);
+  return strncmp(p, "true", 4) == 0 ? 1 : 0;
+}
+
+static double hostTimeOf(uint64_t recvNs) {
+  return realSeconds() - (monoNs() - recvNs) * 1e-9;
+}
+
+// One ODOM or SENS line; true if the state changed
+static bool applyLine(FleetRobotState &s, Transport transport, const char *line, uint64_t recvNs,
+                      WorkerCounters &c) {
+  c.lines.add();
+  if (!strncmp(line, "ODOM ", 5)) {
+    OdomLine o;
+    if (!parseOdom(line, o)) {
+      c.bad.add();
+      return false;
+    }
+    // A polled /status shows the same ODOM until the Mega sends the next
+    if (transport == HTTP_SOURCE && s.bridge.seq > 0 && o.megaMs == s.bridge.megaMs) {
+      c.repeats.add();
+      return false;
+    }
+    bridgeApplyOdom(s.bridge, o, hostTimeOf(recvNs), BRIDGE_TICKS_PER_REV);
+    s.recvNs = recvNs;
+    c.odom[transport].add();
+    return true;
+  }
+  if (!strncmp(line, "SENS ", 5)) {
+    SensLine l;
+    if (!parseSens(line, l)) {
+      c.bad.add();
+      return false;
+    }
+    if (transport == HTTP_SOURCE && l.batteryMv == s.bridge.batteryMv &&
+        !memcmp(l.currentMa, s.bridge.currentMa, sizeof(l.currentMa))) {
+      c.repeats.add();
+      return false;
+    }
+    bridgeApplySens(s.bridge, l);
+    c.sens.add();
+    return true;
+  }
+  return false;
+}
+
+static bool applyPacket(FleetRobotState &s, const BridgePacket &p, uint64_t recvNs, WorkerCounters &c) {
+  c.packets.add();
+  s.bridge.seq = p.seq;
+  s.bridge.hostTime = p.hostTime;
+  s.bridge.megaMs = p.megaMs;
+  s.bridge.x = p.x;
+  s.bridge.y = p.y;
+  s.bridge.theta = p.theta;
+  s.bridge.v = p.v;
+  s.bridge.w = p.w;
+  s.bridge.slipMask = p.slipMask;
+  for (int i = 0; i < 4; i++) {
+    s.bridge.wheelPosition[i] = p.wheelPosition[i];
+    s.bridge.wheelVelocity[i] = p.wheelVelocity[i];
+    s.bridge.currentMa[i] = p.currentMa[i];
+  }
+  s.bridge.batteryMv = p.batteryMv;
+  s.recvNs = recvNs;
+  c.odom[UDP_SOURCE].add();
+  return true;
+}
+
+static bool applyItem(FleetItem &item, WorkerCounters &c) {
+  FleetRobotState &s = working[item.robot];
+  Transport transport = robots[item.robot].transport;
+  switch (item.kind) {
+    case FLEET_ITEM_LINE:
+      return applyLine(s, transport, item.data, item.recvNs, c);
+
+    case FLEET_ITEM_DATAGRAM: {
+      const BridgePacket *p = (const BridgePacket *)item.data;
+      if (item.len == sizeof(BridgePacket) && p->magic[0] == BRIDGE_MAGIC0 && p->magic[1] == BRIDGE_MAGIC1) {
+        return applyPacket(s, *p, item.recvNs, c);
+      }
+      bool changed = false;
+      char *save = nullptr;
+      for (char *line = strtok_r(item.data, "\r\n", &save); line; line = strtok_r(nullptr, "\r\n", &save)) {
+        changed |= applyLine(s, transport, line, item.recvNs, c);
+      }
+      return changed;
+    }
+
+    case FLEET_ITEM_STATUS: {
+      c.statuses.add();
+      bool changed = false;
+      int connected = jsonBool(item.data, "connected");
+      uint8_t flags = connected == 0 ? (s.flags | FLEET_FLAG_NO_MEGA) : (s.flags & ~FLEET_FLAG_NO_MEGA);
+      if (flags != s.flags) {
+        s.flags = flags;
+        changed = true;
+      }
+      char line[MAX_LINE];
+      if (jsonString(item.data, "odometry", line, sizeof(line)) && line[0]) {
+        changed |= applyLine(s, transport, line, item.recvNs, c);
+      }
+      if (jsonString(item.data, "sensors", line, sizeof(line)) && line[0]) {
+        changed |= applyLine(s, transport, line, item.recvNs, c);
+      }
+      return changed;
+    }
+
+    case FLEET_ITEM_LINK: {
+      uint8_t flags = item.linkUp ? (s.flags & ~FLEET_FLAG_LINK_DOWN) : (s.flags | FLEET_FLAG_LINK_DOWN);
+      if (flags == s.flags) return false;
+      s.flags = flags;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void workerMain(Worker &w) {
+  while (running.load()) {
+    uint64_t wakes;
+    if (read(w.wakeFd, &wakes, sizeof(wakes)) < 0 && errno != EINTR) break;
+    FleetItem *item;
+    while ((item = w.queue->front()) != nullptr) {
+      uint16_t robot = item->robot;
+      if (applyItem(*item, w.counters)) {
+        working[robot].version++;
+        fleetSlotWrite(slots[robot], working[robot]);
+      }
+      w.queue->pop();
+    }
+  }
+}
+
+// ---------------- Fan-out ----------------
+
+struct Subscriber {
+  sockaddr_in addr;
+  double lastHeard;
+  uint32_t seq;
+  bool needsAll;             // just subscribed: send every robot once
+};
+
+static uint64_t sumWorkers(Counter WorkerCounters::*field) {
+  uint64_t n = 0;
+  for (auto &w : workers) n += (w->counters.*field).get();
+  return n;
+}
+
+static std::string statsText() {
+  uint64_t odom[TRANSPORTS] = {0, 0, 0};
+  for (auto &w : workers) {
+    for (int t = 0; t < TRANSPORTS; t++) odom[t] += w->counters.odom[t].get();
+  }
+  char buf[1024];
+  int n = snprintf(buf, sizeof(buf),
+                   "STATS uptime_s %.3f robots %zu workers %zu subscribers %llu stale %llu"
+                   " rx_bytes %llu items %llu dropped %llu overlong %llu"
+                   " lines %llu odom %llu", monoSeconds() - startSeconds, robots.size(), workers.size(),
+                   (unsigned long long)subscriberCount.get(), (unsigned long long)staleCount.get(),
+                   (unsigned long long)io.rxBytes.get(), (unsigned long long)io.items.get(),
+                   (unsigned long long)io.dropped.get(), (unsigned long long)io.overlong.get(),
+                   (unsigned long long)sumWorkers(&WorkerCounters::lines),
+                   (unsigned long long)(odom[0] + odom[1] + odom[2]));
+  for (int t = 0; t < TRANSPORTS; t++) {
+    n += snprintf(buf + n, sizeof(buf) - n, " odom_%s %llu", transportNames[t], (unsigned long long)odom[t]);
+  }
+  snprintf(buf + n, sizeof(buf) - n,
+           " sens %llu packets %llu statuses %llu repeats %llu bad %llu"
+           " http_ok %llu http_fail %llu reopens %llu entries %llu datagrams %llu"
+           " publish_p50_us %llu publish_p99_us %llu publish_max_us %llu rss_kb %ld",
+           (unsigned long long)sumWorkers(&WorkerCounters::sens),
+           (unsigned long long)sumWorkers(&WorkerCounters::packets),
+           (unsigned long long)sumWorkers(&WorkerCounters::statuses),
+           (unsigned long long)sumWorkers(&WorkerCounters::repeats),
+           (unsigned long long)sumWorkers(&WorkerCounters::bad),
+           (unsigned long long)io.httpOk.get(), (unsigned long long)io.httpFail.get(),
+           (unsigned long long)io.reopens.get(), (unsigned long long)entriesSent.get(),
+           (unsigned long long)packetsSent.get(), (unsigned long long)publishLatency.quantileUs(0.5),
+           (unsigned long long)publishLatency.quantileUs(0.99), (unsigned long long)publishLatency.maxUs,
+           rssKb());
+  return buf;
+}
+
+static void sendEntries(int fd, Subscriber &sub, const std::vector<FleetEntry> &entries) {
+  uint8_t buf[FLEET_MAX_DATAGRAM];
+  for (size_t first = 0; first < entries.size(); first += FLEET_MAX_ENTRIES) {
+    size_t count = std::min(FLEET_MAX_ENTRIES, entries.size() - first);
+    FleetHeader h;
+    h.magic[0] = FLEET_MAGIC0;
+    h.magic[1] = FLEET_MAGIC1;
+    h.version = FLEET_VERSION;
+    h.count = count;
+    h.seq = sub.seq++;
+    h.robots = robots.size();
+    h.reserved = 0;
+    h.hostTime = realSeconds();
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), &entries[first], count * sizeof(FleetEntry));
+    sendto(fd, buf, sizeof(h) + count * sizeof(FleetEntry), 0, (const sockaddr *)&sub.addr, sizeof(sub.addr));
+    packetsSent.add();
+    entriesSent.add(count);
+  }
+}
+
+static void onRequest(int fd, std::vector<Subscriber> &subs, double now) {
+  char buf[64];
+  sockaddr_in from;
+  socklen_t fromLen = sizeof(from);
+  ssize_t got;
+  while ((got = recvfrom(fd, buf, sizeof(buf) - 1, 0, (sockaddr *)&from, &fromLen)) > 0) {
+    buf[got] = '\0';
+    while (got > 0 && (buf[got - 1] == '\n' || buf[got - 1] == '\r')) buf[--got] = '\0';
+    auto same = [&](const Subscriber &s) {
+      return s.addr.sin_addr.s_addr == from.sin_addr.s_addr && s.addr.sin_port == from.sin_port;
+    };
+    auto it = std::find_if(subs.begin(), subs.end(), same);
+    std::string reply;
+    if (!strcmp(buf, "SUB")) {
+      if (it != subs.end()) it->lastHeard = now;
+      else if (subs.size() < MAX_SUBSCRIBERS) subs.push_back(Subscriber{from, now, 0, true});
+      else reply = "ERR SUB full";
+    } else if (!strcmp(buf, "UNSUB")) {
+      if (it != subs.end()) subs.erase(it);
+    } else if (!strcmp(buf, "STATS")) {
+      reply = statsText();
+    } else if (!strcmp(buf, "NAMES")) {
+      // As many datagrams as the names take
+      reply = "NAMES";
+      for (const Robot &r : robots) {
+        std::string entry = " " + std::to_string(r.index) + "=" + r.name;
+        if (reply.size() + entry.size() > FLEET_MAX_DATAGRAM) {
+          sendto(fd, reply.data(), reply.size(), 0, (sockaddr *)&from, fromLen);
+          reply = "NAMES";
+        }
+        reply += entry;
+      }
+    } else {
+      reply = std::string("ERR ") + buf;
+    }
+    if (!reply.empty()) sendto(fd, reply.data(), reply.size(), 0, (sockaddr *)&from, fromLen);
+    subscriberCount.set(subs.size());
+    fromLen = sizeof(from);
+  }
+}
+
+static void publish(int fd, std::vector<Subscriber> &subs, double now, std::vector<uint64_t> &sentVersion,
+                    std::vector<uint8_t> &sentFlags, std::vector<uint64_t> &sentOdom) {
+  subs.erase(std::remove_if(subs.begin(), subs.end(),
+                            [&](const Subscriber &s) { return now - s.lastHeard > FLEET_SUB_TIMEOUT_S; }),
+             subs.end());
+  subscriberCount.set(subs.size());
+
+  uint64_t nowNs = monoNs();
+  uint64_t staleNs = (uint64_t)(opt.stale * 1e9);
+  std::vector<FleetEntry> all, changed;
+  uint64_t stale = 0;
+  all.reserve(robots.size());
+  for (size_t i = 0; i < robots.size(); i++) {
+    FleetRobotState s;
+    if (!fleetSlotRead(slots[i], s)) continue;
+    FleetEntry e;
+    e.robot = i;
+    e.flags = s.flags;
+    if (s.recvNs == 0 || nowNs - s.recvNs > staleNs) {
+      e.flags |= FLEET_FLAG_STALE;
+      stale++;
+    }
+    e.slipMask = s.bridge.slipMask;
+    e.seq = (uint32_t)s.bridge.seq;
+    e.megaMs = s.bridge.megaMs;
+    e.ageUs = s.recvNs ? (uint32_t)std::min<uint64_t>((nowNs - s.recvNs) / 1000, UINT32_MAX) : UINT32_MAX;
+    e.x = s.bridge.x;
+    e.y = s.bridge.y;
+    e.theta = s.bridge.theta;
+    e.v = s.bridge.v;
+    e.w = s.bridge.w;
+    for (int m = 0; m < 4; m++) e.currentMa[m] = s.bridge.currentMa[m];
+    e.batteryMv = s.bridge.batteryMv;
+    all.push_back(e);
+    if (s.version != sentVersion[i] || e.flags != sentFlags[i]) {
+      changed.push_back(e);
+      sentVersion[i] = s.version;
+      sentFlags[i] = e.flags;
+      if (s.bridge.seq != sentOdom[i] && !subs.empty()) publishLatency.add(e.ageUs);
+      sentOdom[i] = s.bridge.seq;
+    }
+  }
+  staleCount.set(stale);
+
+  for (Subscriber &sub : subs) {
+    sendEntries(fd, sub, sub.needsAll ? all : changed);
+    sub.needsAll = false;
+  }
+}
+
+static void fanoutMain(int subFd) {
+  int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  itimerspec tick;
+  tick.it_interval.tv_sec = opt.publishMs / 1000;
+  tick.it_interval.tv_nsec = (opt.publishMs % 1000) * 1000000L;
+  tick.it_value = tick.it_interval;
+  timerfd_settime(timerFd, 0, &tick, nullptr);
+
+  int fanEp = epoll_create1(0);
+  int fds[2] = {subFd, timerFd};
+  for (int fd : fds) {
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(fanEp, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  std::vector<Subscriber> subs;
+  std::vector<uint64_t> sentVersion(robots.size(), ~0ULL), sentOdom(robots.size(), 0);
+  std::vector<uint8_t> sentFlags(robots.size(), 0xff);
+  while (running.load()) {
+    epoll_event events[2];
+    int n = epoll_wait(fanEp, events, 2, 100);
+    for (int e = 0; e < n; e++) {
+      double now = monoSeconds();
+      if (events[e].data.fd == subFd) {
+        onRequest(subFd, subs, now);
+      } else {
+        uint64_t expirations;
+        while (read(timerFd, &expirations, sizeof(expirations)) > 0) {}
+        publish(subFd, subs, now, sentVersion, sentFlags, sentOdom);
+      }
+    }
+  }
+  close(fanEp);
+  close(timerFd);
+}
+
+static int openSubscriberSocket(const char *address, int port) {
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (fd < 0) return -1;
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &addr.sin_addr) != 1 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  if (!parseArgs(argc, argv, opt)) {
+    fprintf(stderr, "usage: %s [--robot [NAME=]SPEC]... [--robots FILE]\n"
+                    "  SPEC: serial:PATH[@BAUD] | udp:[ADDR:]PORT | http://HOST[:PORT][/PATH]\n"
+                    "  [--workers N] [--queue ITEMS] [--publish-ms MS] [--sub-port P] [--listen ADDR]\n"
+                    "  [--poll-ms MS] [--http-timeout S] [--stale S] [--duration S]\n", argv[0]);
+    return 2;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  int subFd = openSubscriberSocket(opt.listen, opt.subPort);
+  if (subFd < 0) {
+    fprintf(stderr, "subscriber port %s:%d: %s\n", opt.listen, opt.subPort, strerror(errno));
+    return 1;
+  }
+
+  epfd = epoll_create1(0);
+  startSeconds = monoSeconds();
+  robots.resize(opt.robots.size());
+  working.assign(robots.size(), FleetRobotState());
+  slots.reset(new FleetSlot[robots.size()]);
+  for (size_t i = 0; i < robots.size(); i++) {
+    Robot &r = robots[i];
+    r.index = i;
+    r.name = opt.robots[i].name;
+    std::string error;
+    if (!parseSource(opt.robots[i].spec, r, error)) {
+      fprintf(stderr, "robot %s: %s\n", r.name.c_str(), error.c_str());
+      return 1;
+    }
+    working[i].flags = FLEET_FLAG_LINK_DOWN;
+    slots[i].seq.store(0);
+    fleetSlotWrite(slots[i], working[i]);
+    // Spread the polls over the interval rather than sending them together
+    r.pollAt = startSeconds + opt.pollMs / 1000.0 * i / robots.size();
+  }
+
+  for (int i = 0; i < opt.workers; i++) {
+    std::unique_ptr<Worker> w(new Worker);
+    w->queue.reset(new SpscQueue<FleetItem>(opt.queue));
+    w->wakeFd = eventfd(0, 0);
+    workers.push_back(std::move(w));
+  }
+
+  // Sources open before the workers start; their link-up items wait in the queues
+  for (Robot &r : robots) {
+    std::string error;
+    if (r.transport == UDP_SOURCE && !openUdp(r, error)) {
+      fprintf(stderr, "robot %s: udp port %d: %s\n", r.name.c_str(), ntohs(r.addr.sin_port), error.c_str());
+      return 1;
+    }
+    if (r.transport == SERIAL_SOURCE) {
+      openSerial(r, startSeconds);
+      if (r.fd < 0) fprintf(stderr, "robot %s: %s: %s, retrying\n", r.name.c_str(), r.path.c_str(), strerror(errno));
+    }
+  }
+  for (auto &w : workers) {
+    Worker *p = w.get();
+    w->thread = std::thread([p]() { workerMain(*p); });
+  }
+  wakeWorkers();
+  std::thread fanout(fanoutMain, subFd);
+
+  int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  itimerspec tick;
+  tick.it_interval.tv_sec = 0;
+  tick.it_interval.tv_nsec = 10 * 1000 * 1000;
+  tick.it_value = tick.it_interval;
+  timerfd_settime(timerFd, 0, &tick, nullptr);
+  epoll_event tev;
+  tev.events = EPOLLIN;
+  tev.data.u64 = TIMER_EVENT;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, timerFd, &tev);
+
+  while (!stopRequested) {
+    double now = monoSeconds();
+    if (opt.duration > 0 && now - startSeconds >= opt.duration) break;
+    epoll_event events[64];
+    int n = epoll_wait(epfd, events, 64, 100);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    now = monoSeconds();
+    for (int e = 0; e < n; e++) {
+      if (events[e].data.u64 == TIMER_EVENT) {
+        uint64_t expirations;
+        while (read(timerFd, &expirations, sizeof(expirations)) > 0) {}
+        onTick(now);
+        continue;
+      }
+      Robot &r = robots[events[e].data.u64];
+      if (r.fd < 0) continue;    // closed earlier in this round
+      switch (r.transport) {
+        case SERIAL_SOURCE: onSerialReadable(r, now); break;
+        case UDP_SOURCE: onUdpReadable(r); break;
+        case HTTP_SOURCE: onHttpEvent(r, events[e].events); break;
+        default: break;
+      }
+    }
+    wakeWorkers();
+  }
+
+  running.store(false);
+  for (auto &w : workers) {
+    uint64_t one = 1;
+    if (write(w->wakeFd, &one, sizeof(one)) < 0) perror("eventfd");
+    w->thread.join();
+    close(w->wakeFd);
+  }
+  fanout.join();
+  for (Robot &r : robots) closeSource(r);
+  close(timerFd);
+  close(subFd);
+  close(epfd);
+
+  fprintf(stderr, "%s\n", statsText().c_str());
+  return 0;
+}
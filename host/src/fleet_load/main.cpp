@@ -0,0 +1,611 @@
+/* fleet_load
+   Load test for fleet_gateway. For each fleet size in --robots it starts
+   the gateway with that many simulated robots, drives them from this
+   process and subscribes to the gateway's updates. It reports how fast the
+   gateway takes in telemetry, its memory per robot and CPU use, and the
+   latency from a robot sending ODOM to the update reaching a subscriber.
+
+   Usage: fleet_load --gateway PATH [--robots 8,16,32,64] [--seconds 5]
+                     [--rate 20] [--transport mix|udp|serial|http]
+                     [--workers 2] [--publish-ms 10] [--poll-ms 25]
+                     [--base-port 5700] [--sub-port 5621] [--verbose 1]
+                     [--expect-ingest 0.95] [--max-p99-ms 0]
+
+   Every robot sends ODOM at --rate Hz and SENS at a fifth of that, in the
+   firmware's format. udp robots send datagrams to their own port, serial
+   robots write to a pseudo terminal the gateway opens, and http robots
+   serve /status the way the ESP does, polled by the gateway every
+   --poll-ms. mix takes turns between the three.
+
+   Memory per robot is the gateway's RSS over that of a gateway with no
+   robots. "expected" is the ODOM the gateway could have seen: all of it
+   from udp and serial robots, at most one per poll from http robots.
+   --expect-ingest fails the run when the gateway decodes less than that
+   fraction of it, and --max-p99-ms when the 99th percentile latency is
+   higher, at any fleet size.
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fleet_protocol.h"
+
+static const double WARMUP_S = 1.0;
+static const double READY_TIMEOUT_S = 5.0;
+static const int SEND_RING = 64;         // send times kept per robot, by ODOM number
+static const int SENS_EVERY = 5;
+
+enum Transport { SERIAL_ROBOT, UDP_ROBOT, HTTP_ROBOT, TRANSPORTS };
+
+enum EventKind : uint32_t { EV_SUB = 1, EV_TIMER, EV_LISTEN, EV_CONN };
+
+struct Options {
+  const char *gateway = nullptr;
+  std::vector<int> sizes = {8, 16, 32, 64};
+  double seconds = 5;
+  double rate = 20;
+  const char *transport = "mix";
+  int workers = 2;
+  int publishMs = 10;
+  int pollMs = 25;
+  int basePort = 5700;
+  int subPort = 5621;
+  bool verbose = false;
+  double expectIngest = -1;
+  double maxP99Ms = 0;
+};
+
+struct SimRobot {
+  Transport transport;
+  int port;
+  int fd = -1;               // pty master (serial), listening socket (http)
+  int slaveFd = -1;          // held open so the pty stays up between gateway opens
+  std::string slavePath;
+  uint32_t odomSeq = 0;
+  uint64_t nextSendNs = 0;
+  uint64_t sentNs[SEND_RING];
+  uint32_t sentSeq[SEND_RING];
+  uint32_t lastSeen = 0;
+  double x = 0;
+  std::string status;        // http: the current /status body
+  std::string sens;          // http: the SENS line it shows
+};
+
+struct StepResult {
+  int robots = 0;
+  double sentPerS = 0, ingestPerS = 0, ratio = 0, cpuPercent = 0, updatesPerS = 0;
+  unsigned long long dropped = 0;
+  long rssKb = 0;
+  double p50Ms = 0, p99Ms = 0, maxMs = 0;
+  bool ok = false;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+static uint64_t monoNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool parseArgs(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (!v) return false;
+    if (!strcmp(a, "--gateway")) o.gateway = v;
+    else if (!strcmp(a, "--robots")) {
+      o.sizes.clear();
+      for (const char *p = v; *p; p++) {
+        if (p == v || p[-1] == ',') o.sizes.push_back(atoi(p));
+      }
+    } else if (!strcmp(a, "--seconds")) o.seconds = atof(v);
+    else if (!strcmp(a, "--rate")) o.rate = atof(v);
+    else if (!strcmp(a, "--transport")) o.transport = v;
+    else if (!strcmp(a, "--workers")) o.workers = atoi(v);
+    else if (!strcmp(a, "--publish-ms")) o.publishMs = atoi(v);
+    else if (!strcmp(a, "--poll-ms")) o.pollMs = atoi(v);
+    else if (!strcmp(a, "--base-port")) o.basePort = atoi(v);
+    else if (!strcmp(a, "--sub-port")) o.subPort = atoi(v);
+    else if (!strcmp(a, "--verbose")) o.verbose = atoi(v) != 0;
+    else if (!strcmp(a, "--expect-ingest")) o.expectIngest = atof(v);
+    else if (!strcmp(a, "--max-p99-ms")) o.maxP99Ms = atof(v);
+    else return false;
+    i++;
+  }
+  bool knownTransport = false;
+  for (const char *t : {"mix", "udp", "serial", "http"}) knownTransport |= !strcmp(o.transport, t);
+  for (int n : o.sizes) {
+    if (n <= 0) return false;
+  }
+  return o.gateway && knownTransport && !o.sizes.empty() && o.seconds > 0 && o.rate > 0 && o.pollMs > 0;
+}
+
+static Transport transportFor(const Options &o, int index) {
+  if (!strcmp(o.transport, "udp")) return UDP_ROBOT;
+  if (!strcmp(o.transport, "serial")) return SERIAL_ROBOT;
+  if (!strcmp(o.transport, "http")) return HTTP_ROBOT;
+  static const Transport cycle[] = {UDP_ROBOT, SERIAL_ROBOT, HTTP_ROBOT};
+  return cycle[index % 3];
+}
+
+// "STATS key value ..." to the value of key, or -1
+static double statsValue(const std::string &stats, const char *key) {
+  std::string pattern = std::string(" ") + key + " ";
+  size_t at = stats.find(pattern);
+  return at == std::string::npos ? -1 : atof(stats.c_str() + at + pattern.size());
+}
+
+// utime + stime of a process, in seconds
+static double cpuSeconds(pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  FILE *f = fopen(path, "r");
+  if (!f) return 0;
+  char buf[1024];
+  size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[n] = '\0';
+  // Fields after the command name, which may hold spaces: state is field 3,
+  // utime and stime are fields 14 and 15
+  const char *p = strrchr(buf, ')');
+  if (!p) return 0;
+  unsigned long utime = 0, stime = 0;
+  sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+  return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static double percentile(std::vector<double> &sorted, double q) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t)(q * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+// ---------------- Simulated robots ----------------
+
+static bool makeRaw(int fd) {
+  termios t;
+  if (tcgetattr(fd, &t) < 0) return false;
+  cfmakeraw(&t);
+  t.c_cflag |= CLOCAL | CREAD;
+  return tcsetattr(fd, TCSANOW, &t) == 0;
+}
+
+static bool openPty(SimRobot &r) {
+  r.fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (r.fd < 0 || grantpt(r.fd) < 0 || unlockpt(r.fd) < 0) return false;
+  r.slavePath = ptsname(r.fd);
+  r.slaveFd = open(r.slavePath.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  return r.slaveFd >= 0 && makeRaw(r.slaveFd) && makeRaw(r.fd);
+}
+
+static bool openListener(SimRobot &r) {
+  r.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int one = 1;
+  setsockopt(r.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(r.port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return r.fd >= 0 && bind(r.fd, (sockaddr *)&addr, sizeof(addr)) == 0 && listen(r.fd, 64) == 0;
+}
+
+static void closeRobot(SimRobot &r) {
+  if (r.fd >= 0) close(r.fd);
+  if (r.slaveFd >= 0) close(r.slaveFd);
+  r.fd = r.slaveFd = -1;
+}
+
+// The firmware's ODOM and SENS lines (README "Odometry Output"). The Mega
+// time field carries the ODOM number, which is how an update is matched
+// to its send time.
+static int formatOdom(SimRobot &r, double rate, char *buf, size_t size) {
+  double dt = 1.0 / rate;
+  r.x += 0.3 * dt;
+  return snprintf(buf, size,
+                  "ODOM %lu %d 21 20 21 20 0.0150 0.0150 0.300 0.300 %.4f 0.0000 0.0000 0.300 0.000 0\r\n",
+                  (unsigned long)r.odomSeq, (int)(dt * 1000), r.x);
+}
+
+static int formatSens(uint32_t odomSeq, char *buf, size_t size) {
+  return snprintf(buf, size, "SENS %u 410 395 402 388 1200\r\n", 7400 + odomSeq % 50);
+}
+
+static std::string statusBody(const char *odom, const char *sens, uint32_t uptime) {
+  std::string odomLine(odom), sensLine(sens);
+  while (!odomLine.empty() && (odomLine.back() == '\n' || odomLine.back() == '\r')) odomLine.pop_back();
+  while (!sensLine.empty() && (sensLine.back() == '\n' || sensLine.back() == '\r')) sensLine.pop_back();
+  return "{\"connected\":true,\"last_response\":\"OK SET_V\",\"motors_enabled\":true,\"current_speed\":150,"
+         "\"odometry\":\"" + odomLine + "\",\"sensors\":\"" + sensLine + "\",\"last_trip\":\"\",\"uptime\":" +
+         std::to_string(uptime) + "}";
+}
+
+struct Sender {
+  int udpFd = -1;
+  unsigned long long lines = 0, odom[TRANSPORTS] = {0, 0, 0}, blocked = 0;
+};
+
+// Returns false if the line didn't go out (a pty nobody is reading)
+static bool sendLine(SimRobot &r, Sender &s, const char *line, int len) {
+  if (r.transport == UDP_ROBOT) {
+    sockaddr_in dst;
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family = AF_INET;
+    dst.sin_port = htons(r.port);
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sendto(s.udpFd, line, len, 0, (sockaddr *)&dst, sizeof(dst)) == len;
+  }
+  return write(r.fd, line, len) == len;
+}
+
+static void robotTick(SimRobot &r, Sender &s, const Options &o, uint64_t nowNs) {
+  uint64_t periodNs = (uint64_t)(1e9 / o.rate);
+  while (r.nextSendNs <= nowNs) {
+    r.nextSendNs += periodNs;
+    char odom[192], sens[64];
+    r.odomSeq++;
+    formatOdom(r, o.rate, odom, sizeof(odom));
+    bool withSens = r.odomSeq % SENS_EVERY == 0;
+    if (withSens) formatSens(r.odomSeq, sens, sizeof(sens));
+    int slot = r.odomSeq % SEND_RING;
+    r.sentSeq[slot] = r.odomSeq;
+    r.sentNs[slot] = monoNs();
+    if (r.transport == HTTP_ROBOT) {
+      if (withSens) r.sens = sens;
+      r.status = statusBody(odom, r.sens.c_str(), (uint32_t)(nowNs / 1000000));
+      s.lines += withSens ? 2 : 1;
+      s.odom[HTTP_ROBOT]++;
+      continue;
+    }
+    if (!sendLine(r, s, odom, strlen(odom))) {
+      s.blocked++;
+      continue;
+    }
+    s.lines++;
+    s.odom[r.transport]++;
+    if (withSens && sendLine(r, s, sens, strlen(sens))) s.lines++;
+  }
+}
+
+// One request per connection, like the ESP's web server with Connection: close
+struct HttpConn {
+  int robot;
+  std::string request;
+};
+
+static void serveStatus(int fd, HttpConn &c, const std::vector<SimRobot> &robots) {
+  char buf[1024];
+  ssize_t got;
+  while ((got = recv(fd, buf, sizeof(buf), 0)) > 0) c.request.append(buf, got);
+  if (c.request.find("\r\n\r\n") == std::string::npos) return;
+  const std::string &body = robots[c.robot].status;
+  std::string reply = "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                      std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+  if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) < 0) perror("send");
+}
+
+// ---------------- One fleet size ----------------
+
+static pid_t spawnGateway(const Options &o, const std::vector<SimRobot> &robots) {
+  std::vector<std::string> args = {o.gateway, "--workers", std::to_string(o.workers), "--publish-ms",
+                                   std::to_string(o.publishMs), "--sub-port", std::to_string(o.subPort),
+                                   "--poll-ms", std::to_string(o.pollMs)};
+  for (size_t i = 0; i < robots.size(); i++) {
+    const SimRobot &r = robots[i];
+    std::string spec = r.transport == SERIAL_ROBOT ? "serial:" + r.slavePath
+                     : r.transport == UDP_ROBOT ? "udp:127.0.0.1:" + std::to_string(r.port)
+                     : "http://127.0.0.1:" + std::to_string(r.port) + "/status";
+    args.push_back("--robot");
+    args.push_back("r" + std::to_string(i) + "=" + spec);
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (!o.verbose) {
+      int devNull = open("/dev/null", O_WRONLY);
+      dup2(devNull, 2);
+    }
+    std::vector<char *> argv;
+    for (std::string &a : args) argv.push_back(&a[0]);
+    argv.push_back(nullptr);
+    execv(o.gateway, argv.data());
+    perror(o.gateway);
+    _exit(127);
+  }
+  return pid;
+}
+
+static int openSubscriber(const Options &o, sockaddr_in &gateway) {
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int big = 4 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &big, sizeof(big));
+  if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) return -1;
+  gateway = addr;
+  gateway.sin_port = htons(o.subPort);
+  return fd;
+}
+
+static void request(int fd, const sockaddr_in &gateway, const char *text) {
+  sendto(fd, text, strlen(text), 0, (const sockaddr *)&gateway, sizeof(gateway));
+}
+
+// Robots of the given size, or none for the gateway's baseline memory
+static StepResult runStep(const Options &o, int count) {
+  StepResult result;
+  result.robots = count;
+  std::vector<SimRobot> robots(count);
+  Sender sender;
+  sender.udpFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  uint64_t startNs = monoNs();
+  uint64_t periodNs = (uint64_t)(1e9 / o.rate);
+  bool setupOk = true;
+  for (int i = 0; i < count; i++) {
+    SimRobot &r = robots[i];
+    r.transport = transportFor(o, i);
+    r.port = o.basePort + i;
+    memset(r.sentSeq, 0, sizeof(r.sentSeq));
+    // Spread over the period, like robots that booted at different times
+    r.nextSendNs = startNs + periodNs * i / count;
+    if (r.transport == SERIAL_ROBOT && !openPty(r)) setupOk = false;
+    if (r.transport == HTTP_ROBOT && !openListener(r)) setupOk = false;
+    if (r.transport == HTTP_ROBOT) r.status = statusBody("", "", 0);
+  }
+  if (!setupOk) {
+    perror("robot setup");
+    for (SimRobot &r : robots) closeRobot(r);
+    close(sender.udpFd);
+    return result;
+  }
+
+  sockaddr_in gateway;
+  int subFd = openSubscriber(o, gateway);
+  pid_t pid = spawnGateway(o, robots);
+
+  int ep = epoll_create1(0);
+  auto watch = [&](int fd, EventKind kind, uint32_t index) {
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)kind << 32) | index;
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+  };
+  int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  itimerspec tick;
+  tick.it_interval.tv_sec = 0;
+  tick.it_interval.tv_nsec = 1000 * 1000;
+  tick.it_value = tick.it_interval;
+  timerfd_settime(timerFd, 0, &tick, nullptr);
+  watch(subFd, EV_SUB, 0);
+  watch(timerFd, EV_TIMER, 0);
+  for (int i = 0; i < count; i++) {
+    if (robots[i].transport == HTTP_ROBOT) watch(robots[i].fd, EV_LISTEN, i);
+  }
+  std::map<int, HttpConn> conns;
+
+  // Ready once it answers STATS; the measured window starts after warm-up
+  enum Phase { WAIT_READY, WARMUP, MEASURE, DONE } phase = WAIT_READY;
+  std::string statsA, statsB;
+  bool statsPending = false;
+  double cpuA = 0, cpuB = 0;
+  uint64_t phaseNs = monoNs(), lastRequestNs = 0, measureNs = 0, measureEndNs = 0;
+  Sender sentA, sentB;
+  unsigned long long updates = 0, updatesA = 0;
+  std::vector<double> latencyMs;
+  bool failed = false;
+
+  while (phase != DONE && !stopRequested) {
+    epoll_event events[64];
+    int n = epoll_wait(ep, events, 64, 10);
+    uint64_t nowNs = monoNs();
+    for (int e = 0; e < n; e++) {
+      EventKind kind = (EventKind)(events[e].data.u64 >> 32);
+      uint32_t index = (uint32_t)events[e].data.u64;
+      if (kind == EV_TIMER) {
+        uint64_t expirations;
+        while (read(timerFd, &expirations, sizeof(expirations)) > 0) {}
+        if (phase != WAIT_READY) {
+          for (SimRobot &r : robots) robotTick(r, sender, o, nowNs);
+        }
+      } else if (kind == EV_LISTEN) {
+        int fd;
+        while ((fd = accept4(robots[index].fd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+          conns[fd] = HttpConn{(int)index, std::string()};
+          watch(fd, EV_CONN, fd);
+        }
+      } else if (kind == EV_CONN) {
+        int fd = (int)index;
+        auto it = conns.find(fd);
+        if (it == conns.end()) continue;
+        serveStatus(fd, it->second, robots);
+        if (it->second.request.find("\r\n\r\n") != std::string::npos) {
+          close(fd);
+          conns.erase(it);
+        }
+      } else if (kind == EV_SUB) {
+        uint8_t buf[FLEET_MAX_DATAGRAM + 1];
+        ssize_t got;
+        while ((got = recv(subFd, buf, sizeof(buf) - 1, 0)) > 0) {
+          if (got >= (ssize_t)sizeof(FleetHeader) && buf[0] == FLEET_MAGIC0 && buf[1] == FLEET_MAGIC1) {
+            FleetHeader h;
+            memcpy(&h, buf, sizeof(h));
+            for (int i = 0; i < h.count && sizeof(h) + (i + 1) * sizeof(FleetEntry) <= (size_t)got; i++) {
+              FleetEntry entry;
+              memcpy(&entry, buf + sizeof(h) + i * sizeof(FleetEntry), sizeof(entry));
+              updates++;
+              if (entry.robot >= robots.size()) continue;
+              SimRobot &r = robots[entry.robot];
+              if (entry.megaMs == r.lastSeen) continue;
+              r.lastSeen = entry.megaMs;
+              int slot = entry.megaMs % SEND_RING;
+              if (phase == MEASURE && r.sentSeq[slot] == entry.megaMs && r.sentNs[slot] >= measureNs) {
+                latencyMs.push_back((nowNs - r.sentNs[slot]) * 1e-6);
+              }
+            }
+            continue;
+          }
+          buf[got] = '\0';
+          if (strncmp((char *)buf, "STATS ", 6) != 0 || !statsPending) continue;
+          statsPending = false;
+          if (phase == WAIT_READY) {
+            phase = WARMUP;
+            phaseNs = nowNs;
+            for (SimRobot &r : robots) r.nextSendNs += nowNs - startNs;
+            request(subFd, gateway, "SUB");
+          } else if (phase == WARMUP) {
+            statsA = (char *)buf;
+          } else if (phase == MEASURE) {
+            statsB = (char *)buf;
+            phase = DONE;
+          }
+        }
+      }
+    }
+
+    nowNs = monoNs();
+    double inPhase = (nowNs - phaseNs) * 1e-9;
+    if (phase == WAIT_READY) {
+      if (inPhase > READY_TIMEOUT_S) {
+        fprintf(stderr, "fleet_load: gateway did not answer on port %d\n", o.subPort);
+        failed = true;
+        break;
+      }
+      if (nowNs - lastRequestNs > 100000000ULL) {
+        request(subFd, gateway, "STATS");
+        statsPending = true;
+        lastRequestNs = nowNs;
+      }
+    } else if (phase == WARMUP && inPhase >= WARMUP_S && !statsPending && statsA.empty()) {
+      request(subFd, gateway, "STATS");
+      statsPending = true;
+      cpuA = cpuSeconds(pid);
+      sentA = sender;
+      updatesA = updates;
+      measureNs = nowNs;
+    } else if (phase == WARMUP && !statsA.empty()) {
+      phase = MEASURE;
+      phaseNs = measureNs;
+    } else if (phase == MEASURE && inPhase >= o.seconds && measureEndNs == 0) {
+      request(subFd, gateway, "STATS");
+      statsPending = true;
+      cpuB = cpuSeconds(pid);
+      sentB = sender;
+      result.updatesPerS = (updates - updatesA) / o.seconds;
+      measureEndNs = nowNs;
+    } else if (phase == MEASURE && measureEndNs && nowNs - measureEndNs > 1000000000ULL) {
+      fprintf(stderr, "fleet_load: no STATS reply at the end of the run\n");
+      failed = true;
+      break;
+    }
+    // Renew well inside the gateway's timeout
+    if (phase != WAIT_READY && nowNs - lastRequestNs > 1000000000ULL) {
+      request(subFd, gateway, "SUB");
+      lastRequestNs = nowNs;
+    }
+  }
+
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+  for (auto &c : conns) close(c.first);
+  for (SimRobot &r : robots) closeRobot(r);
+  close(timerFd);
+  close(subFd);
+  close(sender.udpFd);
+  close(ep);
+  if (failed || statsB.empty()) return result;
+
+  double seconds = (measureEndNs - measureNs) * 1e-9;
+  double expectedOdom = sentB.odom[UDP_ROBOT] - sentA.odom[UDP_ROBOT] + sentB.odom[SERIAL_ROBOT] -
+                        sentA.odom[SERIAL_ROBOT];
+  int httpRobots = 0;
+  for (const SimRobot &r : robots) httpRobots += r.transport == HTTP_ROBOT;
+  expectedOdom += std::min((double)(sentB.odom[HTTP_ROBOT] - sentA.odom[HTTP_ROBOT]),
+                           httpRobots * seconds * 1000.0 / o.pollMs);
+  double ingestedOdom = statsValue(statsB, "odom") - statsValue(statsA, "odom");
+  result.sentPerS = (sentB.lines - sentA.lines) / seconds;
+  result.ingestPerS = (ingestedOdom + statsValue(statsB, "sens") - statsValue(statsA, "sens")) / seconds;
+  result.ratio = expectedOdom > 0 ? ingestedOdom / expectedOdom : 1;
+  result.dropped = (unsigned long long)(statsValue(statsB, "dropped") - statsValue(statsA, "dropped"));
+  result.rssKb = (long)statsValue(statsB, "rss_kb");
+  result.cpuPercent = (cpuB - cpuA) * 100 / seconds;
+  std::sort(latencyMs.begin(), latencyMs.end());
+  result.p50Ms = percentile(latencyMs, 0.5);
+  result.p99Ms = percentile(latencyMs, 0.99);
+  result.maxMs = latencyMs.empty() ? 0 : latencyMs.back();
+  result.ok = true;
+  return result;
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseArgs(argc, argv, opt)) {
+    fprintf(stderr, "usage: %s --gateway PATH [--robots N,N,...] [--seconds S] [--rate HZ]\n"
+                    "  [--transport mix|udp|serial|http] [--workers N] [--publish-ms MS] [--poll-ms MS]\n"
+                    "  [--base-port P] [--sub-port P] [--verbose 1]\n"
+                    "  [--expect-ingest FRACTION] [--max-p99-ms MS]\n", argv[0]);
+    return 2;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  // The gateway with no robots: what memory per robot is measured against
+  std::vector<int> sizes = opt.sizes;
+  Options empty = opt;
+  empty.seconds = 0.2;
+  StepResult base = runStep(empty, 0);
+  if (!base.ok) return 1;
+
+  printf("%s robots at %.0f Hz ODOM, %d workers, publish every %d ms, %.0f s each\n", opt.transport, opt.rate,
+         opt.workers, opt.publishMs, opt.seconds);
+  printf("%6s %9s %9s %9s %7s %8s %8s %6s %9s %8s %8s %8s\n", "robots", "sent/s", "ingest/s", "decoded",
+         "dropped", "rss_kb", "kb/robot", "cpu%", "updates/s", "p50_ms", "p99_ms", "max_ms");
+  printf("%6d %9s %9s %9s %7s %8ld %8s %6s %9s %8s %8s %8s\n", 0, "-", "-", "-", "-", base.rssKb, "-", "-", "-",
+         "-", "-", "-");
+  bool pass = true;
+  for (int n : sizes) {
+    if (stopRequested) break;
+    StepResult r = runStep(opt, n);
+    if (!r.ok) {
+      printf("%6d  failed\n", n);
+      pass = false;
+      continue;
+    }
+    printf("%6d %9.0f %9.0f %8.1f%% %7llu %8ld %8.1f %6.1f %9.0f %8.2f %8.2f %8.2f\n", n, r.sentPerS, r.ingestPerS,
+           r.ratio * 100, r.dropped, r.rssKb, (double)(r.rssKb - base.rssKb) / n, r.cpuPercent, r.updatesPerS,
+           r.p50Ms, r.p99Ms, r.maxMs);
+    fflush(stdout);
+    if (opt.expectIngest >= 0 && r.ratio < opt.expectIngest) {
+      fprintf(stderr, "FAIL: %d robots: gateway decoded %.1f%% of the ODOM, expected %.1f%%\n", n,
+              r.ratio * 100, opt.expectIngest * 100);
+      pass = false;
+    }
+    if (opt.maxP99Ms > 0 && r.p99Ms > opt.maxP99Ms) {
+      fprintf(stderr, "FAIL: %d robots: p99 latency %.2f ms, limit %.2f ms\n", n, r.p99Ms, opt.maxP99Ms);
+      pass = false;
+    }
+  }
+  return pass ? 0 : 1;
+}
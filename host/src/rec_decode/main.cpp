@@ -0,0 +1,124 @@
+/* rec_decode
+   Converts flight recorder dumps (REC_DUMP) to CSV. The input can be a raw
+   capture of the Mega's serial output: text lines around the blocks are
+   skipped, and each block is found by its header and checked against its
+   checksum, so one capture can hold several dumps.
+
+   Usage: rec_decode [--block N] [--out file.csv] capture.bin
+          (reads stdin when the file is "-"; CSV goes to stdout by default)
+
+   Columns: block, sample, t_us (from the trigger sample), loop_us, late_us,
+   d1..d4 (encoder ticks since the previous sample), pwm1..pwm4 (signed,
+   wheel-forward positive), held (safety mask), fwd_blocked, clipped, trigger
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "rec_format.h"
+
+static const char *triggerName(uint8_t source) {
+  switch (source) {
+    case 0: return "none";
+    case REC_TRIG_COMMAND: return "command";
+    case REC_TRIG_FAULT: return "fault";
+    case REC_TRIG_SAFETY: return "safety";
+    default: return "?";
+  }
+}
+
+static bool readAll(FILE *f, std::vector<uint8_t> &out) {
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  return !ferror(f);
+}
+
+// Length of a valid block starting at p, or 0
+static size_t blockAt(const uint8_t *p, size_t avail) {
+  if (avail < sizeof(RecHeader) + 2) return 0;
+  RecHeader h;
+  memcpy(&h, p, sizeof(h));
+  if (h.magic[0] != REC_MAGIC0 || h.magic[1] != REC_MAGIC1 || h.version != REC_VERSION) return 0;
+  if (h.sampleBytes != sizeof(RecSample) || h.triggerIndex > h.count) return 0;
+  size_t body = sizeof(RecHeader) + (size_t)h.count * sizeof(RecSample);
+  if (avail < body + 2) return 0;
+  uint8_t s1 = 0, s2 = 0;
+  for (size_t i = 0; i < body; i++) {
+    s1 = (s1 + p[i]) % 255;
+    s2 = (s2 + s1) % 255;
+  }
+  return p[body] == s1 && p[body + 1] == s2 ? body + 2 : 0;
+}
+
+static void writeBlock(FILE *out, int block, const uint8_t *p) {
+  RecHeader h;
+  memcpy(&h, p, sizeof(h));
+  const uint8_t *s = p + sizeof(h);
+  for (unsigned i = 0; i < h.count; i++, s += sizeof(RecSample)) {
+    RecSample r;
+    memcpy(&r, s, sizeof(r));
+    long t = ((long)i - (long)h.triggerIndex) * h.periodUs;
+    if (h.triggerIndex == h.count) t = (long)i * h.periodUs;
+    fprintf(out, "%d,%u,%ld,%u,%u", block, i, t, r.loopUs, r.lateUs);
+    for (int w = 0; w < 4; w++) fprintf(out, ",%d", r.dEnc[w]);
+    for (int w = 0; w < 4; w++) fprintf(out, ",%d", (r.dir & (1 << w)) ? -(int)r.pwm[w] : r.pwm[w]);
+    fprintf(out, ",%u,%d,%d,%d\n", r.dir >> 4, (r.flags & REC_FLAG_FWD_BLOCKED) != 0,
+            (r.flags & REC_FLAG_ENC_CLIPPED) != 0, (r.flags & REC_FLAG_TRIGGER) != 0);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *inPath = nullptr, *outPath = nullptr;
+  int only = -1;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    if (!strcmp(a, "--block") && i + 1 < argc) only = atoi(argv[++i]);
+    else if (!strcmp(a, "--out") && i + 1 < argc) outPath = argv[++i];
+    else if (a[0] != '-' || !strcmp(a, "-")) inPath = a;
+    else {
+      fprintf(stderr, "unknown option %s\n", a);
+      return 2;
+    }
+  }
+  if (!inPath) {
+    fprintf(stderr, "usage: rec_decode [--block N] [--out file.csv] capture.bin\n");
+    return 2;
+  }
+
+  FILE *in = strcmp(inPath, "-") ? fopen(inPath, "rb") : stdin;
+  if (!in) { perror(inPath); return 1; }
+  std::vector<uint8_t> data;
+  if (!readAll(in, data)) { perror(inPath); return 1; }
+  if (in != stdin) fclose(in);
+
+  FILE *out = outPath ? fopen(outPath, "w") : stdout;
+  if (!out) { perror(outPath); return 1; }
+  fprintf(out, "block,sample,t_us,loop_us,late_us,d1,d2,d3,d4,pwm1,pwm2,pwm3,pwm4,held,fwd_blocked,clipped,trigger\n");
+
+  int found = 0;
+  for (size_t pos = 0; pos < data.size();) {
+    size_t len = blockAt(data.data() + pos, data.size() - pos);
+    if (!len) {
+      pos++;
+      continue;
+    }
+    RecHeader h;
+    memcpy(&h, data.data() + pos, sizeof(h));
+    fprintf(stderr, "block %d: %u samples at %u us, trigger %s at sample %u (Mega %lu ms)\n",
+            found, h.count, h.periodUs, triggerName(h.triggerSource), h.triggerIndex,
+            (unsigned long)h.triggerMs);
+    if (only < 0 || only == found) writeBlock(out, found, data.data() + pos);
+    found++;
+    pos += len;
+  }
+  if (out != stdout) fclose(out);
+
+  if (!found) {
+    fprintf(stderr, "no valid dump blocks in %s\n", inPath);
+    return 1;
+  }
+  return 0;
+}
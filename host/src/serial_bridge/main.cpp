@@ -0,0 +1,570 @@
+/* serial_bridge
+   Linux side of a wired (USB/UART) link to the Mega, for ROS-style stacks.
+   Decodes the ODOM and SENS telemetry into pose and wheel joint states,
+   publishes them to one or more outputs, and forwards velocity commands to
+   the robot at a bounded rate. One epoll loop, no threads: the serial port
+   is read straight into a mirrored ring (rx_ring.h) and lines are decoded
+   in place.
+
+   Usage: serial_bridge (--device /dev/ttyUSB0 [--baud 115200] | --spawn "cmd")
+                        [--out text|udp:HOST:PORT|ros:HOST:PORT|shm:NAME]...
+                        [--cmd-port 5610] [--cmd-rate 20] [--cmd-timeout 0.5]
+                        [--max-speed 0.6] [--send-at SECONDS:COMMAND]...
+                        [--duration 0] [--expect-odom-hz 5] [--expect-distance 0.5]
+                        [--capture link.ucap]
+
+   The Mega takes commands and sends telemetry on Serial2 (pins 16 TX2 and
+   17 RX2), where the ESP sits. --device is a USB-UART adapter wired there
+   in place of the ESP: adapter RX to pin 16, TX to pin 17, GND to GND. The
+   Mega's own USB port (/dev/ttyACM0) only carries its debug output. The
+   bridge sends HELLO at start and warns if no READY, ODOM or SENS line
+   comes back within LINK_CHECK_S.
+
+   --spawn runs a command on a pseudo terminal instead of opening a port,
+   e.g. --spawn "sim/program --stdio" for an end-to-end test against the
+   simulator. --out defaults to text.
+
+   Commands arrive as UDP datagrams on 127.0.0.1:--cmd-port, either as a
+   text line (SET_V, MALL, FWD, BACK, LEFT, RIGHT or STOP) or as a ROS 1
+   serialized geometry_msgs/Twist, which becomes SET_V with full PWM at
+   --max-speed m/s. Only the newest command is kept and it goes out at most
+   --cmd-rate times a second; STOP goes out at once. If no command arrives
+   for --cmd-timeout seconds after motion, the bridge sends STOP itself.
+   --send-at writes any command (ENABLE, say) at a fixed time after start.
+
+   --capture records the link both ways (include/uart_capture.h) for the
+   simulator's replay scenario.
+
+   --expect-odom-hz and --expect-distance make the exit status report
+   whether the ODOM rate and the distance driven reached those values.
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bridge_outputs.h"
+#include "bridge_telemetry.h"
+#include "ros_adapter.h"
+#include "rx_ring.h"
+#include "uart_capture.h"
+
+static const double TRACK_WIDTH = 0.19;   // meters, include/config.h
+static const size_t RX_RING_BYTES = 64 * 1024;
+static const size_t MAX_LINE = 256;       // longer runs without '\n' are noise
+static const double LINK_CHECK_S = 3.0;   // the Mega answers HELLO well within this
+
+struct ScriptedCommand {
+  double at;
+  std::string command;
+};
+
+struct Options {
+  const char *device = nullptr;
+  const char *spawn = nullptr;
+  int baud = 115200;
+  std::vector<std::string> outputs;
+  int cmdPort = 5610;
+  double cmdRate = 20;
+  double cmdTimeout = 0.5;
+  double maxSpeed = 0.6;
+  std::vector<ScriptedCommand> sendAt;
+  double duration = 0;
+  double expectOdomHz = -1;
+  double expectDistance = -1;
+  const char *capture = nullptr;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+static double monoSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double captureStart;
+
+static uint64_t captureUs() {
+  return (uint64_t)((monoSeconds() - captureStart) * 1e6);
+}
+
+static double realSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool parseArgs(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (!v) return false;
+    if (!strcmp(a, "--device")) o.device = v;
+    else if (!strcmp(a, "--spawn")) o.spawn = v;
+    else if (!strcmp(a, "--baud")) o.baud = atoi(v);
+    else if (!strcmp(a, "--out")) o.outputs.push_back(v);
+    else if (!strcmp(a, "--cmd-port")) o.cmdPort = atoi(v);
+    else if (!strcmp(a, "--cmd-rate")) o.cmdRate = atof(v);
+    else if (!strcmp(a, "--cmd-timeout")) o.cmdTimeout = atof(v);
+    else if (!strcmp(a, "--max-speed")) o.maxSpeed = atof(v);
+    else if (!strcmp(a, "--duration")) o.duration = atof(v);
+    else if (!strcmp(a, "--expect-odom-hz")) o.expectOdomHz = atof(v);
+    else if (!strcmp(a, "--expect-distance")) o.expectDistance = atof(v);
+    else if (!strcmp(a, "--capture")) o.capture = v;
+    else if (!strcmp(a, "--send-at")) {
+      const char *colon = strchr(v, ':');
+      if (!colon) return false;
+      o.sendAt.push_back(ScriptedCommand{atof(v), colon + 1});
+    } else return false;
+    i++;
+  }
+  if (o.outputs.empty()) o.outputs.push_back("text");
+  return (o.device != nullptr) != (o.spawn != nullptr) && o.cmdRate > 0 && o.maxSpeed > 0;
+}
+
+static speed_t baudConstant(int baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return 0;
+  }
+}
+
+static bool makeRaw(int fd, speed_t speed) {
+  termios t;
+  if (tcgetattr(fd, &t) < 0) return false;
+  cfmakeraw(&t);
+  t.c_cflag |= CLOCAL | CREAD;
+  t.c_cc[VMIN] = 1;
+  t.c_cc[VTIME] = 0;
+  if (speed) {
+    cfsetispeed(&t, speed);
+    cfsetospeed(&t, speed);
+  }
+  return tcsetattr(fd, TCSANOW, &t) == 0;
+}
+
+static int openDevice(const char *path, int baud) {
+  speed_t speed = baudConstant(baud);
+  if (!speed) {
+    fprintf(stderr, "unsupported baud rate %d\n", baud);
+    return -1;
+  }
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  if (!makeRaw(fd, speed)) {
+    perror("tcsetattr");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Runs cmd with a pseudo terminal as its stdin and stdout; returns the
+// master side
+static int spawnOnPty(const char *cmd, pid_t &child) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("posix_openpt");
+    return -1;
+  }
+  std::string slaveName = ptsname(master);
+  child = fork();
+  if (child < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (child == 0) {
+    setsid();
+    int slave = open(slaveName.c_str(), O_RDWR);
+    if (slave < 0) _exit(127);
+    makeRaw(slave, 0);
+    dup2(slave, 0);
+    dup2(slave, 1);
+    if (slave > 1) close(slave);
+    close(master);
+    execl("/bin/sh", "sh", "-c", cmd, (char *)nullptr);
+    _exit(127);
+  }
+  // Raw on the master side too, so nothing echoes back into the ring
+  makeRaw(master, 0);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  return master;
+}
+
+static int openCommandSocket(int port) {
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (fd < 0) return -1;
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// ---------------- Velocity commands ----------------
+
+static const char *const forwardedCommands[] = {
+  "SET_V", "MALL", "FWD", "BACK", "LEFT", "RIGHT", "STOP"
+};
+
+static bool isForwarded(const std::string &line) {
+  for (const char *c : forwardedCommands) {
+    size_t n = strlen(c);
+    if (line.compare(0, n, c) == 0 && (line.size() == n || line[n] == ' ')) return true;
+  }
+  return false;
+}
+
+static int clampPwm(double pwm) {
+  return (int)std::max(-255.0, std::min(255.0, std::round(pwm)));
+}
+
+// Skid steer: each side runs at v -+ w * track / 2
+static std::string twistToSetV(double linearX, double angularZ, double maxSpeed) {
+  double left = linearX - angularZ * TRACK_WIDTH / 2;
+  double right = linearX + angularZ * TRACK_WIDTH / 2;
+  char buf[32];
+  snprintf(buf, sizeof(buf), "SET_V %d %d", clampPwm(left / maxSpeed * 255),
+           clampPwm(right / maxSpeed * 255));
+  return buf;
+}
+
+// Newest command wins; the rest are counted as coalesced
+struct CommandGate {
+  double minInterval;
+  double timeout;
+  std::string pending;
+  double lastSent = -1e9;
+  double lastReceived = 0;
+  bool moving = false;
+  unsigned long received = 0, sent = 0, coalesced = 0, deadman = 0;
+
+  void offer(const std::string &command, double now) {
+    received++;
+    lastReceived = now;
+    if (!pending.empty()) coalesced++;
+    pending = command;
+  }
+
+  // The command to write now, if any
+  std::string poll(double now) {
+    std::string out;
+    if (!pending.empty() && (pending == "STOP" || now - lastSent >= minInterval)) {
+      out.swap(pending);
+    } else if (pending.empty() && moving && timeout > 0 && now - lastReceived > timeout) {
+      out = "STOP";
+      deadman++;
+    }
+    if (!out.empty()) {
+      lastSent = now;
+      moving = out != "STOP";
+      sent++;
+    }
+    return out;
+  }
+};
+
+// ---------------- Serial link ----------------
+
+struct Link {
+  int fd = -1;
+  int epfd = -1;
+  std::string txQueue;
+  bool wantWrite = false;
+  UcapWriter capture;
+  unsigned long lines = 0, odom = 0, sens = 0, ready = 0, other = 0, bad = 0, overlong = 0;
+  unsigned long rxBytes = 0, txBytes = 0;
+
+  void updateInterest() {
+    bool want = !txQueue.empty();
+    if (want == wantWrite) return;
+    wantWrite = want;
+    epoll_event ev;
+    ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+  }
+
+  void flush() {
+    while (!txQueue.empty()) {
+      ssize_t n = write(fd, txQueue.data(), txQueue.size());
+      if (n <= 0) break;
+      txBytes += n;
+      if (capture.isOpen()) capture.add(captureUs(), UCAP_TO_MEGA, txQueue.data(), n);
+      txQueue.erase(0, n);
+    }
+    updateInterest();
+  }
+
+  void send(const std::string &command) {
+    txQueue += command;
+    txQueue += "\r\n";
+    flush();
+  }
+};
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseArgs(argc, argv, opt)) {
+    fprintf(stderr, "usage: %s (--device PATH [--baud B] | --spawn CMD)\n"
+                    "  [--out text|udp:HOST:PORT|ros:HOST:PORT|shm:NAME]...\n"
+                    "  [--cmd-port P] [--cmd-rate HZ] [--cmd-timeout S] [--max-speed M/S]\n"
+                    "  [--send-at S:COMMAND]... [--duration S]\n"
+                    "  [--expect-odom-hz HZ] [--expect-distance M] [--capture FILE]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<std::unique_ptr<BridgeOutput>> outputs;
+  for (const std::string &spec : opt.outputs) {
+    std::string error;
+    std::unique_ptr<BridgeOutput> out = bridgeOutputOpen(spec, error);
+    if (!out) {
+      fprintf(stderr, "--out %s: %s\n", spec.c_str(), error.c_str());
+      return 1;
+    }
+    outputs.push_back(std::move(out));
+  }
+
+  RxRing ring(RX_RING_BYTES);
+  if (!ring.ok()) {
+    perror("rx ring");
+    return 1;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  Link link;
+  pid_t child = -1;
+  link.fd = opt.spawn ? spawnOnPty(opt.spawn, child) : openDevice(opt.device, opt.baud);
+  if (link.fd < 0) return 1;
+  captureStart = monoSeconds();
+  if (opt.capture && !link.capture.open(opt.capture, UCAP_CLOCK_HOST, opt.baud, (uint32_t)realSeconds())) {
+    perror(opt.capture);
+    return 1;
+  }
+
+  int cmdFd = openCommandSocket(opt.cmdPort);
+  if (cmdFd < 0) {
+    fprintf(stderr, "command port %d: %s\n", opt.cmdPort, strerror(errno));
+    return 1;
+  }
+
+  // 10 ms tick for the rate limiter, the deadman and --send-at
+  int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  itimerspec tick;
+  tick.it_interval.tv_sec = 0;
+  tick.it_interval.tv_nsec = 10 * 1000 * 1000;
+  tick.it_value = tick.it_interval;
+  timerfd_settime(timerFd, 0, &tick, nullptr);
+
+  link.epfd = epoll_create1(0);
+  int fds[3] = {link.fd, cmdFd, timerFd};
+  for (int fd : fds) {
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(link.epfd, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  CommandGate gate;
+  gate.minInterval = 1.0 / opt.cmdRate;
+  gate.timeout = opt.cmdTimeout;
+  std::sort(opt.sendAt.begin(), opt.sendAt.end(),
+            [](const ScriptedCommand &a, const ScriptedCommand &b) { return a.at < b.at; });
+  size_t nextScripted = 0;
+
+  BridgeState state;
+  memset(&state, 0, sizeof(state));
+  double distance = 0;
+  double firstOdom = -1, lastOdom = -1;
+  double decodeSeconds = 0;
+  bool linkClosed = false;
+  bool linkChecked = false;
+
+  const double start = monoSeconds();
+  // The Mega answers with READY (and announces itself after a reset)
+  link.send("HELLO");
+  while (!stopRequested && !linkClosed) {
+    double now = monoSeconds() - start;
+    if (opt.duration > 0 && now >= opt.duration) break;
+
+    epoll_event events[8];
+    int n = epoll_wait(link.epfd, events, 8, 100);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    for (int e = 0; e < n; e++) {
+      int fd = events[e].data.fd;
+
+      if (fd == link.fd) {
+        if (events[e].events & EPOLLOUT) link.flush();
+        if (!(events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) continue;
+        ssize_t got;
+        for (;;) {
+          char *at = ring.data() + ring.available();
+          if ((got = ring.fill(link.fd)) <= 0) break;
+          link.rxBytes += got;
+          if (link.capture.isOpen()) link.capture.add(captureUs(), UCAP_FROM_MEGA, at, got);
+        }
+        // A pty master reads EIO once the child has gone
+        if (got == 0 && ring.available() < ring.size()) linkClosed = true;
+        if (got < 0 && errno != EAGAIN && errno != EINTR) linkClosed = true;
+
+        double t0 = monoSeconds();
+        double hostTime = realSeconds();
+        char *p = ring.data();
+        size_t avail = ring.available();
+        char *nl;
+        while ((nl = (char *)memchr(p, '\n', avail)) != nullptr) {
+          size_t len = nl - p;
+          *nl = '\0';
+          if (len > 0 && p[len - 1] == '\r') p[len - 1] = '\0';
+          link.lines++;
+          OdomLine o;
+          SensLine s;
+          if (!strncmp(p, "ODOM ", 5)) {
+            if (parseOdom(p, o)) {
+              bridgeApplyOdom(state, o, hostTime, BRIDGE_TICKS_PER_REV);
+              distance += (fabs(o.distL) + fabs(o.distR)) / 2;
+              link.odom++;
+              lastOdom = monoSeconds() - start;
+              if (firstOdom < 0) firstOdom = lastOdom;
+              for (auto &out : outputs) out->publish(state);
+            } else {
+              link.bad++;
+            }
+          } else if (!strncmp(p, "SENS ", 5)) {
+            if (parseSens(p, s)) {
+              bridgeApplySens(state, s);
+              link.sens++;
+            } else {
+              link.bad++;
+            }
+          } else if (!strncmp(p, "READY", 5)) {
+            link.ready++;
+          } else {
+            link.other++;
+          }
+          ring.consume(len + 1);
+          p = nl + 1;
+          avail -= len + 1;
+        }
+        if (avail >= MAX_LINE) {
+          ring.consume(avail);
+          link.overlong++;
+        }
+        decodeSeconds += monoSeconds() - t0;
+
+      } else if (fd == cmdFd) {
+        uint8_t buf[512];
+        ssize_t got;
+        while ((got = recv(cmdFd, buf, sizeof(buf), 0)) > 0) {
+          double linearX, angularZ;
+          if (rosParseTwist(buf, got, linearX, angularZ)) {
+            gate.offer(twistToSetV(linearX, angularZ, opt.maxSpeed), now);
+            continue;
+          }
+          std::string line((const char *)buf, got);
+          while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+          if (isForwarded(line)) gate.offer(line, now);
+          else fprintf(stderr, "ignored command: %s\n", line.c_str());
+        }
+
+      } else if (fd == timerFd) {
+        uint64_t expirations;
+        while (read(timerFd, &expirations, sizeof(expirations)) > 0) {}
+      }
+    }
+
+    now = monoSeconds() - start;
+    if (!linkChecked && now >= LINK_CHECK_S) {
+      linkChecked = true;
+      if (!link.ready && !link.odom && !link.sens) {
+        fprintf(stderr, "%s: no READY, ODOM or SENS line in %.0f s (%lu other lines); the Mega's "
+                        "link is Serial2 (pins 16/17), not its USB port\n",
+                opt.spawn ? opt.spawn : opt.device, LINK_CHECK_S, link.other);
+      }
+    }
+    while (nextScripted < opt.sendAt.size() && opt.sendAt[nextScripted].at <= now) {
+      link.send(opt.sendAt[nextScripted++].command);
+    }
+    std::string command = gate.poll(now);
+    if (!command.empty()) link.send(command);
+  }
+
+  // Leave the robot stopped
+  if (gate.moving && !linkClosed) {
+    link.send("STOP");
+    usleep(50000);
+  }
+  if (child > 0) {
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+  }
+  close(timerFd);
+  close(cmdFd);
+  close(link.epfd);
+  close(link.fd);
+  link.capture.close();
+
+  double odomSpan = lastOdom - firstOdom;
+  double odomHz = link.odom > 1 && odomSpan > 0 ? (link.odom - 1) / odomSpan : 0;
+  fprintf(stderr, "lines %lu: odom %lu, sens %lu, ready %lu, other %lu, bad %lu, overlong %lu\n",
+          link.lines, link.odom, link.sens, link.ready, link.other, link.bad, link.overlong);
+  fprintf(stderr, "rx %lu bytes, tx %lu bytes; decode and publish %.1f us per line\n", link.rxBytes,
+          link.txBytes, link.lines ? decodeSeconds * 1e6 / link.lines : 0.0);
+  fprintf(stderr, "commands: received %lu, sent %lu, coalesced %lu, deadman stops %lu\n",
+          gate.received, gate.sent, gate.coalesced, gate.deadman);
+  fprintf(stderr, "odom %.2f Hz; pose x %.3f y %.3f theta %.3f; driven %.3f m\n", odomHz,
+          state.x, state.y, state.theta, distance);
+
+  bool pass = true;
+  if (opt.expectOdomHz >= 0 && odomHz < opt.expectOdomHz) {
+    fprintf(stderr, "FAIL: odom %.2f Hz, expected %.2f\n", odomHz, opt.expectOdomHz);
+    pass = false;
+  }
+  if (opt.expectDistance >= 0 && distance < opt.expectDistance) {
+    fprintf(stderr, "FAIL: drove %.3f m, expected %.3f\n", distance, opt.expectDistance);
+    pass = false;
+  }
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/* ucap_dump
+   Lists a UART capture (serial_bridge --capture, or the simulator's
+   --uart-capture) as text: one row per line sent in either direction, with
+   the time its last byte was seen. Non-printable bytes are shown as \xNN.
+
+   Usage: ucap_dump [--raw] [--stats] capture.ucap
+          --raw    one row per record instead of per line
+          --stats  only the totals: bytes and lines each way, the busiest
+                   second, and the file size per captured byte
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "uart_capture.h"
+
+static const char *dirName(UcapDir dir) {
+  return dir == UCAP_TO_MEGA ? "->mega" : "<-mega";
+}
+
+static std::string escaped(const uint8_t *p, size_t n) {
+  std::string out;
+  for (size_t i = 0; i < n; i++) {
+    if (p[i] >= 0x20 && p[i] < 0x7F && p[i] != '\\') {
+      out += (char)p[i];
+    } else {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\x%02x", p[i]);
+      out += buf;
+    }
+  }
+  return out;
+}
+
+int main(int argc, char **argv) {
+  const char *path = nullptr;
+  bool raw = false, statsOnly = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--raw")) raw = true;
+    else if (!strcmp(argv[i], "--stats")) statsOnly = true;
+    else if (argv[i][0] != '-') path = argv[i];
+    else {
+      path = nullptr;
+      break;
+    }
+  }
+  if (!path) {
+    fprintf(stderr, "usage: %s [--raw] [--stats] capture.ucap\n", argv[0]);
+    return 2;
+  }
+
+  UcapReader reader;
+  if (!reader.open(path)) {
+    fprintf(stderr, "%s: not a UART capture\n", path);
+    return 1;
+  }
+  const UcapHeader &h = reader.header();
+  printf("# %s clock, %u baud\n", h.clock == UCAP_CLOCK_SIM ? "sim" : "host", h.baud);
+
+  unsigned long bytes[2] = {0, 0}, lines[2] = {0, 0}, records = 0;
+  unsigned long secondBytes = 0, busiestBytes = 0;
+  uint64_t second = 0, busiest = 0, lastUs = 0;
+  std::string partial[2];
+  UcapRecord r;
+  while (reader.next(r)) {
+    records++;
+    bytes[r.dir] += r.len;
+    lastUs = r.us;
+    if (r.us / 1000000 != second) {
+      second = r.us / 1000000;
+      secondBytes = 0;
+    }
+    secondBytes += r.len;
+    if (secondBytes > busiestBytes) {
+      busiestBytes = secondBytes;
+      busiest = second;
+    }
+
+    if (raw && !statsOnly) {
+      printf("%12.6f %s %s\n", r.us / 1e6, dirName(r.dir), escaped(r.data, r.len).c_str());
+    }
+    for (size_t i = 0; i < r.len; i++) {
+      uint8_t c = r.data[i];
+      if (c == '\r') continue;
+      if (c != '\n') {
+        partial[r.dir] += (char)c;
+        continue;
+      }
+      lines[r.dir]++;
+      if (!raw && !statsOnly) {
+        printf("%12.6f %s %s\n", r.us / 1e6, dirName(r.dir),
+               escaped((const uint8_t *)partial[r.dir].data(), partial[r.dir].size()).c_str());
+      }
+      partial[r.dir].clear();
+    }
+  }
+
+  long fileBytes = 0;
+  FILE *f = fopen(path, "rb");
+  if (f) {
+    fseek(f, 0, SEEK_END);
+    fileBytes = ftell(f);
+    fclose(f);
+  }
+  unsigned long total = bytes[0] + bytes[1];
+  printf("# %.3f s, %lu records; to the Mega %lu bytes in %lu lines, from it %lu bytes in %lu lines\n",
+         lastUs / 1e6, records, bytes[UCAP_TO_MEGA], lines[UCAP_TO_MEGA], bytes[UCAP_FROM_MEGA],
+         lines[UCAP_FROM_MEGA]);
+  printf("# busiest second %lu: %lu bytes; file %.2f bytes per captured byte\n", (unsigned long)busiest,
+         busiestBytes, total ? (double)fileBytes / total : 0.0);
+  return 0;
+}
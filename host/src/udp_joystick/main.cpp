@@ -0,0 +1,178 @@
+/* udp_joystick
+   Test client for the ESP's UDP joystick port. Sends JoyPackets at a fixed
+   rate, optionally dropping, reordering or backdating some of them, and
+   reports what the robot accepted plus the ack round trip time.
+
+   Usage: udp_joystick [--host 192.168.4.1] [--port 4210] [--rate 50]
+                       [--duration 10] [--left 120] [--right 120]
+                       [--loss 0.1] [--reorder 0.05] [--stale 0.05]
+                       [--stale-ms 500] [--silence-after 5] [--no-deadman]
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "joy_protocol.h"
+
+struct Options {
+  const char *host = "192.168.4.1";
+  int port = JOY_UDP_PORT;
+  double rate = 50;
+  double duration = 10;
+  int left = 120, right = 120;
+  double loss = 0, reorder = 0, stale = 0;
+  int staleMs = 500;
+  double silenceAfter = -1;
+  bool deadman = true;
+};
+
+static uint64_t nowUs() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool parseArgs(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (!strcmp(a, "--no-deadman")) { o.deadman = false; continue; }
+    if (!v) return false;
+    if (!strcmp(a, "--host")) o.host = v;
+    else if (!strcmp(a, "--port")) o.port = atoi(v);
+    else if (!strcmp(a, "--rate")) o.rate = atof(v);
+    else if (!strcmp(a, "--duration")) o.duration = atof(v);
+    else if (!strcmp(a, "--left")) o.left = atoi(v);
+    else if (!strcmp(a, "--right")) o.right = atoi(v);
+    else if (!strcmp(a, "--loss")) o.loss = atof(v);
+    else if (!strcmp(a, "--reorder")) o.reorder = atof(v);
+    else if (!strcmp(a, "--stale")) o.stale = atof(v);
+    else if (!strcmp(a, "--stale-ms")) o.staleMs = atoi(v);
+    else if (!strcmp(a, "--silence-after")) o.silenceAfter = atof(v);
+    else return false;
+    i++;
+  }
+  return o.rate > 0;
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseArgs(argc, argv, opt)) {
+    fprintf(stderr, "usage: %s [--host H] [--port P] [--rate HZ] [--duration S]\n"
+                    "  [--left V] [--right V] [--loss P] [--reorder P] [--stale P]\n"
+                    "  [--stale-ms MS] [--silence-after S] [--no-deadman]\n", argv[0]);
+    return 2;
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) { perror("socket"); return 1; }
+  sockaddr_in dst;
+  memset(&dst, 0, sizeof(dst));
+  dst.sin_family = AF_INET;
+  dst.sin_port = htons(opt.port);
+  if (inet_pton(AF_INET, opt.host, &dst.sin_addr) != 1) {
+    fprintf(stderr, "bad host address: %s\n", opt.host);
+    return 1;
+  }
+  if (connect(fd, (sockaddr *)&dst, sizeof(dst)) < 0) { perror("connect"); return 1; }
+
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+
+  // Send time per sequence number, indexed by the 16-bit seq itself
+  std::vector<uint64_t> sentAt(65536, 0);
+  std::vector<double> rttMs;
+  unsigned long sent = 0, skipped = 0, reordered = 0, backdated = 0;
+  unsigned long acks[3] = {0, 0, 0};
+
+  const uint64_t start = nowUs();
+  const uint64_t period = (uint64_t)(1e6 / opt.rate);
+  const uint64_t sendUntil = start + (uint64_t)(opt.duration * 1e6);
+  const uint64_t silenceAt = opt.silenceAfter >= 0
+      ? start + (uint64_t)(opt.silenceAfter * 1e6) : sendUntil;
+  uint64_t nextSend = start;
+  uint16_t seq = 0;
+  bool holding = false;
+  JoyPacket held;
+
+  auto transmit = [&](const JoyPacket &p) {
+    sentAt[p.seq] = nowUs();
+    send(fd, &p, sizeof(p), 0);
+    sent++;
+  };
+
+  // Keep listening for half a second after the last send for late acks
+  while (nowUs() < sendUntil + 500000) {
+    uint64_t t = nowUs();
+    if (t >= nextSend && t < sendUntil) {
+      nextSend += period;
+      if (t < silenceAt) {
+        JoyPacket p;
+        p.magic = JOY_MAGIC;
+        p.flags = opt.deadman ? JOY_FLAG_DEADMAN : 0;
+        p.seq = seq++;
+        p.sentMs = (uint32_t)((t - start) / 1000);
+        p.left = opt.left;
+        p.right = opt.right;
+
+        if (uni(rng) < opt.stale) {
+          p.sentMs -= opt.staleMs;
+          backdated++;
+        }
+        if (uni(rng) < opt.loss) {
+          skipped++;
+        } else if (!holding && uni(rng) < opt.reorder) {
+          held = p;            // goes out after the next packet
+          holding = true;
+          reordered++;
+        } else {
+          transmit(p);
+          if (holding) { transmit(held); holding = false; }
+        }
+      }
+    }
+
+    int waitMs = 0;
+    if (nextSend > t) waitMs = (int)((nextSend - t) / 1000);
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, std::min(waitMs, 50)) > 0) {
+      JoyAck ack;
+      while (recv(fd, &ack, sizeof(ack), MSG_DONTWAIT) == (ssize_t)sizeof(ack)) {
+        if (ack.magic != JOY_ACK_MAGIC || ack.status > JOY_DROP_STALE) continue;
+        acks[ack.status]++;
+        if (sentAt[ack.seq]) {
+          rttMs.push_back((nowUs() - sentAt[ack.seq]) / 1000.0);
+          sentAt[ack.seq] = 0;
+        }
+      }
+    }
+  }
+  close(fd);
+
+  unsigned long acked = acks[0] + acks[1] + acks[2];
+  printf("sent %lu (skipped %lu, reordered %lu, backdated %lu)\n",
+         sent, skipped, reordered, backdated);
+  printf("acked %lu: accepted %lu, out-of-order %lu, stale %lu, no ack %lu\n",
+         acked, acks[JOY_ACCEPTED], acks[JOY_DROP_ORDER], acks[JOY_DROP_STALE],
+         sent > acked ? sent - acked : 0);
+  if (!rttMs.empty()) {
+    std::sort(rttMs.begin(), rttMs.end());
+    double sum = 0;
+    for (double r : rttMs) sum += r;
+    auto pct = [&](double q) { return rttMs[(size_t)(q * (rttMs.size() - 1))]; };
+    printf("rtt ms: min %.2f avg %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f\n",
+           rttMs.front(), sum / rttMs.size(), pct(0.5), pct(0.95), pct(0.99),
+           rttMs.back());
+  }
+  return 0;
+}
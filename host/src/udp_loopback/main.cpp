@@ -0,0 +1,136 @@
+/* udp_loopback
+   Stand-in for the ESP's UDP joystick port, for testing clients without
+   hardware. Applies the same drop and timeout rules as the firmware
+   (joy_filter.h), acks every packet, and prints the M commands the ESP
+   would forward to the Mega. Optional loss and delay emulate a bad link.
+
+   Usage: udp_loopback [--bind 127.0.0.1] [--port 4210] [--timeout 300]
+                       [--max-age 150] [--loss 0.1] [--delay 20] [--jitter 40]
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+
+#include "joy_filter.h"
+
+struct Pending {
+  unsigned long releaseMs;
+  JoyPacket pkt;
+  sockaddr_in from;
+};
+
+static volatile sig_atomic_t running = 1;
+static void onSignal(int) { running = 0; }
+
+static unsigned long nowMs() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+  const char *bindAddr = "127.0.0.1";
+  int port = JOY_UDP_PORT;
+  unsigned long timeoutMs = 300, maxAgeMs = 150, delayMs = 0, jitterMs = 0;
+  double loss = 0;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *a = argv[i], *v = argv[i + 1];
+    if (!strcmp(a, "--bind")) bindAddr = v;
+    else if (!strcmp(a, "--port")) port = atoi(v);
+    else if (!strcmp(a, "--timeout")) timeoutMs = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--max-age")) maxAgeMs = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--loss")) loss = atof(v);
+    else if (!strcmp(a, "--delay")) delayMs = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--jitter")) jitterMs = strtoul(v, nullptr, 10);
+    else {
+      fprintf(stderr, "unknown option %s\n", a);
+      return 2;
+    }
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) { perror("socket"); return 1; }
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, bindAddr, &addr.sin_addr) != 1) {
+    fprintf(stderr, "bad bind address: %s\n", bindAddr);
+    return 1;
+  }
+  if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) { perror("bind"); return 1; }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  printf("listening on %s:%d (timeout %lu ms, max age %lu ms)\n",
+         bindAddr, port, timeoutMs, maxAgeMs);
+  fflush(stdout);
+
+  JoyFilter filter(timeoutMs, maxAgeMs);
+  std::deque<Pending> queue;
+  std::mt19937 rng(54321);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  unsigned long received = 0, lost = 0;
+  int curLeft = 0, curRight = 0;
+
+  auto drive = [&](int l, int r, const char *why) {
+    if (l == curLeft && r == curRight) return;
+    curLeft = l;
+    curRight = r;
+    printf("%8lu ms  {\"cmd\":\"M\",\"args\":[%d,%d,%d,%d,1]}%s\n",
+           nowMs(), l, r, l, r, why);
+    fflush(stdout);
+  };
+
+  while (running) {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 5) > 0) {
+      Pending p;
+      socklen_t len = sizeof(p.from);
+      ssize_t n = recvfrom(fd, &p.pkt, sizeof(p.pkt), 0, (sockaddr *)&p.from, &len);
+      if (n == (ssize_t)sizeof(p.pkt) && p.pkt.magic == JOY_MAGIC) {
+        received++;
+        if (uni(rng) < loss) {
+          lost++;
+        } else {
+          p.releaseMs = nowMs() + delayMs + (unsigned long)(uni(rng) * jitterMs);
+          queue.push_back(p);
+        }
+      }
+    }
+
+    // Jitter can release packets out of order, which is the point
+    unsigned long now = nowMs();
+    for (auto it = queue.begin(); it != queue.end();) {
+      if (it->releaseMs > now) { ++it; continue; }
+      int l = curLeft, r = curRight;
+      JoyAck ack;
+      ack.magic = JOY_ACK_MAGIC;
+      ack.status = filter.accept(it->pkt, now, l, r);
+      ack.seq = it->pkt.seq;
+      ack.sentMs = it->pkt.sentMs;
+      if (ack.status == JOY_ACCEPTED) drive(l, r, "");
+      sendto(fd, &ack, sizeof(ack), 0, (sockaddr *)&it->from, sizeof(it->from));
+      it = queue.erase(it);
+    }
+
+    if (filter.expired(now)) drive(0, 0, "  <- link timeout");
+  }
+
+  printf("received %lu, lost %lu, out-of-order %lu, stale %lu, timeouts %lu\n",
+         received, lost, filter.droppedOrder, filter.droppedStale, filter.timeouts);
+  close(fd);
+  return 0;
+}
@@ -6,4 +6,9 @@
 void processLine(String line);
 void handleSerialCommands(String &rxBuf);
 
+// READY to the ESP at the end of setup(), then repeated from loop() until
+// the ESP's first line arrives
+void announceReady();
+void processLinkAnnounce();
+
 #endif // COMMAND_PARSER_H
@@ -4,14 +4,21 @@
 #include <Arduino.h>
 
 // ---------------- USER CONFIG ----------------
+#if defined(BENCH)
+// Benchmarks (bench/) time the formatting, not the UART
+#include "bench_sink.h"
+#define DEBUG_SERIAL      benchSink
+#define RADIO_SERIAL      benchSink
+#else
 #define DEBUG_SERIAL      Serial      // USB serial
 #define RADIO_SERIAL      Serial2     // UART2: pins 16(TX2)/17(RX2) - ESP8266 connection
+#endif
 
 // Motor driver pins - Mixed setup
 // Front motors: TB6612 | Rear motors: L298N
 
 // Motor 1 (Front Left) - TB6612
-#define M1_PWM   3
+#define M1_PWM   7    // was 3; pin 3 now carries encoder 4's interrupt
 #define M1_IN1   22
 #define M1_IN2   23
 
@@ -43,17 +50,87 @@
 #define ENC3_A_PIN 19
 #define ENC3_B_PIN 32
 
-#define ENC4_A_PIN 20
+#define ENC4_A_PIN 3     // was 20; 20/21 are the I2C bus (SDA/SCL) for the IMU
 #define ENC4_B_PIN 33
 
+// IMU - MPU-6050 on I2C (SDA=20, SCL=21)
+#define MPU_I2C_ADDR  0x68
+#define MPU_INT_PIN   A8      // PCINT16: no external interrupt pins left
+const unsigned long I2C_CLOCK_HZ = 400000;
+const int IMU_SAMPLE_HZ = 200;
+const int IMU_BIAS_SAMPLES = 200;   // gyro bias averaged at boot; keep the robot still
+
+// Sensors (sensor_manager.cpp): sampled by the free-running ADC
+#define BATTERY_ADC_PIN  A0     // through a divider, see BATTERY_DIVIDER
+#define M1_CURRENT_PIN   A1     // ACS712-5A current sensors, one per motor
+#define M2_CURRENT_PIN   A2
+#define M3_CURRENT_PIN   A3
+#define M4_CURRENT_PIN   A4
+
+// HC-SR04 ultrasonic; echo on ICP5 (Timer5 input capture), so Timer5's
+// PWM pins 44-46 can't be used with analogWrite
+#define US_TRIG_PIN      47
+#define US_ECHO_PIN      48
+
+const float BATTERY_DIVIDER = 3.0;          // Vbat / Vadc (20k over 10k)
+const float CURRENT_SENSE_V_PER_A = 0.185;  // ACS712-5A, zero at 2.5 V
+const int SENSOR_ADC_AVG = 16;              // samples averaged per frame (power of two)
+const unsigned long RANGE_PERIOD_MS = 60;   // ultrasonic ping interval
+
+// Safety cutoff (safety.cpp), checked inside the sensor interrupts.
+// SAFE_RANGE / SAFE_CURRENT change the limits at runtime; 0 turns one off.
+const uint16_t SAFETY_RANGE_MM = 250;       // refuse forward motion closer than this
+const uint16_t SAFETY_RANGE_HYST_MM = 50;   // released this much further out
+const uint8_t SAFETY_RANGE_NO_ECHO = 5;     // pings in a row with no echo at all also block (~0.3 s)
+const uint16_t SAFETY_CURRENT_MA = 2000;    // per motor
+const uint16_t SAFETY_CURRENT_MS = 100;     // must last this long; rides out start-up inrush
+
+// Motion queue (motion_queue.cpp)
+const uint8_t MOTION_QUEUE_LEN = 16;        // primitives per uploaded maneuver
+
+// Waypoint follower (pursuit.cpp), PWM units like SET_V
+const uint8_t PURSUIT_MAX_WAYPOINTS = 24;
+const int PURSUIT_LOOKAHEAD_MM = 250;
+const int PURSUIT_ARRIVE_MM = 50;       // last waypoint counts as reached inside this
+const int PURSUIT_SLOW_MM = 300;        // speed ramps down over the last stretch
+const int PURSUIT_MIN_PWM = 70;         // clear of the motor deadband
+const int PURSUIT_TURN_PWM = 120;       // turning on the spot when the goal is behind
+
+// Body twist (twist.cpp): TWIST <vx mm/s> <wz mrad/s>
+const int TWIST_FULL_SCALE_MMPS = 900;  // wheel speed at PWM 255 when no calibration table is in use
+const float TWIST_KP = 0.5;             // closed loop (TWIST_MODE 1), on the v and w errors
+const float TWIST_KI = 2.0;             // per second
+
+// Motor calibration (motor_calibration.cpp): CAL_MOTORS sweep timing
+const int CAL_EEPROM_ADDR = 0;
+const unsigned long CAL_SETTLE_MS = 400;       // per PWM step before timing starts
+const unsigned long CAL_WINDOW_MIN_MS = 250;
+const unsigned long CAL_WINDOW_MAX_MS = 1500;  // slow steps give up here
+const long CAL_MIN_TICKS = 20;
+
+// Flight recorder (flight_recorder.cpp): 14-byte samples in SRAM
+const uint16_t REC_SAMPLES = 160;           // 160 ms at 1 kHz; REC_ARM can sample slower
+
 // Physical constants (adjust to match your robot)
 const float WHEEL_RADIUS = 0.0425;  // meters
 const float GEAR_RATIO = 1.0;       // gearbox ratio if encoder before gear
 const int PULSES_PER_REV = 11;      // encoder CPR (check datasheet)
 const float PI_F = 3.141592653589793;
 const float DIST_PER_TICK = (2.0 * PI_F * WHEEL_RADIUS) / (PULSES_PER_REV * GEAR_RATIO);
+const float TRACK_WIDTH = 0.19;     // meters, effective skid-steer track (wider than wheel spacing)
+
+// Link bring-up (command_parser.cpp): READY is repeated with backoff until
+// the ESP is heard from
+const uint8_t LINK_PROTOCOL = 1;
+const unsigned long LINK_ANNOUNCE_FIRST_MS = 50;   // gap after the first READY; doubles
+const unsigned long LINK_ANNOUNCE_MAX_MS = 2000;
 
 // Odometry update interval
 const unsigned long ODOM_MS = 200;
 
+// Pose filter (pose_ekf.cpp)
+const unsigned long EKF_MS = 20;            // filter step
+const unsigned long EKF_BUDGET_US = 2500;   // per-step budget; longer steps are counted as overruns
+const float EKF_SLIP_M = 0.05;              // wheel travel disagreeing with the filter that flags slip
+
 #endif // CONFIG_H
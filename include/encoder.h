@@ -10,6 +10,6 @@ void ISR_enc1();
 void ISR_enc2();
 void ISR_enc3();
 void ISR_enc4();
-void resetEncoderCounts(long &c1, long &c2, long &c3, long &c4);
+void readEncoderCounts(long &c1, long &c2, long &c3, long &c4);
 
 #endif // ENCODER_H
@@ -0,0 +1,37 @@
+#ifndef FIXED_MATH_H
+#define FIXED_MATH_H
+
+#include <Arduino.h>
+
+// Fixed-point helpers shared by the pose filter and the path follower.
+// Angles are Q24 radians; products go through a 32x32->64 multiply
+// (__mulsidi3 on the AVR) and are shifted back down.
+typedef int32_t fix;
+
+#define Q16(f) ((fix)((f) * 65536.0))
+#define Q24(f) ((fix)((f) * 16777216.0))
+#define Q28(f) ((fix)((f) * 268435456.0))
+
+const fix PI_Q24 = 52707179;
+
+static inline fix mulq(fix a, fix b, uint8_t shift) {
+  return (fix)(((int64_t)a * b) >> shift);
+}
+
+static inline fix wrapAngle(fix a) {
+  if (a > PI_Q24) a -= 2 * PI_Q24;
+  else if (a < -PI_Q24) a += 2 * PI_Q24;
+  return a;
+}
+
+// Binary angle: 65536 = full turn
+static inline uint16_t angleToBam(fix theta) {
+  return (uint16_t)(((int64_t)theta * 2670177) >> 32);   // 65536 / 2pi, Q8
+}
+
+int16_t sinBam(uint16_t bam);            // Q15
+static inline int16_t cosBam(uint16_t bam) { return sinBam(bam + 0x4000); }
+
+uint32_t isqrt32(uint32_t v);            // floor(sqrt(v))
+
+#endif // FIXED_MATH_H
@@ -0,0 +1,76 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <Arduino.h>
+
+// Flight recorder: samples encoder deltas, applied PWM and loop timing into
+// an SRAM ring at up to 1 kHz while armed. A trigger (REC_TRIG, a fault,
+// or a safety trip) lets it run on for the post-trigger samples and then
+// freezes the ring, keeping what led up to the event. REC_DUMP sends the
+// frozen ring as one binary block; host/src/rec_decode turns it into CSV.
+//
+// Dump block, little-endian, as the AVR lays out the structs below:
+//   RecHeader, RecHeader.count RecSamples (oldest first), uint16 checksum
+// The checksum is the Fletcher-16 of the header and samples, sent as sum1
+// then sum2. REC_DUMP announces the block with a "REC DUMP <bytes>" line.
+
+enum RecTrigger : uint8_t {
+  REC_TRIG_COMMAND = 0x01,   // REC_TRIG
+  REC_TRIG_FAULT = 0x02,     // encoder jump, missed sample period, IMU FIFO/bus error
+  REC_TRIG_SAFETY = 0x04     // obstacle or current trip
+};
+
+enum RecFlags : uint8_t {
+  REC_FLAG_FWD_BLOCKED = 0x01,   // safety obstacle block active
+  REC_FLAG_ENC_CLIPPED = 0x02,   // an encoder delta didn't fit in int8
+  REC_FLAG_TRIGGER = 0x04        // the trigger landed in this sample
+};
+
+const uint8_t REC_MAGIC0 = 'F';
+const uint8_t REC_MAGIC1 = 'R';
+const uint8_t REC_VERSION = 1;
+
+struct __attribute__((packed)) RecHeader {
+  uint8_t magic[2];
+  uint8_t version;
+  uint8_t sampleBytes;       // sizeof(RecSample)
+  uint16_t count;            // samples in the block
+  uint16_t triggerIndex;     // sample the trigger landed in; count if none
+  uint16_t periodUs;
+  uint8_t triggerSource;     // RecTrigger, 0 if stopped with REC_STOP
+  uint8_t reserved;
+  uint32_t triggerMs;        // millis() at the trigger
+};
+
+struct __attribute__((packed)) RecSample {
+  uint16_t loopUs;           // longest loop() pass since the previous sample
+  uint16_t lateUs;           // how long after its due time the sample was taken
+  int8_t dEnc[4];            // encoder ticks since the previous sample, M1..M4
+  uint8_t pwm[4];            // applied PWM magnitude, M1..M4
+  uint8_t dir;               // bits 0..3: wheel driven in reverse; bits 4..7: wheel held by safety
+  uint8_t flags;             // RecFlags
+};
+
+enum RecState : uint8_t {
+  REC_IDLE,        // nothing recorded yet
+  REC_ARMED,       // filling the ring, waiting for a trigger
+  REC_TRIGGERED,   // recording the post-trigger samples
+  REC_FROZEN       // ring holds a finished recording
+};
+
+struct RecorderStatus {
+  RecState state;
+  uint16_t count;            // samples in the ring
+  uint16_t periodUs;
+  uint8_t triggerSource;
+  uint16_t triggerIndex;
+};
+
+void processRecorder();      // call from loop() every pass
+bool recorderArm(uint16_t periodMs, uint16_t postSamples, uint8_t triggerMask);
+bool recorderTrigger(RecTrigger source);   // false unless armed for that source
+void recorderStop();         // freeze now, keeping the samples
+bool recorderDump();         // writes the block to RADIO_SERIAL; false if nothing frozen
+void recorderGetStatus(RecorderStatus &out);
+
+#endif // FLIGHT_RECORDER_H
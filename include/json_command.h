@@ -0,0 +1,89 @@
+#ifndef JSON_COMMAND_H
+#define JSON_COMMAND_H
+
+#include <Arduino.h>
+
+// JSON commands, as the ESP sketch (esp_Code/) sends them:
+//   {"cmd":"SET_V","args":[120,-80]}      args as an array of scalars,
+//   {"cmd":"SET_V","args":"120 -80"}      as one string,
+//   {"cmd":"FWD","args":150}              as a single value,
+//   {"cmd":"PING","id":17}                or left out; "id" traces it
+// They run through the same commands as the ASCII lines.
+//
+// The tokenizer works in place on the received line: no heap and no
+// copies. Scalars are NUL-terminated where they lie (strings unescaped in
+// place), so a token's text is just json + start. Tokens come in document
+// order; an object's keys have the object as parent and each value has its
+// key as parent.
+
+enum JsonType : uint8_t {
+  JSON_OBJECT = 1,
+  JSON_ARRAY,
+  JSON_STRING,
+  JSON_PRIMITIVE             // number, true, false, null
+};
+
+const uint8_t JSON_NO_PARENT = 0xFF;
+const uint8_t JSON_MAX_TOKENS = 16;   // {"cmd":..,"args":[..],"id":..} with up to 10 args
+
+const int8_t JSON_ERR_INVALID = -1;
+const int8_t JSON_ERR_TOKENS = -2;    // more than max tokens
+const int8_t JSON_ERR_PARTIAL = -3;   // ends inside a string or container
+
+struct JsonToken {
+  uint8_t type;              // JsonType
+  uint8_t start;             // offset of the text (after the quote for strings)
+  uint8_t size;              // containers: keys or elements; primitives: length
+  uint8_t parent;            // token index, JSON_NO_PARENT at the top
+};
+
+// Token count, or a JSON_ERR_*. json must be NUL-terminated, at most 255 chars.
+int8_t jsonTokenize(char *json, JsonToken *tokens, uint8_t maxTokens);
+
+// Index of the value of key in the top-level object, -1 if it isn't there
+int8_t jsonFind(const char *json, const JsonToken *tokens, uint8_t count, const char *key);
+
+// Walks a command's "args" value one argument at a time, like strtok()
+// walks an ASCII line. true/false come out as "1"/"0".
+struct JsonArgs {
+  char *json;
+  const JsonToken *tokens;
+  uint8_t count;
+  int8_t value;              // the args token, -1 for none
+  uint8_t next;
+};
+
+// false if args is an object or holds an array or object
+bool jsonArgsBegin(JsonArgs &a, char *json, const JsonToken *tokens, uint8_t count, int8_t value);
+char *jsonArgsNext(JsonArgs &a);   // NULL after the last
+
+// Turns the ASCII reply lines written to it into JSON objects, one per
+// line, streamed to out as the characters arrive:
+//   OK SET_V                  {"resp":"ACK","type":"SET_V"}
+//   ERR SET_V params          {"resp":"ERROR","msg":"SET_V params"}
+//   STATUS motors=1 ...       {"resp":"STATUS","motors":1,...}
+//   EKF 12 0 410 3            {"resp":"EKF","v":[12,0,410,3]}
+// Numbers go out bare, other words as strings.
+class JsonReply : public Print {
+public:
+  explicit JsonReply(Print &out) : out_(out), state_(HEAD), len_(0), arrayOpen_(false) {}
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+private:
+  enum State : uint8_t { HEAD, TEXT, WORDS, LONG_WORD };
+  static const uint8_t WORD_MAX = 24;
+
+  void endHead();
+  void endWord();
+  void endLine();
+  void writeEscaped(char c);
+
+  Print &out_;
+  State state_;
+  uint8_t len_;
+  bool arrayOpen_;           // "v":[ written and not closed yet
+  char word_[WORD_MAX];
+};
+
+#endif // JSON_COMMAND_H
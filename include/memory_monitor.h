@@ -0,0 +1,25 @@
+#ifndef MEMORY_MONITOR_H
+#define MEMORY_MONITOR_H
+
+#include <Arduino.h>
+
+// SRAM high-water marks. At boot the free space between the heap and the
+// stack is painted with a fixed byte; REQ_MEM later scans for how far the
+// paint has been worn away from either side. The heap top is also sampled
+// every loop() pass. Static sizes come from scripts/memory_budget.py at
+// build time; this only covers what changes at run time.
+
+struct MemoryStatus {
+  uint16_t staticBytes;      // .data + .bss
+  uint16_t heapBytes;        // heap in use now (String, etc.)
+  uint16_t heapMaxBytes;
+  uint16_t stackBytes;       // stack depth at the REQ_MEM handler
+  uint16_t stackMaxBytes;
+  uint16_t freeMinBytes;     // never-touched gap between heap and stack
+};
+
+void initializeMemoryMonitor();   // call first in setup()
+void processMemoryMonitor();      // call from loop()
+void memoryGetStatus(MemoryStatus &out);
+
+#endif // MEMORY_MONITOR_H
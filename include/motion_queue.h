@@ -0,0 +1,39 @@
+#ifndef MOTION_QUEUE_H
+#define MOTION_QUEUE_H
+
+#include <Arduino.h>
+
+// On-board motion sequencer. The ESP uploads a maneuver as a batch of
+// primitives, each with a start time relative to Q_RUN and a duration, and
+// the Mega plays it back from its own clock, so link jitter only delays the
+// start of the whole sequence. Any direct motion command cancels playback.
+
+enum MotionType : uint8_t {
+  MOTION_VEL,     // a = left, b = right, as SET_V
+  MOTION_TURN,    // a = speed, positive turns left (CCW)
+  MOTION_STOP
+};
+
+struct MotionPrimitive {
+  unsigned long startMs;   // from Q_RUN
+  uint16_t durationMs;     // 0: until the next one starts; the last is stopped at once
+  MotionType type;
+  int16_t a, b;
+};
+
+struct MotionQueueStatus {
+  bool running;
+  uint8_t count;
+  uint8_t next;                  // index of the next primitive to start
+  unsigned long elapsedMs;
+  unsigned long maxLateUs;       // worst start delay in the last run
+};
+
+void processMotionQueue();       // call from loop()
+bool motionQueueAdd(const MotionPrimitive &p);   // false if full or out of order
+void motionQueueRun();
+void motionQueueClear();         // empties the queue; stops the motors if it was running
+void motionQueueCancel();        // stops playback, leaves the motors alone
+void motionQueueGetStatus(MotionQueueStatus &out);
+
+#endif // MOTION_QUEUE_H
@@ -0,0 +1,40 @@
+#ifndef MOTOR_CALIBRATION_H
+#define MOTOR_CALIBRATION_H
+
+#include <Arduino.h>
+
+// Per-wheel, per-direction PWM -> speed tables. CAL_MOTORS sweeps every
+// wheel through a PWM ladder (robot on a stand), measures steady-state
+// encoder speed at each step and stores the tables in EEPROM. While a
+// valid table is in use, setM1..setM4 treat their argument as a fraction
+// of the speed every wheel can reach (255 = the slowest wheel's top speed)
+// and pick each wheel's PWM from its table, which removes the deadband
+// and evens out the drivers' gains.
+
+const uint8_t CAL_POINTS = 12;            // PWM ladder: 255 * (i + 1) / CAL_POINTS
+
+struct MotorCalTable {
+  uint16_t magic;
+  uint8_t points;
+  uint8_t reserved;
+  int16_t mmps[4][2][CAL_POINTS];         // wheel, forward/reverse, speed at each step
+  uint16_t checksum;
+};
+
+void initializeMotorCalibration();        // loads the table from EEPROM
+void processMotorCalibration();           // runs the sweep; call from loop()
+bool motorCalibrationStart();
+void motorCalibrationAbort();             // stops the motors
+bool motorCalibrationRunning();
+bool motorCalibrationValid();
+void motorCalibrationUse(bool on);
+bool motorCalibrationInUse();
+int motorCalibrationRefMmps(bool reverse);   // what a command of 255 asks for; 0 when not in use
+void sendMotorCalibration(Print &out);
+
+// Called by motor_control.cpp: command (-255..255, wheel-forward positive) -> PWM
+int motorLinearize(uint8_t wheel, int command);
+// Feed-forward PWM for a wheel surface speed; 0 without a valid table
+int motorFeedForward(uint8_t wheel, int mmps);
+
+#endif // MOTOR_CALIBRATION_H
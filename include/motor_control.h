@@ -19,5 +19,18 @@ void setMotorL298N(int enPin, int in1, int in2, int speed);
 int clamp255(long v);
 void enableMotors();
 void disableMotors();
+bool motorsEnabled();                      // TB6612 standby released
+
+// Safety interlock, callable from interrupts. Wheels are bits 0..3 for M1..M4.
+void motorInhibit(uint8_t wheelMask);     // coast now and hold at zero
+void motorRelease(uint8_t wheelMask);     // accept commands again; wheels stay stopped
+uint8_t motorInhibited();
+void motorBlockForward(bool on);          // coast forward-turning wheels, refuse forward commands
+bool motorForwardBlocked();
+
+// Signed PWM each wheel is driven at after the interlock, wheel-forward positive
+void motorGetOutputs(int16_t out[4]);
+// micros() when setM1..setM4 last wrote the pins
+unsigned long motorLastOutputUs();
 
 #endif // MOTOR_CONTROL_H
@@ -0,0 +1,43 @@
+#ifndef MPU_DMP_H
+#define MPU_DMP_H
+
+#include <Arduino.h>
+
+// MPU-6050 reader. The INT pin (data ready) starts an interrupt-driven TWI
+// chain that burst-reads the hardware FIFO; samples go into a lock-free
+// ring that processImu() drains from loop().
+
+// One FIFO sample in raw sensor units
+struct ImuSample {
+  unsigned long timeUs;
+  int16_t accel[3];
+  int16_t gyro[3];
+};
+
+struct ImuStats {
+  unsigned long samples;         // read out of the MPU FIFO
+  unsigned long fifoOverflows;   // MPU FIFO filled up and was reset
+  unsigned long ringStalls;      // ring full; samples left in the MPU FIFO
+  unsigned long busErrors;       // NACKs, arbitration loss, bus watchdog
+  unsigned long busBytes;        // FIFO payload bytes read
+};
+
+bool initializeImu();
+void processImu();
+bool imuReady();
+float imuYawRate();                  // rad/s, CCW positive, bias removed
+// Mean yaw rate of the samples since the last call, in rad/s Q24 without
+// float math; false if none arrived
+bool imuTakeYawRate(int32_t &rateQ24);
+float imuHeading();                  // rad, -pi..pi
+void imuGetQuaternion(float q[4]);   // w, x, y, z
+void imuGetStats(ImuStats &out);
+void mpuIntPinChanged();             // pin-change interrupt body
+
+#if defined(BENCH)
+// Benchmarks have no MPU: takes s as read from the FIFO, bias calibration
+// done, so the pose filter runs its gyro update
+void imuBenchSample(const ImuSample &s);
+#endif
+
+#endif // MPU_DMP_H
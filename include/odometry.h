@@ -2,10 +2,12 @@
 #define ODOMETRY_H
 
 #include <Arduino.h>
+#include "pose_ekf.h"
 
 void sendOdomPacket(unsigned long now, unsigned long dt,
                     long d1, long d2, long d3, long d4,
-                    float distL, float distR, float vL, float vR);
+                    float distL, float distR, float vL, float vR,
+                    const PoseEstimate &pose);
 
 void processOdometry(unsigned long &lastOdomMillis);
 
@@ -0,0 +1,34 @@
+#ifndef POSE_EKF_H
+#define POSE_EKF_H
+
+#include <Arduino.h>
+
+// Planar pose filter in fixed point. The state is heading, forward speed,
+// yaw rate and residual gyro bias; x/y are integrated from it. All four
+// encoders are fused separately with the gyro, and a wheel whose travel
+// disagrees with the other three is flagged as slipping and left out
+// until it agrees again.
+
+struct PoseEstimate {
+  float x, y;          // m since power-on
+  float theta;         // rad, -pi..pi, CCW positive
+  float v;             // m/s forward
+  float w;             // rad/s CCW
+  uint8_t slipMask;    // bit i set: wheel M(i+1) slipping
+};
+
+struct EkfStats {
+  unsigned long steps;
+  unsigned long overruns;      // steps longer than EKF_BUDGET_US
+  unsigned long maxStepUs;
+  unsigned long slipEvents;    // a wheel went from gripping to slipping
+};
+
+void initializePoseEkf();
+bool updatePoseEkf();                  // call from loop(); steps every EKF_MS, true if it did
+void getPoseEstimate(PoseEstimate &out);
+void getPoseFixed(int32_t &xQ16, int32_t &yQ16, int32_t &thetaQ24);   // m Q16, rad Q24
+void getVelocityFixed(int32_t &vQ24, int32_t &wQ24);                  // m/s, rad/s Q24
+void getEkfStats(EkfStats &out);
+
+#endif // POSE_EKF_H
@@ -0,0 +1,27 @@
+#ifndef PURSUIT_H
+#define PURSUIT_H
+
+#include <Arduino.h>
+
+// Waypoint follower. Waypoints in millimetres, in the same frame as the
+// ODOM x/y fields, are kept on the Mega and followed with pure pursuit on
+// the fused pose, one steering update per pose filter step. WP lines
+// report each waypoint passed and the end of the path. Any direct motion
+// command cancels it.
+
+struct PursuitStatus {
+  bool running;
+  uint8_t count;
+  uint8_t target;          // waypoint being steered to
+  int32_t distMm;          // to the target
+  int32_t crossTrackMm;    // off the current segment, left positive
+};
+
+void processPursuit();                     // call right after a pose filter step
+bool pursuitAdd(int16_t xMm, int16_t yMm); // false when full
+bool pursuitRun(int speed);                // false with no waypoints
+void pursuitClear();                       // empties the list; stops the motors if it was running
+void pursuitCancel();                      // stops steering, leaves the motors alone
+void pursuitGetStatus(PursuitStatus &out);
+
+#endif // PURSUIT_H
@@ -0,0 +1,42 @@
+#ifndef SAFETY_H
+#define SAFETY_H
+
+#include <Arduino.h>
+
+// Safety cutoff that doesn't wait for the ESP. The sensor interrupts hand
+// every ultrasonic reading and every motor-current conversion to the
+// checks below, which stop the affected wheels through motor_control
+// before returning. Trips are reported from loop() as TRIP lines.
+//
+//   obstacle closer than the range limit: forward commands are refused and
+//   forward-turning wheels coast; reversing is allowed. Released once an
+//   echo shows the range opened up by SAFETY_RANGE_HYST_MM, or nothing in
+//   range (RANGE_CLEAR). Pings without any echo count as blind: they never
+//   release, and SAFETY_RANGE_NO_ECHO in a row block forward motion as an
+//   obstacle would.
+//
+//   motor current over the limit for the trip time: that wheel coasts and
+//   stays held until SAFE_CLEAR.
+
+struct SafetyStatus {
+  uint16_t rangeLimitMm;       // 0: off
+  uint16_t currentLimitMa;     // 0: off
+  uint16_t currentTripMs;
+  bool forwardBlocked;
+  uint8_t inhibitMask;         // bit i: motor M(i+1) held
+  unsigned long obstacleTrips;
+  unsigned long currentTrips;
+};
+
+void initializeSafety();
+void processSafety();                    // sends TRIP lines; call from loop()
+void safetySetRangeLimit(uint16_t mm);
+void safetySetCurrentLimit(uint16_t mA, uint16_t tripMs);
+void safetyClear();                      // releases current trips
+void safetyGetStatus(SafetyStatus &out);
+
+// Called from the sensor_manager.cpp interrupts
+void safetyCheckRange(uint16_t mm);                   // 0: no echo, RANGE_CLEAR: nothing in range
+void safetyCheckCurrent(uint8_t wheel, uint16_t raw); // wheel 0..3, raw ADC counts
+
+#endif // SAFETY_H
@@ -0,0 +1,41 @@
+#ifndef SENSOR_MANAGER_H
+#define SENSOR_MANAGER_H
+
+#include <Arduino.h>
+
+// Non-blocking sensor sampling. The ADC runs free, interrupt-driven, over
+// the channel list below and the ultrasonic echo is timed by Timer5 input
+// capture. Averaged values are published as frames into a double buffer,
+// so readers always get a complete, consistent frame without stopping the
+// sampling. Don't call analogRead() or pulseIn() elsewhere: the ADC and
+// Timer5 belong to this module.
+
+enum SensorChannel {
+  SENSOR_BATTERY,
+  SENSOR_CURRENT_M1,
+  SENSOR_CURRENT_M2,
+  SENSOR_CURRENT_M3,
+  SENSOR_CURRENT_M4,
+  SENSOR_ADC_CHANNELS
+};
+
+// An echo held for the sensor's full timeout: the path is clear out to ~4.3 m
+const uint16_t RANGE_CLEAR = 0xFFFF;
+
+struct SensorFrame {
+  uint8_t seq;                          // increments per frame, never 0
+  unsigned long timeUs;                 // when the frame was completed
+  uint16_t adc[SENSOR_ADC_CHANNELS];    // raw 0..1023, averaged
+  uint16_t rangeMm;                     // 0: no echo, RANGE_CLEAR: nothing in range
+  unsigned long rangeTimeUs;            // when rangeMm was measured
+};
+
+void initializeSensors();
+void processSensors();                  // fires the ultrasonic ping; call from loop()
+bool sensorsGetFrame(SensorFrame &out); // false until the first frame
+float sensorBatteryVolts(const SensorFrame &f);
+float sensorMotorAmps(const SensorFrame &f, uint8_t motor);   // motor 1..4
+void sendSensorPacket(Print &out);
+unsigned long sensorFrameCount();
+
+#endif // SENSOR_MANAGER_H
@@ -0,0 +1,34 @@
+#ifndef TWI_ASYNC_H
+#define TWI_ASYNC_H
+
+#include <Arduino.h>
+
+// Interrupt-driven I2C master on the AVR TWI peripheral. One transfer at a
+// time: an optional write phase, then an optional read phase after a
+// repeated start. The callback runs in interrupt context when it ends.
+
+// TWSR status codes (same values as <util/twi.h>)
+#define TWI_ST_START          0x08
+#define TWI_ST_REP_START      0x10
+#define TWI_ST_MT_SLA_ACK     0x18
+#define TWI_ST_MT_SLA_NACK    0x20
+#define TWI_ST_MT_DATA_ACK    0x28
+#define TWI_ST_MT_DATA_NACK   0x30
+#define TWI_ST_ARB_LOST       0x38
+#define TWI_ST_MR_SLA_ACK     0x40
+#define TWI_ST_MR_SLA_NACK    0x48
+#define TWI_ST_MR_DATA_ACK    0x50
+#define TWI_ST_MR_DATA_NACK   0x58
+
+typedef void (*TwiCallback)(bool ok);
+
+void twiInit(unsigned long clockHz);
+bool twiBusy();
+bool twiTransfer(uint8_t addr, const uint8_t *tx, uint8_t txLen,
+                 uint8_t *rx, uint8_t rxLen, TwiCallback done);
+bool twiTransferBlocking(uint8_t addr, const uint8_t *tx, uint8_t txLen,
+                         uint8_t *rx, uint8_t rxLen);
+void twiReset();
+void twiInterrupt();
+
+#endif // TWI_ASYNC_H
@@ -0,0 +1,49 @@
+#ifndef TWIST_H
+#define TWIST_H
+
+#include <Arduino.h>
+
+// Body twist -> wheel speeds, in integer math. TWIST <vx> <wz> (mm/s,
+// mrad/s CCW) becomes left/right wheel surface speeds v -+ w * track / 2
+// for the skid-steer body. When the faster side would pass full scale both
+// sides are scaled by the same factor, so the curvature w / v is kept and
+// only the speed along the arc drops.
+//
+// Open loop, the speeds go to setM1..setM4 as a fraction of full scale
+// (through the calibration tables when they are in use). Closed loop, a PI
+// on the pose filter's v and w trims the twist every filter step before
+// the same conversion. Any other motion command cancels it.
+
+enum TwistMode : uint8_t {
+  TWIST_OPEN_LOOP,
+  TWIST_CLOSED_LOOP
+};
+
+struct WheelSpeeds {
+  int16_t left, right;     // mm/s, M1/M3 and M2/M4
+  bool saturated;          // scaled down to fit
+};
+
+struct TwistStatus {
+  bool running;
+  TwistMode mode;
+  uint16_t trackMm;
+  int16_t fullScaleMmps;
+  WheelSpeeds wheels;      // last sent
+  int16_t vMmps;           // pose filter estimate
+  int16_t wMradps;
+};
+
+// The kinematics alone: speeds for (vx, wz) with neither side past limit,
+// which is an int16 speed (0 < limitMmps < 32768)
+void twistToWheels(int32_t vxMmps, int32_t wzMradps, uint16_t trackMm, int32_t limitMmps,
+                   WheelSpeeds &out);
+
+void processTwist();                       // call right after a pose filter step
+void twistSet(int vxMmps, int wzMradps);   // 0 0 stops
+bool twistSetTrack(uint16_t mm);           // false outside 50..2000
+void twistSetMode(TwistMode mode);
+void twistCancel();                        // stops steering, leaves the motors alone
+void twistGetStatus(TwistStatus &out);
+
+#endif // TWIST_H
@@ -0,0 +1,211 @@
+"""Runs the firmware microbenchmarks (bench/) and checks them against a
+stored baseline.
+
+As a PlatformIO extra script (env:bench and env:bench_avr) it adds two
+targets:
+
+    pio run -e bench -t bench             run, write bench.json, compare
+    pio run -e bench -t bench_baseline    run and store bench/baseline_bench.json
+
+env:bench runs the native program; env:bench_avr runs firmware.elf under
+simavr (tool-simavr). Results go to $BUILD_DIR/bench.json. The comparison
+takes these options from platformio.ini:
+
+    custom_bench_stat = median        (or min, steadier for wall clock times)
+    custom_bench_threshold = 10       (percent slower that fails the run)
+    custom_bench_noise = 0            (differences up to this many units pass)
+    custom_bench_thresholds =         (optional, one "<case prefix> <percent>" per line)
+        processLine/REQ_IMU 25
+    custom_bench_budgets =            (optional, one "<case prefix> <units>" per line:
+        updatePoseEkf/step 40000       a hard limit, baseline or not)
+
+It also runs on its own:
+
+    python3 scripts/bench.py compare results.json|output.log baseline.json
+                             [--stat median] [--threshold 10] [--noise 0]
+                             [--case prefix=percent ...] [--budget prefix=units ...]
+    python3 scripts/bench.py parse output.log > results.json
+"""
+
+import json
+import os
+import re
+import subprocess
+import sys
+
+LINE = re.compile(r"BENCH (\{.*\})")
+ANSI = re.compile(r"\x1b\[[0-9;]*m")
+
+
+def parse_output(text):
+    """BENCH lines from the program (or simavr's UART echo) to one document:
+    {"target", "unit", "reps", "overhead", "results": {name: {min, median, max}}}"""
+    doc = {"results": {}}
+    ended = False
+    for line in text.splitlines():
+        m = LINE.search(ANSI.sub("", line))
+        if not m:
+            continue
+        # simavr shows control characters (the line end) as dots
+        record = json.loads(m.group(1).rstrip("."))
+        if "name" in record:
+            doc["results"][record.pop("name")] = record
+        elif "end" in record:
+            ended = True
+        else:
+            doc.update(record)
+    if not ended:
+        raise ValueError("benchmark output ends early (no BENCH end line)")
+    return doc
+
+
+def load(path):
+    with open(path) as f:
+        text = f.read()
+    try:
+        return json.loads(text)
+    except ValueError:
+        return parse_output(text)
+
+
+def parse_thresholds(text):
+    cases = {}
+    for line in (text or "").replace(",", "\n").splitlines():
+        parts = line.replace("=", " ").split()
+        if len(parts) == 2:
+            cases[parts[0]] = float(parts[1])
+    return cases
+
+
+def threshold_for(name, default, cases):
+    best = None
+    for prefix, pct in cases.items():
+        if name.startswith(prefix) and (best is None or len(prefix) > len(best)):
+            best = prefix
+    return cases[best] if best is not None else default
+
+
+def compare(current, baseline, threshold=10.0, noise=0.0, cases=None, stat="median", out=sys.stdout,
+            budgets=None):
+    """Prints the table; returns a list of regressions and cases over budget."""
+    cases = cases or {}
+    budgets = budgets or {}
+    unit = current.get("unit", "")
+    if baseline.get("unit") not in (None, unit):
+        return ["baseline is in %s, results in %s" % (baseline.get("unit"), unit)]
+    base = baseline.get("results", {})
+    out.write("%-30s %10s %10s %8s  (%s, %s)\n" % ("case", "baseline", "now", "change", unit, stat))
+    errors = []
+    for name, r in sorted(current.get("results", {}).items()):
+        now = r[stat]
+        budget = threshold_for(name, None, budgets)
+        if budget is not None and r["max"] > budget:
+            out.write("%-30s %10s %10d %8s  OVER BUDGET %g\n" % (name, "max", r["max"], "", budget))
+            errors.append("%s: max %d %s, budget %g" % (name, r["max"], unit, budget))
+        if name not in base:
+            out.write("%-30s %10s %10d %8s\n" % (name, "-", now, "new"))
+            continue
+        was = base[name][stat]
+        change = (now - was) * 100.0 / was if was else 0.0
+        limit = threshold_for(name, threshold, cases)
+        slower = now - was > noise and change > limit
+        out.write("%-30s %10d %10d %+7.1f%%%s\n" % (name, was, now, change, "  REGRESSION" if slower else ""))
+        if slower:
+            errors.append("%s: %d -> %d %s (%+.1f%%, limit %g%%)" % (name, was, now, unit, change, limit))
+    for name in sorted(set(base) - set(current.get("results", {}))):
+        out.write("%-30s %10d %10s %8s\n" % (name, base[name][stat], "-", "gone"))
+    return errors
+
+
+def main(argv):
+    if len(argv) >= 3 and argv[1] == "parse":
+        with open(argv[2]) as f:
+            json.dump(parse_output(f.read()), sys.stdout, indent=1, sort_keys=True)
+        sys.stdout.write("\n")
+        return 0
+    if len(argv) < 4 or argv[1] != "compare":
+        sys.stderr.write(__doc__)
+        return 2
+    threshold, noise, cases, budgets, stat = 10.0, 0.0, {}, {}, "median"
+    args = argv[4:]
+    while args:
+        opt = args.pop(0)
+        if opt == "--threshold":
+            threshold = float(args.pop(0))
+        elif opt == "--stat":
+            stat = args.pop(0)
+        elif opt == "--noise":
+            noise = float(args.pop(0))
+        elif opt == "--case":
+            cases.update(parse_thresholds(args.pop(0)))
+        elif opt == "--budget":
+            budgets.update(parse_thresholds(args.pop(0)))
+        else:
+            sys.stderr.write("unknown option %s\n" % opt)
+            return 2
+    errors = compare(load(argv[2]), load(argv[3]), threshold, noise, cases, stat, budgets=budgets)
+    for e in errors:
+        sys.stderr.write("bench: %s\n" % e)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
+else:
+    Import("env")  # noqa: F821 - provided by PlatformIO's SCons
+
+    env_name = env.subst("$PIOENV")  # noqa: F821
+    project_dir = env.subst("$PROJECT_DIR")  # noqa: F821
+    results_path = os.path.join(env.subst("$BUILD_DIR"), "bench.json")  # noqa: F821
+    baseline_path = os.path.join(project_dir, "bench", "baseline_%s.json" % env_name)
+
+    def _option(name, default):
+        value = str(env.GetProjectOption(name, "")).strip()  # noqa: F821
+        return float(value) if value else default
+
+    def _command():
+        if env.subst("$PIOPLATFORM") == "native":  # noqa: F821
+            return [env.subst("$BUILD_DIR/${PROGNAME}")]  # noqa: F821
+        simavr = os.path.join(env.PioPlatform().get_package_dir("tool-simavr") or "", "bin", "simavr")  # noqa: F821
+        return [simavr, "-m", "atmega2560", "-f", "16000000", env.subst("$BUILD_DIR/${PROGNAME}.elf")]  # noqa: F821
+
+    def _run():
+        proc = subprocess.run(_command(), stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                              universal_newlines=True, timeout=600)
+        doc = parse_output(proc.stdout)
+        with open(results_path, "w") as f:
+            json.dump(doc, f, indent=1, sort_keys=True)
+        return doc
+
+    def _bench(target, source, env):
+        doc = _run()
+        # Budgets hold with or without a baseline
+        baseline = {}
+        if os.path.exists(baseline_path):
+            with open(baseline_path) as f:
+                baseline = json.load(f)
+        else:
+            sys.stdout.write("bench: no %s yet; store one with -t bench_baseline\n" % baseline_path)
+        errors = compare(doc, baseline, _option("custom_bench_threshold", 10.0), _option("custom_bench_noise", 0.0),
+                         parse_thresholds(env.GetProjectOption("custom_bench_thresholds", "")),
+                         env.GetProjectOption("custom_bench_stat", "median") or "median",
+                         budgets=parse_thresholds(env.GetProjectOption("custom_bench_budgets", "")))
+        for e in errors:
+            sys.stderr.write("bench: %s\n" % e)
+        return 1 if errors else 0
+
+    def _baseline(target, source, env):
+        doc = _run()
+        with open(baseline_path, "w") as f:
+            json.dump(doc, f, indent=1, sort_keys=True)
+            f.write("\n")
+        sys.stdout.write("bench: stored %d results in %s\n" % (len(doc["results"]), baseline_path))
+        return 0
+
+    program = "$BUILD_DIR/${PROGNAME}" if env.subst("$PIOPLATFORM") == "native" else "$BUILD_DIR/${PROGNAME}.elf"  # noqa: F821
+    env.AddCustomTarget(  # noqa: F821
+        "bench", program, _bench,
+        title="Benchmarks", description="Run the microbenchmarks and compare with the stored baseline")
+    env.AddCustomTarget(  # noqa: F821
+        "bench_baseline", program, _baseline,
+        title="Benchmark baseline", description="Run the microbenchmarks and store the results as the baseline")
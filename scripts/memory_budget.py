@@ -0,0 +1,182 @@
+"""SRAM/flash budget report from the linker map.
+
+As a PlatformIO extra script (env:megaatmega2560) it asks the linker for a
+map file, prints the per-module table after every link and fails the build
+when a budget in platformio.ini is exceeded:
+
+    custom_ram_budget = 6144          (.data + .bss; the rest is heap and stack)
+    custom_flash_budget = 253952      (.text + .data initializers)
+    custom_module_ram_budgets =       (optional, one "<module> <bytes>" per line)
+        flight_recorder 2400
+
+`pio run -e megaatmega2560 -t mem_report` prints the table without relinking.
+
+It also runs on its own, e.g. on a map from another toolchain:
+
+    python3 scripts/memory_budget.py firmware.map [--ram N] [--flash N] [--module name=N ...]
+"""
+
+import os
+import re
+import sys
+from collections import OrderedDict
+
+# Output sections and what they cost. .data lives in RAM and its initial
+# values in flash; .bss and .noinit are RAM only.
+RAM_SECTIONS = (".data", ".bss", ".noinit")
+FLASH_SECTIONS = (".text", ".data")
+
+INPUT_LINE = re.compile(r"^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+INPUT_NAME_ONLY = re.compile(r"^ (\S+)\s*$")
+INPUT_CONT = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+OUTPUT_SECTION = re.compile(r"^(\.\S+)(\s|$)")
+
+
+def module_name(path):
+    """firmware.map object paths to a short name:
+    .pio/build/env/src/safety.cpp.o -> safety
+    .../libFrameworkArduino.a(HardwareSerial2.cpp.o) -> HardwareSerial2
+    """
+    m = re.search(r"\(([^)]+)\)\s*$", path)
+    name = os.path.basename(m.group(1) if m else path.strip())
+    for ext in (".o", ".obj", ".c", ".cpp", ".S"):
+        if name.endswith(ext):
+            name = name[: -len(ext)]
+    return name or "?"
+
+
+def parse_map(path):
+    """Returns {module: {".text": n, ".data": n, ".bss": n, ".noinit": n}}."""
+    usage = OrderedDict()
+    section = None
+    pending = None  # input section name whose address/size is on the next line
+    in_map = False
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_map:
+                in_map = line.startswith("Linker script and memory map")
+                continue
+            m = OUTPUT_SECTION.match(line)
+            if m:
+                name = m.group(1)
+                section = next((s for s in RAM_SECTIONS + FLASH_SECTIONS if name == s), None)
+                pending = None
+                continue
+            if section is None:
+                continue
+
+            size = obj = None
+            m = INPUT_LINE.match(line)
+            if m and not m.group(1).startswith("*"):
+                size, obj = int(m.group(3), 16), m.group(4)
+            elif pending:
+                m = INPUT_CONT.match(line)
+                if m:
+                    size, obj = int(m.group(2), 16), m.group(3)
+            pending = None
+            if size is None:
+                m = INPUT_NAME_ONLY.match(line)
+                if m and not m.group(1).startswith("*"):
+                    pending = m.group(1)
+                continue
+            if not size or obj.startswith("load address"):
+                continue
+            mod = usage.setdefault(module_name(obj), {s: 0 for s in (".text", ".data", ".bss", ".noinit")})
+            mod[section] += size
+    return usage
+
+
+def ram_of(u):
+    return u[".data"] + u[".bss"] + u[".noinit"]
+
+
+def flash_of(u):
+    return u[".text"] + u[".data"]
+
+
+def report(usage, ram_budget=None, flash_budget=None, module_budgets=None, out=sys.stdout):
+    """Prints the table; returns a list of budget violations."""
+    module_budgets = module_budgets or {}
+    rows = sorted(usage.items(), key=lambda kv: (-ram_of(kv[1]), -flash_of(kv[1])))
+    out.write("%-24s %7s %7s %7s %7s\n" % ("module", "flash", ".data", ".bss", "ram"))
+    total = {s: 0 for s in (".text", ".data", ".bss", ".noinit")}
+    for name, u in rows:
+        for s in total:
+            total[s] += u[s]
+        if ram_of(u) or flash_of(u) >= 256:
+            out.write("%-24s %7d %7d %7d %7d\n" % (name, flash_of(u), u[".data"], u[".bss"] + u[".noinit"], ram_of(u)))
+    out.write("%-24s %7d %7d %7d %7d\n" % ("total", flash_of(total), total[".data"],
+                                           total[".bss"] + total[".noinit"], ram_of(total)))
+
+    errors = []
+    if ram_budget is not None and ram_of(total) > ram_budget:
+        errors.append("static RAM %d bytes over the %d byte budget" % (ram_of(total), ram_budget))
+    if flash_budget is not None and flash_of(total) > flash_budget:
+        errors.append("flash %d bytes over the %d byte budget" % (flash_of(total), flash_budget))
+    for name, budget in module_budgets.items():
+        used = ram_of(usage[name]) if name in usage else 0
+        if used > budget:
+            errors.append("%s uses %d bytes of RAM, budget %d" % (name, used, budget))
+    if ram_budget is not None:
+        out.write("static RAM %d of %d budgeted bytes; %d left for heap and stack on an 8 KB Mega\n"
+                  % (ram_of(total), ram_budget, 8192 - ram_of(total)))
+    return errors
+
+
+def parse_module_budgets(text):
+    budgets = {}
+    for line in (text or "").replace(",", "\n").splitlines():
+        parts = line.replace("=", " ").split()
+        if len(parts) == 2:
+            budgets[parts[0]] = int(parts[1])
+    return budgets
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write(__doc__)
+        return 2
+    ram = flash = None
+    modules = {}
+    args = argv[2:]
+    while args:
+        opt = args.pop(0)
+        if opt == "--ram":
+            ram = int(args.pop(0))
+        elif opt == "--flash":
+            flash = int(args.pop(0))
+        elif opt == "--module":
+            modules.update(parse_module_budgets(args.pop(0)))
+        else:
+            sys.stderr.write("unknown option %s\n" % opt)
+            return 2
+    errors = report(parse_map(argv[1]), ram, flash, modules)
+    for e in errors:
+        sys.stderr.write("memory budget: %s\n" % e)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
+else:
+    Import("env")  # noqa: F821 - provided by PlatformIO's SCons
+
+    map_path = os.path.join(env.subst("$BUILD_DIR"), "firmware.map")  # noqa: F821
+    env.Append(LINKFLAGS=["-Wl,-Map," + map_path])  # noqa: F821
+
+    def _option(name):
+        value = env.GetProjectOption(name, "")  # noqa: F821
+        return int(value) if str(value).strip() else None
+
+    def _check(target, source, env):
+        errors = report(parse_map(map_path), _option("custom_ram_budget"), _option("custom_flash_budget"),
+                        parse_module_budgets(env.GetProjectOption("custom_module_ram_budgets", "")))
+        for e in errors:
+            sys.stderr.write("memory budget: %s\n" % e)
+        return 1 if errors else 0
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", _check)  # noqa: F821
+    env.AddCustomTarget(  # noqa: F821
+        "mem_report", "$BUILD_DIR/${PROGNAME}.elf", _check,
+        title="Memory budget", description="Per-module .data/.bss/flash from the linker map")
@@ -0,0 +1,249 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Native stand-in for the Arduino core: just enough of the API for the Mega
+// firmware in src/ to build and run on Linux against the simulated hardware
+// in sim.h. Time is virtual and only moves when the simulator advances it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <deque>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+// A type of its own, as on AVR, so F() strings only go where the core takes them
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+// Mega analog pins
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+#define A6 60
+#define A7 61
+#define A8 62
+#define A9 63
+#define A10 64
+#define A11 65
+#define A12 66
+#define A13 67
+#define A14 68
+#define A15 69
+
+#define SIM_NUM_PINS 70
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+int analogRead(uint8_t pin);
+
+// The simulator numbers external interrupts by pin
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interruptNum);
+void noInterrupts();
+void interrupts();
+
+// ---------------- String ----------------
+class String {
+public:
+  String(const char *s = "") : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  String(int v, unsigned char base = DEC) { fromLong(v, base); }
+  String(unsigned int v, unsigned char base = DEC) { fromULong(v, base); }
+  String(long v, unsigned char base = DEC) { fromLong(v, base); }
+  String(unsigned long v, unsigned char base = DEC) { fromULong(v, base); }
+  String(float v, unsigned char digits = 2) { fromDouble(v, digits); }
+  String(double v, unsigned char digits = 2) { fromDouble(v, digits); }
+
+  unsigned int length() const { return s_.size(); }
+  const char *c_str() const { return s_.c_str(); }
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+  bool reserve(unsigned int n) { s_.reserve(n); return true; }
+
+  String &operator=(const char *s) { s_ = s ? s : ""; return *this; }
+  String &operator+=(const String &o) { s_ += o.s_; return *this; }
+  String &operator+=(const char *s) { s_ += s; return *this; }
+  String &operator+=(char c) { s_ += c; return *this; }
+  bool concat(const char *s, unsigned int n) { s_.append(s, n); return true; }
+
+  bool operator==(const String &o) const { return s_ == o.s_; }
+  bool operator!=(const String &o) const { return s_ != o.s_; }
+  bool operator==(const char *o) const { return s_ == o; }
+  bool operator!=(const char *o) const { return s_ != o; }
+
+  bool startsWith(const String &p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String &p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const { return pos(s_.find(c, from)); }
+  int indexOf(const String &p, unsigned int from = 0) const { return pos(s_.find(p.s_, from)); }
+  int lastIndexOf(char c) const { return pos(s_.rfind(c)); }
+  String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) { unsigned int t = from; from = to; to = t; }
+    if (from >= s_.size()) return String();
+    return String(s_.substr(from, to - from));
+  }
+  long toInt() const { return atol(s_.c_str()); }
+  float toFloat() const { return atof(s_.c_str()); }
+  void toCharArray(char *buf, unsigned int size) const {
+    if (!size) return;
+    size_t n = s_.size() < size - 1 ? s_.size() : size - 1;
+    memcpy(buf, s_.data(), n);
+    buf[n] = 0;
+  }
+  void trim() {
+    size_t b = s_.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) { s_.clear(); return; }
+    size_t e = s_.find_last_not_of(" \t\r\n");
+    s_ = s_.substr(b, e - b + 1);
+  }
+  void toUpperCase() { for (auto &c : s_) c = toupper(c); }
+
+  friend String operator+(const String &a, const String &b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String &a, const char *b) { return String(a.s_ + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.s_); }
+
+private:
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  void fromLong(long v, unsigned char base) {
+    if (base == DEC) { s_ = std::to_string(v); return; }
+    fromULong((unsigned long)v, base);
+  }
+  void fromULong(unsigned long v, unsigned char base) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", v);
+    s_ = buf;
+  }
+  void fromDouble(double v, unsigned char digits) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, v);
+    s_ = buf;
+  }
+  std::string s_;
+};
+
+// ---------------- Print / Serial ----------------
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  size_t write(const uint8_t *buf, size_t n) { for (size_t i = 0; i < n; i++) write(buf[i]); return n; }
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t write(const char *buf, size_t n) { return write((const uint8_t *)buf, n); }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const __FlashStringHelper *s) { return write(reinterpret_cast<const char *>(s)); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(double v, int digits = 2) { return print(String(v, (unsigned char)digits)); }
+
+  // ESP8266 core extension; the ESP code in the sim build uses it
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) return 0;
+    return write(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+  }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(T v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+};
+
+// Sees every byte a port sends and everything injected into it
+typedef void (*SimSerialTap)(bool fromFirmware, const char *data, size_t len);
+
+class HardwareSerial : public Print {
+public:
+  HardwareSerial() : echo_(nullptr), tap_(nullptr), baud_(0) {}
+  void begin(unsigned long baud) { baud_ = baud; }
+  void end() {}
+  int available() { return (int)rx_.size(); }
+  int read() {
+    if (rx_.empty()) return -1;
+    uint8_t c = rx_.front();
+    rx_.pop_front();
+    return c;
+  }
+  int peek() { return rx_.empty() ? -1 : rx_.front(); }
+  void flush() {}
+  int availableForWrite() { return 63; }
+  bool hasRxError() { return false; }   // ESP8266 core
+  bool hasOverrun() { return false; }
+  size_t write(uint8_t c) override;
+  using Print::write;
+  operator bool() { return true; }
+
+  // Simulation side
+  // Bytes that arrive before begin() are lost, as with the UART receiver off
+  void simInject(const char *data, size_t len) {
+    if (tap_) tap_(false, data, len);
+    if (baud_) rx_.insert(rx_.end(), data, data + len);
+  }
+  void simInject(const char *line) { simInject(line, strlen(line)); }
+  std::string simTakeOutput() { std::string out; out.swap(tx_); return out; }
+  void simEcho(FILE *f) { echo_ = f; }
+  void simTap(SimSerialTap tap) { tap_ = tap; }
+  unsigned long simBaud() const { return baud_; }
+
+private:
+  std::deque<uint8_t> rx_;
+  std::string tx_;
+  FILE *echo_;
+  SimSerialTap tap_;
+  unsigned long baud_;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif // SIM_ARDUINO_H
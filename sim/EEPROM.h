@@ -0,0 +1,31 @@
+#ifndef SIM_EEPROM_H
+#define SIM_EEPROM_H
+
+#include <Arduino.h>
+
+// The Mega's 4 KB EEPROM. Starts erased (0xFF); with "--eeprom file" it
+// is loaded from and written through to that file, so it survives runs.
+class EEPROMClass {
+public:
+  uint8_t read(int idx);
+  void write(int idx, uint8_t val);
+  void update(int idx, uint8_t val) {
+    if (read(idx) != val) write(idx, val);
+  }
+  uint16_t length() { return 4096; }
+
+  template <typename T> T &get(int idx, T &t) {
+    uint8_t *p = (uint8_t *)&t;
+    for (size_t i = 0; i < sizeof(T); i++) p[i] = read(idx + i);
+    return t;
+  }
+  template <typename T> const T &put(int idx, const T &t) {
+    const uint8_t *p = (const uint8_t *)&t;
+    for (size_t i = 0; i < sizeof(T); i++) update(idx + i, p[i]);
+    return t;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // SIM_EEPROM_H
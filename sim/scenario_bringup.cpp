@@ -0,0 +1,277 @@
+// Bring-up scenario: power-on to the first turn of the wheels. The ESP end
+// runs the ESP's own link_handshake.cpp the way robot_comm.cpp does: a
+// HELLO from its setup() on and more with backoff, ENABLE when the link
+// comes up, and a page command held until then. Both sides power up at sim
+// time 0. The Mega's setup() runs after --boot-ms (sim_main.cpp) and the
+// ESP's after --esp-boot-ms; its access point and web server then take
+// --esp-ap-ms before loop() runs, and the page sends FWD 150 the moment the
+// web server answers. Bytes take their 10 bit times at 115200 baud, bytes
+// reaching a side that hasn't begun its UART are lost, and the ESP's
+// receive buffer holds 256 bytes until loop() reads it.
+//
+// --legacy plays the old setup() instead: delay(2000), ENABLE, then the
+// access point, and the page's command straight out. With the Mega booting
+// later than that (--boot-ms 2500) the page's FWD 150 reaches it before its
+// UART is on and is lost, so the wheels never turn. The ENABLE is lost as
+// well, which doesn't matter: initializeMotors() enables the motors at boot.
+//
+// Reported from power-on: the Mega's first READY, the ESP's link up, the
+// web server up, and the first actuation (MOTOR_STBY high and M1 driven).
+// Then the commands that arrived before the Mega's UART was on.
+//
+// --mega-reset-at resets the Mega on the wire while the link is up: its
+// output stops, and --mega-reboot-ms later the READY of a fresh boot
+// arrives, up_ms counting from the reset. That is sooner than
+// COMMAND_TIMEOUT_MS, so the link never drops; the ESP has to tell the
+// restart from the uptime alone and send ENABLE again. The firmware itself
+// runs on, since the simulator can't restart it.
+//
+//   --legacy                  the fixed-delay bring-up
+//   --esp-boot-ms 80          ESP setup() start (ROM and SDK boot)
+//   --esp-ap-ms 60            WiFi.softAP() and server.begin()
+//   --esp-loop-us 1000        ESP loop() period (delay(1) and handlers)
+//   --max-actuation-ms 500    fail if the wheels turn later than this, or never
+//   --mega-reset-at 2         reset the Mega at this time (s)
+//   --mega-reboot-ms 300      bootloader and setup() after that reset
+
+#include "sim.h"
+#include "config.h"
+#include "esp_config.h"
+#include "link_handshake.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static const double BYTE_US = 10 * 1e6 / 115200;
+static const uint64_t LINK_TICK_US = 20;           // one Mega loop() pass
+static const size_t ESP_RX_BYTES = 256;            // the core's receive buffer
+static const uint64_t LEGACY_DELAY_US = 2000000;   // delay(2000) in setupRobotCommunication()
+static const char *const PAGE_COMMAND = "FWD 150";
+
+struct WireByte {
+  double atUs;
+  char c;
+};
+
+static bool legacy;
+static uint64_t espBootUs, espApUs, espLoopUs;
+static double maxActuationMs;
+static uint64_t megaResetUs = SIM_NEVER, megaRebootUs;
+static bool megaRebooted;
+static std::string megaReadyLine;                 // the Mega's own READY, for the reboot's
+
+static double outFreeUs, backFreeUs;              // when each wire direction is idle again
+static std::deque<WireByte> backWire;             // Mega -> ESP, in flight
+static std::deque<char> espRx;                    // arrived, not yet read by the ESP
+static unsigned espRxDropped;
+static bool espUartOn;
+static std::string espLine;
+static std::string held;
+static uint64_t nextPollUs;
+
+static uint64_t megaReadyUs = SIM_NEVER, linkUpUs = SIM_NEVER, webUpUs = SIM_NEVER;
+static uint64_t pageSentUs = SIM_NEVER, actuationUs = SIM_NEVER;
+static int enablesSent, heldCommands;
+static std::vector<std::string> sentCommands;
+static std::string lostCommands;             // reached the Mega before its Serial2.begin()
+
+static uint32_t espMillis() {
+  return (uint32_t)((simNowUs() - espBootUs) / 1000);
+}
+
+static void deliverByte(void *ctx) {
+  char c = (char)(uintptr_t)ctx;
+  RADIO_SERIAL.simInject(&c, 1);
+}
+
+// Serial.println() + Serial.flush()
+static void espWrite(const std::string &line) {
+  double at = std::max((double)simNowUs(), outFreeUs);
+  for (char c : line + "\r\n") {
+    at += BYTE_US;
+    simSchedule((uint64_t)(at - simNowUs()), deliverByte, (void *)(uintptr_t)(uint8_t)c);
+  }
+  outFreeUs = at;
+}
+
+// After a command's last byte: was the Mega listening?
+static void commandArrived(void *ctx) {
+  if (RADIO_SERIAL.simBaud()) return;
+  if (!lostCommands.empty()) lostCommands += ", ";
+  lostCommands += sentCommands[(uintptr_t)ctx];
+}
+
+static void espSend(const std::string &command) {
+  if (command == "ENABLE") enablesSent++;
+  espWrite(command);
+  sentCommands.push_back(command);
+  simSchedule((uint64_t)(outFreeUs - simNowUs()), commandArrived, (void *)(uintptr_t)(sentCommands.size() - 1));
+}
+
+// sendCommandToRobot(): held while the link is down
+static void espCommand(const std::string &command) {
+  if (!legacy && !linkUp()) {
+    held = command;
+    heldCommands++;
+    return;
+  }
+  espSend(command);
+}
+
+// handleRobotMessage() as far as the link goes
+static void espHandleLine(const std::string &line) {
+  LinkEvent event = linkLineReceived(line.c_str(), espMillis());
+  if (event == LINK_NO_CHANGE) return;
+  if (linkUpUs == SIM_NEVER) linkUpUs = simNowUs();
+  if (event == LINK_CAME_UP) espSend("ENABLE");
+  if (!held.empty()) espSend(held);
+  held.clear();
+}
+
+static void espReadLink() {
+  while (!espRx.empty()) {
+    char c = espRx.front();
+    espRx.pop_front();
+    if (c == '\r') continue;
+    if (c != '\n') {
+      espLine += c;
+      continue;
+    }
+    if (!legacy && !espLine.empty()) espHandleLine(espLine);
+    espLine.clear();
+  }
+}
+
+// handleWebRequests(), processRobotResponse(), updateRobotStatus()
+static void espLoop(void *) {
+  uint64_t now = simNowUs();
+  if (pageSentUs == SIM_NEVER) {
+    pageSentUs = now;
+    espCommand(PAGE_COMMAND);
+  }
+  espReadLink();
+  if (!legacy && linkProbeDue(espMillis())) espWrite("HELLO");
+  if ((legacy || linkUp()) && now >= nextPollUs) {
+    nextPollUs = now + STATUS_UPDATE_INTERVAL_MS * 1000;
+    espCommand("REQ_ODOM");
+  }
+  simSchedule(std::max((uint64_t)((double)now + espLoopUs), (uint64_t)outFreeUs) - now, espLoop, nullptr);
+}
+
+static void espSetup(void *) {
+  espUartOn = true;                  // Serial.begin()
+  if (legacy) {
+    // delay(2000), ENABLE, then setupWiFiAP() and setupWebServer()
+    outFreeUs = simNowUs() + LEGACY_DELAY_US;
+    espSend("ENABLE");
+    webUpUs = (uint64_t)outFreeUs + espApUs;
+  } else {
+    linkBegin(espMillis());
+    if (linkProbeDue(espMillis())) espWrite("HELLO");
+    webUpUs = simNowUs() + espApUs;
+  }
+  nextPollUs = webUpUs;
+  simSchedule(webUpUs - simNowUs(), espLoop, nullptr);
+}
+
+// The Mega's READY with up_ms from the reset
+static std::string readyAfterReset(uint32_t upMs) {
+  size_t at = megaReadyLine.find("up_ms=") + 6;
+  size_t end = megaReadyLine.find(' ', at);
+  return megaReadyLine.substr(0, at) + std::to_string(upMs) + megaReadyLine.substr(end);
+}
+
+// What the Mega wrote goes out byte by byte behind what's already on the
+// wire; arrived bytes wait in the ESP's buffer
+static void linkTick(void *) {
+  uint64_t now = simNowUs();
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  size_t ready = out.find("READY ");
+  if (megaReadyUs == SIM_NEVER && ready != std::string::npos) {
+    megaReadyUs = now;
+    megaReadyLine = out.substr(ready, out.find('\n', ready) - ready + 1);
+  }
+  if (now >= megaResetUs && !megaRebooted) {
+    // Silent while it reboots, then the READY of the new boot
+    out.clear();
+    if (now >= megaResetUs + megaRebootUs) {
+      megaRebooted = true;
+      out = readyAfterReset((uint32_t)((now - megaResetUs) / 1000));
+    }
+  }
+  double at = std::max((double)now, backFreeUs);
+  for (char c : out) {
+    at += BYTE_US;
+    backWire.push_back(WireByte{at, c});
+  }
+  backFreeUs = at;
+  while (!backWire.empty() && backWire.front().atUs <= now) {
+    if (!espUartOn) {
+      // Not listening yet
+    } else if (espRx.size() < ESP_RX_BYTES) {
+      espRx.push_back(backWire.front().c);
+    } else {
+      espRxDropped++;
+    }
+    backWire.pop_front();
+  }
+  simSchedule(LINK_TICK_US, linkTick, nullptr);
+}
+
+static void motorsWritten(uint8_t) {
+  if (actuationUs != SIM_NEVER) return;
+  if (simPinLevel(MOTOR_STBY) && simPwm(M1_PWM) > 0 && simPinLevel(M1_IN1) != simPinLevel(M1_IN2)) {
+    actuationUs = simNowUs();
+  }
+}
+
+static void bringupSetup() {
+  legacy = simFlag("legacy");
+  espBootUs = (uint64_t)(simOptionF("esp-boot-ms", 80) * 1000);
+  espApUs = (uint64_t)(simOptionF("esp-ap-ms", 60) * 1000);
+  espLoopUs = (uint64_t)simOptionF("esp-loop-us", 1000);
+  maxActuationMs = simOptionF("max-actuation-ms", -1);
+  double resetAt = simOptionF("mega-reset-at", -1);
+  if (resetAt >= 0) megaResetUs = (uint64_t)(resetAt * 1e6);
+  megaRebootUs = (uint64_t)(simOptionF("mega-reboot-ms", 300) * 1000);
+  simAddOutputHook(motorsWritten);
+  simSchedule(LINK_TICK_US, linkTick, nullptr);
+  simSchedule(espBootUs, espSetup, nullptr);
+}
+
+static void printTime(const char *what, uint64_t us) {
+  if (us == SIM_NEVER) printf("  %-16s never\n", what);
+  else printf("  %-16s %8.1f ms\n", what, us / 1000.0);
+}
+
+static void bringupReport() {
+  LinkStatus link;
+  linkGetStatus(link);
+  printf("%s bring-up, from power-on:\n", legacy ? "legacy" : "handshake");
+  printTime("mega READY", megaReadyUs);
+  printTime("esp setup()", espBootUs);
+  if (!legacy) printTime("esp link up", linkUpUs);
+  printTime("web server up", webUpUs);
+  printTime("page command", pageSentUs);
+  printTime("first actuation", actuationUs);
+  printf("ENABLE sent %d, HELLO probes %u, commands held %d, esp rx bytes dropped %u\n",
+         enablesSent, (unsigned)link.probes, heldCommands, espRxDropped);
+  if (!legacy) printf("mega: proto %u, caps \"%s\"\n", link.protocol, link.caps);
+  printf("lost before the Mega listened: %s\n", lostCommands.empty() ? "none" : lostCommands.c_str());
+  if (megaResetUs != SIM_NEVER) printf("mega reset at %.1f ms, restarts seen %u\n", megaResetUs / 1000.0, (unsigned)link.megaRestarts);
+
+  if (maxActuationMs >= 0 && (actuationUs == SIM_NEVER || actuationUs > maxActuationMs * 1000)) {
+    simFail("first actuation later than %.0f ms", maxActuationMs);
+  }
+  if (!legacy && linkUpUs == SIM_NEVER) simFail("the link never came up");
+  if (!legacy && link.protocol != LINK_PROTOCOL) simFail("READY with protocol %u", link.protocol);
+  int enablesDue = 1 + (megaRebooted ? 1 : 0);
+  if (!legacy && enablesSent != enablesDue) simFail("ENABLE sent %d times, expected %d", enablesSent, enablesDue);
+  if (!legacy && link.megaRestarts != (megaRebooted ? 1u : 0u)) simFail("%u Mega restarts seen", (unsigned)link.megaRestarts);
+}
+
+SIM_SCENARIO(bringup, "power-on to first actuation: ESP/Mega link handshake vs fixed delays",
+             bringupSetup, nullptr, bringupReport);
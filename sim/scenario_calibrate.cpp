@@ -0,0 +1,191 @@
+// Calibrate scenario: gives each wheel its own motor model (the TB6612
+// pair strong with small deadbands, the L298N pair weaker with large ones),
+// runs CAL_MOTORS, checks the table against the models, then drives
+// straight with the table off and on and compares how evenly the wheels
+// turn, at cruise and at a crawl that sits inside some deadbands.
+//
+//   --skip-cal          don't sweep; expect a valid table from --eeprom
+//   --max-table-err 5   fail if a table entry is off by more (% of top speed)
+//   --max-spread 5      fail if calibrated wheel speeds differ by more (% of mean)
+//
+// The sweep takes ~40 s of simulated time; pass --seconds 70.
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "motor_calibration.h"
+#include "config.h"
+
+#include <math.h>
+#include <string>
+#include <vector>
+
+static const SimWheelParams wheels[4] = {
+  {0.95, 15, 0.07, 2.5},    // M1 TB6612
+  {0.85, 25, 0.08, 2.5},    // M2 TB6612
+  {0.70, 45, 0.10, 2.0},    // M3 L298N: ~2 V lost in the bridge
+  {0.78, 38, 0.09, 2.0},    // M4 L298N
+};
+
+struct DriveTest {
+  const char *label;
+  const char *use;
+  int speed;
+  double spread;            // (max - min) / mean wheel speed at the end
+  double slowest;           // m/s
+  double turnDeg;           // heading change over the test
+};
+
+static DriveTest tests[] = {
+  {"raw cruise", "CAL_USE 0", 150, 0, 0, 0},
+  {"cal cruise", "CAL_USE 1", 150, 0, 0, 0},
+  {"raw crawl", "CAL_USE 0", 40, 0, 0, 0},
+  {"cal crawl", "CAL_USE 1", 40, 0, 0, 0},
+};
+static const int TESTS = sizeof(tests) / sizeof(tests[0]);
+static const uint64_t TEST_US = 3000000;
+static const uint64_t GAP_US = 500000;
+
+static bool skipCal;
+static bool calDone, calValid;
+static uint64_t testsAtUs = SIM_NEVER;
+static int testIndex = -1;
+static bool testEnded;
+static double testStartTheta;
+static double tableErrSum, tableErrMax, deadbandErrMax;
+static int tableEntries;
+static std::string rxLine;
+
+// Steady-state speed of the model at a PWM, mm/s
+static double modelMmps(const SimWheelParams &p, int pwm) {
+  if (pwm <= p.deadband) return 0;
+  return 1000 * p.topSpeed * (pwm - p.deadband) / (255 - p.deadband);
+}
+
+static void checkTableLine(const char *line) {
+  int motor, deadband, n = 0;
+  char dir;
+  if (sscanf(line, "CALT %d %c %d%n", &motor, &dir, &deadband, &n) != 3 || motor < 1 || motor > 4) {
+    simFail("bad table line: %s", line);
+    return;
+  }
+  const SimWheelParams &p = wheels[motor - 1];
+  double dbErr = fabs(deadband - p.deadband);
+  if (dbErr > deadbandErrMax) deadbandErrMax = dbErr;
+  const char *rest = line + n;
+  for (int i = 0; i < CAL_POINTS; i++) {
+    int mmps, used;
+    if (sscanf(rest, "%d%n", &mmps, &used) != 1) {
+      simFail("short table line: %s", line);
+      return;
+    }
+    rest += used;
+    int pwm = 255 * (i + 1) / CAL_POINTS;
+    double err = 100 * fabs(mmps - modelMmps(p, pwm)) / (1000 * p.topSpeed);
+    tableErrSum += err;
+    tableEntries++;
+    if (err > tableErrMax) tableErrMax = err;
+  }
+}
+
+static void handleLine(const std::string &line) {
+  if (line == "CAL DONE") calDone = true;
+  else if (line == "CAL FAIL") simFail("calibration failed");
+  else if (line.compare(0, 5, "CALT ") == 0 && !skipCal) checkTableLine(line.c_str());
+  else if (line.compare(0, 4, "CAL ") == 0) {
+    int valid = 0;
+    sscanf(line.c_str(), "CAL %d", &valid);
+    calValid = valid != 0;
+  }
+  else if (line.compare(0, 3, "ERR") == 0) simFail("%s", line.c_str());
+}
+
+static void endTest(DriveTest &t) {
+  SimDrivetrain &drive = simRobotDrivetrain();
+  double lo = 1e9, hi = -1e9, sum = 0;
+  for (int w = 0; w < 4; w++) {
+    double v = drive.wheelSpeed(w);
+    sum += v;
+    if (v < lo) lo = v;
+    if (v > hi) hi = v;
+  }
+  t.slowest = lo;
+  t.spread = sum > 0 ? 100 * (hi - lo) / (sum / 4) : 100;
+  t.turnDeg = (drive.pose().theta - testStartTheta) * 180 / M_PI;
+}
+
+static void calibrateSetup() {
+  skipCal = simFlag("skip-cal");
+  for (int w = 0; w < 4; w++) simRobotDrivetrain().setWheel(w, wheels[w]);
+}
+
+static void calibrateEveryMs() {
+  uint64_t now = simNowUs();
+  if (now >= 500000 && now < 501000) RADIO_SERIAL.simInject("ENABLE\n");
+  if (now >= 2000000 && now < 2001000) {
+    if (skipCal) {
+      RADIO_SERIAL.simInject("REQ_CAL\n");
+      testsAtUs = now + 100000;
+    } else {
+      RADIO_SERIAL.simInject("CAL_MOTORS\n");
+    }
+  }
+  if (calDone && testsAtUs == SIM_NEVER) testsAtUs = now + GAP_US;
+
+  // Each test starts TEST_US + GAP_US after the previous one
+  if (testIndex < TESTS && testIndex >= 0 && !testEnded &&
+      now >= testsAtUs + testIndex * (TEST_US + GAP_US) + TEST_US) {
+    endTest(tests[testIndex]);
+    testEnded = true;
+    RADIO_SERIAL.simInject("STOP\n");
+  }
+  if (testIndex < TESTS && now >= testsAtUs + (testIndex + 1) * (TEST_US + GAP_US)) {
+    testIndex++;
+    testEnded = false;
+    if (testIndex < TESTS) {
+      char line[48];
+      snprintf(line, sizeof(line), "%s\nFWD %d\n", tests[testIndex].use, tests[testIndex].speed);
+      RADIO_SERIAL.simInject(line);
+      testStartTheta = simRobotDrivetrain().pose().theta;
+    }
+  }
+
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  for (char c : out) {
+    if (c == '\r') continue;
+    if (c != '\n') {
+      rxLine += c;
+      continue;
+    }
+    handleLine(rxLine);
+    rxLine.clear();
+  }
+}
+
+static void calibrateReport() {
+  if (!skipCal) {
+    printf("table: %d entries, error mean %.1f%% max %.1f%% of top speed, deadband error max %.0f PWM\n",
+           tableEntries, tableEntries ? tableErrSum / tableEntries : 0.0, tableErrMax, deadbandErrMax);
+  }
+  for (int i = 0; i < TESTS; i++) {
+    const DriveTest &t = tests[i];
+    printf("%-10s  FWD %3d: wheel spread %5.1f%%, slowest %.3f m/s, turned %6.1f deg\n",
+           t.label, t.speed, t.spread, t.slowest, t.turnDeg);
+  }
+
+  if (skipCal && !calValid) simFail("no valid table in EEPROM");
+  if (!skipCal && !calDone) {
+    simFail("calibration didn't finish; run longer");
+    return;
+  }
+  if (testIndex < TESTS) {
+    simFail("drive tests didn't finish; run longer");
+    return;
+  }
+  if (!skipCal && tableErrMax > simOptionF("max-table-err", 5)) simFail("table error %.1f%%", tableErrMax);
+  double maxSpread = simOptionF("max-spread", 5);
+  if (tests[1].spread > maxSpread) simFail("calibrated cruise spread %.1f%%", tests[1].spread);
+  if (tests[3].spread > maxSpread || tests[3].slowest <= 0.01) simFail("calibrated crawl uneven or stalled");
+}
+
+SIM_SCENARIO(calibrate, "motor sweep, PWM tables in EEPROM, raw vs calibrated driving",
+             calibrateSetup, calibrateEveryMs, calibrateReport);
@@ -0,0 +1,182 @@
+// Drive scenario: runs a scripted course through RADIO_SERIAL commands on
+// the simulated drivetrain and compares two pose sources against truth:
+// dead reckoning from the original ODOM fields (distL/distR, what a host
+// integrates today) and the fused pose appended by pose_ekf.cpp.
+//
+//   --course square|slalom|spin   (default square)
+//   --track 0.23                  true effective track; firmware assumes TRACK_WIDTH
+//   --slip-wheel 3 --slip-at 6 --slip-ms 500 --slip-extra 1.5
+//                                 wheel 1..4 spins without moving the body (0 = none)
+//   --log drive.csv               per-ODOM truth, dead-reckoned and fused pose
+//   --max-drift 0.2               fail if the fused position error ends above this (m)
+//   --expect-better               fail unless fused beats dead reckoning in both
+//                                 position and heading
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "config.h"
+
+#include <math.h>
+#include <string>
+#include <vector>
+
+struct TimedCommand {
+  uint64_t atUs;
+  std::string line;
+};
+
+struct PoseError {
+  double pos, heading;
+  double maxPos, maxHeading;
+};
+
+static std::vector<TimedCommand> script;
+static size_t nextCommand;
+static std::string rxLine;
+static FILE *logFile;
+
+static uint64_t slipAt, slipEnd;
+static int slipWheel;
+static double slipExtra;
+
+static double deadX, deadY, deadTheta;
+static PoseError deadErr, fusedErr;
+static unsigned long odomLines, slipReports;
+
+static void at(double seconds, const char *line) {
+  script.push_back(TimedCommand{(uint64_t)(seconds * 1e6), line});
+}
+
+static void buildCourse(const char *course) {
+  at(0.5, "ENABLE");
+  double t = 2.0;   // after the gyro bias calibration
+  if (strcmp(course, "square") == 0) {
+    for (int side = 0; side < 4; side++) {
+      at(t, "FWD 150");    t += 2.0;
+      at(t, "STOP");       t += 0.4;
+      at(t, "RIGHT 150");  t += 0.35;
+      at(t, "STOP");       t += 0.4;
+    }
+  } else if (strcmp(course, "slalom") == 0) {
+    for (int i = 0; i < 6; i++) {
+      at(t, i % 2 ? "SET_V 120 190" : "SET_V 190 120");
+      t += 1.5;
+    }
+    at(t, "STOP");
+  } else if (strcmp(course, "spin") == 0) {
+    at(t, "LEFT 120");   t += 3.0;
+    at(t, "STOP");       t += 0.5;
+    at(t, "RIGHT 120");  t += 2.0;
+    at(t, "STOP");
+  } else {
+    simFail("unknown course %s", course);
+  }
+}
+
+static double wrapAngle(double a) {
+  while (a > M_PI) a -= 2 * M_PI;
+  while (a < -M_PI) a += 2 * M_PI;
+  return a;
+}
+
+static void track(PoseError &e, double x, double y, double theta, const SimPose &truth) {
+  e.pos = hypot(x - truth.x, y - truth.y);
+  e.heading = fabs(wrapAngle(theta - truth.theta));
+  if (e.pos > e.maxPos) e.maxPos = e.pos;
+  if (e.heading > e.maxHeading) e.maxHeading = e.heading;
+}
+
+static void handleOdom(const char *line) {
+  unsigned long now, dt;
+  long d[4];
+  float distL, distR, vL, vR, x, y, theta, v, w;
+  int slip;
+  if (sscanf(line, "ODOM %lu %lu %ld %ld %ld %ld %f %f %f %f %f %f %f %f %f %d",
+             &now, &dt, &d[0], &d[1], &d[2], &d[3], &distL, &distR, &vL, &vR,
+             &x, &y, &theta, &v, &w, &slip) != 16) {
+    simFail("bad ODOM line: %s", line);
+    return;
+  }
+  odomLines++;
+  if (slip) slipReports++;
+
+  double center = 0.5 * (distL + distR);
+  double turn = (distR - distL) / TRACK_WIDTH;
+  deadX += center * cos(deadTheta + 0.5 * turn);
+  deadY += center * sin(deadTheta + 0.5 * turn);
+  deadTheta = wrapAngle(deadTheta + turn);
+
+  const SimPose &truth = simRobotDrivetrain().pose();
+  track(deadErr, deadX, deadY, deadTheta, truth);
+  track(fusedErr, x, y, theta, truth);
+
+  if (logFile) {
+    fprintf(logFile, "%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%d\n", now,
+            truth.x, truth.y, truth.theta, deadX, deadY, deadTheta, x, y, theta, slip);
+  }
+}
+
+static void driveSetup() {
+  SimDrivetrain &drive = simRobotDrivetrain();
+  drive.setTrack(simOptionF("track", 0.23));
+  buildCourse(simOption("course", "square"));
+
+  slipWheel = (int)simOptionF("slip-wheel", 3);
+  slipAt = simOptionTimeUs("slip-at");
+  if (slipAt == SIM_NEVER) slipAt = 6000000;
+  slipEnd = slipAt + (uint64_t)(simOptionF("slip-ms", 500) * 1000);
+  slipExtra = simOptionF("slip-extra", 1.5);
+
+  const char *log = simOption("log", nullptr);
+  if (log) {
+    logFile = fopen(log, "w");
+    if (logFile) fprintf(logFile, "t_ms,true_x,true_y,true_theta,dead_x,dead_y,dead_theta,"
+                                  "fused_x,fused_y,fused_theta,slip\n");
+  }
+}
+
+static void driveEveryMs() {
+  uint64_t now = simNowUs();
+  while (nextCommand < script.size() && script[nextCommand].atUs <= now) {
+    std::string line = script[nextCommand++].line + "\n";
+    RADIO_SERIAL.simInject(line.c_str());
+  }
+
+  if (slipWheel >= 1 && slipWheel <= 4) {
+    bool slipping = now >= slipAt && now < slipEnd;
+    simRobotDrivetrain().setSlip(slipWheel - 1, slipping ? slipExtra : 0);
+  }
+
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  for (char c : out) {
+    if (c != '\n') {
+      rxLine += c;
+      continue;
+    }
+    if (rxLine.compare(0, 5, "ODOM ") == 0) handleOdom(rxLine.c_str());
+    rxLine.clear();
+  }
+}
+
+static void driveReport() {
+  if (logFile) fclose(logFile);
+  const SimPose &truth = simRobotDrivetrain().pose();
+  printf("truth:  x %.3f y %.3f theta %.1f deg, %lu ODOM lines, %lu with slip flagged\n",
+         truth.x, truth.y, truth.theta * 180 / M_PI, odomLines, slipReports);
+  printf("dead reckoning: end %.3f m %.1f deg, max %.3f m %.1f deg\n",
+         deadErr.pos, deadErr.heading * 180 / M_PI, deadErr.maxPos, deadErr.maxHeading * 180 / M_PI);
+  printf("fused:          end %.3f m %.1f deg, max %.3f m %.1f deg\n",
+         fusedErr.pos, fusedErr.heading * 180 / M_PI, fusedErr.maxPos, fusedErr.maxHeading * 180 / M_PI);
+
+  double maxDrift = simOptionF("max-drift", -1);
+  if (maxDrift >= 0 && fusedErr.pos > maxDrift) {
+    simFail("fused drift %.3f m above %.3f m", fusedErr.pos, maxDrift);
+  }
+  if (simFlag("expect-better") &&
+      (fusedErr.pos >= deadErr.pos || fusedErr.heading >= deadErr.heading)) {
+    simFail("fused pose not better than dead reckoning");
+  }
+  if (odomLines == 0) simFail("no ODOM output");
+}
+
+SIM_SCENARIO(drive, "scripted course; dead reckoning vs fused pose", driveSetup, driveEveryMs, driveReport);
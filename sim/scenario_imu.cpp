@@ -0,0 +1,86 @@
+// IMU scenario: the robot sits still for the gyro bias calibration, then
+// yaws back and forth. Reports FIFO health, bus load and heading error.
+//
+//   --yaw-dps 90        peak yaw rate of the sine
+//   --period 4          seconds per yaw cycle
+//   --bias-dps 1.5      gyro bias
+//   --noise-dps 0.05    gyro noise
+//   --int-gap-at 8 --int-gap-ms 200   hold INT low (missed interrupts)
+//   --i2c-hang-at 12 --i2c-hang-ms 20 stop TWI interrupts (stuck bus)
+//   --stall-at 5 --stall-ms 300       stop calling loop() (sim_main option)
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "mpu_dmp.h"
+
+#include <math.h>
+
+static const double STILL_S = 1.5;
+
+static double yawDps, periodS;
+static uint64_t gapAt, gapUs, hangAt, hangEnd;
+static double maxError;
+
+static void imuSetup() {
+  SimMpu6050 &imu = simRobotImu();
+  simRobotDrivetrain().setFeedImu(false);   // the yaw profile below drives the gyro
+  yawDps = simOptionF("yaw-dps", 90);
+  periodS = simOptionF("period", 4);
+  imu.setGyroBias(simOptionF("bias-dps", 1.5));
+  imu.setGyroNoise(simOptionF("noise-dps", 0.05));
+
+  gapAt = simOptionTimeUs("int-gap-at");
+  gapUs = (uint64_t)(simOptionF("int-gap-ms", 200) * 1000);
+  hangAt = simOptionTimeUs("i2c-hang-at");
+  hangEnd = hangAt + (uint64_t)(simOptionF("i2c-hang-ms", 0) * 1000);
+}
+
+static double wrapAngle(double a) {
+  while (a > M_PI) a -= 2 * M_PI;
+  while (a < -M_PI) a += 2 * M_PI;
+  return a;
+}
+
+static void imuEveryMs() {
+  SimMpu6050 &imu = simRobotImu();
+  uint64_t now = simNowUs();
+  double t = now / 1e6;
+
+  double rate = t < STILL_S ? 0 : yawDps * sin(2 * M_PI * (t - STILL_S) / periodS);
+  imu.setYawRate(rate * M_PI / 180);
+
+  if (now >= gapAt) {
+    imu.suppressIntUntil(now + gapUs);
+    gapAt = SIM_NEVER;
+  }
+  if (now >= hangAt && now < hangEnd) simTwiHang(true);
+  if (now >= hangEnd && hangEnd < SIM_NEVER) {
+    simTwiHang(false);
+    hangAt = hangEnd = SIM_NEVER;
+  }
+
+  if (imuReady()) {
+    double err = fabs(wrapAngle(imuHeading() - imu.trueHeading()));
+    if (err > maxError) maxError = err;
+  }
+}
+
+static void imuReport() {
+  SimMpu6050 &imu = simRobotImu();
+  ImuStats st;
+  imuGetStats(st);
+  double seconds = simNowUs() / 1e6;
+
+  printf("model:  %lu samples, %lu lost in FIFO, %lu overflows, FIFO %u bytes\n",
+         imu.samplesTaken(), imu.samplesLost(), imu.overflows(), imu.fifoLevel());
+  printf("driver: %lu samples, %lu FIFO resets, %lu ring stalls, %lu bus errors\n",
+         (unsigned long)st.samples, (unsigned long)st.fifoOverflows,
+         (unsigned long)st.ringStalls, (unsigned long)st.busErrors);
+  printf("bus:    %.1f%% busy, %.0f B/s FIFO data, %.0f B/s total\n",
+         100.0 * simTwiBusyUs() / simNowUs(), st.busBytes / seconds, simTwiBytes() / seconds);
+  printf("yaw:    ready=%d heading %.2f deg, true %.2f deg, error %.3f deg (max %.3f)\n",
+         imuReady(), imuHeading() * 180 / M_PI, wrapAngle(imu.trueHeading()) * 180 / M_PI,
+         wrapAngle(imuHeading() - imu.trueHeading()) * 180 / M_PI, maxError * 180 / M_PI);
+}
+
+SIM_SCENARIO(imu, "MPU-6050 FIFO reader and heading", imuSetup, imuEveryMs, imuReport);
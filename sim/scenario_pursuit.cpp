@@ -0,0 +1,234 @@
+// Pursuit scenario: follows a waypoint path either with the on-board
+// follower (WP_ADD + WP_RUN) or with the same pure-pursuit law running
+// off-board: reading the fused pose from ODOM lines and streaming SET_V
+// back over a link with latency in both directions. Tracking error is
+// measured on the true pose against the path polyline.
+//
+//   --path square|zigzag   (default square, 1.5 m sides)
+//   --mode onboard|offboard
+//   --speed 150            cruise PWM
+//   --latency-ms 40        one-way link latency, offboard mode
+//   --max-xtrack 0.1       fail if the worst cross-track error is above this (m)
+//   --max-end 0.1          fail if the robot stops further than this from the end (m)
+//
+// Runs take up to ~16 s of simulated time; pass --seconds 20.
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "config.h"
+
+#include <math.h>
+#include <string>
+#include <vector>
+
+struct Point {
+  double x, y;
+};
+
+struct PendingLine {
+  uint64_t atUs;
+  std::string line;
+};
+
+static const uint64_t START_US = 2000000;    // after the gyro bias calibration
+
+static std::vector<Point> path;               // starts at the robot's start position
+static bool offboard;
+static int speed;
+static uint64_t latencyUs;
+static std::vector<PendingLine> toRobot, toHost;
+static std::string rxLine;
+
+static bool done;
+static uint64_t doneUs;
+static double xtrackSum, xtrackMax;
+static unsigned long xtrackSamples, reachedLines;
+
+// Off-board follower state: same law as pursuit.cpp, in doubles
+static size_t hostTarget = 1;
+static Point hostSegStart;
+
+static void buildPath(const char *name) {
+  path.push_back(Point{0, 0});
+  if (strcmp(name, "square") == 0) {
+    path.push_back(Point{1.5, 0});
+    path.push_back(Point{1.5, 1.5});
+    path.push_back(Point{0, 1.5});
+    path.push_back(Point{0, 0});
+  } else if (strcmp(name, "zigzag") == 0) {
+    path.push_back(Point{0.8, 0.4});
+    path.push_back(Point{1.6, -0.4});
+    path.push_back(Point{2.4, 0.4});
+    path.push_back(Point{3.2, -0.4});
+    path.push_back(Point{4.0, 0});
+  } else {
+    simFail("unknown path %s", name);
+  }
+}
+
+static double segmentDistance(const Point &a, const Point &b, double x, double y) {
+  double dx = b.x - a.x, dy = b.y - a.y;
+  double len2 = dx * dx + dy * dy;
+  double t = len2 > 0 ? ((x - a.x) * dx + (y - a.y) * dy) / len2 : 0;
+  t = constrain(t, 0.0, 1.0);
+  return hypot(a.x + t * dx - x, a.y + t * dy - y);
+}
+
+static double pathDistance(double x, double y) {
+  double best = 1e9;
+  for (size_t i = 1; i < path.size(); i++) {
+    double d = segmentDistance(path[i - 1], path[i], x, y);
+    if (d < best) best = d;
+  }
+  return best;
+}
+
+static void sendToRobot(uint64_t atUs, const char *line) {
+  toRobot.push_back(PendingLine{atUs, std::string(line) + "\n"});
+}
+
+static void hostSteer(double x, double y, double theta, uint64_t now) {
+  const double lookahead = PURSUIT_LOOKAHEAD_MM / 1000.0;
+  double along, len, ux, uy;
+  bool last;
+  for (;;) {
+    const Point &b = path[hostTarget];
+    len = hypot(b.x - hostSegStart.x, b.y - hostSegStart.y);
+    ux = len > 0 ? (b.x - hostSegStart.x) / len : 0;
+    uy = len > 0 ? (b.y - hostSegStart.y) / len : 0;
+    along = (x - hostSegStart.x) * ux + (y - hostSegStart.y) * uy;
+    last = hostTarget == path.size() - 1;
+    if (last || len - along >= lookahead) break;
+    hostSegStart = path[hostTarget++];
+  }
+
+  char line[32];
+  const Point &b = path[hostTarget];
+  if (last && (hypot(b.x - x, b.y - y) < PURSUIT_ARRIVE_MM / 1000.0 || along >= len)) {
+    sendToRobot(now + latencyUs, "STOP");
+    hostTarget = path.size();      // finished
+    return;
+  }
+  double goal = along + lookahead < len ? along + lookahead : len;
+  double gx = hostSegStart.x + ux * goal - x, gy = hostSegStart.y + uy * goal - y;
+  double lx = gx * cos(theta) + gy * sin(theta);
+  double ly = gy * cos(theta) - gx * sin(theta);
+  if (lx <= 0) {
+    int turn = ly >= 0 ? PURSUIT_TURN_PWM : -PURSUIT_TURN_PWM;
+    snprintf(line, sizeof(line), "SET_V %d %d", -turn, turn);
+  } else {
+    double v = speed;
+    if (last && len - along < PURSUIT_SLOW_MM / 1000.0) {
+      v = PURSUIT_MIN_PWM + (speed - PURSUIT_MIN_PWM) * (len - along) / (PURSUIT_SLOW_MM / 1000.0);
+    }
+    double turn = constrain(ly * TRACK_WIDTH / (lx * lx + ly * ly), -2.0, 2.0);
+    double left = v * (1 - turn), right = v * (1 + turn);
+    double big = fmax(fabs(left), fabs(right));
+    if (big > 255) {
+      left *= 255 / big;
+      right *= 255 / big;
+    }
+    snprintf(line, sizeof(line), "SET_V %d %d", (int)left, (int)right);
+  }
+  sendToRobot(now + latencyUs, line);
+}
+
+static void handleLine(const std::string &line, uint64_t now) {
+  if (line.compare(0, 11, "WP REACHED ") == 0) reachedLines++;
+  if (line.compare(0, 8, "WP DONE ") == 0 && !done) {
+    done = true;
+    doneUs = now;
+  }
+  if (line.compare(0, 3, "ERR") == 0) simFail("%s", line.c_str());
+  if (offboard && line.compare(0, 5, "ODOM ") == 0) toHost.push_back(PendingLine{now + latencyUs, line});
+}
+
+static void pursuitSetup() {
+  buildPath(simOption("path", "square"));
+  offboard = strcmp(simOption("mode", "onboard"), "offboard") == 0;
+  speed = (int)simOptionF("speed", 150);
+  latencyUs = (uint64_t)(simOptionF("latency-ms", 40) * 1000);
+  hostSegStart = path[0];
+
+  sendToRobot(500000, "ENABLE");
+  if (!offboard) {
+    char line[32];
+    for (size_t i = 1; i < path.size(); i++) {
+      snprintf(line, sizeof(line), "WP_ADD %d %d", (int)lround(path[i].x * 1000), (int)lround(path[i].y * 1000));
+      sendToRobot(1000000, line);
+    }
+    snprintf(line, sizeof(line), "WP_RUN %d", speed);
+    sendToRobot(START_US, line);
+  }
+}
+
+static void pursuitEveryMs() {
+  uint64_t now = simNowUs();
+  while (!toRobot.empty() && toRobot.front().atUs <= now) {
+    RADIO_SERIAL.simInject(toRobot.front().line.c_str());
+    toRobot.erase(toRobot.begin());
+  }
+
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  for (char c : out) {
+    if (c == '\r') continue;
+    if (c != '\n') {
+      rxLine += c;
+      continue;
+    }
+    handleLine(rxLine, now);
+    rxLine.clear();
+  }
+
+  // The host acts on each ODOM line once it has crossed the link
+  while (!toHost.empty() && toHost.front().atUs <= now) {
+    float f[16];
+    const char *p = toHost.front().line.c_str() + 5;
+    int n = 0;
+    while (n < 16 && sscanf(p, "%f", &f[n]) == 1) {
+      n++;
+      p = strchr(p, ' ');
+      if (!p) break;
+      p++;
+    }
+    toHost.erase(toHost.begin());
+    if (n < 13 || now < START_US || hostTarget >= path.size()) continue;
+    hostSteer(f[10], f[11], f[12], now);
+    if (hostTarget >= path.size() && !done) {
+      done = true;
+      doneUs = now + latencyUs;
+    }
+  }
+
+  if (now < START_US) return;
+  const SimPose &truth = simRobotDrivetrain().pose();
+  if (!done || now < doneUs) {
+    double d = pathDistance(truth.x, truth.y);
+    xtrackSum += d;
+    xtrackSamples++;
+    if (d > xtrackMax) xtrackMax = d;
+  }
+}
+
+static void pursuitReport() {
+  const SimPose &truth = simRobotDrivetrain().pose();
+  double endError = hypot(truth.x - path.back().x, truth.y - path.back().y);
+  printf("%s: ", offboard ? "offboard" : "onboard");
+  if (done) printf("done after %.2f s, ", (doneUs - START_US) / 1e6);
+  else printf("not done, ");
+  printf("cross-track mean %.3f m max %.3f m, end %.3f m from the last waypoint\n",
+         xtrackSamples ? xtrackSum / xtrackSamples : 0.0, xtrackMax, endError);
+  if (!offboard) printf("%lu WP REACHED lines for %d waypoints\n", reachedLines, (int)path.size() - 1);
+
+  if (!done) {
+    simFail("path not finished; run longer");
+    return;
+  }
+  double maxXtrack = simOptionF("max-xtrack", -1);
+  if (maxXtrack >= 0 && xtrackMax > maxXtrack) simFail("cross-track %.3f m above %.3f m", xtrackMax, maxXtrack);
+  double maxEnd = simOptionF("max-end", -1);
+  if (maxEnd >= 0 && endError > maxEnd) simFail("stopped %.3f m from the end", endError);
+  if (!offboard && reachedLines != path.size() - 2) simFail("expected a WP REACHED per intermediate waypoint");
+}
+
+SIM_SCENARIO(pursuit, "waypoint following on board vs over the link", pursuitSetup, pursuitEveryMs, pursuitReport);
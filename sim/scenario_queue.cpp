@@ -0,0 +1,150 @@
+// Queue scenario: plays the same maneuver twice over a link with random
+// per-line delay. First each step is sent as a direct command when it is
+// due, the way a host drives the robot today. Then the whole maneuver is
+// uploaded with Q_ADD and played back by motion_queue.cpp. Step timing is
+// taken from the motor pins and compared with the schedule, relative to
+// when the first step actually started. Last, a queue whose only step has
+// no duration must end with the motors stopped, as every Q DONE must.
+//
+//   --jitter-ms 40       link delay per line, uniform 0..jitter
+//   --max-late-us 1000   fail if a queued step is off schedule by more
+//   --seed 1
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "config.h"
+
+#include <math.h>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Step {
+  unsigned long startMs, durationMs;
+  const char *direct;      // the same step as an immediate command
+  const char *queued;      // its Q_ADD body
+};
+
+static const Step maneuver[] = {
+  {0, 1000, "SET_V 150 150", "VEL 150 150"},
+  {1000, 350, "RIGHT 150", "TURN -150"},
+  {1350, 800, "SET_V 120 180", "VEL 120 180"},
+  {2150, 400, "LEFT 150", "TURN 150"},
+  {2550, 600, "SET_V -150 -150", "VEL -150 -150"},
+  {3150, 0, "STOP", "STOP"},
+};
+static const int STEPS = sizeof(maneuver) / sizeof(maneuver[0]);
+
+static const uint64_t DIRECT_AT_US = 2000000;
+static const uint64_t QUEUED_AT_US = 6000000;
+static const uint64_t OPEN_END_AT_US = 9500000;   // Q_ADD 0 0 VEL ..., nothing after it
+static const uint64_t SAME_STEP_US = 1000;     // pin changes closer than this are one step
+
+struct PendingLine {
+  uint64_t atUs;
+  std::string line;
+};
+
+static std::vector<PendingLine> link;
+static std::vector<uint64_t> directSteps, queuedSteps;
+static std::vector<uint64_t> *recording;
+static uint64_t lastChangeUs;
+static std::mt19937 rng;
+static double jitterMs;
+static int queueDones;
+static bool drivenAtDone;
+static std::string rxLine;
+
+// Lines keep their order on the link: each one is delayed from its send
+// time or from the line ahead of it, whichever is later
+static void sendAt(uint64_t atUs, const std::string &line) {
+  std::uniform_real_distribution<double> delay(0, jitterMs * 1000);
+  uint64_t arrive = atUs + (uint64_t)delay(rng);
+  if (!link.empty() && arrive < link.back().atUs) arrive = link.back().atUs;
+  link.push_back(PendingLine{arrive, line + "\n"});
+}
+
+static void motorPinChanged(uint8_t pin) {
+  if (!recording) return;
+  bool motorPin = false;
+  const uint8_t pins[] = {M1_PWM, M1_IN1, M1_IN2, M2_PWM, M2_IN1, M2_IN2,
+                          M3_PWM, M3_IN1, M3_IN2, M4_PWM, M4_IN1, M4_IN2};
+  for (uint8_t p : pins) motorPin |= p == pin;
+  if (!motorPin) return;
+  uint64_t now = simNowUs();
+  if (recording->empty() || now - lastChangeUs > SAME_STEP_US) recording->push_back(now);
+  lastChangeUs = now;
+}
+
+static void queueSetup() {
+  jitterMs = simOptionF("jitter-ms", 40);
+  rng.seed((unsigned)simOptionF("seed", 1));
+  simAddOutputHook(motorPinChanged);
+
+  sendAt(500000, "ENABLE");
+  for (int i = 0; i < STEPS; i++) {
+    sendAt(DIRECT_AT_US + maneuver[i].startMs * 1000, maneuver[i].direct);
+  }
+  // Upload at once; the link delay now only shifts when Q_RUN lands
+  for (int i = 0; i < STEPS; i++) {
+    char line[48];
+    snprintf(line, sizeof(line), "Q_ADD %lu %lu %s", maneuver[i].startMs,
+             maneuver[i].durationMs, maneuver[i].queued);
+    sendAt(QUEUED_AT_US, line);
+  }
+  sendAt(QUEUED_AT_US, "Q_RUN");
+  sendAt(OPEN_END_AT_US, "Q_CLEAR");
+  sendAt(OPEN_END_AT_US, "Q_ADD 0 0 VEL 150 150");
+  sendAt(OPEN_END_AT_US, "Q_RUN");
+}
+
+static void queueEveryMs() {
+  uint64_t now = simNowUs();
+  recording = now >= OPEN_END_AT_US ? nullptr : now >= QUEUED_AT_US ? &queuedSteps
+            : now >= DIRECT_AT_US ? &directSteps : nullptr;
+
+  while (!link.empty() && link.front().atUs <= now) {
+    RADIO_SERIAL.simInject(link.front().line.c_str());
+    link.erase(link.begin());
+  }
+
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  for (char c : out) {
+    if (c == '\r') continue;
+    if (c != '\n') {
+      rxLine += c;
+      continue;
+    }
+    if (rxLine.compare(0, 7, "Q DONE ") == 0) {
+      queueDones++;
+      drivenAtDone |= simPwm(M1_PWM) || simPwm(M2_PWM) || simPwm(M3_PWM) || simPwm(M4_PWM);
+    }
+    if (rxLine.compare(0, 3, "ERR") == 0) simFail("%s", rxLine.c_str());
+    rxLine.clear();
+  }
+}
+
+static double scheduleError(const std::vector<uint64_t> &steps, const char *name) {
+  if ((int)steps.size() != STEPS) {
+    simFail("%s: saw %d steps, expected %d", name, (int)steps.size(), STEPS);
+    return 0;
+  }
+  double worst = 0, sum = 0;
+  for (int i = 1; i < STEPS; i++) {
+    double err = fabs((double)(steps[i] - steps[0]) - maneuver[i].startMs * 1000.0);
+    sum += err;
+    if (err > worst) worst = err;
+  }
+  printf("%s: step timing error mean %8.1f us, max %8.1f us\n", name, sum / (STEPS - 1), worst);
+  return worst;
+}
+
+static void queueReport() {
+  scheduleError(directSteps, "direct");
+  double worst = scheduleError(queuedSteps, "queued");
+  if (queueDones != 2) simFail("%d Q DONE reports, expected 2", queueDones);
+  if (drivenAtDone) simFail("Q DONE with the motors still driven");
+  if (worst > simOptionF("max-late-us", 1000)) simFail("queued step %.0f us off schedule", worst);
+}
+
+SIM_SCENARIO(queue, "direct commands vs on-board queue over a jittery link", queueSetup, queueEveryMs, queueReport);
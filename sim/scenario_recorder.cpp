@@ -0,0 +1,206 @@
+// Recorder scenario: arms the flight recorder at 1 kHz and drives at a wall
+// until the safety cutoff triggers it, then dumps the ring over the link.
+// A second recording at 2 ms is triggered with REC_TRIG, or by a fault
+// when a loop() stall is passed (--stall-at 6.5 --stall-ms 20). Each
+// dump is checked byte for byte: checksum, trigger position, PWM around
+// the cutoff, and encoder ticks against the drivetrain model.
+//
+//   --wall 1.5             wall distance ahead of the start position (m)
+//   --speed 200            FWD speed
+//   --capture file         write everything the Mega sent, for host/rec_decode
+//   --max-late-us 100      fail if a sample was taken later than this
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "flight_recorder.h"
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+struct Block {
+  RecHeader header;
+  std::vector<RecSample> samples;
+  bool checksumOk;
+};
+
+static const uint64_t ARM_US = 2000000;
+static const uint64_t REARM_US = 6000000;
+static const uint64_t TRIG_US = 7000000;
+static const uint16_t POST_SAMPLES = 40;
+
+static double wallX;
+static int speed;
+static FILE *capture;
+static std::string rx;               // bytes not parsed yet
+static std::vector<Block> blocks;
+static int doneLines;
+static bool wantDump, rearmed, triggered;
+static std::vector<double> wheelPos[4];   // model wheel travel (m), indexed by millis()
+
+static void send(const char *line) {
+  RADIO_SERIAL.simInject(line);
+}
+
+static bool parseBlock(const uint8_t *p, size_t n, Block &b) {
+  if (n < sizeof(RecHeader) + 2) return false;
+  memcpy(&b.header, p, sizeof(RecHeader));
+  size_t body = sizeof(RecHeader) + b.header.count * sizeof(RecSample);
+  if (b.header.sampleBytes != sizeof(RecSample) || n != body + 2) return false;
+  uint8_t s1 = 0, s2 = 0;
+  for (size_t i = 0; i < body; i++) {
+    s1 = (s1 + p[i]) % 255;
+    s2 = (s2 + s1) % 255;
+  }
+  b.checksumOk = p[body] == s1 && p[body + 1] == s2;
+  b.samples.resize(b.header.count);
+  memcpy(b.samples.data(), p + sizeof(RecHeader), b.header.count * sizeof(RecSample));
+  return true;
+}
+
+// Text lines, except that "REC DUMP <n>" is followed by n binary bytes
+static void parseOutput() {
+  for (;;) {
+    size_t eol = rx.find("\r\n");
+    if (eol == std::string::npos) return;
+    std::string line = rx.substr(0, eol);
+    unsigned long bytes;
+    if (sscanf(line.c_str(), "REC DUMP %lu", &bytes) == 1) {
+      if (rx.size() < eol + 2 + bytes) return;
+      Block b;
+      if (!parseBlock((const uint8_t *)rx.data() + eol + 2, bytes, b)) simFail("malformed dump block");
+      else blocks.push_back(b);
+      rx.erase(0, eol + 2 + bytes);
+      continue;
+    }
+    if (line.compare(0, 9, "REC DONE ") == 0) {
+      doneLines++;
+      wantDump = true;
+    }
+    if (line.compare(0, 3, "ERR") == 0) simFail("%s", line.c_str());
+    rx.erase(0, eol + 2);
+  }
+}
+
+static void recorderSetup() {
+  wallX = simOptionF("wall", 1.5);
+  speed = (int)simOptionF("speed", 200);
+  const char *path = simOption("capture", nullptr);
+  if (path && !(capture = fopen(path, "wb"))) simFail("can't write %s", path);
+}
+
+static void recorderEveryMs() {
+  uint64_t now = simNowUs();
+  SimDrivetrain &drive = simRobotDrivetrain();
+  simRobotSensors().setRange(wallX - drive.pose().x);
+  for (int w = 0; w < 4; w++) {
+    double prev = wheelPos[w].empty() ? 0 : wheelPos[w].back();
+    wheelPos[w].resize(now / 1000 + 1, prev);
+    wheelPos[w].back() = prev + drive.wheelSpeed(w) * 0.001;
+  }
+
+  if (now >= 500000 && now < 501000) send("ENABLE\nSAFE_RANGE 300\n");
+  if (now >= ARM_US && now < ARM_US + 1000) {
+    char line[48];
+    snprintf(line, sizeof(line), "REC_ARM 1 %u\nFWD %d\n", POST_SAMPLES, speed);
+    send(line);
+  }
+  if (now >= REARM_US && !rearmed) {
+    rearmed = true;
+    char line[48];
+    snprintf(line, sizeof(line), "BACK 120\nREC_ARM 2 %u\n", POST_SAMPLES);
+    send(line);
+  }
+  if (now >= TRIG_US && !triggered) {
+    triggered = true;
+    if (doneLines < 2) send("REC_TRIG\n");
+  }
+  if (wantDump) {
+    wantDump = false;
+    send("REC_DUMP\n");
+  }
+
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  if (capture) fwrite(out.data(), 1, out.size(), capture);
+  rx += out;
+  parseOutput();
+}
+
+static void checkBlock(const Block &b, const char *name, uint16_t periodUs) {
+  const RecHeader &h = b.header;
+  unsigned maxLate = 0, maxLoop = 0;
+  for (const RecSample &s : b.samples) {
+    if (s.lateUs > maxLate) maxLate = s.lateUs;
+    if (s.loopUs > maxLoop) maxLoop = s.loopUs;
+  }
+  printf("%s: trigger %u, %u samples at %u us, trigger at sample %u, late max %u us, loop max %u us, checksum %s\n",
+         name, h.triggerSource, h.count, h.periodUs, h.triggerIndex, maxLate, maxLoop,
+         b.checksumOk ? "ok" : "BAD");
+
+  if (!b.checksumOk) simFail("%s: checksum mismatch", name);
+  if (h.magic[0] != REC_MAGIC0 || h.magic[1] != REC_MAGIC1 || h.version != REC_VERSION) simFail("%s: bad header", name);
+  if (h.periodUs != periodUs) simFail("%s: period %u us", name, h.periodUs);
+  if (h.count != REC_SAMPLES) simFail("%s: %u samples, expected a full ring", name, h.count);
+  if (h.triggerIndex != h.count - 1 - POST_SAMPLES) simFail("%s: trigger at %u", name, h.triggerIndex);
+  if (h.triggerIndex < h.count && !(b.samples[h.triggerIndex].flags & REC_FLAG_TRIGGER)) {
+    simFail("%s: trigger sample not flagged", name);
+  }
+  if (maxLate > simOptionF("max-late-us", 100) && h.triggerSource != REC_TRIG_FAULT) {
+    simFail("%s: sample %u us late", name, maxLate);
+  }
+}
+
+static void recorderReport() {
+  if (capture) fclose(capture);
+  if (blocks.size() != 2) {
+    simFail("got %d dumps, expected 2; run longer", (int)blocks.size());
+    return;
+  }
+
+  const Block &cut = blocks[0];
+  checkBlock(cut, "cutoff", 1000);
+  if (cut.header.triggerSource != REC_TRIG_SAFETY) simFail("cutoff: not triggered by the safety trip");
+  const RecSample *trig = cut.samples.data() + cut.header.triggerIndex;
+  if (cut.header.triggerIndex > 0) {
+    const RecSample &before = trig[-1];
+    bool drove = true, cutOff = true;
+    for (int w = 0; w < 4; w++) {
+      drove &= before.pwm[w] == speed && !(before.dir & (1 << w));
+      cutOff &= trig->pwm[w] == 0;
+    }
+    printf("cutoff: PWM %u %u %u %u the sample before the trigger, %u %u %u %u at it, forward block %s\n",
+           before.pwm[0], before.pwm[1], before.pwm[2], before.pwm[3],
+           trig->pwm[0], trig->pwm[1], trig->pwm[2], trig->pwm[3],
+           trig->flags & REC_FLAG_FWD_BLOCKED ? "set" : "clear");
+    if (!drove || !cutOff) simFail("cutoff: PWM doesn't show the cutoff at the trigger");
+    if (!(trig->flags & REC_FLAG_FWD_BLOCKED)) simFail("cutoff: forward block not recorded");
+  }
+
+  // Ticks over the ring against the model's wheel travel over the same
+  // milliseconds; the trigger sample was taken at triggerMs
+  size_t lastMs = cut.header.triggerMs + POST_SAMPLES;
+  size_t firstMs = cut.header.triggerMs - cut.header.triggerIndex - 1;
+  if (lastMs < wheelPos[0].size()) {
+    printf("cutoff: ticks over the ring vs model:");
+    for (int w = 0; w < 4; w++) {
+      long ticks = 0;
+      for (const RecSample &s : cut.samples) ticks += s.dEnc[w];
+      double model = (wheelPos[w][lastMs] - wheelPos[w][firstMs]) / DIST_PER_TICK;
+      printf(" %ld/%.1f", labs(ticks), model);
+      if (fabs(labs(ticks) - model) > 1.5) simFail("cutoff: M%d encoder ticks off the model", w + 1);
+    }
+    printf("\n");
+  }
+
+  const Block &manual = blocks[1];
+  checkBlock(manual, "second", 2000);
+  if (manual.header.triggerSource == REC_TRIG_COMMAND) {
+    const RecSample &s = manual.samples[manual.header.triggerIndex];
+    if (s.dir != 0x0F) simFail("second: expected all wheels reversing at REC_TRIG");
+  }
+}
+
+SIM_SCENARIO(recorder, "1 kHz flight recorder triggered by a safety trip, dumped and decoded",
+             recorderSetup, recorderEveryMs, recorderReport);
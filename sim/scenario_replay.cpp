@@ -0,0 +1,413 @@
+// Replay scenario: plays a UART capture (host/include/uart_capture.h) back
+// into the firmware's command parser and into the ESP's robot_comm.cpp, and
+// reports what each side cost on this machine and how the responses differ.
+//
+// Mega side: the captured bytes to the Mega go into RADIO_SERIAL, either at
+// their captured times (--speed original) or a line per loop() pass
+// (--speed max). The firmware's OK/ERR replies are compared in order with
+// the captured ones. ESP side: the captured bytes from the Mega go through
+// processRobotResponse(), at their captured times or back to back.
+//
+// Cost is host CPU time: for the Mega, the loop() pass that ran a line less
+// the median pass with nothing to do; for the ESP, the
+// processRobotResponse() calls that completed a line. Both are reported per
+// command or message type.
+//
+// A capture taken with --uart-capture from this firmware replays at
+// original speed with no reply differences. Keep the --responses file from
+// a known-good build and pass it to --expect-responses to gate changes.
+//
+//   --replay capture.ucap         required
+//   --speed original              or max
+//   --side both                   mega, esp or both
+//   --responses out.txt           write every response line
+//   --expect-responses good.txt   fail on any difference from that file
+//   --max-reply-diffs 0           OK/ERR replies allowed to differ from the capture
+//   --max-cost-us 0               fail if a Mega line costs more on average (0 = off)
+//
+// --seconds must cover the capture at original speed.
+
+#include "sim.h"
+#include "config.h"
+#include "uart_capture.h"
+#include "robot_comm.h"
+#include "metrics.h"
+#include "telemetry_history.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static const uint64_t PASS_US = 20;   // LOOP_US in sim_main.cpp
+
+// ---------------- metrics.cpp stand-ins ----------------
+// metrics.cpp needs the WiFi stack; robot_comm.cpp only reports to it
+
+LinkCounters linkCounters;
+static unsigned long espReplies, espTxBytes;
+
+void metricsCountTx(size_t bytes) { espTxBytes += bytes; }
+void metricsCommandSent(unsigned long) {}
+void metricsReplyReceived(unsigned long) { espReplies++; }
+void metricsRecordTrace(const TraceResult &) {}
+
+// ---------------- Capture ----------------
+
+static std::vector<UcapRecord> records;
+static std::vector<std::string> capturedReplies;
+static bool maxSpeed, replayMega, replayEsp;
+
+static bool isReply(const std::string &line) {
+  return line.compare(0, 2, "OK") == 0 || line.compare(0, 3, "ERR") == 0;
+}
+
+// Splits a byte stream into lines without their line ends
+struct LineSplitter {
+  std::string partial;
+
+  template <typename F> void feed(const char *p, size_t n, F onLine) {
+    for (size_t i = 0; i < n; i++) {
+      if (p[i] == '\r') continue;
+      if (p[i] != '\n') {
+        partial += p[i];
+        continue;
+      }
+      onLine(partial);
+      partial.clear();
+    }
+  }
+};
+
+// Command name of a line to the Mega, past any "#<trace id> "
+static std::string commandName(const std::string &line) {
+  size_t start = 0;
+  if (!line.empty() && line[0] == '#') {
+    start = line.find(' ');
+    start = start == std::string::npos ? line.size() : start + 1;
+  }
+  size_t end = line.find(' ', start);
+  std::string name = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+  return name.empty() ? "(empty)" : name;
+}
+
+struct CostTable {
+  std::map<std::string, std::vector<double>> us;
+  double total = 0;
+  unsigned long count = 0;
+
+  void add(const std::string &name, double costUs) {
+    us[name].push_back(costUs);
+    total += costUs;
+    count++;
+  }
+};
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1) + 0.5)];
+}
+
+// ---------------- Mega side ----------------
+
+static std::vector<std::string> megaLines;     // max speed: one line per pass
+static size_t nextMegaLine;
+static LineSplitter megaOut;
+static std::vector<std::string> megaResponses;
+static std::vector<std::string> megaInFlight;  // lines injected, not yet run
+static LineSplitter megaIn;
+static std::vector<double> idlePassUs;
+static std::vector<double> linePassUs;
+static std::vector<std::string> linePassNames;
+static unsigned long megaChecksPending;
+
+static void collectMega() {
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  megaOut.feed(out.data(), out.size(), [](const std::string &l) { megaResponses.push_back(l); });
+}
+
+static void injectMega(const char *p, size_t n);
+
+// One pass after a line went in: that pass ran it
+static void checkMegaPass(void *) {
+  megaChecksPending--;
+  if (RADIO_SERIAL.available()) {
+    megaChecksPending++;
+    simSchedule(PASS_US, checkMegaPass, nullptr);
+    return;
+  }
+  collectMega();
+  double us = simLastLoopWallNs() / 1000.0;
+  for (const std::string &name : megaInFlight) {
+    linePassUs.push_back(us / megaInFlight.size());
+    linePassNames.push_back(name);
+  }
+  megaInFlight.clear();
+
+  if (maxSpeed && nextMegaLine < megaLines.size()) {
+    const std::string &l = megaLines[nextMegaLine++];
+    injectMega(l.data(), l.size());
+  }
+}
+
+static void injectMega(const char *p, size_t n) {
+  RADIO_SERIAL.simInject(p, n);
+  size_t before = megaInFlight.size();
+  megaIn.feed(p, n, [](const std::string &l) { megaInFlight.push_back(commandName(l)); });
+  if (megaInFlight.size() > before && megaChecksPending == 0) {
+    megaChecksPending++;
+    simSchedule(PASS_US, checkMegaPass, nullptr);
+  }
+}
+
+static void injectMegaRecord(void *ctx) {
+  const UcapRecord &r = records[(size_t)(uintptr_t)ctx];
+  injectMega((const char *)r.data, r.len);
+}
+
+// ---------------- ESP side ----------------
+
+static std::vector<std::string> espResponses;
+static LineSplitter espIn, espOut;
+static CostTable espCost;
+static double espPendingUs;
+static size_t espRecordsDone;
+
+static void collectEsp() {
+  std::string out = Serial.simTakeOutput();
+  espOut.feed(out.data(), out.size(), [](const std::string &l) { espResponses.push_back(l); });
+}
+
+// robot_comm.cpp reads the Mega on Serial, which the firmware only writes
+// debug output to: drop that, then feed the ESP a line at a time, so each
+// line is charged for its own processRobotResponse() call, and keep what
+// it prints
+static void feedEsp(const UcapRecord &r) {
+  const char *p = (const char *)r.data;
+  size_t left = r.len;
+  while (left > 0) {
+    const char *nl = (const char *)memchr(p, '\n', left);
+    size_t n = nl ? (size_t)(nl - p) + 1 : left;
+    Serial.simTakeOutput();
+    Serial.simInject(p, n);
+    auto start = std::chrono::steady_clock::now();
+    processRobotResponse();
+    espPendingUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    espIn.feed(p, n, [](const std::string &l) {
+      if (l.empty()) return;
+      espCost.add(commandName(l), espPendingUs);
+      espPendingUs = 0;
+    });
+    collectEsp();
+    p += n;
+    left -= n;
+  }
+  espRecordsDone++;
+}
+
+static void espRecordEvent(void *ctx) {
+  feedEsp(records[(size_t)(uintptr_t)ctx]);
+}
+
+static void espAllAtOnce(void *) {
+  for (const UcapRecord &r : records) {
+    if (r.dir == UCAP_FROM_MEGA) feedEsp(r);
+  }
+}
+
+// ---------------- Scenario ----------------
+
+static std::chrono::steady_clock::time_point wallStart;
+static size_t megaRecordCount, espRecordCount;
+static uint64_t captureSpanUs;
+
+static void replaySetup() {
+  const char *path = simOption("replay", nullptr);
+  UcapReader reader;
+  if (!path || !reader.open(path)) {
+    simFail("--replay needs a UART capture (%s)", path ? path : "none given");
+    return;
+  }
+  const char *speed = simOption("speed", "original");
+  maxSpeed = strcmp(speed, "max") == 0;
+  const char *side = simOption("side", "both");
+  replayMega = strcmp(side, "esp") != 0;
+  replayEsp = strcmp(side, "mega") != 0;
+
+  UcapRecord r;
+  LineSplitter capturedOut, capturedIn;
+  std::string pending;
+  while (reader.next(r)) {
+    records.push_back(r);
+    captureSpanUs = r.us;
+    if (r.dir == UCAP_FROM_MEGA) {
+      espRecordCount++;
+      capturedOut.feed((const char *)r.data, r.len, [](const std::string &l) {
+        if (isReply(l)) capturedReplies.push_back(l);
+      });
+    } else {
+      megaRecordCount++;
+      // Lines for max speed keep their own line ends
+      for (size_t i = 0; i < r.len; i++) {
+        pending += (char)r.data[i];
+        if (r.data[i] == '\n') {
+          megaLines.push_back(pending);
+          pending.clear();
+        }
+      }
+    }
+  }
+  printf("capture: %zu records over %.3f s (%s clock), %zu to the Mega, %zu from it\n", records.size(),
+         captureSpanUs / 1e6, reader.header().clock == UCAP_CLOCK_SIM ? "sim" : "host",
+         megaRecordCount, espRecordCount);
+
+  for (size_t i = 0; i < records.size(); i++) {
+    const UcapRecord &rec = records[i];
+    bool toMega = rec.dir == UCAP_TO_MEGA;
+    if (toMega && replayMega && !maxSpeed) simSchedule(rec.us, injectMegaRecord, (void *)(uintptr_t)i);
+    if (!toMega && replayEsp && !maxSpeed) simSchedule(rec.us, espRecordEvent, (void *)(uintptr_t)i);
+  }
+  // At max speed, start where the capture's first command was sent
+  if (maxSpeed) {
+    uint64_t firstUs = records.empty() ? 0 : records.front().us;
+    for (const UcapRecord &rec : records) {
+      if (rec.dir == UCAP_TO_MEGA) {
+        firstUs = rec.us;
+        break;
+      }
+    }
+    if (replayMega && !megaLines.empty()) {
+      simSchedule(firstUs, [](void *) {
+        const std::string &l = megaLines[nextMegaLine++];
+        injectMega(l.data(), l.size());
+      }, nullptr);
+    }
+    if (replayEsp) simSchedule(firstUs, espAllAtOnce, nullptr);
+  }
+  wallStart = std::chrono::steady_clock::now();
+}
+
+static void replayEveryMs() {
+  if (megaChecksPending == 0 && !RADIO_SERIAL.available()) idlePassUs.push_back(simLastLoopWallNs() / 1000.0);
+  collectMega();
+}
+
+static void printCosts(const char *title, const CostTable &t) {
+  printf("%s: %lu lines, mean %.2f us", title, t.count, t.count ? t.total / t.count : 0.0);
+  if (t.total > 0) printf(", %.0f lines/s of CPU", t.count / (t.total / 1e6));
+  printf("\n");
+  printf("  %-14s %7s %9s %9s %9s\n", "message", "count", "p50 us", "p99 us", "max us");
+  for (const auto &e : t.us) {
+    printf("  %-14s %7zu %9.2f %9.2f %9.2f\n", e.first.c_str(), e.second.size(), percentile(e.second, 0.5),
+           percentile(e.second, 0.99), percentile(e.second, 1.0));
+  }
+}
+
+static std::vector<std::string> allResponses() {
+  std::vector<std::string> out;
+  for (const std::string &l : megaResponses) out.push_back("mega " + l);
+  for (const std::string &l : espResponses) out.push_back("esp " + l);
+  if (replayEsp) {
+    char state[96];
+    snprintf(state, sizeof(state), "esp state connected %d motors %d speed %d history %u",
+             robotStatus.connected, robotStatus.motorsEnabled, robotStatus.currentSpeed,
+             (unsigned)historyCount(HISTORY_RAW));
+    out.push_back(state);
+  }
+  return out;
+}
+
+static void compareResponses(const std::vector<std::string> &got, const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    simFail("can't read %s", path);
+    return;
+  }
+  std::vector<std::string> want;
+  char buf[512];
+  while (fgets(buf, sizeof(buf), f)) {
+    std::string l = buf;
+    while (!l.empty() && (l.back() == '\n' || l.back() == '\r')) l.pop_back();
+    want.push_back(l);
+  }
+  fclose(f);
+  size_t diffs = 0;
+  for (size_t i = 0; i < std::max(want.size(), got.size()); i++) {
+    const std::string *a = i < want.size() ? &want[i] : nullptr;
+    const std::string *b = i < got.size() ? &got[i] : nullptr;
+    if (a && b && *a == *b) continue;
+    if (diffs++ < 5) {
+      printf("  line %zu: expected \"%s\"\n           got      \"%s\"\n", i + 1, a ? a->c_str() : "(end)",
+             b ? b->c_str() : "(end)");
+    }
+  }
+  printf("responses: %zu lines, %zu differ from %s\n", got.size(), diffs, path);
+  if (diffs) simFail("%zu response lines changed", diffs);
+}
+
+static void replayReport() {
+  if (records.empty()) return;
+  collectMega();
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  printf("replay: %s speed, %.3f s of host time\n", maxSpeed ? "max" : "original", wallS);
+
+  if (replayMega) {
+    std::sort(idlePassUs.begin(), idlePassUs.end());
+    double idleUs = idlePassUs.empty() ? 0 : idlePassUs[idlePassUs.size() / 2];
+    CostTable mega;
+    for (size_t i = 0; i < linePassUs.size(); i++) {
+      mega.add(linePassNames[i], std::max(0.0, linePassUs[i] - idleUs));
+    }
+    printf("mega: idle loop() pass %.2f us (median, subtracted)\n", idleUs);
+    printCosts("mega", mega);
+
+    std::vector<std::string> replies;
+    for (const std::string &l : megaResponses) {
+      if (isReply(l)) replies.push_back(l);
+    }
+    size_t diffs = 0;
+    for (size_t i = 0; i < std::max(replies.size(), capturedReplies.size()); i++) {
+      const char *a = i < capturedReplies.size() ? capturedReplies[i].c_str() : "(none)";
+      const char *b = i < replies.size() ? replies[i].c_str() : "(none)";
+      if (!strcmp(a, b)) continue;
+      if (diffs++ < 5) printf("  reply %zu: capture \"%s\", replay \"%s\"\n", i + 1, a, b);
+    }
+    printf("mega replies: %zu in capture, %zu in replay, %zu differ\n", capturedReplies.size(), replies.size(),
+           diffs);
+    if (diffs > (size_t)simOptionF("max-reply-diffs", 0)) simFail("%zu replies differ from the capture", diffs);
+    double maxCost = simOptionF("max-cost-us", 0);
+    if (maxCost > 0 && mega.count && mega.total / mega.count > maxCost) {
+      simFail("a Mega line costs %.2f us, more than %.2f", mega.total / mega.count, maxCost);
+    }
+    size_t left = maxSpeed ? megaLines.size() - nextMegaLine : 0;
+    if (!maxSpeed && !records.empty() && simNowUs() < captureSpanUs) left = 1;
+    if (left || !megaInFlight.empty()) simFail("replay cut short; raise --seconds");
+  }
+
+  if (replayEsp) {
+    printCosts("esp", espCost);
+    printf("esp: %lu replies seen, %u line overflows, %lu bytes of debug output\n", espReplies,
+           linkCounters.lineOverflows, espTxBytes);
+    if (espRecordsDone < espRecordCount) simFail("ESP replay cut short; raise --seconds");
+  }
+
+  std::vector<std::string> responses = allResponses();
+  const char *outPath = simOption("responses", nullptr);
+  if (outPath) {
+    FILE *f = fopen(outPath, "w");
+    if (!f) {
+      simFail("can't write %s", outPath);
+    } else {
+      for (const std::string &l : responses) fprintf(f, "%s\n", l.c_str());
+      fclose(f);
+    }
+  }
+  const char *expectPath = simOption("expect-responses", nullptr);
+  if (expectPath) compareResponses(responses, expectPath);
+}
+
+SIM_SCENARIO(replay, "replay a UART capture into the parser and robot_comm.cpp",
+             replaySetup, replayEveryMs, replayReport);
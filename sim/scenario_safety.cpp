@@ -0,0 +1,269 @@
+// Safety scenario: drives at a wall with the obstacle limit armed, then
+// jams one wheel to trip the current limit, and measures how long each
+// cutoff takes from the moment the firmware could first know about it.
+//
+//   obstacle: from the falling edge of the echo that shows the wall inside
+//   the limit to the last wheel's direction pins going low. Anything above
+//   zero is time spent with interrupts masked.
+//
+//   current:  from the jammed motor's current crossing the limit to its
+//   direction pins going low; SAFE_CURRENT's trip time plus ADC sampling.
+//
+//   blind:    the sensor stops answering. Near the wall it must not release
+//   the block, so a forward command is still refused; in the open, a
+//   forward command must be cut off after SAFETY_RANGE_NO_ECHO pings. Once
+//   the echoes return past the hysteresis the block is released.
+//
+//   open:     the wall goes away and every echo runs the sensor's full
+//   timeout. That is a clear path: forward motion must not be blocked.
+//
+//   --wall 1.5          wall distance ahead of the start position (m)
+//   --speed 200         FWD/BACK speed
+//   --stop-mm 300       SAFE_RANGE limit
+//   --current-ma 1500 --trip-ms 100
+//                       SAFE_CURRENT limit
+//   --jam-motor 3       motor 1..4 held still in the current test
+//   --max-react-us 100  fail if the obstacle cutoff takes longer
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "config.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <string>
+
+enum Phase { PHASE_START, PHASE_APPROACH, PHASE_STOPPED, PHASE_REFUSED, PHASE_BACKING,
+             PHASE_JAMMED, PHASE_BLIND, PHASE_SIGHTED, PHASE_OPEN, PHASE_DONE };
+
+static const uint8_t dirPins[4][2] = {
+  {M1_IN1, M1_IN2}, {M2_IN1, M2_IN2}, {M3_IN1, M3_IN2}, {M4_IN1, M4_IN2}
+};
+
+static Phase phase;
+static uint64_t phaseUs;
+static double wallX, stopM, currentLimitA;
+static int speed, jamWheel;
+static std::string rxLine;
+
+static uint64_t crossUs = SIM_NEVER, echoUs, cutUs = SIM_NEVER;
+static uint64_t overUs = SIM_NEVER, jamCutUs = SIM_NEVER;
+static uint64_t blindUs, blindCutUs = SIM_NEVER;
+static bool blindDriven;
+static double cutRange, minRange = 1e9;
+static bool refusedMoved, othersStopped, openBlocked;
+static unsigned long obstacleLines, blindLines, clearLines, currentLines, wrongMotorLines;
+
+static void send(const char *fmt, ...) {
+  char line[48];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line) - 1, fmt, ap);
+  va_end(ap);
+  strcat(line, "\n");
+  RADIO_SERIAL.simInject(line);
+}
+
+static void enter(Phase p) {
+  phase = p;
+  phaseUs = simNowUs();
+}
+
+static bool coasting(int wheel) {
+  return simPinLevel(dirPins[wheel][0]) == LOW && simPinLevel(dirPins[wheel][1]) == LOW;
+}
+
+// Timestamps the cutoffs at the exact pin write, not at the next millisecond
+static void dirPinsChanged(uint8_t pin) {
+  (void)pin;
+  if (phase == PHASE_APPROACH && cutUs == SIM_NEVER &&
+      coasting(0) && coasting(1) && coasting(2) && coasting(3)) {
+    cutUs = simNowUs();
+    echoUs = simRobotSensors().lastEchoUs();
+    cutRange = wallX - simRobotDrivetrain().pose().x;
+  }
+  if (phase == PHASE_JAMMED && overUs != SIM_NEVER && jamCutUs == SIM_NEVER && coasting(jamWheel)) {
+    jamCutUs = simNowUs();
+  }
+  if (phase == PHASE_BLIND && blindUs && blindCutUs == SIM_NEVER) {
+    bool allCoasting = coasting(0) && coasting(1) && coasting(2) && coasting(3);
+    if (!allCoasting) blindDriven = true;
+    else if (blindDriven) blindCutUs = simNowUs();
+  }
+}
+
+static void handleLine(const std::string &line) {
+  int motor;
+  long mA;
+  if (line == "TRIP OBSTACLE 0") blindLines++;
+  else if (line.compare(0, 14, "TRIP OBSTACLE ") == 0) obstacleLines++;
+  else if (line == "TRIP OBSTACLE_CLEAR") clearLines++;
+  else if (sscanf(line.c_str(), "TRIP CURRENT %d %ld", &motor, &mA) == 2) {
+    if (motor == jamWheel + 1) currentLines++;
+    else wrongMotorLines++;
+  }
+}
+
+static void safetySetup() {
+  wallX = simOptionF("wall", 1.5);
+  speed = (int)simOptionF("speed", 200);
+  stopM = simOptionF("stop-mm", 300) / 1000;
+  currentLimitA = simOptionF("current-ma", 1500) / 1000;
+  jamWheel = constrain((int)simOptionF("jam-motor", 3), 1, 4) - 1;
+  simAddOutputHook(dirPinsChanged);
+}
+
+static void safetyEveryMs() {
+  SimDrivetrain &drive = simRobotDrivetrain();
+  uint64_t now = simNowUs();
+  double range = wallX - drive.pose().x;
+  bool blind = phase == PHASE_STOPPED || phase == PHASE_REFUSED || (phase == PHASE_BLIND && blindUs);
+  simRobotSensors().setDead(blind);
+  simRobotSensors().setRange(phase == PHASE_OPEN ? -1 : range);
+  if (phase != PHASE_OPEN && range < minRange) minRange = range;
+
+  switch (phase) {
+  case PHASE_START:
+    if (now >= 500000 && now < 501000) {
+      send("ENABLE");
+      send("SAFE_RANGE %d", (int)(stopM * 1000));
+      send("SAFE_CURRENT %d %d", (int)(currentLimitA * 1000), (int)simOptionF("trip-ms", 100));
+    }
+    if (now >= 2000000) {     // after the gyro bias calibration
+      send("FWD %d", speed);
+      enter(PHASE_APPROACH);
+    }
+    break;
+
+  case PHASE_APPROACH:
+    if (crossUs == SIM_NEVER && range < stopM) crossUs = now;
+    if (cutUs != SIM_NEVER) enter(PHASE_STOPPED);
+    else if (now - phaseUs > 10000000) {
+      simFail("no obstacle cutoff, range %.3f m", range);
+      enter(PHASE_DONE);
+    }
+    break;
+
+  case PHASE_STOPPED:
+    if (now - phaseUs >= 500000) {
+      send("FWD %d", speed);      // must be refused while the wall is close
+      enter(PHASE_REFUSED);
+    }
+    break;
+
+  case PHASE_REFUSED:
+    for (int w = 0; w < 4; w++) {
+      if (drive.wheelSpeed(w) > 0.01) refusedMoved = true;
+    }
+    if (now - phaseUs >= 200000) {
+      send("BACK %d", speed);
+      enter(PHASE_BACKING);
+    }
+    break;
+
+  case PHASE_BACKING:
+    if (now - phaseUs >= 1000000) {
+      enter(PHASE_JAMMED);
+      drive.setHeld(jamWheel, true);
+      send("BACK %d", speed);     // away from the wall, so only the current limit can trip
+    }
+    break;
+
+  case PHASE_JAMMED:
+    if (overUs == SIM_NEVER && fabs(drive.current(jamWheel)) > currentLimitA) overUs = now;
+    if (now - phaseUs >= 1000000) {
+      othersStopped = false;
+      for (int w = 0; w < 4; w++) {
+        if (w != jamWheel && fabs(drive.wheelSpeed(w)) < 0.01) othersStopped = true;
+      }
+      send("STOP");
+      send("SAFE_CLEAR");
+      drive.setHeld(jamWheel, false);
+      enter(PHASE_BLIND);
+    }
+    break;
+
+  case PHASE_BLIND:
+    if (!blindUs && now - phaseUs >= 200000) {
+      blindUs = now;
+      send("FWD %d", speed);      // away from the wall, but nothing to see it by
+    }
+    if (blindCutUs != SIM_NEVER || now - phaseUs >= 1200000) enter(PHASE_SIGHTED);
+    break;
+
+  case PHASE_SIGHTED:
+    if (now - phaseUs >= 500000) {
+      send("STOP");
+      enter(PHASE_OPEN);
+      send("FWD %d", speed);      // nothing in range, well past the no-echo count
+    }
+    break;
+
+  case PHASE_OPEN:
+    if (now - phaseUs >= 500000) {
+      for (int w = 0; w < 4; w++) {
+        if (drive.wheelSpeed(w) < 0.01) openBlocked = true;
+      }
+    }
+    if (now - phaseUs >= 1000000) {
+      send("STOP");
+      enter(PHASE_DONE);
+    }
+    break;
+
+  case PHASE_DONE:
+    break;
+  }
+
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  for (char c : out) {
+    if (c == '\r') continue;
+    if (c != '\n') {
+      rxLine += c;
+      continue;
+    }
+    handleLine(rxLine);
+    rxLine.clear();
+  }
+}
+
+static void safetyReport() {
+  if (cutUs != SIM_NEVER) {
+    printf("obstacle: limit crossed at %.3f s, cutoff %.1f ms later at %.3f m, "
+           "%llu us after the echo; closest %.3f m\n",
+           crossUs / 1e6, (cutUs - crossUs) / 1e3, cutRange,
+           (unsigned long long)(cutUs - echoUs), minRange);
+  }
+  if (jamCutUs != SIM_NEVER && overUs != SIM_NEVER) {
+    printf("current:  motor %d over %.2f A at %.3f s, cutoff %.1f ms later\n",
+           jamWheel + 1, currentLimitA, overUs / 1e6, (jamCutUs - overUs) / 1e3);
+  }
+  if (blindCutUs != SIM_NEVER) {
+    printf("blind:    forward cut off %.1f ms after the echoes stopped\n", (blindCutUs - blindUs) / 1e3);
+  }
+  printf("reports:  %lu TRIP OBSTACLE, %lu TRIP OBSTACLE 0, %lu TRIP OBSTACLE_CLEAR, %lu TRIP CURRENT\n",
+         obstacleLines, blindLines, clearLines, currentLines);
+
+  if (phase != PHASE_DONE) simFail("scenario didn't finish; run longer");
+  if (cutUs == SIM_NEVER) return;
+  double maxReactUs = simOptionF("max-react-us", 100);
+  if (cutUs - echoUs > maxReactUs) {
+    simFail("obstacle cutoff took %llu us", (unsigned long long)(cutUs - echoUs));
+  }
+  if (minRange <= 0) simFail("hit the wall");
+  if (refusedMoved) simFail("forward command not refused near the wall");
+  if (obstacleLines != 1 || blindLines != 1 || clearLines != 2) {
+    simFail("expected an obstacle trip, a blind trip and a clear after each");
+  }
+  if (phase == PHASE_DONE && jamCutUs == SIM_NEVER) simFail("jammed motor not cut off");
+  if (currentLines != 1 || wrongMotorLines) simFail("expected one current trip, on motor %d", jamWheel + 1);
+  if (othersStopped) simFail("current trip stopped other wheels");
+  uint64_t maxBlindUs = (SAFETY_RANGE_NO_ECHO + 1) * RANGE_PERIOD_MS * 1000;
+  if (openBlocked) simFail("forward motion blocked with nothing in range");
+  if (blindCutUs == SIM_NEVER) simFail("no cutoff with the sensor blind");
+  else if (blindCutUs - blindUs > maxBlindUs) {
+    simFail("blind cutoff took %.1f ms", (blindCutUs - blindUs) / 1e3);
+  }
+}
+
+SIM_SCENARIO(safety, "obstacle and stall cutoffs from the sensor interrupts", safetySetup, safetyEveryMs, safetyReport);
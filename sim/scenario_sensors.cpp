@@ -0,0 +1,86 @@
+// Sensors scenario: the robot drives toward a wall while the sensor
+// manager samples battery, motor currents and ultrasonic range in the
+// background. Reports frame rate, ADC throughput, measurement error against
+// the models and the longest loop() pass.
+//
+//   --wall 2.0        wall distance ahead of the start position (m)
+//   --speed 150       FWD speed
+//   --battery 7.6     open-circuit battery voltage
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "sim_adc.h"
+#include "sensor_manager.h"
+#include "config.h"
+
+#include <math.h>
+
+static double wallX;
+static char fwdCommand[24];
+static bool started, stopped;
+static unsigned long framesRead, rangeSamples;
+static uint8_t lastSeq;
+static unsigned long lastRangeUs;
+static double rangeErrSum, rangeErrMax, batteryErrMax, currentErrSum, currentErrMax;
+
+static void sensorsSetup() {
+  wallX = simOptionF("wall", 2.0);
+  snprintf(fwdCommand, sizeof(fwdCommand), "FWD %d\n", (int)simOptionF("speed", 150));
+  simRobotSensors().setBatteryVolts(simOptionF("battery", 7.6));
+}
+
+static void sensorsEveryMs() {
+  SimSensors &sensors = simRobotSensors();
+  SimDrivetrain &drive = simRobotDrivetrain();
+  uint64_t now = simNowUs();
+
+  double range = wallX - drive.pose().x;
+  sensors.setRange(range);
+  if (!started && now >= 2000000) {
+    RADIO_SERIAL.simInject(fwdCommand);
+    started = true;
+  }
+  if (started && !stopped && range < 0.3) {
+    RADIO_SERIAL.simInject("STOP\n");
+    stopped = true;
+  }
+
+  SensorFrame f;
+  if (!sensorsGetFrame(f) || f.seq == lastSeq) return;
+  lastSeq = f.seq;
+  framesRead++;
+
+  // Frames average over the last ~8 ms; compare with the models now
+  double batteryErr = fabs(sensorBatteryVolts(f) - sensors.batteryVolts());
+  if (batteryErr > batteryErrMax) batteryErrMax = batteryErr;
+  for (int m = 1; m <= 4; m++) {
+    double err = fabs(sensorMotorAmps(f, m) - drive.current(m - 1));
+    currentErrSum += err;
+    if (err > currentErrMax) currentErrMax = err;
+  }
+  if (f.rangeMm && f.rangeMm != RANGE_CLEAR && f.rangeTimeUs != lastRangeUs) {
+    // Up to one frame old: the robot has moved a few mm since
+    lastRangeUs = f.rangeTimeUs;
+    double err = fabs(f.rangeMm / 1000.0 - range);
+    rangeErrSum += err;
+    if (err > rangeErrMax) rangeErrMax = err;
+    rangeSamples++;
+  }
+}
+
+static void sensorsReport() {
+  double seconds = simNowUs() / 1e6;
+  printf("frames: %lu published (%.0f/s), %lu read by the scenario\n",
+         sensorFrameCount(), sensorFrameCount() / seconds, framesRead);
+  printf("adc:    %lu conversions (%.0f/s per channel)\n",
+         simAdcConversions(), simAdcConversions() / seconds / SENSOR_ADC_CHANNELS);
+  printf("range:  %lu pings, %lu fresh readings, error mean %.1f mm max %.1f mm\n",
+         simRobotSensors().pings(), rangeSamples,
+         rangeSamples ? 1000 * rangeErrSum / rangeSamples : 0.0, 1000 * rangeErrMax);
+  printf("analog: battery error max %.3f V, motor current error mean %.3f A max %.3f A\n",
+         batteryErrMax, framesRead ? currentErrSum / (4 * framesRead) : 0.0, currentErrMax);
+  if (sensorFrameCount() == 0) simFail("no sensor frames");
+  if (rangeSamples == 0) simFail("no ultrasonic readings");
+}
+
+SIM_SCENARIO(sensors, "ADC/ultrasonic sampling while driving at a wall", sensorsSetup, sensorsEveryMs, sensorsReport);
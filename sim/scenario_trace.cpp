@@ -0,0 +1,261 @@
+// Trace scenario: the ESP end of the link runs the ESP's own
+// command_trace.cpp against the firmware. Bytes take their 10 bit times at
+// 115200 baud in each direction, and the ESP only reads a reply at its next
+// loop() pass. Its clock is offset from the Mega's and runs at a slightly
+// different rate. The ESP polls REQ_ODOM every 500 ms, as robot_comm.cpp
+// does, and a "page" sends traced drive commands in between.
+//
+// Checks: every traced command reports back, drive commands show an
+// actuation and REQ_ODOM doesn't, and the clock offset and the UART stages
+// stay within the error bound the ESP reports. The sim charges no time for
+// running code, so mega_exec and mega_reply read 0 here. A loop() stall
+// (--stall-at 5.18 --stall-ms 30) shows up in uart_out of the command that
+// meets it; --esp-loop-us 10000 shows what the old delay(10) cost.
+//
+//   --esp-offset-us 123456789   ESP micros() minus Mega micros() at start
+//   --drift-ppm 40              ESP clock rate error
+//   --esp-loop-us 1000          ESP loop() period (delay(1) and handlers)
+//   --esp-handler-us 300        /command handler time before the UART write
+//   --max-offset-err-us 100     fail if the offset is typically further off
+//   --seed 1
+
+#include "sim.h"
+#include "config.h"
+#include "command_trace.h"
+#include "esp_config.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+static const double BYTE_US = 10 * 1e6 / 115200;
+static const uint64_t LINK_TICK_US = 20;           // one Mega loop() pass
+static const uint64_t POLL_EVERY_US = 500000;      // STATUS_UPDATE_INTERVAL_MS
+
+struct PageCommand {
+  uint64_t atUs;
+  const char *command;
+  bool drives;
+};
+
+static const PageCommand pageCommands[] = {
+  {1000000, "ENABLE", false},
+  {1700000, "FWD 150", true},
+  {2650000, "LEFT 120", true},
+  {3300000, "STOP", true},
+  {4150000, "SET_V 120 180", true},
+  {5180000, "BACK 100", true},
+  {6420000, "STOP", true},
+  {7310000, "MALL 80 80 80 80", true},
+  {8050000, "REQ_IMU", false},
+  {8900000, "STOP", true},
+};
+static const int PAGE_COMMANDS = sizeof(pageCommands) / sizeof(pageCommands[0]);
+
+struct Sent {
+  uint64_t doneUs;          // sim time the last byte left the ESP
+  bool drives;
+};
+
+struct WireByte {
+  double atUs;
+  char c;
+};
+
+struct StageStats {
+  std::vector<uint32_t> us;
+};
+
+static double espOffsetUs, driftPpm, espLoopUs, espHandlerUs, maxOffsetErr;
+static std::mt19937 rng;
+
+static double outFreeUs, backFreeUs;              // when each wire direction is idle again
+static std::deque<WireByte> backWire;             // Mega -> ESP, in flight
+static std::string espLine;
+static std::map<uint16_t, Sent> sent;
+static int nextPage;
+static uint16_t pageId;
+static uint64_t nextPollUs;
+static uint64_t replyReadUs;                      // sim time the last OK/ERR was read
+static int results;
+static std::vector<double> offsetErrors;
+static double worstError;
+static StageStats stats[TRACE_STAGE_COUNT];
+
+static uint32_t espClock(uint64_t simUs) {
+  return (uint32_t)(uint64_t)(espOffsetUs + simUs * (1 + driftPpm * 1e-6));
+}
+
+// Mega micros() minus ESP micros() right now
+static int32_t trueOffset() {
+  uint64_t now = simNowUs();
+  return (int32_t)((uint32_t)now - espClock(now));
+}
+
+static void deliverByte(void *ctx) {
+  char c = (char)(uintptr_t)ctx;
+  RADIO_SERIAL.simInject(&c, 1);
+}
+
+// Serial.printf + Serial.flush(): returns when the last byte is out
+static uint64_t espWrite(const std::string &line) {
+  double at = std::max((double)simNowUs(), outFreeUs);
+  for (char c : line) {
+    at += BYTE_US;
+    simSchedule((uint64_t)(at - simNowUs()), deliverByte, (void *)(uintptr_t)(uint8_t)c);
+  }
+  outFreeUs = at;
+  return (uint64_t)at;
+}
+
+// sendCommandToRobot() with a trace id
+static void espSend(const char *command, uint16_t id, uint32_t receivedUs, bool drives) {
+  char line[64];
+  snprintf(line, sizeof(line), "#%u %s\r\n", id, command);
+  uint64_t doneUs = espWrite(line);
+  traceCommandSent(id, receivedUs, espClock(doneUs));
+  sent[id] = Sent{doneUs, drives};
+}
+
+static void checkResult(const TraceResult &r, const std::string &line) {
+  auto it = sent.find(r.id);
+  if (it == sent.end()) {
+    simFail("TR for unknown id %u", r.id);
+    return;
+  }
+  Sent s = it->second;
+  sent.erase(it);
+  results++;
+  if (r.actuated != s.drives) {
+    simFail("id %u: actuation %s for a command that %s the motors", r.id,
+            r.actuated ? "reported" : "missing", s.drives ? "drives" : "doesn't drive");
+  }
+  for (int i = 0; i < TRACE_STAGE_COUNT; i++) {
+    if (i != TRACE_MEGA_EXEC || r.actuated) stats[i].us.push_back(r.stageUs[i]);
+  }
+
+  // The Mega stamps are on the sim clock, so the true UART stages follow
+  // from the TR line and the link model
+  unsigned id;
+  unsigned long rxUs, toAck;
+  long toAct;
+  if (sscanf(line.c_str(), "TR %u %lu %ld %lu", &id, &rxUs, &toAct, &toAck) != 4) return;
+  double outErr = (double)r.stageUs[TRACE_UART_OUT] - ((double)rxUs - s.doneUs);
+  double backErr = (double)r.stageUs[TRACE_UART_BACK] - ((double)replyReadUs - (rxUs + toAck));
+
+  TraceClock clock;
+  traceGetClock(clock);
+  double err = (double)(int32_t)(clock.offsetUs - trueOffset());
+  double worst = std::max(fabs(err), std::max(fabs(outErr), fabs(backErr)));
+  if (clock.samples >= 3) {
+    offsetErrors.push_back(fabs(err));
+    worstError = std::max(worstError, worst);
+  }
+  if (worst > clock.uncertaintyUs + 2) {
+    simFail("id %u: offset off by %.0f us, more than its %u us bound", r.id, worst, clock.uncertaintyUs);
+  }
+}
+
+// Reads what has arrived and handles whole lines, like processRobotResponse()
+static void espReadLink() {
+  uint64_t now = simNowUs();
+  while (!backWire.empty() && backWire.front().atUs <= now) {
+    char c = backWire.front().c;
+    backWire.pop_front();
+    if (c == '\r') continue;
+    if (c != '\n') {
+      espLine += c;
+      continue;
+    }
+    uint32_t espNow = espClock(now);
+    if (espLine.compare(0, 2, "OK") == 0 || espLine.compare(0, 3, "ERR") == 0) {
+      traceReplyReceived(espNow, espLine.size() + 2);
+      replyReadUs = now;
+    } else if (espLine.compare(0, 3, "TR ") == 0) {
+      TraceResult r;
+      if (traceMegaReport(espLine.c_str(), espNow, r)) checkResult(r, espLine);
+    }
+    espLine.clear();
+  }
+}
+
+static void espLoop(void *) {
+  espReadLink();
+  uint64_t now = simNowUs();
+
+  if (nextPage < PAGE_COMMANDS && now >= pageCommands[nextPage].atUs) {
+    const PageCommand &p = pageCommands[nextPage++];
+    // The handler parses the request before the UART write
+    outFreeUs = std::max(outFreeUs, now + espHandlerUs);
+    espSend(p.command, ++pageId, espClock(now), p.drives);
+  } else if (now >= nextPollUs) {
+    nextPollUs = now + POLL_EVERY_US;
+    espSend("REQ_ODOM", traceNextId(), espClock(now), false);
+  }
+
+  // delay(1) and the rest of loop(); never before a flush() returned
+  std::uniform_real_distribution<double> jitter(0, 200);
+  double next = std::max((double)now + espLoopUs + jitter(rng), outFreeUs);
+  simSchedule((uint64_t)(next - now), espLoop, nullptr);
+}
+
+// Everything the Mega wrote goes out byte by byte behind what's already
+// on the wire
+static void linkTick(void *) {
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  double at = std::max((double)simNowUs(), backFreeUs);
+  for (char c : out) {
+    at += BYTE_US;
+    backWire.push_back(WireByte{at, c});
+  }
+  backFreeUs = at;
+  simSchedule(LINK_TICK_US, linkTick, nullptr);
+}
+
+static void traceSetup() {
+  espOffsetUs = simOptionF("esp-offset-us", 123456789);
+  driftPpm = simOptionF("drift-ppm", 40);
+  espLoopUs = simOptionF("esp-loop-us", 1000);
+  espHandlerUs = simOptionF("esp-handler-us", 300);
+  maxOffsetErr = simOptionF("max-offset-err-us", 100);
+  rng.seed((unsigned)simOptionF("seed", 1));
+  nextPollUs = 500000;
+  simSchedule(LINK_TICK_US, linkTick, nullptr);
+  simSchedule(300000, espLoop, nullptr);
+}
+
+static uint32_t percentile(std::vector<uint32_t> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1) + 0.5)];
+}
+
+static void traceReport() {
+  TraceClock clock;
+  traceGetClock(clock);
+  printf("traces: %d completed, %u lost, %d still in flight\n", results, clock.lost, (int)sent.size());
+  std::vector<double> errs = offsetErrors;
+  std::sort(errs.begin(), errs.end());
+  double medianErr = errs.empty() ? 0 : errs[errs.size() / 2];
+  printf("clock: offset %ld us (true %ld), bound %lu us; error median %.0f us, worst %.0f us\n",
+         (long)clock.offsetUs, (long)trueOffset(), (unsigned long)clock.uncertaintyUs, medianErr, worstError);
+  printf("%-11s %8s %8s %8s\n", "stage", "p50 us", "p90 us", "max us");
+  for (int i = 0; i < TRACE_STAGE_COUNT; i++) {
+    printf("%-11s %8u %8u %8u\n", traceStageName(i), percentile(stats[i].us, 0.5),
+           percentile(stats[i].us, 0.9), percentile(stats[i].us, 1.0));
+  }
+
+  if (results < 20) simFail("only %d traces completed", results);
+  if (clock.lost) simFail("%u traces lost", clock.lost);
+  if (sent.size() > 1) simFail("%d traces never reported", (int)sent.size());
+  if (medianErr > maxOffsetErr) simFail("clock offset typically off by %.0f us", medianErr);
+}
+
+SIM_SCENARIO(trace, "command tracing ESP <-> Mega with a modeled UART and ESP clock",
+             traceSetup, nullptr, traceReport);
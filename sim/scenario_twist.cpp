@@ -0,0 +1,138 @@
+// Twist scenario: TWIST commands through the on-board kinematics, open
+// loop and then closed loop, on a drivetrain with the default deadband.
+// Each step holds a twist for 3 s; the body's true v and w are averaged
+// over its last 1.5 s and compared with the command. The last step of
+// each mode asks for more than the wheels can give, which must cost speed
+// but not curvature.
+//
+//   --track 0.19               true effective track; firmware assumes TRACK_WIDTH
+//   --max-closed-err 0.05      fail if a closed-loop step misses v or w by more
+//                              than this fraction (unsaturated steps)
+//   --max-curvature-err 0.05   fail if a saturated closed-loop step's w/v is off
+//                              by more than this fraction
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "config.h"
+
+#include <math.h>
+#include <string>
+#include <vector>
+
+struct TwistStep {
+  const char *mode;
+  int vx, wz;            // mm/s, mrad/s
+  bool saturates;
+  double sumV, sumW;
+  unsigned long samples;
+  int left, right;       // wheel targets from REQ_TWIST
+  int saturated;
+};
+
+static std::vector<TwistStep> steps;
+static std::string rxLine;
+static int reportStep = -1;
+
+const double STEP_S = 3.0;
+const double START_S = 2.0;       // after the gyro bias calibration
+
+static void addSteps(const char *mode) {
+  steps.push_back(TwistStep{mode, 300, 0, false, 0, 0, 0, 0, 0, 0});
+  steps.push_back(TwistStep{mode, 200, 1500, false, 0, 0, 0, 0, 0, 0});
+  steps.push_back(TwistStep{mode, 1200, 4000, true, 0, 0, 0, 0, 0, 0});
+}
+
+static void twistSetup() {
+  simRobotDrivetrain().setTrack(simOptionF("track", TRACK_WIDTH));
+  addSteps("open");
+  addSteps("closed");
+}
+
+static void send(const char *line) {
+  RADIO_SERIAL.simInject(line);
+  RADIO_SERIAL.simInject("\n");
+}
+
+static void twistEveryMs() {
+  uint64_t now = simNowUs();
+  if (now == 500000) send("ENABLE");
+
+  double t = now / 1e6 - START_S;
+  if (t >= 0) {
+    size_t i = (size_t)(t / STEP_S);
+    double into = t - i * STEP_S;
+    uint64_t stepStartUs = (uint64_t)((START_S + i * STEP_S) * 1e6);
+    if (i < steps.size()) {
+      TwistStep &s = steps[i];
+      if (now == stepStartUs) {
+        if (i == steps.size() / 2) send("TWIST_MODE 1");
+        char line[40];
+        snprintf(line, sizeof(line), "TWIST %d %d", s.vx, s.wz);
+        send(line);
+      }
+      if (into >= STEP_S / 2) {
+        const SimPose &p = simRobotDrivetrain().pose();
+        s.sumV += p.v;
+        s.sumW += p.w;
+        s.samples++;
+      }
+      if (now == stepStartUs + (uint64_t)(STEP_S * 1e6) - 1000) {
+        reportStep = i;
+        send("REQ_TWIST");
+      }
+    } else if (now == stepStartUs) {
+      send("TWIST 0 0");
+    }
+  }
+
+  std::string out = RADIO_SERIAL.simTakeOutput();
+  for (char c : out) {
+    if (c != '\n') {
+      if (c != '\r') rxLine += c;
+      continue;
+    }
+    int running, closed, track, full, left, right, sat, v, w;
+    if (reportStep >= 0 &&
+        sscanf(rxLine.c_str(), "TW %d %d %d %d %d %d %d %d %d",
+               &running, &closed, &track, &full, &left, &right, &sat, &v, &w) == 9) {
+      steps[reportStep].left = left;
+      steps[reportStep].right = right;
+      steps[reportStep].saturated = sat;
+      reportStep = -1;
+    }
+    rxLine.clear();
+  }
+}
+
+static void twistReport() {
+  double maxClosedErr = simOptionF("max-closed-err", -1);
+  double maxCurvatureErr = simOptionF("max-curvature-err", -1);
+  printf("%-6s %6s %6s  %6s %6s  %7s %7s  %5s %5s %3s  %8s\n", "mode", "vx", "wz",
+         "v", "w", "v err", "w err", "left", "right", "sat", "w/v err");
+  for (const TwistStep &s : steps) {
+    if (!s.samples) {
+      simFail("run ended before the %s %d %d step; run longer", s.mode, s.vx, s.wz);
+      continue;
+    }
+    double v = s.sumV / s.samples * 1000, w = s.sumW / s.samples * 1000;
+    double vErr = (v - s.vx) / s.vx;
+    double wErr = s.wz ? (w - s.wz) / s.wz : w / 1000;   // rad/s when none was asked for
+    double kWant = (double)s.wz / s.vx, kGot = w / v;
+    double kErr = s.wz ? (kGot - kWant) / kWant : 0;
+    printf("%-6s %6d %6d  %6.0f %6.0f  %+6.1f%% %+6.1f%%  %5d %5d %3d  %+7.1f%%\n", s.mode,
+           s.vx, s.wz, v, w, vErr * 100, wErr * 100, s.left, s.right, s.saturated, kErr * 100);
+
+    bool closed = strcmp(s.mode, "closed") == 0;
+    if (s.saturates && !s.saturated) simFail("%s %d %d: wheels not saturated", s.mode, s.vx, s.wz);
+    if (!closed) continue;
+    if (!s.saturates && maxClosedErr >= 0 && (fabs(vErr) > maxClosedErr || fabs(wErr) > maxClosedErr)) {
+      simFail("closed %d %d: v %+.1f%% w %+.1f%% off", s.vx, s.wz, vErr * 100, wErr * 100);
+    }
+    if (s.saturates && maxCurvatureErr >= 0 && fabs(kErr) > maxCurvatureErr) {
+      simFail("closed %d %d: curvature %+.1f%% off", s.vx, s.wz, kErr * 100);
+    }
+  }
+}
+
+SIM_SCENARIO(twist, "TWIST kinematics open and closed loop, with a saturating turn",
+             twistSetup, twistEveryMs, twistReport);
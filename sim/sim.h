@@ -0,0 +1,63 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <Arduino.h>
+
+// Simulator core: virtual clock, event queue, pins and interrupts.
+// Events run as "interrupts": only while interrupts are enabled, never
+// nested, and with interrupts disabled for their duration.
+
+typedef void (*SimEventFn)(void *ctx);
+
+const uint64_t SIM_NEVER = ~(uint64_t)0;
+
+uint64_t simNowUs();
+void simAdvance(uint64_t us);
+void simSchedule(uint64_t delayUs, SimEventFn fn, void *ctx);
+
+// Pin state as seen by the simulated hardware
+int simPinLevel(uint8_t pin);
+int simPwm(uint8_t pin);
+void simSetAnalog(uint8_t pin, int value);
+
+// Drive an input pin from outside; edges run handlers from attachInterrupt()
+// and simOnPinChange(), like external and pin-change interrupts on the AVR.
+void simSetPin(uint8_t pin, int level);
+void simOnPinChange(uint8_t pin, void (*handler)());
+
+// Called whenever the firmware changes a pin output or PWM value
+typedef void (*SimOutputHook)(uint8_t pin);
+void simAddOutputHook(SimOutputHook hook);
+
+// Command line of the simulator: "--name value" pairs
+const char *simOption(const char *name, const char *def);
+double simOptionF(const char *name, double def);
+uint64_t simOptionTimeUs(const char *name);   // "--x 2.5" seconds; SIM_NEVER if absent
+bool simFlag(const char *name);
+
+// Host CPU time of the latest loop() pass, for scenarios that benchmark
+// the firmware; simulated time doesn't move while code runs
+uint64_t simLastLoopWallNs();
+
+// Mark the run as failed (exit status 1); scenarios use this for checks
+void simFail(const char *fmt, ...);
+
+// A scenario sets up the hardware models before setup() runs, may act on
+// the world every millisecond of simulated time, and prints its results
+// when the run ends. Scenarios register themselves with SIM_SCENARIO.
+struct SimScenario {
+  const char *name;
+  const char *help;
+  void (*setup)();
+  void (*everyMs)();
+  void (*report)();
+};
+
+struct SimScenarioRegistrar {
+  explicit SimScenarioRegistrar(const SimScenario &s);
+};
+
+#define SIM_SCENARIO(id, ...) \
+  static SimScenarioRegistrar simScenario_##id(SimScenario{#id, __VA_ARGS__})
+
+#endif // SIM_H
@@ -0,0 +1,37 @@
+#include "sim_adc.h"
+#include "sim.h"
+
+static void (*adcIsr)() = nullptr;
+static uint64_t conversionUs = 104;
+static uint8_t selected = 0;      // ADMUX
+static uint8_t converting = 0;    // latched at conversion start
+static uint16_t result = 0;
+static unsigned long conversions = 0;
+static uint32_t generation = 0;
+
+static void conversionDone(void *ctx) {
+  if ((uint32_t)(uintptr_t)ctx != generation) return;
+  result = (uint16_t)constrain(analogRead(A0 + converting), 0, 1023);
+  conversions++;
+  // Free running: the next conversion starts at once with the current mux
+  converting = selected;
+  simSchedule(conversionUs, conversionDone, ctx);
+  if (adcIsr) adcIsr();
+}
+
+void simAdcStart(unsigned long adcClockHz, void (*isr)()) {
+  adcIsr = isr;
+  conversionUs = (13 * 1000000UL + adcClockHz - 1) / adcClockHz;
+  converting = selected;
+  generation++;
+  simSchedule(conversionUs, conversionDone, (void *)(uintptr_t)generation);
+}
+
+void simAdcStop() {
+  generation++;
+  adcIsr = nullptr;
+}
+
+void simAdcSelect(uint8_t channel) { selected = channel & 0x0F; }
+uint16_t simAdcResult() { return result; }
+unsigned long simAdcConversions() { return conversions; }
@@ -0,0 +1,18 @@
+#ifndef SIM_ADC_H
+#define SIM_ADC_H
+
+#include <Arduino.h>
+
+// Simulated ADC in free-running mode behind sensor_manager.cpp. Each
+// conversion takes 13 ADC clocks and then raises the ADC interrupt. The
+// channel is latched when a conversion starts, so a channel change made in
+// the interrupt lands one conversion later, as on the AVR. Inputs are the
+// values set with simSetAnalog() on A0..A15.
+
+void simAdcStart(unsigned long adcClockHz, void (*isr)());
+void simAdcStop();
+void simAdcSelect(uint8_t channel);
+uint16_t simAdcResult();
+unsigned long simAdcConversions();
+
+#endif // SIM_ADC_H
@@ -0,0 +1,29 @@
+#include "sim_capture.h"
+#include "sim.h"
+
+static uint8_t capturePin = 0;
+static unsigned long ticksPerSec = 2000000;
+static void (*captureIsr)() = nullptr;
+static bool risingEdge = true;
+static uint16_t latched = 0;
+
+uint16_t simCaptureNow() {
+  return (uint16_t)(simNowUs() * ticksPerSec / 1000000);
+}
+
+static void pinChanged() {
+  bool rising = digitalRead(capturePin) == HIGH;
+  if (rising != risingEdge || !captureIsr) return;
+  latched = simCaptureNow();
+  captureIsr();
+}
+
+void simCaptureStart(uint8_t pin, unsigned long tickHz, void (*isr)()) {
+  capturePin = pin;
+  ticksPerSec = tickHz;
+  captureIsr = isr;
+  simOnPinChange(pin, pinChanged);
+}
+
+void simCaptureEdge(bool rising) { risingEdge = rising; }
+uint16_t simCaptureTicks() { return latched; }
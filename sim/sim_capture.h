@@ -0,0 +1,15 @@
+#ifndef SIM_CAPTURE_H
+#define SIM_CAPTURE_H
+
+#include <Arduino.h>
+
+// Simulated timer input capture (Timer5/ICP5 on the Mega) behind
+// sensor_manager.cpp: a free-running 16-bit counter is latched on the
+// selected edge of the capture pin and the capture interrupt runs.
+
+void simCaptureStart(uint8_t pin, unsigned long tickHz, void (*isr)());
+void simCaptureEdge(bool rising);   // ICES
+uint16_t simCaptureTicks();         // ICR, latched at the edge
+uint16_t simCaptureNow();           // TCNT
+
+#endif // SIM_CAPTURE_H
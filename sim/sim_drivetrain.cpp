@@ -0,0 +1,96 @@
+#include "sim_drivetrain.h"
+#include "sim.h"
+#include "sim_robot.h"
+#include "config.h"
+
+#include <math.h>
+
+static const uint64_t STEP_US = 1000;
+
+struct MotorPins {
+  uint8_t pwm, in1, in2;
+  int mount;            // -1: wired reversed, setM2/setM4 negate the speed
+  bool needsStandby;    // TB6612 front pair
+  uint8_t encA, encB;
+};
+
+static const MotorPins motorPins[4] = {
+  {M1_PWM, M1_IN1, M1_IN2, 1, true, ENC1_A_PIN, ENC1_B_PIN},
+  {M2_PWM, M2_IN1, M2_IN2, -1, true, ENC2_A_PIN, ENC2_B_PIN},
+  {M3_PWM, M3_IN1, M3_IN2, 1, false, ENC3_A_PIN, ENC3_B_PIN},
+  {M4_PWM, M4_IN1, M4_IN2, -1, false, ENC4_A_PIN, ENC4_B_PIN},
+};
+
+SimDrivetrain::SimDrivetrain() : track_(TRACK_WIDTH), feedImu_(true), pose_() {
+  for (int i = 0; i < 4; i++) {
+    params_[i] = SimWheelParams{0.9, 20, 0.08, 2.5};
+    speed_[i] = slip_[i] = encoderPos_[i] = 0;
+    ticks_[i] = 0;
+    held_[i] = false;
+  }
+}
+
+void SimDrivetrain::begin() {
+  simSchedule(STEP_US, stepEvent, this);
+}
+
+void SimDrivetrain::stepEvent(void *ctx) {
+  SimDrivetrain *d = (SimDrivetrain *)ctx;
+  d->step();
+  simSchedule(STEP_US, stepEvent, d);
+}
+
+double SimDrivetrain::duty(int wheel) const {
+  const MotorPins &m = motorPins[wheel];
+  if (m.needsStandby && simPinLevel(MOTOR_STBY) == LOW) return 0;
+  int dir = (simPinLevel(m.in1) == HIGH) - (simPinLevel(m.in2) == HIGH);
+  return dir * m.mount * simPwm(m.pwm) / 255.0;
+}
+
+// Wheel surface speed the motor settles at for the current pin state
+double SimDrivetrain::targetSpeed(int wheel) const {
+  const SimWheelParams &p = params_[wheel];
+  double pwm = fabs(duty(wheel)) * 255;
+  if (pwm <= p.deadband) return 0;
+  return (duty(wheel) > 0 ? 1 : -1) * p.topSpeed * (pwm - p.deadband) / (255 - p.deadband);
+}
+
+// Drive voltage minus back-EMF over the winding
+double SimDrivetrain::current(int wheel) const {
+  const SimWheelParams &p = params_[wheel];
+  return motorPins[wheel].mount * p.stallAmps * (duty(wheel) - speed_[wheel] / p.topSpeed);
+}
+
+void SimDrivetrain::emitTicks(int wheel) {
+  const MotorPins &m = motorPins[wheel];
+  double edge = floor(encoderPos_[wheel]);
+  while (edge != ticks_[wheel]) {
+    bool forward = edge > ticks_[wheel];
+    ticks_[wheel] += forward ? 1 : -1;
+    // Channel B leads: high when turning forward at A's rising edge
+    simSetPin(m.encB, forward ? HIGH : LOW);
+    simSetPin(m.encA, HIGH);
+    simSetPin(m.encA, LOW);
+  }
+}
+
+void SimDrivetrain::step() {
+  const double dt = STEP_US / 1e6;
+  for (int i = 0; i < 4; i++) {
+    const SimWheelParams &p = params_[i];
+    speed_[i] += (targetSpeed(i) - speed_[i]) * dt / (p.tau > dt ? p.tau : dt);
+    if (held_[i]) speed_[i] = 0;
+    encoderPos_[i] += speed_[i] * (1 + slip_[i]) * dt / DIST_PER_TICK;
+    emitTicks(i);
+  }
+
+  double left = 0.5 * (speed_[0] + speed_[2]);
+  double right = 0.5 * (speed_[1] + speed_[3]);
+  pose_.v = 0.5 * (left + right);
+  pose_.w = (right - left) / track_;
+  pose_.x += pose_.v * cos(pose_.theta + 0.5 * pose_.w * dt) * dt;
+  pose_.y += pose_.v * sin(pose_.theta + 0.5 * pose_.w * dt) * dt;
+  pose_.theta += pose_.w * dt;
+
+  if (feedImu_) simRobotImu().setYawRate(pose_.w);
+}
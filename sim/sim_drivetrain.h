@@ -0,0 +1,60 @@
+#ifndef SIM_DRIVETRAIN_H
+#define SIM_DRIVETRAIN_H
+
+#include <Arduino.h>
+
+// Skid-steer drivetrain model. Reads the motor driver pins from config.h,
+// runs a first-order motor model per wheel, moves the body, feeds the IMU
+// yaw rate and produces encoder edges on the ENCx pins. Wheels are indexed
+// 0..3 for M1..M4 (front left, front right, rear left, rear right).
+
+struct SimWheelParams {
+  double topSpeed;    // m/s of wheel surface at full PWM
+  double deadband;    // PWM below which the motor doesn't turn
+  double tau;         // s, speed time constant
+  double stallAmps;   // current at full PWM with the wheel held
+};
+
+struct SimPose {
+  double x, y, theta;
+  double v, w;
+};
+
+class SimDrivetrain {
+public:
+  SimDrivetrain();
+
+  void begin();
+  void setWheel(int wheel, const SimWheelParams &p) { params_[wheel] = p; }
+  const SimWheelParams &wheel(int wheel) const { return params_[wheel]; }
+  // Effective track of the skid-steer body (turning resistance included)
+  void setTrack(double meters) { track_ = meters; }
+  // Extra encoder rotation that doesn't move the body: 1.0 spins the wheel
+  // at twice its ground speed. 0 restores grip.
+  void setSlip(int wheel, double extra) { slip_[wheel] = extra; }
+  void setFeedImu(bool on) { feedImu_ = on; }
+  // Wheel jammed: it stops turning and draws stall current
+  void setHeld(int wheel, bool held) { held_[wheel] = held; }
+
+  const SimPose &pose() const { return pose_; }
+  double wheelSpeed(int wheel) const { return speed_[wheel]; }   // m/s, ground
+  double current(int wheel) const;    // A, in the motor's own polarity
+  long encoderTicks(int wheel) const { return ticks_[wheel]; }
+
+private:
+  static void stepEvent(void *ctx);
+  void step();
+  double targetSpeed(int wheel) const;
+  double duty(int wheel) const;       // -1..1, wheel-forward positive
+  void emitTicks(int wheel);
+
+  SimWheelParams params_[4];
+  double speed_[4], slip_[4], encoderPos_[4];
+  long ticks_[4];
+  double track_;
+  bool feedImu_;
+  bool held_[4];
+  SimPose pose_;
+};
+
+#endif // SIM_DRIVETRAIN_H
@@ -0,0 +1,37 @@
+#include "EEPROM.h"
+#include "sim.h"
+
+EEPROMClass EEPROM;
+
+static uint8_t cells[4096];
+static bool loaded = false;
+static const char *path = nullptr;
+
+static void load() {
+  if (loaded) return;
+  loaded = true;
+  memset(cells, 0xFF, sizeof(cells));
+  path = simOption("eeprom", nullptr);
+  if (!path) return;
+  FILE *f = fopen(path, "rb");
+  if (!f) return;
+  size_t n = fread(cells, 1, sizeof(cells), f);
+  (void)n;
+  fclose(f);
+}
+
+uint8_t EEPROMClass::read(int idx) {
+  load();
+  return idx >= 0 && idx < (int)sizeof(cells) ? cells[idx] : 0xFF;
+}
+
+void EEPROMClass::write(int idx, uint8_t val) {
+  load();
+  if (idx < 0 || idx >= (int)sizeof(cells)) return;
+  cells[idx] = val;
+  if (!path) return;
+  FILE *f = fopen(path, "wb");
+  if (!f) return;
+  fwrite(cells, 1, sizeof(cells), f);
+  fclose(f);
+}
@@ -0,0 +1,183 @@
+// Arduino core functions and simulator core for the native build.
+
+#include "sim.h"
+
+#include <queue>
+#include <vector>
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+HardwareSerial Serial3;
+
+size_t HardwareSerial::write(uint8_t c) {
+  tx_ += (char)c;
+  if (echo_) fputc(c, echo_);
+  if (tap_) tap_(true, (const char *)&c, 1);
+  return 1;
+}
+
+// ---------------- Clock and events ----------------
+struct SimEvent {
+  uint64_t at;
+  uint64_t order;      // FIFO among events due at the same time
+  SimEventFn fn;
+  void *ctx;
+  bool operator<(const SimEvent &o) const {
+    return at != o.at ? at > o.at : order > o.order;
+  }
+};
+
+static uint64_t nowUs = 0;
+static uint64_t eventOrder = 0;
+static std::priority_queue<SimEvent> events;
+static bool interruptsOn = true;
+static bool inInterrupt = false;
+
+uint64_t simNowUs() { return nowUs; }
+
+void simSchedule(uint64_t delayUs, SimEventFn fn, void *ctx) {
+  events.push(SimEvent{nowUs + delayUs, eventOrder++, fn, ctx});
+}
+
+// Run everything due by now, unless interrupts are masked or one is running
+static void runDueEvents() {
+  while (interruptsOn && !inInterrupt && !events.empty() && events.top().at <= nowUs) {
+    SimEvent ev = events.top();
+    events.pop();
+    inInterrupt = true;
+    interruptsOn = false;
+    ev.fn(ev.ctx);
+    interruptsOn = true;
+    inInterrupt = false;
+  }
+}
+
+void simAdvance(uint64_t us) {
+  uint64_t target = nowUs + us;
+  while (interruptsOn && !inInterrupt && !events.empty() && events.top().at <= target) {
+    if (events.top().at > nowUs) nowUs = events.top().at;
+    runDueEvents();
+  }
+  nowUs = target;
+}
+
+unsigned long millis() { return (unsigned long)(nowUs / 1000); }
+unsigned long micros() { return (unsigned long)nowUs; }
+void delay(unsigned long ms) { simAdvance((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { simAdvance(us); }
+void yield() {}
+
+void noInterrupts() { interruptsOn = false; }
+
+void interrupts() {
+  if (inInterrupt) return;    // re-enabled when the handler returns
+  interruptsOn = true;
+  runDueEvents();
+}
+
+// ---------------- Pins ----------------
+struct SimPin {
+  uint8_t mode;
+  int level;
+  int pwm;
+  int analog;
+  void (*isr)();
+  int isrMode;
+  void (*onChange)();
+};
+
+static SimPin pins[SIM_NUM_PINS];
+static std::vector<SimOutputHook> outputHooks;
+
+static bool validPin(uint8_t pin) { return pin < SIM_NUM_PINS; }
+
+static void outputChanged(uint8_t pin) {
+  for (SimOutputHook hook : outputHooks) hook(pin);
+}
+
+void simAddOutputHook(SimOutputHook hook) { outputHooks.push_back(hook); }
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (!validPin(pin)) return;
+  pins[pin].mode = mode;
+  if (mode == INPUT_PULLUP) pins[pin].level = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (!validPin(pin)) return;
+  int level = val ? HIGH : LOW;
+  if (pins[pin].level == level && pins[pin].pwm == 0) return;
+  pins[pin].level = level;
+  pins[pin].pwm = 0;
+  outputChanged(pin);
+}
+
+int digitalRead(uint8_t pin) { return validPin(pin) ? pins[pin].level : LOW; }
+
+void analogWrite(uint8_t pin, int val) {
+  if (!validPin(pin)) return;
+  val = constrain(val, 0, 255);
+  if (pins[pin].pwm == val) return;
+  pins[pin].pwm = val;
+  pins[pin].level = val > 0 ? HIGH : LOW;
+  outputChanged(pin);
+}
+
+int analogRead(uint8_t pin) {
+  if (pin < A0 && pin < 16) pin += A0;    // analogRead(0) means A0
+  return validPin(pin) ? pins[pin].analog : 0;
+}
+
+int simPinLevel(uint8_t pin) { return digitalRead(pin); }
+int simPwm(uint8_t pin) { return validPin(pin) ? pins[pin].pwm : 0; }
+void simSetAnalog(uint8_t pin, int value) { if (validPin(pin)) pins[pin].analog = value; }
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  if (!validPin(pin)) return;
+  pins[pin].isr = isr;
+  pins[pin].isrMode = mode;
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (validPin(pin)) pins[pin].isr = nullptr;
+}
+
+void simOnPinChange(uint8_t pin, void (*handler)()) {
+  if (validPin(pin)) pins[pin].onChange = handler;
+}
+
+static void deliverPinEdge(SimPin &p, bool rising) {
+  bool fire = p.isr && (p.isrMode == CHANGE ||
+                        (p.isrMode == RISING && rising) ||
+                        (p.isrMode == FALLING && !rising));
+  if (fire) p.isr();
+  if (p.onChange) p.onChange();
+}
+
+// The edge is packed into ctx: the pin may have changed again before the
+// handler gets to run, exactly like a latched interrupt flag
+static void deferredPinEdge(void *ctx) {
+  uintptr_t edge = (uintptr_t)ctx;
+  deliverPinEdge(pins[edge & 0xFF], edge >> 8);
+}
+
+void simSetPin(uint8_t pin, int level) {
+  if (!validPin(pin)) return;
+  SimPin &p = pins[pin];
+  int old = p.level;
+  p.level = level ? HIGH : LOW;
+  if (old == p.level || (!p.isr && !p.onChange)) return;
+
+  // Pin edges are interrupts too: deliver now if allowed, otherwise as soon
+  // as the running handler returns or interrupts are unmasked
+  if (inInterrupt || !interruptsOn) {
+    simSchedule(0, deferredPinEdge, (void *)(uintptr_t)(pin | (p.level == HIGH) << 8));
+    return;
+  }
+  inInterrupt = true;
+  interruptsOn = false;
+  deliverPinEdge(p, p.level == HIGH);
+  interruptsOn = true;
+  inInterrupt = false;
+}
@@ -0,0 +1,226 @@
+// Native simulator entry point: runs the firmware's setup()/loop() on the
+// virtual clock with the robot models from sim_robot.cpp.
+//
+//   .pio/build/native/program --scenario imu --seconds 20
+//
+// --stdio connects RADIO_SERIAL to stdin/stdout (DEBUG_SERIAL goes to
+// stderr) and paces the virtual clock to the wall clock, so host tools can
+// talk to the simulated Mega through a pipe or pty.
+//
+// --uart-capture <file> records RADIO_SERIAL both ways in the format of
+// host/include/uart_capture.h, for the replay scenario.
+//
+// --boot-ms <ms> holds off setup() that long after power-on, as the
+// bootloader does; millis() still counts from power-on.
+
+#include "sim.h"
+#include "sim_robot.h"
+#include "config.h"
+#include "uart_capture.h"
+
+#include <stdarg.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+const uint64_t LOOP_US = 20;   // roughly one pass of loop() on the Mega
+
+// ---------------- Options ----------------
+static std::map<std::string, std::string> options;
+
+const char *simOption(const char *name, const char *def) {
+  auto it = options.find(name);
+  return it == options.end() ? def : it->second.c_str();
+}
+
+double simOptionF(const char *name, double def) {
+  const char *v = simOption(name, nullptr);
+  return v ? atof(v) : def;
+}
+
+uint64_t simOptionTimeUs(const char *name) {
+  double s = simOptionF(name, -1);
+  return s < 0 ? SIM_NEVER : (uint64_t)(s * 1e6);
+}
+
+bool simFlag(const char *name) {
+  return options.count(name) != 0;
+}
+
+static void parseOptions(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--", 2) != 0) {
+      fprintf(stderr, "ignoring argument %s\n", argv[i]);
+      continue;
+    }
+    const char *name = argv[i] + 2;
+    const char *value = "1";
+    if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) value = argv[++i];
+    options[name] = value;
+  }
+}
+
+static bool failed = false;
+
+void simFail(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  fputs("FAIL: ", stdout);
+  vprintf(fmt, ap);
+  fputc('\n', stdout);
+  va_end(ap);
+  failed = true;
+}
+
+// ---------------- Scenarios ----------------
+static std::vector<SimScenario> &scenarios() {
+  static std::vector<SimScenario> list;
+  return list;
+}
+
+SimScenarioRegistrar::SimScenarioRegistrar(const SimScenario &s) {
+  scenarios().push_back(s);
+}
+
+SIM_SCENARIO(idle, "firmware only; drive it with --stdio", nullptr, nullptr, nullptr);
+
+static const SimScenario *findScenario(const char *name) {
+  for (const SimScenario &s : scenarios()) {
+    if (strcmp(s.name, name) == 0) return &s;
+  }
+  return nullptr;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: program [--scenario name] [--seconds s] [--stdio]\n"
+                  "               [--stall-at s --stall-ms ms] [--uart-capture file] [--boot-ms ms]\n"
+                  "               [scenario options]\n"
+                  "scenarios:\n");
+  for (const SimScenario &s : scenarios()) fprintf(stderr, "  %-12s %s\n", s.name, s.help);
+}
+
+// ---------------- Host I/O ----------------
+static void pumpStdin() {
+  struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+  while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+    char buf[256];
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    if (n <= 0) return;
+    RADIO_SERIAL.simInject(buf, n);
+  }
+}
+
+static uint64_t wallUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t wallNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t lastLoopWallNs = 0;
+
+uint64_t simLastLoopWallNs() { return lastLoopWallNs; }
+
+static UcapWriter uartCapture;
+
+static void captureRadio(bool fromFirmware, const char *data, size_t len) {
+  uartCapture.add(simNowUs(), fromFirmware ? UCAP_FROM_MEGA : UCAP_TO_MEGA, data, len);
+}
+
+// ---------------- Main ----------------
+int main(int argc, char **argv) {
+  parseOptions(argc, argv);
+  if (simFlag("help")) {
+    usage();
+    return 0;
+  }
+  const SimScenario *scenario = findScenario(simOption("scenario", "idle"));
+  if (!scenario) {
+    usage();
+    return 1;
+  }
+
+  bool stdio = simFlag("stdio");
+  uint64_t endUs = (uint64_t)(simOptionF("seconds", stdio ? 1e9 : 10) * 1e6);
+  uint64_t stallAt = simOptionTimeUs("stall-at");
+  uint64_t stallEnd = stallAt == SIM_NEVER ? SIM_NEVER
+                                           : stallAt + (uint64_t)(simOptionF("stall-ms", 0) * 1000);
+
+  setvbuf(stdout, nullptr, _IONBF, 0);
+  if (stdio) {
+    RADIO_SERIAL.simEcho(stdout);
+    DEBUG_SERIAL.simEcho(stderr);
+  } else if (simFlag("verbose")) {
+    DEBUG_SERIAL.simEcho(stderr);
+  }
+
+  const char *capturePath = simOption("uart-capture", nullptr);
+  if (capturePath) {
+    if (!uartCapture.open(capturePath, UCAP_CLOCK_SIM, 115200, 0)) {
+      perror(capturePath);
+      return 1;
+    }
+    RADIO_SERIAL.simTap(captureRadio);
+  }
+
+  simRobotBegin();
+  if (scenario->setup) scenario->setup();
+
+  // Power-on reset and bootloader: the models and the scenario already run,
+  // the firmware doesn't, and its UARTs drop what arrives until begin()
+  uint64_t bootUs = (uint64_t)(simOptionF("boot-ms", 0) * 1000);
+  uint64_t nextMs = 1000;
+  while (simNowUs() < bootUs) {
+    simAdvance(LOOP_US);
+    if (simNowUs() < nextMs) continue;
+    nextMs += 1000;
+    if (scenario->everyMs) scenario->everyMs();
+  }
+  setup();
+
+  uint64_t wallStart = wallUs();
+  unsigned long passes = 0;
+  uint64_t longestLoopUs = 0;
+  nextMs = simNowUs() - simNowUs() % 1000 + 1000;
+  while (simNowUs() < endUs) {
+    // A stall keeps the loop from running while interrupts continue
+    if (simNowUs() < stallAt || simNowUs() >= stallEnd) {
+      uint64_t started = simNowUs();
+      uint64_t wallStarted = wallNs();
+      loop();
+      lastLoopWallNs = wallNs() - wallStarted;
+      passes++;
+      if (simNowUs() - started > longestLoopUs) longestLoopUs = simNowUs() - started;
+    }
+    simAdvance(LOOP_US);
+
+    if (simNowUs() < nextMs) continue;
+    nextMs += 1000;
+    if (scenario->everyMs) scenario->everyMs();
+    if (stdio) {
+      pumpStdin();
+      uint64_t ahead = simNowUs() - (wallUs() - wallStart);
+      if ((int64_t)ahead > 2000) usleep(ahead);
+    }
+    // Echoed output has already been written out; scenarios read theirs above
+    RADIO_SERIAL.simTakeOutput();
+    DEBUG_SERIAL.simTakeOutput();
+  }
+
+  fprintf(stdio ? stderr : stdout, "simulated %.3f s, %lu loop() passes, longest %llu us\n",
+          simNowUs() / 1e6, passes, (unsigned long long)longestLoopUs);
+  if (scenario->report) scenario->report();
+  uartCapture.close();
+  return failed ? 1 : 0;
+}
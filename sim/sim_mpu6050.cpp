@@ -0,0 +1,172 @@
+#include "sim_mpu6050.h"
+#include "sim.h"
+
+#include <random>
+
+// Registers the firmware touches
+enum {
+  SMPLRT_DIV = 0x19, CONFIG = 0x1A, GYRO_CONFIG = 0x1B, ACCEL_CONFIG = 0x1C,
+  FIFO_EN = 0x23, INT_PIN_CFG = 0x37, INT_ENABLE = 0x38, INT_STATUS = 0x3A,
+  ACCEL_XOUT_H = 0x3B, GYRO_XOUT_H = 0x43, USER_CTRL = 0x6A, PWR_MGMT_1 = 0x6B,
+  FIFO_COUNTH = 0x72, FIFO_COUNTL = 0x73, FIFO_R_W = 0x74, WHO_AM_I = 0x75
+};
+
+static std::mt19937 noiseRng(7);
+
+SimMpu6050::SimMpu6050(uint8_t intPin)
+  : intPin_(intPin), yawRate_(0), biasDps_(0), noiseDps_(0), heading_(0),
+    lastTickUs_(0), intSuppressedUntil_(0), samples_(0), lost_(0), overflows_(0) {
+  reset();
+}
+
+void SimMpu6050::reset() {
+  memset(regs_, 0, sizeof(regs_));
+  regs_[PWR_MGMT_1] = 0x40;           // asleep after reset
+  regs_[WHO_AM_I] = 0x68;
+  fifoHead_ = fifoCount_ = 0;
+  ptr_ = 0;
+  ptrNext_ = false;
+  countLatch_ = 0;
+}
+
+void SimMpu6050::begin() {
+  lastTickUs_ = simNowUs();
+  simSchedule(125, tickEvent, this);
+}
+
+uint64_t SimMpu6050::samplePeriodUs() const {
+  unsigned gyroRate = (regs_[CONFIG] & 0x07) ? 1000 : 8000;
+  return 1000000ULL * (1 + regs_[SMPLRT_DIV]) / gyroRate;
+}
+
+void SimMpu6050::tickEvent(void *ctx) {
+  SimMpu6050 *self = (SimMpu6050 *)ctx;
+  self->tick();
+  simSchedule(self->samplePeriodUs(), tickEvent, self);
+}
+
+static void put16(uint8_t *p, long v) {
+  v = constrain(v, -32768L, 32767L);
+  p[0] = (uint8_t)((v >> 8) & 0xFF);
+  p[1] = (uint8_t)(v & 0xFF);
+}
+
+void SimMpu6050::tick() {
+  uint64_t now = simNowUs();
+  heading_ += yawRate_ * (now - lastTickUs_) * 1e-6;
+  lastTickUs_ = now;
+  if (regs_[PWR_MGMT_1] & 0x40) return;     // sleeping
+
+  std::normal_distribution<double> noise(0.0, noiseDps_ > 0 ? noiseDps_ : 1e-9);
+  double lsbPerDps = 131.0 / (1 << ((regs_[GYRO_CONFIG] >> 3) & 3));
+  double lsbPerG = 16384.0 / (1 << ((regs_[ACCEL_CONFIG] >> 3) & 3));
+  double zDps = yawRate_ * 180.0 / M_PI + biasDps_;
+
+  uint8_t sample[12];
+  put16(sample + 0, 0);
+  put16(sample + 2, 0);
+  put16(sample + 4, lround(lsbPerG));
+  put16(sample + 6, lround(noise(noiseRng) * lsbPerDps));
+  put16(sample + 8, lround(noise(noiseRng) * lsbPerDps));
+  put16(sample + 10, lround((zDps + noise(noiseRng)) * lsbPerDps));
+  memcpy(regs_ + ACCEL_XOUT_H, sample, 6);
+  memcpy(regs_ + GYRO_XOUT_H, sample + 6, 6);
+  samples_++;
+
+  if (regs_[USER_CTRL] & 0x40) {
+    // FIFO order follows register order: accel, then gyro X/Y/Z
+    uint8_t en = regs_[FIFO_EN];
+    if (en & 0x08) fifoPush(sample, 6);
+    if (en & 0x40) fifoPush(sample + 6, 2);
+    if (en & 0x20) fifoPush(sample + 8, 2);
+    if (en & 0x10) fifoPush(sample + 10, 2);
+  }
+
+  regs_[INT_STATUS] |= 0x01;                // DATA_RDY
+  if (regs_[INT_ENABLE] & regs_[INT_STATUS]) raiseInt();
+}
+
+void SimMpu6050::fifoPush(const uint8_t *bytes, unsigned n) {
+  for (unsigned i = 0; i < n; i++) {
+    if (fifoCount_ == sizeof(fifo_)) {
+      // Full: the oldest byte is overwritten, as on the real part
+      fifoHead_ = (fifoHead_ + 1) % sizeof(fifo_);
+      fifoCount_--;
+      if (!(regs_[INT_STATUS] & 0x10)) overflows_++;
+      regs_[INT_STATUS] |= 0x10;            // FIFO_OFLOW
+      lost_++;
+    }
+    fifo_[(fifoHead_ + fifoCount_) % sizeof(fifo_)] = bytes[i];
+    fifoCount_++;
+  }
+}
+
+void SimMpu6050::raiseInt() {
+  if (simNowUs() < intSuppressedUntil_) return;
+  simSetPin(intPin_, HIGH);
+  if (!(regs_[INT_PIN_CFG] & 0x20)) {
+    // Not latched: 50 us pulse
+    struct Pulse { static void end(void *ctx) { simSetPin(*(uint8_t *)ctx, LOW); } };
+    simSchedule(50, Pulse::end, &intPin_);
+  }
+}
+
+void SimMpu6050::clearInt() {
+  regs_[INT_STATUS] = 0;
+  simSetPin(intPin_, LOW);
+}
+
+bool SimMpu6050::address(bool read) {
+  ptrNext_ = !read;
+  return true;
+}
+
+void SimMpu6050::writeByte(uint8_t b) {
+  if (ptrNext_) {
+    ptr_ = b & 0x7F;
+    ptrNext_ = false;
+    return;
+  }
+  uint8_t reg = ptr_;
+  if (reg == FIFO_R_W) return;
+  ptr_ = (ptr_ + 1) & 0x7F;
+
+  if (reg == PWR_MGMT_1 && (b & 0x80)) {
+    reset();
+    clearInt();
+    return;
+  }
+  if (reg == USER_CTRL && (b & 0x04)) {
+    fifoHead_ = fifoCount_ = 0;
+    b &= ~0x04;                             // self-clearing
+  }
+  if (reg != WHO_AM_I && reg != INT_STATUS) regs_[reg] = b;
+}
+
+uint8_t SimMpu6050::readByte() {
+  uint8_t reg = ptr_;
+  uint8_t v;
+
+  if (reg == FIFO_R_W) {
+    v = 0xFF;
+    if (fifoCount_ > 0) {
+      v = fifo_[fifoHead_];
+      fifoHead_ = (fifoHead_ + 1) % sizeof(fifo_);
+      fifoCount_--;
+    }
+  } else {
+    if (reg == FIFO_COUNTH) countLatch_ = fifoCount_;
+    if (reg == FIFO_COUNTH) v = countLatch_ >> 8;
+    else if (reg == FIFO_COUNTL) v = countLatch_ & 0xFF;
+    else v = regs_[reg];
+    ptr_ = (ptr_ + 1) & 0x7F;
+  }
+
+  // INT_RD_CLEAR: any read clears the status; otherwise only INT_STATUS
+  if (reg == INT_STATUS || (regs_[INT_PIN_CFG] & 0x10)) clearInt();
+  return v;
+}
+
+void SimMpu6050::stop() {
+  ptrNext_ = false;
+}
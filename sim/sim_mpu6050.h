@@ -0,0 +1,52 @@
+#ifndef SIM_MPU6050_H
+#define SIM_MPU6050_H
+
+#include "sim_twi.h"
+
+// Register-level MPU-6050 model: sample clock, hardware FIFO with overflow,
+// latched INT pin, gyro bias and noise. The body yaw rate comes from the
+// scenario (or the drivetrain model) through setYawRate().
+class SimMpu6050 : public SimI2cDevice {
+public:
+  explicit SimMpu6050(uint8_t intPin);
+
+  void begin();                       // power on and start the sample clock
+  void setYawRate(double radPerSec) { yawRate_ = radPerSec; }
+  void setGyroBias(double degPerSec) { biasDps_ = degPerSec; }
+  void setGyroNoise(double degPerSec) { noiseDps_ = degPerSec; }
+  // Don't raise INT until this time; models a missed or masked interrupt line
+  void suppressIntUntil(uint64_t us) { intSuppressedUntil_ = us; }
+
+  double trueHeading() const { return heading_; }
+  unsigned long samplesTaken() const { return samples_; }
+  unsigned long samplesLost() const { return lost_ / 12; }   // overwritten in the FIFO
+  unsigned long overflows() const { return overflows_; }
+  unsigned fifoLevel() const { return fifoCount_; }
+
+  bool address(bool read) override;
+  void writeByte(uint8_t b) override;
+  uint8_t readByte() override;
+  void stop() override;
+
+private:
+  static void tickEvent(void *ctx);
+  void tick();
+  void reset();
+  uint64_t samplePeriodUs() const;
+  void fifoPush(const uint8_t *bytes, unsigned n);
+  void raiseInt();
+  void clearInt();
+
+  uint8_t intPin_;
+  uint8_t regs_[128];
+  uint8_t fifo_[1024];
+  unsigned fifoHead_, fifoCount_;
+  uint8_t ptr_;
+  bool ptrNext_;
+  uint16_t countLatch_;
+  double yawRate_, biasDps_, noiseDps_, heading_;
+  uint64_t lastTickUs_, intSuppressedUntil_;
+  unsigned long samples_, lost_, overflows_;   // lost_ counts bytes
+};
+
+#endif // SIM_MPU6050_H
@@ -0,0 +1,17 @@
+#include "sim_robot.h"
+#include "config.h"
+
+static SimMpu6050 imu(MPU_INT_PIN);
+static SimDrivetrain drivetrain;
+static SimSensors sensors;
+
+void simRobotBegin() {
+  simTwiAttach(MPU_I2C_ADDR, &imu);
+  imu.begin();
+  drivetrain.begin();
+  sensors.begin();
+}
+
+SimMpu6050 &simRobotImu() { return imu; }
+SimDrivetrain &simRobotDrivetrain() { return drivetrain; }
+SimSensors &simRobotSensors() { return sensors; }
@@ -0,0 +1,15 @@
+#ifndef SIM_ROBOT_H
+#define SIM_ROBOT_H
+
+#include "sim_mpu6050.h"
+#include "sim_drivetrain.h"
+#include "sim_sensors.h"
+
+// The simulated robot: the hardware models wired to the pins in config.h.
+// sim_main calls simRobotBegin() before the scenario's setup.
+void simRobotBegin();
+SimMpu6050 &simRobotImu();
+SimDrivetrain &simRobotDrivetrain();
+SimSensors &simRobotSensors();
+
+#endif // SIM_ROBOT_H
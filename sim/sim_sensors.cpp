@@ -0,0 +1,70 @@
+#include "sim_sensors.h"
+#include "sim.h"
+#include "sim_robot.h"
+#include "config.h"
+
+#include <math.h>
+
+static const double BATTERY_OHMS = 0.08;
+static const uint64_t ECHO_DELAY_US = 450;       // HC-SR04: burst before echo goes high
+static const uint64_t NO_ECHO_US = 38000;        // echo width when nothing answers
+
+static SimSensors *instance = nullptr;
+static const uint8_t currentPins[4] = {M1_CURRENT_PIN, M2_CURRENT_PIN, M3_CURRENT_PIN, M4_CURRENT_PIN};
+
+static int adcCounts(double volts) {
+  return (int)constrain(volts / 5.0 * 1023 + 0.5, 0.0, 1023.0);
+}
+
+SimSensors::SimSensors()
+  : batteryVolts_(7.6), loadedVolts_(7.6), range_(-1), dead_(false), echoBusy_(false),
+    pings_(0), lastEchoUs_(0) {}
+
+void SimSensors::begin() {
+  instance = this;
+  simAddOutputHook(trigChanged);
+  update();
+  simSchedule(1000, updateEvent, this);
+}
+
+void SimSensors::updateEvent(void *ctx) {
+  SimSensors *s = (SimSensors *)ctx;
+  s->update();
+  simSchedule(1000, updateEvent, s);
+}
+
+void SimSensors::update() {
+  SimDrivetrain &drive = simRobotDrivetrain();
+  double total = 0;
+  for (int i = 0; i < 4; i++) {
+    double amps = drive.current(i);
+    total += fabs(amps);
+    simSetAnalog(currentPins[i], adcCounts(2.5 + amps * CURRENT_SENSE_V_PER_A));
+  }
+  loadedVolts_ = batteryVolts_ - total * BATTERY_OHMS;
+  simSetAnalog(BATTERY_ADC_PIN, adcCounts(loadedVolts_ / BATTERY_DIVIDER));
+}
+
+// A ping is the falling edge of a trigger pulse
+void SimSensors::trigChanged(uint8_t pin) {
+  if (pin != US_TRIG_PIN || !instance || simPinLevel(pin) != LOW || instance->echoBusy_) return;
+  if (instance->dead_) return;
+  instance->echoBusy_ = true;
+  instance->pings_++;
+  simSchedule(ECHO_DELAY_US, echoStartEvent, instance);
+}
+
+void SimSensors::echoStartEvent(void *ctx) {
+  SimSensors *s = (SimSensors *)ctx;
+  uint64_t width = (s->range_ < 0.02 || s->range_ > 4.0) ? NO_ECHO_US
+                                                         : (uint64_t)(2 * s->range_ / 343.0 * 1e6);
+  simSetPin(US_ECHO_PIN, HIGH);
+  simSchedule(width, echoEndEvent, s);
+}
+
+void SimSensors::echoEndEvent(void *ctx) {
+  SimSensors *s = (SimSensors *)ctx;
+  simSetPin(US_ECHO_PIN, LOW);
+  s->echoBusy_ = false;
+  s->lastEchoUs_ = simNowUs();
+}
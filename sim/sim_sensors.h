@@ -0,0 +1,36 @@
+#ifndef SIM_SENSORS_H
+#define SIM_SENSORS_H
+
+#include <Arduino.h>
+
+// Analog and ranging sensors from config.h: battery voltage through its
+// divider (sagging with motor current), ACS712 current sensors fed by the
+// drivetrain model, and an HC-SR04 that answers pings on US_TRIG_PIN.
+class SimSensors {
+public:
+  SimSensors();
+
+  void begin();
+  void setBatteryVolts(double v) { batteryVolts_ = v; }
+  void setRange(double meters) { range_ = meters; }    // <0 or >4 m: nothing in range
+  void setDead(bool dead) { dead_ = dead; }             // no echo at all, as unplugged
+  double batteryVolts() const { return loadedVolts_; }
+  double range() const { return range_; }
+  unsigned long pings() const { return pings_; }
+  uint64_t lastEchoUs() const { return lastEchoUs_; }  // falling edge of the last echo
+
+private:
+  static void updateEvent(void *ctx);
+  static void echoStartEvent(void *ctx);
+  static void echoEndEvent(void *ctx);
+  static void trigChanged(uint8_t pin);
+  void update();
+
+  double batteryVolts_, loadedVolts_, range_;
+  bool dead_;
+  bool echoBusy_;
+  unsigned long pings_;
+  uint64_t lastEchoUs_;
+};
+
+#endif // SIM_SENSORS_H
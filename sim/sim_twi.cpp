@@ -0,0 +1,82 @@
+#include "sim_twi.h"
+#include "sim.h"
+#include "twi_async.h"
+
+static SimI2cDevice *devices[128];
+static SimI2cDevice *current = nullptr;
+static unsigned long clockHz = 100000;
+static bool started = false;
+static bool addressNext = false;
+static bool hung = false;
+static uint8_t status = 0xF8;
+static uint8_t data = 0;
+static uint64_t busyUs = 0;
+static unsigned long bytes = 0;
+static uint32_t generation = 0;     // invalidates completions after a reset
+
+void simTwiAttach(uint8_t addr, SimI2cDevice *dev) { devices[addr & 0x7F] = dev; }
+void simTwiHang(bool hang) { hung = hang; }
+uint64_t simTwiBusyUs() { return busyUs; }
+unsigned long simTwiBytes() { return bytes; }
+
+static void complete(void *ctx) {
+  if ((uint32_t)(uintptr_t)ctx != generation || hung) return;
+  twiInterrupt();
+}
+
+// Raise the TWI interrupt after `bits` SCL periods
+static void finishAfter(unsigned bits, uint8_t newStatus) {
+  uint64_t us = ((uint64_t)bits * 1000000 + clockHz - 1) / clockHz;
+  busyUs += us;
+  status = newStatus;
+  simSchedule(us, complete, (void *)(uintptr_t)generation);
+}
+
+void simTwiInit(unsigned long hz) {
+  // --i2c-hz overrides the firmware's bus clock to test bus headroom
+  clockHz = (unsigned long)simOptionF("i2c-hz", hz ? hz : 100000);
+  if (current) current->stop();
+  current = nullptr;
+  started = false;
+  status = 0xF8;
+  generation++;
+}
+
+void simTwiStart() {
+  uint8_t st = started ? TWI_ST_REP_START : TWI_ST_START;
+  started = true;
+  addressNext = true;
+  finishAfter(1, st);
+}
+
+void simTwiStop() {
+  if (current) current->stop();
+  current = nullptr;
+  started = false;
+  busyUs += (1000000 + clockHz - 1) / clockHz;
+}
+
+void simTwiWrite(uint8_t b) {
+  bytes++;
+  if (addressNext) {
+    addressNext = false;
+    bool read = b & 1;
+    current = devices[b >> 1];
+    bool ack = current && current->address(read);
+    if (!ack) current = nullptr;
+    if (read) finishAfter(9, ack ? TWI_ST_MR_SLA_ACK : TWI_ST_MR_SLA_NACK);
+    else finishAfter(9, ack ? TWI_ST_MT_SLA_ACK : TWI_ST_MT_SLA_NACK);
+    return;
+  }
+  if (current) current->writeByte(b);
+  finishAfter(9, current ? TWI_ST_MT_DATA_ACK : TWI_ST_MT_DATA_NACK);
+}
+
+void simTwiRead(bool ack) {
+  bytes++;
+  data = current ? current->readByte() : 0xFF;
+  finishAfter(9, ack ? TWI_ST_MR_DATA_ACK : TWI_ST_MR_DATA_NACK);
+}
+
+uint8_t simTwiData() { return data; }
+uint8_t simTwiStatus() { return status; }
@@ -0,0 +1,33 @@
+#ifndef SIM_TWI_H
+#define SIM_TWI_H
+
+#include <Arduino.h>
+
+// Simulated AVR TWI peripheral behind twi_async.cpp on native builds. Each
+// bus action completes after its real bus time at the configured clock and
+// then raises the TWI "interrupt" (twiInterrupt) with the matching status.
+
+class SimI2cDevice {
+public:
+  virtual ~SimI2cDevice() {}
+  virtual bool address(bool read) = 0;    // true = ACK
+  virtual void writeByte(uint8_t b) = 0;
+  virtual uint8_t readByte() = 0;
+  virtual void stop() {}
+};
+
+void simTwiAttach(uint8_t addr, SimI2cDevice *dev);
+void simTwiHang(bool hang);               // stop raising interrupts (stuck bus)
+uint64_t simTwiBusyUs();
+unsigned long simTwiBytes();
+
+// Register-level operations used by twi_async.cpp
+void simTwiInit(unsigned long clockHz);
+void simTwiStart();
+void simTwiStop();
+void simTwiWrite(uint8_t b);
+void simTwiRead(bool ack);
+uint8_t simTwiData();
+uint8_t simTwiStatus();
+
+#endif // SIM_TWI_H
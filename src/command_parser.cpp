@@ -1,105 +1,539 @@
 #include "command_parser.h"
 #include "motor_control.h"
+#include "mpu_dmp.h"
+#include "pose_ekf.h"
+#include "sensor_manager.h"
+#include "safety.h"
+#include "motion_queue.h"
+#include "pursuit.h"
+#include "twist.h"
+#include "motor_calibration.h"
+#include "flight_recorder.h"
+#include "memory_monitor.h"
+#include "json_command.h"
 #include "config.h"
 
+// ---------------- Link bring-up ----------------
+// Once setup() is done the ESP is told, with what this firmware understands:
+//   READY proto=<LINK_PROTOCOL> up_ms=<millis> <capability>...
+// Whatever the ESP sent before RADIO_SERIAL.begin() is gone and it may
+// still be booting, so the line is repeated with backoff until the first
+// line from it arrives. HELLO gets the same line as its reply at any time.
+static bool linkHeard = false;
+static unsigned long nextAnnounceMs = 0;
+static unsigned long announceGapMs = LINK_ANNOUNCE_FIRST_MS;
+
+static void printReady(Print &out) {
+  out.print(F("READY proto="));
+  out.print(LINK_PROTOCOL);
+  out.print(F(" up_ms="));
+  out.print(millis());
+  out.println(F(" trace json twist queue wp cal rec safe mem"));
+}
+
+void announceReady() {
+  printReady(RADIO_SERIAL);
+  nextAnnounceMs = millis() + announceGapMs;
+}
+
+void processLinkAnnounce() {
+  if (linkHeard || (long)(millis() - nextAnnounceMs) < 0) return;
+  printReady(RADIO_SERIAL);
+  announceGapMs = announceGapMs * 2 > LINK_ANNOUNCE_MAX_MS ? LINK_ANNOUNCE_MAX_MS : announceGapMs * 2;
+  nextAnnounceMs = millis() + announceGapMs;
+}
+
 // ---------------- Command parser ----------------
-void processLine(String line) {
-  line.trim();
-  if (line.length() == 0) return;
+// Where the arguments come from: the rest of an ASCII line through
+// strtok(), or a JSON command's "args"
+static JsonArgs *jsonArgs = NULL;
 
-  char buf[line.length() + 1];
-  line.toCharArray(buf, sizeof(buf));
-  char *tok = strtok(buf, " ");
+static char *nextArg() {
+  return jsonArgs ? jsonArgsNext(*jsonArgs) : strtok(NULL, " ");
+}
 
-  if (!tok) return;
+// Commands that drive the motors directly; they take over from a queued maneuver
+static bool isMotionCommand(const char *tok) {
+  static const char *const names[] = {
+    "SET_V", "MALL", "M", "M1", "M2", "M3", "M4", "FWD", "BACK", "LEFT", "RIGHT", "STOP", "TWIST"
+  };
+  for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(tok, names[i]) == 0) return true;
+  }
+  return false;
+}
+
+// Q_ADD <start ms> <duration ms> VEL <left> <right> | TURN <speed> | STOP
+static bool parseMotionPrimitive(MotionPrimitive &p) {
+  char *start = nextArg();
+  char *dur = nextArg();
+  char *type = nextArg();
+  if (!start || !dur || !type) return false;
+  p.startMs = strtoul(start, NULL, 10);
+  p.durationMs = atoi(dur);
+  p.a = p.b = 0;
+  if (strcmp(type, "VEL") == 0) {
+    char *a = nextArg();
+    char *b = nextArg();
+    if (!a || !b) return false;
+    p.type = MOTION_VEL;
+    p.a = atoi(a);
+    p.b = atoi(b);
+  } else if (strcmp(type, "TURN") == 0) {
+    char *a = nextArg();
+    if (!a) return false;
+    p.type = MOTION_TURN;
+    p.a = atoi(a);
+  } else if (strcmp(type, "STOP") == 0) {
+    p.type = MOTION_STOP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Runs one command; tok is its name, nextArg() gives the arguments and
+// the replies go to out
+static void runCommand(char *tok, Print &out) {
+  if (isMotionCommand(tok)) {
+    motionQueueCancel();
+    pursuitCancel();
+    twistCancel();
+    motorCalibrationAbort();
+  }
 
   if (strcmp(tok, "SET_V") == 0) {
-    char *a = strtok(NULL, " ");
-    char *b = strtok(NULL, " ");
+    char *a = nextArg();
+    char *b = nextArg();
     if (a && b) {
       int L = atoi(a), R = atoi(b);
       setM1(L); setM3(L); setM2(R); setM4(R);
-      RADIO_SERIAL.println("OK SET_V");
-    } else RADIO_SERIAL.println("ERR SET_V params");
+      out.println(F("OK SET_V"));
+    } else out.println(F("ERR SET_V params"));
 
   } else if (strcmp(tok, "MALL") == 0) {
-    char *a = strtok(NULL, " ");
-    char *b = strtok(NULL, " ");
-    char *c = strtok(NULL, " ");
-    char *d = strtok(NULL, " ");
+    char *a = nextArg();
+    char *b = nextArg();
+    char *c = nextArg();
+    char *d = nextArg();
+    if (a && b && c && d) {
+      setM1(atoi(a)); setM2(atoi(b)); setM3(atoi(c)); setM4(atoi(d));
+      out.println(F("OK MALL"));
+    } else out.println(F("ERR MALL params"));
+
+  } else if (strcmp(tok, "M") == 0) {
+    // M <m1> <m2> <m3> <m4> [enable], as the ESP sketch sends it
+    char *a = nextArg();
+    char *b = nextArg();
+    char *c = nextArg();
+    char *d = nextArg();
+    char *e = nextArg();
     if (a && b && c && d) {
+      if (e && atoi(e)) enableMotors();
       setM1(atoi(a)); setM2(atoi(b)); setM3(atoi(c)); setM4(atoi(d));
-      RADIO_SERIAL.println("OK MALL");
-    } else RADIO_SERIAL.println("ERR MALL params");
+      if (e && !atoi(e)) disableMotors();
+      out.println(F("OK M"));
+    } else out.println(F("ERR M params"));
 
   } else if (strcmp(tok, "M1") == 0) {
-    char *a = strtok(NULL, " ");
-    if (a) { setM1(atoi(a)); RADIO_SERIAL.println("OK M1"); }
+    char *a = nextArg();
+    if (a) { setM1(atoi(a)); out.println(F("OK M1")); }
 
   } else if (strcmp(tok, "M2") == 0) {
-    char *a = strtok(NULL, " ");
-    if (a) { setM2(atoi(a)); RADIO_SERIAL.println("OK M2"); }
+    char *a = nextArg();
+    if (a) { setM2(atoi(a)); out.println(F("OK M2")); }
 
   } else if (strcmp(tok, "M3") == 0) {
-    char *a = strtok(NULL, " ");
-    if (a) { setM3(atoi(a)); RADIO_SERIAL.println("OK M3"); }
+    char *a = nextArg();
+    if (a) { setM3(atoi(a)); out.println(F("OK M3")); }
 
   } else if (strcmp(tok, "M4") == 0) {
-    char *a = strtok(NULL, " ");
-    if (a) { setM4(atoi(a)); RADIO_SERIAL.println("OK M4"); }
+    char *a = nextArg();
+    if (a) { setM4(atoi(a)); out.println(F("OK M4")); }
 
   } else if (strcmp(tok, "FWD") == 0) {
-    char *a = strtok(NULL, " ");
+    char *a = nextArg();
     int spd = a ? atoi(a) : 150;
     driveForward(spd);
-    RADIO_SERIAL.println("OK FWD");
+    out.println(F("OK FWD"));
 
   } else if (strcmp(tok, "BACK") == 0) {
-    char *a = strtok(NULL, " ");
+    char *a = nextArg();
     int spd = a ? atoi(a) : 150;
     driveBackward(spd);
-    RADIO_SERIAL.println("OK BACK");
+    out.println(F("OK BACK"));
 
   } else if (strcmp(tok, "LEFT") == 0) {
-    char *a = strtok(NULL, " ");
+    char *a = nextArg();
     int spd = a ? atoi(a) : 150;
     turnLeft(spd);
-    RADIO_SERIAL.println("OK LEFT");
+    out.println(F("OK LEFT"));
 
   } else if (strcmp(tok, "RIGHT") == 0) {
-    char *a = strtok(NULL, " ");
+    char *a = nextArg();
     int spd = a ? atoi(a) : 150;
     turnRight(spd);
-    RADIO_SERIAL.println("OK RIGHT");
+    out.println(F("OK RIGHT"));
 
   } else if (strcmp(tok, "STOP") == 0) {
     stopAll();
-    RADIO_SERIAL.println("OK STOP");
+    out.println(F("OK STOP"));
+
+  } else if (strcmp(tok, "TWIST") == 0) {
+    // TWIST <vx mm/s> <wz mrad/s, CCW>
+    char *a = nextArg();
+    char *b = nextArg();
+    if (a && b) {
+      twistSet(atoi(a), atoi(b));
+      out.println(F("OK TWIST"));
+    } else out.println(F("ERR TWIST params"));
+
+  } else if (strcmp(tok, "TWIST_TRACK") == 0) {
+    char *a = nextArg();
+    if (a && twistSetTrack(atoi(a))) out.println(F("OK TWIST_TRACK"));
+    else out.println(F("ERR TWIST_TRACK params"));
+
+  } else if (strcmp(tok, "TWIST_MODE") == 0) {
+    char *a = nextArg();
+    if (a) {
+      twistSetMode(atoi(a) ? TWIST_CLOSED_LOOP : TWIST_OPEN_LOOP);
+      out.println(F("OK TWIST_MODE"));
+    } else out.println(F("ERR TWIST_MODE params"));
+
+  } else if (strcmp(tok, "REQ_TWIST") == 0) {
+    // TW <running> <closed loop> <track mm> <full scale mm/s> <left mm/s> <right mm/s> <saturated> <v mm/s> <w mrad/s>
+    TwistStatus st;
+    twistGetStatus(st);
+    out.print(F("TW "));
+    out.print(st.running ? 1 : 0); out.print(' ');
+    out.print((int)st.mode); out.print(' ');
+    out.print(st.trackMm); out.print(' ');
+    out.print(st.fullScaleMmps); out.print(' ');
+    out.print(st.wheels.left); out.print(' ');
+    out.print(st.wheels.right); out.print(' ');
+    out.print(st.wheels.saturated ? 1 : 0); out.print(' ');
+    out.print(st.vMmps); out.print(' ');
+    out.println(st.wMradps);
+    out.println(F("OK REQ_TWIST"));
 
   } else if (strcmp(tok, "ENABLE") == 0) {
     enableMotors();
-    RADIO_SERIAL.println("OK ENABLE");
+    out.println(F("OK ENABLE"));
 
   } else if (strcmp(tok, "DISABLE") == 0) {
     disableMotors();
-    RADIO_SERIAL.println("OK DISABLE");
+    out.println(F("OK DISABLE"));
+
+  } else if (strcmp(tok, "PING") == 0) {
+    out.println(F("PONG"));
+
+  } else if (strcmp(tok, "HELLO") == 0) {
+    // HELLO [who]: the ESP's link probe
+    printReady(out);
+
+  } else if (strcmp(tok, "STATUS") == 0) {
+    out.print(F("STATUS motors="));
+    out.print(motorsEnabled() ? 1 : 0);
+    out.println(F(" system=ready"));
+
+  } else if (strcmp(tok, "INIT") == 0) {
+    // INIT SYSTEM|MOTORS|SENSORS: setup() has already done all three
+    out.println(F("OK INIT"));
+
+  } else if (strcmp(tok, "SENSORS") == 0) {
+    // The SENS values by name: SENSORS battery_mv=.. m1_ma=.. .. m4_ma=.. range_mm=..
+    SensorFrame f;
+    if (sensorsGetFrame(f)) {
+      out.print(F("SENSORS battery_mv="));
+      out.print((long)(sensorBatteryVolts(f) * 1000));
+      for (uint8_t m = 1; m <= 4; m++) {
+        out.print(F(" m")); out.print(m); out.print(F("_ma="));
+        out.print((long)(sensorMotorAmps(f, m) * 1000));
+      }
+      out.print(F(" range_mm="));
+      out.println(f.rangeMm);
+    } else out.println(F("ERR SENSORS not ready"));
 
   } else if (strcmp(tok, "REQ_ODOM") == 0) {
-    RADIO_SERIAL.println("OK REQ_ODOM");
+    out.println(F("OK REQ_ODOM"));
     // Will emit next cycle
 
+  } else if (strcmp(tok, "REQ_IMU") == 0) {
+    // IMU <ready> <heading rad> <yaw rate rad/s> <samples> <fifo resets> <ring stalls> <bus errors>
+    ImuStats st;
+    imuGetStats(st);
+    out.print(F("IMU "));
+    out.print(imuReady() ? 1 : 0); out.print(' ');
+    out.print(imuHeading(), 4); out.print(' ');
+    out.print(imuYawRate(), 4); out.print(' ');
+    out.print(st.samples); out.print(' ');
+    out.print(st.fifoOverflows); out.print(' ');
+    out.print(st.ringStalls); out.print(' ');
+    out.println(st.busErrors);
+    out.println(F("OK REQ_IMU"));
+
+  } else if (strcmp(tok, "REQ_EKF") == 0) {
+    // EKF <steps> <overruns> <max step us> <slip events>
+    EkfStats st;
+    getEkfStats(st);
+    out.print(F("EKF "));
+    out.print(st.steps); out.print(' ');
+    out.print(st.overruns); out.print(' ');
+    out.print(st.maxStepUs); out.print(' ');
+    out.println(st.slipEvents);
+    out.println(F("OK REQ_EKF"));
+
+  } else if (strcmp(tok, "REQ_SENS") == 0) {
+    sendSensorPacket(out);
+    out.println(F("OK REQ_SENS"));
+
+  } else if (strcmp(tok, "SAFE_RANGE") == 0) {
+    char *a = nextArg();
+    if (a) {
+      safetySetRangeLimit(atoi(a));
+      out.println(F("OK SAFE_RANGE"));
+    } else out.println(F("ERR SAFE_RANGE params"));
+
+  } else if (strcmp(tok, "SAFE_CURRENT") == 0) {
+    char *a = nextArg();
+    char *b = nextArg();
+    if (a) {
+      safetySetCurrentLimit(atoi(a), b ? atoi(b) : SAFETY_CURRENT_MS);
+      out.println(F("OK SAFE_CURRENT"));
+    } else out.println(F("ERR SAFE_CURRENT params"));
+
+  } else if (strcmp(tok, "SAFE_CLEAR") == 0) {
+    safetyClear();
+    out.println(F("OK SAFE_CLEAR"));
+
+  } else if (strcmp(tok, "REQ_SAFE") == 0) {
+    // SAFE <range mm> <current mA> <trip ms> <forward blocked> <held mask> <obstacle trips> <current trips>
+    SafetyStatus st;
+    safetyGetStatus(st);
+    out.print(F("SAFE "));
+    out.print(st.rangeLimitMm); out.print(' ');
+    out.print(st.currentLimitMa); out.print(' ');
+    out.print(st.currentTripMs); out.print(' ');
+    out.print(st.forwardBlocked ? 1 : 0); out.print(' ');
+    out.print(st.inhibitMask); out.print(' ');
+    out.print(st.obstacleTrips); out.print(' ');
+    out.println(st.currentTrips);
+    out.println(F("OK REQ_SAFE"));
+
+  } else if (strcmp(tok, "Q_ADD") == 0) {
+    MotionPrimitive prim;
+    if (!parseMotionPrimitive(prim)) out.println(F("ERR Q_ADD params"));
+    else if (!motionQueueAdd(prim)) out.println(F("ERR Q_ADD full or out of order"));
+    else out.println(F("OK Q_ADD"));
+
+  } else if (strcmp(tok, "Q_RUN") == 0) {
+    pursuitCancel();
+    twistCancel();
+    motorCalibrationAbort();
+    motionQueueRun();
+    out.println(F("OK Q_RUN"));
+
+  } else if (strcmp(tok, "Q_CLEAR") == 0) {
+    motionQueueClear();
+    out.println(F("OK Q_CLEAR"));
+
+  } else if (strcmp(tok, "REQ_Q") == 0) {
+    // Q <running> <count> <next> <elapsed ms> <max late us>
+    MotionQueueStatus st;
+    motionQueueGetStatus(st);
+    out.print(F("Q "));
+    out.print(st.running ? 1 : 0); out.print(' ');
+    out.print(st.count); out.print(' ');
+    out.print(st.next); out.print(' ');
+    out.print(st.elapsedMs); out.print(' ');
+    out.println(st.maxLateUs);
+    out.println(F("OK REQ_Q"));
+
+  } else if (strcmp(tok, "WP_ADD") == 0) {
+    char *a = nextArg();
+    char *b = nextArg();
+    if (!a || !b) out.println(F("ERR WP_ADD params"));
+    else if (!pursuitAdd(atoi(a), atoi(b))) out.println(F("ERR WP_ADD full"));
+    else out.println(F("OK WP_ADD"));
+
+  } else if (strcmp(tok, "WP_RUN") == 0) {
+    char *a = nextArg();
+    motionQueueCancel();
+    twistCancel();
+    motorCalibrationAbort();
+    if (pursuitRun(a ? atoi(a) : 150)) out.println(F("OK WP_RUN"));
+    else out.println(F("ERR WP_RUN empty"));
+
+  } else if (strcmp(tok, "WP_CLEAR") == 0) {
+    pursuitClear();
+    out.println(F("OK WP_CLEAR"));
+
+  } else if (strcmp(tok, "REQ_WP") == 0) {
+    // WP <running> <count> <target> <dist mm> <cross-track mm>
+    PursuitStatus st;
+    pursuitGetStatus(st);
+    out.print(F("WP "));
+    out.print(st.running ? 1 : 0); out.print(' ');
+    out.print(st.count); out.print(' ');
+    out.print(st.target); out.print(' ');
+    out.print(st.distMm); out.print(' ');
+    out.println(st.crossTrackMm);
+    out.println(F("OK REQ_WP"));
+
+  } else if (strcmp(tok, "CAL_MOTORS") == 0) {
+    motionQueueCancel();
+    pursuitCancel();
+    twistCancel();
+    if (motorCalibrationStart()) out.println(F("OK CAL_MOTORS"));
+    else out.println(F("ERR CAL_MOTORS running"));
+
+  } else if (strcmp(tok, "CAL_USE") == 0) {
+    char *a = nextArg();
+    if (a) {
+      motorCalibrationUse(atoi(a) != 0);
+      out.println(F("OK CAL_USE"));
+    } else out.println(F("ERR CAL_USE params"));
+
+  } else if (strcmp(tok, "REQ_CAL") == 0) {
+    sendMotorCalibration(out);
+    out.println(F("OK REQ_CAL"));
+
+  } else if (strcmp(tok, "REC_ARM") == 0) {
+    char *a = nextArg();
+    char *b = nextArg();
+    char *c = nextArg();
+    uint16_t periodMs = a ? atoi(a) : 1;
+    uint16_t post = b ? atoi(b) : REC_SAMPLES / 2;
+    uint8_t mask = c ? atoi(c) : REC_TRIG_COMMAND | REC_TRIG_FAULT | REC_TRIG_SAFETY;
+    if (recorderArm(periodMs, post, mask)) out.println(F("OK REC_ARM"));
+    else out.println(F("ERR REC_ARM params"));
+
+  } else if (strcmp(tok, "REC_TRIG") == 0) {
+    if (recorderTrigger(REC_TRIG_COMMAND)) out.println(F("OK REC_TRIG"));
+    else out.println(F("ERR REC_TRIG not armed"));
+
+  } else if (strcmp(tok, "REC_STOP") == 0) {
+    recorderStop();
+    out.println(F("OK REC_STOP"));
+
+  } else if (strcmp(tok, "REC_DUMP") == 0) {
+    if (recorderDump()) out.println(F("OK REC_DUMP"));
+    else out.println(F("ERR REC_DUMP nothing recorded"));
+
+  } else if (strcmp(tok, "REQ_REC") == 0) {
+    // REC <state> <count> <period us> <trigger source> <trigger index>
+    RecorderStatus st;
+    recorderGetStatus(st);
+    out.print(F("REC "));
+    out.print((int)st.state); out.print(' ');
+    out.print(st.count); out.print(' ');
+    out.print(st.periodUs); out.print(' ');
+    out.print(st.triggerSource); out.print(' ');
+    out.println(st.triggerIndex);
+    out.println(F("OK REQ_REC"));
+
+  } else if (strcmp(tok, "REQ_MEM") == 0) {
+    // MEM <static> <heap> <heap max> <stack> <stack max> <free min>, bytes
+    MemoryStatus st;
+    memoryGetStatus(st);
+    out.print(F("MEM "));
+    out.print(st.staticBytes); out.print(' ');
+    out.print(st.heapBytes); out.print(' ');
+    out.print(st.heapMaxBytes); out.print(' ');
+    out.print(st.stackBytes); out.print(' ');
+    out.print(st.stackMaxBytes); out.print(' ');
+    out.println(st.freeMinBytes);
+    out.println(F("OK REQ_MEM"));
+
   } else {
-    RADIO_SERIAL.print("ERR UNKNOWN_CMD ");
-    RADIO_SERIAL.println(tok);
+    out.print(F("ERR UNKNOWN_CMD "));
+    out.println(tok);
   }
 }
 
+// ---------------- Tracing ----------------
+// A line sent as "#<id> <command>" runs as usual and is followed by
+//   TR <id> <rx us> <actuation> <ack>
+// rx is micros() when its newline was read; actuation and ack are us after
+// that until the motors were last written while it ran (-1 if they weren't)
+// and until its reply had been queued. The ESP pairs these with its own
+// timestamps to split the round trip. A JSON command traces with "id".
+static unsigned long lineRxUs = 0;
+
+static void runTraced(char *tok, unsigned long id, Print &out) {
+  unsigned long rxUs = lineRxUs;
+  unsigned long outputUs = motorLastOutputUs();
+  runCommand(tok, out);
+  unsigned long ackUs = micros();
+  unsigned long actUs = motorLastOutputUs();
+
+  out.print(F("TR "));
+  out.print(id); out.print(' ');
+  out.print(rxUs); out.print(' ');
+  if (actUs != outputUs) out.print(actUs - rxUs);
+  else out.print(-1);
+  out.print(' ');
+  out.println(ackUs - rxUs);
+}
+
+// ---------------- JSON ----------------
+// {"cmd":"SET_V","args":[120,-80],"id":7}, answered in JSON (json_command.h)
+static void processJson(char *buf) {
+  JsonReply reply(RADIO_SERIAL);
+  JsonToken tokens[JSON_MAX_TOKENS];
+  int8_t n = jsonTokenize(buf, tokens, JSON_MAX_TOKENS);
+  int8_t cmd = n > 0 ? jsonFind(buf, tokens, n, "cmd") : -1;
+  if (n < 0) {
+    reply.println(n == JSON_ERR_TOKENS ? F("ERR JSON too many tokens") : F("ERR JSON invalid"));
+    return;
+  }
+  if (cmd < 0 || tokens[cmd].type != JSON_STRING) {
+    reply.println(F("ERR JSON no cmd"));
+    return;
+  }
+  JsonArgs args;
+  if (!jsonArgsBegin(args, buf, tokens, n, jsonFind(buf, tokens, n, "args"))) {
+    reply.println(F("ERR JSON args"));
+    return;
+  }
+  int8_t id = jsonFind(buf, tokens, n, "id");
+  jsonArgs = &args;
+  if (id >= 0) runTraced(buf + tokens[cmd].start, strtoul(buf + tokens[id].start, NULL, 10), reply);
+  else runCommand(buf + tokens[cmd].start, reply);
+  jsonArgs = NULL;
+}
+
+void processLine(String line) {
+  line.trim();
+  if (line.length() == 0) return;
+
+  char buf[line.length() + 1];
+  line.toCharArray(buf, sizeof(buf));
+  if (buf[0] == '{') {
+    processJson(buf);
+    return;
+  }
+  char *tok = strtok(buf, " ");
+  if (!tok) return;
+
+  if (tok[0] != '#') {
+    runCommand(tok, RADIO_SERIAL);
+    return;
+  }
+  unsigned long id = strtoul(tok + 1, NULL, 10);
+  tok = strtok(NULL, " ");
+  if (!tok) return;
+  runTraced(tok, id, RADIO_SERIAL);
+}
+
 void handleSerialCommands(String &rxBuf) {
   // Parse commands from ESP
   while (RADIO_SERIAL.available()) {
     char c = RADIO_SERIAL.read();
     if (c == '\r') continue;
     if (c == '\n') {
+      linkHeard = true;
+      lineRxUs = micros();
       String L = rxBuf; 
       rxBuf = "";
       processLine(L);
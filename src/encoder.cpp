@@ -29,12 +29,14 @@ void ISR_enc4() {
   else encCount4--; 
 }
 
-void resetEncoderCounts(long &c1, long &c2, long &c3, long &c4) {
+// Counts are running totals; each consumer (odometry, pose filter) keeps
+// its own previous snapshot and works with the difference.
+void readEncoderCounts(long &c1, long &c2, long &c3, long &c4) {
   noInterrupts();
-  c1 = encCount1; encCount1 = 0;
-  c2 = encCount2; encCount2 = 0;
-  c3 = encCount3; encCount3 = 0;
-  c4 = encCount4; encCount4 = 0;
+  c1 = encCount1;
+  c2 = encCount2;
+  c3 = encCount3;
+  c4 = encCount4;
   interrupts();
 }
 
@@ -0,0 +1,40 @@
+#include "fixed_math.h"
+
+// Quarter sine wave, Q15, 64 segments (one extra entry for interpolation)
+static const int16_t SIN_TABLE[66] PROGMEM = {
+  0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512,
+  10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846,
+  17530, 18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170,
+  23731, 24279, 24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105,
+  28510, 28898, 29268, 29621, 29956, 30273, 30571, 30852, 31113, 31356,
+  31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728,
+  32757, 32767, 32767
+};
+
+int16_t sinBam(uint16_t bam) {
+  uint16_t p = bam & 0x3FFF;
+  if (bam & 0x4000) p = 0x4000 - p;
+  uint8_t idx = p >> 8;
+  uint8_t frac = p & 0xFF;
+  int16_t a = (int16_t)pgm_read_word(&SIN_TABLE[idx]);
+  int16_t b = (int16_t)pgm_read_word(&SIN_TABLE[idx + 1]);
+  int16_t s = a + (int16_t)(((int32_t)(b - a) * frac) >> 8);
+  return (bam & 0x8000) ? -s : s;
+}
+
+// Bit-by-bit square root: 16 iterations of shifts and adds, no multiply
+uint32_t isqrt32(uint32_t v) {
+  uint32_t root = 0;
+  uint32_t bit = (uint32_t)1 << 30;
+  while (bit > v) bit >>= 2;
+  while (bit) {
+    if (v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
@@ -0,0 +1,204 @@
+#include "flight_recorder.h"
+#include "motor_control.h"
+#include "encoder.h"
+#include "mpu_dmp.h"
+#include "safety.h"
+#include "config.h"
+
+// ---------------- Ring ----------------
+static RecSample ring[REC_SAMPLES];
+static uint16_t head = 0;            // next slot to write
+static uint16_t count = 0;
+
+static RecState state = REC_IDLE;
+static uint8_t triggerMask = 0;
+static uint8_t triggerSource = 0;
+static uint16_t triggerIndex = 0;
+static unsigned long triggerMs = 0;
+static uint16_t postSamples = 0, postLeft = 0;
+static uint8_t pendingTrigger = 0;   // lands in the next sample
+
+// ---------------- Sampling state ----------------
+static uint16_t periodUs = 1000;
+static unsigned long nextDueUs = 0;
+static unsigned long lastPassUs = 0;
+static unsigned long loopMaxUs = 0;
+static long lastCount[4];
+static unsigned long lastFaults = 0;     // IMU FIFO overflows + bus errors
+static unsigned long lastTrips = 0;      // obstacle + current trips
+
+static unsigned long imuFaults() {
+  ImuStats st;
+  imuGetStats(st);
+  return st.fifoOverflows + st.busErrors;
+}
+
+static unsigned long safetyTrips() {
+  SafetyStatus st;
+  safetyGetStatus(st);
+  return st.obstacleTrips + st.currentTrips;
+}
+
+bool recorderArm(uint16_t periodMs, uint16_t post, uint8_t mask) {
+  if (periodMs < 1 || periodMs > 60 || post >= REC_SAMPLES) return false;
+  periodUs = periodMs * 1000;
+  postSamples = post;
+  triggerMask = mask;
+  triggerSource = 0;
+  pendingTrigger = 0;
+  head = count = 0;
+  readEncoderCounts(lastCount[0], lastCount[1], lastCount[2], lastCount[3]);
+  lastFaults = imuFaults();
+  lastTrips = safetyTrips();
+  lastPassUs = micros();
+  loopMaxUs = 0;
+  nextDueUs = lastPassUs + periodUs;
+  state = REC_ARMED;
+  return true;
+}
+
+bool recorderTrigger(RecTrigger source) {
+  if (state != REC_ARMED || !(triggerMask & source)) return false;
+  pendingTrigger = source;
+  state = REC_TRIGGERED;
+  return true;
+}
+
+static void freeze() {
+  state = REC_FROZEN;
+  triggerIndex = triggerSource ? count - 1 - (postSamples - postLeft) : count;
+  RADIO_SERIAL.print(F("REC DONE "));
+  RADIO_SERIAL.print(triggerSource); RADIO_SERIAL.print(' ');
+  RADIO_SERIAL.print(count); RADIO_SERIAL.print(' ');
+  RADIO_SERIAL.println(triggerIndex);
+}
+
+void recorderStop() {
+  if (state == REC_ARMED || state == REC_TRIGGERED) freeze();
+}
+
+void recorderGetStatus(RecorderStatus &out) {
+  out.state = state;
+  out.count = count;
+  out.periodUs = periodUs;
+  out.triggerSource = triggerSource;
+  out.triggerIndex = state == REC_FROZEN ? triggerIndex : count;
+}
+
+// ---------------- Sampling ----------------
+static void takeSample(unsigned long lateUs, bool fault) {
+  RecSample &s = ring[head];
+  s.loopUs = loopMaxUs > 0xFFFF ? 0xFFFF : loopMaxUs;
+  s.lateUs = lateUs > 0xFFFF ? 0xFFFF : lateUs;
+  s.flags = motorForwardBlocked() ? REC_FLAG_FWD_BLOCKED : 0;
+
+  long c[4];
+  readEncoderCounts(c[0], c[1], c[2], c[3]);
+  for (uint8_t w = 0; w < 4; w++) {
+    long d = c[w] - lastCount[w];
+    lastCount[w] = c[w];
+    if (d > 127 || d < -128) {
+      d = d > 0 ? 127 : -128;
+      s.flags |= REC_FLAG_ENC_CLIPPED;
+      fault = true;
+    }
+    s.dEnc[w] = d;
+  }
+
+  int16_t out[4];
+  motorGetOutputs(out);
+  s.dir = motorInhibited() << 4;
+  for (uint8_t w = 0; w < 4; w++) {
+    s.pwm[w] = out[w] < 0 ? -out[w] : out[w];
+    if (out[w] < 0) s.dir |= 1 << w;
+  }
+
+  if (fault) recorderTrigger(REC_TRIG_FAULT);
+  if (pendingTrigger) {
+    s.flags |= REC_FLAG_TRIGGER;
+    triggerSource = pendingTrigger;
+    triggerMs = millis();
+    pendingTrigger = 0;
+    postLeft = postSamples;
+  }
+
+  head = head + 1 < REC_SAMPLES ? head + 1 : 0;
+  if (count < REC_SAMPLES) count++;
+  loopMaxUs = 0;
+}
+
+// Samples run on a fixed schedule from REC_ARM; a pass that misses a whole
+// period skips ahead rather than bunching samples up, and counts as a fault.
+// Faults and trips seen at a sample are marked as the trigger in that sample.
+void processRecorder() {
+  if (state != REC_ARMED && state != REC_TRIGGERED) return;
+  unsigned long now = micros();
+  unsigned long pass = now - lastPassUs;
+  lastPassUs = now;
+  if (pass > loopMaxUs) loopMaxUs = pass;
+  if ((long)(now - nextDueUs) < 0) return;
+
+  unsigned long lateUs = now - nextDueUs;
+  nextDueUs += periodUs;
+  bool fault = false;
+  if (lateUs >= periodUs) {
+    nextDueUs = now + periodUs - lateUs % periodUs;
+    fault = true;
+  }
+
+  unsigned long faults = imuFaults();
+  unsigned long trips = safetyTrips();
+  if (faults != lastFaults) fault = true;
+  if (trips != lastTrips) recorderTrigger(REC_TRIG_SAFETY);
+  lastFaults = faults;
+  lastTrips = trips;
+
+  bool triggered = triggerSource != 0;
+  takeSample(lateUs, fault);
+  if (triggered) postLeft--;
+  if (triggerSource && postLeft == 0) freeze();
+}
+
+// ---------------- Dump ----------------
+// Fletcher-16 over the block, so a dump cut short or mixed with text on the
+// link is rejected by the decoder instead of turning into bad rows
+static uint8_t sum1, sum2;
+
+static void writeSummed(const uint8_t *p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    sum1 = (sum1 + p[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  RADIO_SERIAL.write(p, n);
+}
+
+// Blocks until the whole ring has gone out (~200 ms at 115200 baud for a
+// full ring). The safety cutoff keeps running from the sensor interrupts.
+bool recorderDump() {
+  if (state != REC_FROZEN) return false;
+  RecHeader h;
+  h.magic[0] = REC_MAGIC0;
+  h.magic[1] = REC_MAGIC1;
+  h.version = REC_VERSION;
+  h.sampleBytes = sizeof(RecSample);
+  h.count = count;
+  h.triggerIndex = triggerIndex;
+  h.periodUs = periodUs;
+  h.triggerSource = triggerSource;
+  h.reserved = 0;
+  h.triggerMs = triggerMs;
+
+  RADIO_SERIAL.print(F("REC DUMP "));
+  RADIO_SERIAL.println((unsigned long)(sizeof(h) + count * sizeof(RecSample) + 2));
+  sum1 = sum2 = 0;
+  writeSummed((const uint8_t *)&h, sizeof(h));
+  uint16_t i = (head + REC_SAMPLES - count) % REC_SAMPLES;
+  for (uint16_t n = 0; n < count; n++) {
+    writeSummed((const uint8_t *)&ring[i], sizeof(RecSample));
+    i = i + 1 < REC_SAMPLES ? i + 1 : 0;
+  }
+  uint8_t check[2] = {sum1, sum2};
+  RADIO_SERIAL.write(check, 2);
+  RADIO_SERIAL.println();
+  return true;
+}
@@ -0,0 +1,335 @@
+#include "json_command.h"
+
+// ---------------- Tokenizer ----------------
+// Hangs a new token under parent: an array takes any number of values, a
+// key (a string under an object) exactly one, an object only string keys
+static int8_t addToken(JsonToken *tokens, uint8_t &n, uint8_t maxTokens,
+                       uint8_t parent, uint8_t type, uint8_t start) {
+  if (n >= maxTokens) return JSON_ERR_TOKENS;
+  if (parent == JSON_NO_PARENT) {
+    if (n > 0) return JSON_ERR_INVALID;          // a second top-level value
+  } else if (tokens[parent].type == JSON_OBJECT) {
+    if (type != JSON_STRING) return JSON_ERR_INVALID;
+    tokens[parent].size++;
+  } else if (tokens[parent].type == JSON_ARRAY) {
+    tokens[parent].size++;
+  } else if (n - 1 != parent) {
+    return JSON_ERR_INVALID;                     // a key with two values
+  }
+  JsonToken &t = tokens[n++];
+  t.type = type;
+  t.start = start;
+  t.size = 0;
+  t.parent = parent;
+  return 0;
+}
+
+static int8_t hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Unescapes the string starting after the quote at i in place and
+// NUL-terminates it; i is left on the closing quote
+static int8_t scanString(char *json, uint16_t len, uint16_t &i) {
+  uint16_t w = i + 1;
+  for (i++; i < len && json[i] != '"'; i++) {
+    char c = json[i];
+    if (c == '\\') {
+      if (++i >= len) return JSON_ERR_PARTIAL;
+      switch (json[i]) {
+        case '"': case '\\': case '/': c = json[i]; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u': {
+          // ASCII only; there's nothing else in a command
+          if (i + 4 >= len) return JSON_ERR_PARTIAL;
+          int16_t code = 0;
+          for (uint8_t k = 1; k <= 4; k++) {
+            int8_t d = hexDigit(json[i + k]);
+            if (d < 0) return JSON_ERR_INVALID;
+            code = code * 16 + d;
+          }
+          if (code == 0 || code >= 0x80) return JSON_ERR_INVALID;
+          c = (char)code;
+          i += 4;
+          break;
+        }
+        default: return JSON_ERR_INVALID;
+      }
+    }
+    json[w++] = c;
+  }
+  if (i >= len) return JSON_ERR_PARTIAL;
+  json[w] = '\0';    // at the closing quote at the latest
+  return 0;
+}
+
+static bool isDelimiter(char c) {
+  return c == ',' || c == ']' || c == '}' || c == ':' ||
+         c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+int8_t jsonTokenize(char *json, JsonToken *tokens, uint8_t maxTokens) {
+  uint16_t len = strlen(json);
+  if (len > 255) return JSON_ERR_INVALID;
+  uint8_t n = 0;
+  uint8_t super = JSON_NO_PARENT;   // the open container, or the key awaiting its value
+  int8_t err;
+
+  for (uint16_t i = 0; i < len; i++) {
+    char c = json[i];
+    switch (c) {
+      case '{': case '[':
+        err = addToken(tokens, n, maxTokens, super, c == '{' ? JSON_OBJECT : JSON_ARRAY, i);
+        if (err) return err;
+        super = n - 1;
+        break;
+
+      case '}': case ']':
+        if (super == JSON_NO_PARENT) return JSON_ERR_INVALID;
+        if (tokens[super].type == JSON_STRING) {
+          if (n - 1 == super) return JSON_ERR_INVALID;   // "key": with no value
+          super = tokens[super].parent;
+        }
+        if (tokens[super].type != (c == '}' ? JSON_OBJECT : JSON_ARRAY)) return JSON_ERR_INVALID;
+        super = tokens[super].parent;
+        break;
+
+      case '"':
+        err = addToken(tokens, n, maxTokens, super, JSON_STRING, i + 1);
+        if (err) return err;
+        err = scanString(json, len, i);
+        if (err) return err;
+        break;
+
+      case ':':
+        if (super == JSON_NO_PARENT || tokens[super].type != JSON_OBJECT ||
+            tokens[n - 1].type != JSON_STRING || tokens[n - 1].parent != super) {
+          return JSON_ERR_INVALID;
+        }
+        super = n - 1;
+        break;
+
+      case ',':
+        if (super != JSON_NO_PARENT && tokens[super].type == JSON_STRING) {
+          if (n - 1 == super) return JSON_ERR_INVALID;
+          super = tokens[super].parent;
+        }
+        break;
+
+      case ' ': case '\t': case '\r': case '\n':
+        break;
+
+      default: {
+        if (c != '-' && c != 't' && c != 'f' && c != 'n' && (c < '0' || c > '9')) return JSON_ERR_INVALID;
+        err = addToken(tokens, n, maxTokens, super, JSON_PRIMITIVE, i);
+        if (err) return err;
+        uint16_t end = i;
+        while (end < len && !isDelimiter(json[end])) end++;
+        tokens[n - 1].size = end - i;
+        i = end - 1;
+        break;
+      }
+    }
+  }
+  if (super != JSON_NO_PARENT) return JSON_ERR_PARTIAL;
+
+  // Primitives end on a delimiter the loop above still needed
+  for (uint8_t t = 0; t < n; t++) {
+    if (tokens[t].type != JSON_PRIMITIVE) continue;
+    char *p = json + tokens[t].start;
+    p[tokens[t].size] = '\0';
+    if (p[0] >= 'a' && strcmp(p, "true") != 0 && strcmp(p, "false") != 0 && strcmp(p, "null") != 0) {
+      return JSON_ERR_INVALID;
+    }
+  }
+  return n;
+}
+
+int8_t jsonFind(const char *json, const JsonToken *tokens, uint8_t count, const char *key) {
+  if (count == 0 || tokens[0].type != JSON_OBJECT) return -1;
+  for (uint8_t i = 1; i + 1 < count; i++) {
+    if (tokens[i].parent == 0 && strcmp(json + tokens[i].start, key) == 0) return i + 1;
+  }
+  return -1;
+}
+
+// ---------------- Arguments ----------------
+bool jsonArgsBegin(JsonArgs &a, char *json, const JsonToken *tokens, uint8_t count, int8_t value) {
+  a.json = json;
+  a.tokens = tokens;
+  a.count = count;
+  a.value = value;
+  a.next = value + 1;
+  if (value < 0) return true;
+  if (tokens[value].type == JSON_OBJECT) return false;
+  if (tokens[value].type == JSON_ARRAY) {
+    for (uint8_t i = value + 1; i < count && tokens[i].parent == value; i++) {
+      if (tokens[i].type == JSON_OBJECT || tokens[i].type == JSON_ARRAY) return false;
+    }
+  }
+  return true;
+}
+
+static char *scalarText(char *json, const JsonToken &t) {
+  char *p = json + t.start;
+  if (t.type != JSON_PRIMITIVE) return p;
+  if (p[0] == 't') return (char *)"1";
+  if (p[0] == 'f') return (char *)"0";
+  if (p[0] == 'n') return NULL;
+  return p;
+}
+
+char *jsonArgsNext(JsonArgs &a) {
+  if (a.value < 0) return NULL;
+  const JsonToken &v = a.tokens[a.value];
+  bool first = a.next == a.value + 1;
+
+  if (v.type == JSON_ARRAY) {
+    if (a.next >= a.count || a.tokens[a.next].parent != a.value) return NULL;
+    return scalarText(a.json, a.tokens[a.next++]);
+  }
+  a.next = a.value + 2;
+  if (v.type == JSON_STRING) return strtok(first ? a.json + v.start : NULL, " ");
+  return first ? scalarText(a.json, v) : NULL;
+}
+
+// ---------------- Replies ----------------
+static bool isNumber(const char *s) {
+  if (*s == '-') s++;
+  if (*s < '0' || *s > '9') return false;
+  while (*s >= '0' && *s <= '9') s++;
+  if (*s == '.') {
+    s++;
+    if (*s < '0' || *s > '9') return false;
+    while (*s >= '0' && *s <= '9') s++;
+  }
+  return *s == '\0';
+}
+
+void JsonReply::writeEscaped(char c) {
+  if (c == '"' || c == '\\') {
+    out_.write('\\');
+    out_.write((uint8_t)c);
+  } else if ((uint8_t)c < 0x20) {
+    uint8_t low = c & 0x0F;
+    out_.print((uint8_t)c < 0x10 ? F("\\u000") : F("\\u001"));
+    out_.write((uint8_t)(low < 10 ? '0' + low : 'a' + low - 10));
+  } else {
+    out_.write((uint8_t)c);
+  }
+}
+
+void JsonReply::endHead() {
+  word_[len_] = '\0';
+  len_ = 0;
+  if (strcmp(word_, "OK") == 0) {
+    out_.print(F("{\"resp\":\"ACK\",\"type\":\""));
+    state_ = TEXT;
+  } else if (strcmp(word_, "ERR") == 0) {
+    out_.print(F("{\"resp\":\"ERROR\",\"msg\":\""));
+    state_ = TEXT;
+  } else {
+    out_.print(F("{\"resp\":\""));
+    for (const char *p = word_; *p; p++) writeEscaped(*p);
+    out_.write('"');
+    state_ = WORDS;
+  }
+}
+
+// key=value becomes a member; anything else goes into the "v" array
+void JsonReply::endWord() {
+  word_[len_] = '\0';
+  len_ = 0;
+  char *value = strchr(word_, '=');
+  if (value && value != word_) {
+    if (arrayOpen_) out_.write(']');
+    arrayOpen_ = false;
+    *value++ = '\0';
+    out_.print(F(",\""));
+    for (const char *p = word_; *p; p++) writeEscaped(*p);
+    out_.print(F("\":"));
+  } else {
+    out_.print(arrayOpen_ ? F(",") : F(",\"v\":["));
+    arrayOpen_ = true;
+    value = word_;
+  }
+  if (isNumber(value)) {
+    out_.print(value);
+  } else {
+    out_.write('"');
+    for (const char *p = value; *p; p++) writeEscaped(*p);
+    out_.write('"');
+  }
+}
+
+void JsonReply::endLine() {
+  if (state_ == HEAD) {
+    if (len_ == 0) return;                 // blank line
+    endHead();
+  }
+  if (state_ == TEXT) {
+    out_.print(F("\"}"));
+  } else {
+    if (state_ == LONG_WORD) out_.write('"');
+    else if (len_) endWord();
+    out_.print(arrayOpen_ ? F("]}") : F("}"));
+  }
+  out_.println();
+  state_ = HEAD;
+  len_ = 0;
+  arrayOpen_ = false;
+}
+
+size_t JsonReply::write(uint8_t c) {
+  if (c == '\r') return 1;
+  if (c == '\n') {
+    endLine();
+    return 1;
+  }
+  switch (state_) {
+    case HEAD:
+      if (c == ' ') {
+        if (len_) endHead();
+      } else if (len_ < WORD_MAX - 1) {
+        word_[len_++] = c;
+      }
+      break;
+
+    case TEXT:
+      writeEscaped(c);
+      break;
+
+    case WORDS:
+      if (c == ' ') {
+        if (len_) endWord();
+      } else if (len_ < WORD_MAX - 1) {
+        word_[len_++] = c;
+      } else {
+        // Too long to hold: stream it as a string in "v"
+        out_.print(arrayOpen_ ? F(",\"") : F(",\"v\":[\""));
+        arrayOpen_ = true;
+        for (uint8_t i = 0; i < len_; i++) writeEscaped(word_[i]);
+        writeEscaped(c);
+        len_ = 0;
+        state_ = LONG_WORD;
+      }
+      break;
+
+    case LONG_WORD:
+      if (c == ' ') {
+        out_.write('"');
+        state_ = WORDS;
+      } else {
+        writeEscaped(c);
+      }
+      break;
+  }
+  return 1;
+}
@@ -15,6 +15,16 @@
 #include "encoder.h"
 #include "odometry.h"
 #include "command_parser.h"
+#include "mpu_dmp.h"
+#include "pose_ekf.h"
+#include "sensor_manager.h"
+#include "safety.h"
+#include "motion_queue.h"
+#include "pursuit.h"
+#include "twist.h"
+#include "motor_calibration.h"
+#include "flight_recorder.h"
+#include "memory_monitor.h"
 
 // ---------------- Globals ----------------
 unsigned long lastOdomMillis = 0;
@@ -22,17 +32,28 @@ String rxBuf = "";
 
 // ---------------- Setup ----------------
 void setup() {
+  // Paint free SRAM before anything else runs, for the REQ_MEM high-water marks
+  initializeMemoryMonitor();
+
   DEBUG_SERIAL.begin(115200);
   RADIO_SERIAL.begin(115200);
-  DEBUG_SERIAL.println("Mega Robot Control Start...");
+  DEBUG_SERIAL.println(F("Mega Robot Control Start..."));
 
   // Initialize all modules
   initializeMotors();
+  initializeMotorCalibration();
   initializeEncoders();
+  initializeImu();
+  initializePoseEkf();
+  initializeSafety();
+  initializeSensors();
 
   lastOdomMillis = millis();
   
-  DEBUG_SERIAL.println("Robot controller initialized successfully!");
+  DEBUG_SERIAL.println(F("Robot controller initialized successfully!"));
+
+  // Tell the ESP; it starts driving on this instead of after a fixed wait
+  announceReady();
 }
 
 // ---------------- Loop ----------------
@@ -40,6 +61,37 @@ void loop() {
   // Handle incoming serial commands
   handleSerialCommands(rxBuf);
 
+  // Repeat READY until the ESP has said something
+  processLinkAnnounce();
+
+  // Play back a queued maneuver on the local clock
+  processMotionQueue();
+
+  // Motor characterization sweep, when one was requested
+  processMotorCalibration();
+
+  // Consume IMU samples queued by the FIFO reader
+  processImu();
+
+  // Fuse encoders and gyro, then steer along the waypoints or hold the
+  // twist with the new estimate
+  if (updatePoseEkf()) {
+    processPursuit();
+    processTwist();
+  }
+
+  // Ultrasonic ping; ADC and echo timing run in interrupts
+  processSensors();
+
+  // Report safety trips; the cutoff itself already happened in the ISR
+  processSafety();
+
   // Process periodic odometry
   processOdometry(lastOdomMillis);
+
+  // Heap high-water mark; the stack's is read from the paint on REQ_MEM
+  processMemoryMonitor();
+
+  // Sample the flight recorder last, so each pass it sees is a whole loop()
+  processRecorder();
 }
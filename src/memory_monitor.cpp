@@ -0,0 +1,61 @@
+#include "memory_monitor.h"
+#include "config.h"
+
+#if defined(SIM_NATIVE)
+// The host has no AVR memory map; the simulated firmware reports zeros
+void initializeMemoryMonitor() {}
+void processMemoryMonitor() {}
+void memoryGetStatus(MemoryStatus &out) {
+  memset(&out, 0, sizeof(out));
+}
+
+#else
+extern uint8_t __heap_start;
+extern uint8_t *__brkval;
+
+static const uint8_t PAINT = 0xC5;
+static const uint8_t PAINT_MARGIN = 32;     // left unpainted below the stack pointer at boot
+static const uint8_t UNTOUCHED_RUN = 16;    // paint bytes in a row that count as never used
+
+static inline uint8_t *heapEnd() { return __brkval ? __brkval : &__heap_start; }
+static inline uint8_t *stackPointer() { return (uint8_t *)SP; }
+
+static uint8_t *heapMax;
+
+void initializeMemoryMonitor() {
+  heapMax = heapEnd();
+  uint8_t *p = heapEnd();
+  uint8_t *top = stackPointer() - PAINT_MARGIN;
+  while (p < top) *p++ = PAINT;
+}
+
+void processMemoryMonitor() {
+  uint8_t *end = heapEnd();
+  if (end > heapMax) heapMax = end;
+}
+
+// Walks down from the stack pointer past everything the stack has written
+// to the first long run of paint, then on down through the paint to the
+// highest byte the heap has written. Short runs are skipped because a
+// local array that was only partly filled leaves paint inside a frame.
+void memoryGetStatus(MemoryStatus &out) {
+  uint8_t *sp = stackPointer();
+  uint8_t *heapTop = heapMax;
+  uint8_t *p = sp;
+  uint8_t run = 0;
+  while (p > heapTop && run < UNTOUCHED_RUN) {
+    run = *p == PAINT ? run + 1 : 0;
+    p--;
+  }
+  uint8_t *stackLow = p + run + 1;
+  while (p > heapTop && *p == PAINT) p--;
+  if (p > heapTop) heapTop = p + 1;
+
+  out.staticBytes = &__heap_start - (uint8_t *)RAMSTART;
+  out.heapBytes = heapEnd() - &__heap_start;
+  out.heapMaxBytes = heapTop - &__heap_start;
+  out.stackBytes = (uint8_t *)RAMEND - sp;
+  out.stackMaxBytes = (uint8_t *)RAMEND + 1 - stackLow;
+  out.freeMinBytes = stackLow > heapTop ? stackLow - heapTop : 0;
+}
+#endif
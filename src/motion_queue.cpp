@@ -0,0 +1,93 @@
+#include "motion_queue.h"
+#include "motor_control.h"
+#include "config.h"
+
+// ---------------- Queue ----------------
+static MotionPrimitive queue[MOTION_QUEUE_LEN];
+static uint8_t count = 0;
+
+static bool running = false;
+static unsigned long runStartUs = 0;
+static uint8_t nextIndex = 0;
+static bool activeTimed = false;        // a primitive with a duration is playing
+static unsigned long activeEndMs = 0;   // its scheduled end, from Q_RUN
+static unsigned long maxLateUs = 0;
+
+bool motionQueueAdd(const MotionPrimitive &p) {
+  if (count >= MOTION_QUEUE_LEN) return false;
+  if (count && p.startMs < queue[count - 1].startMs) return false;
+  queue[count++] = p;
+  return true;
+}
+
+void motionQueueRun() {
+  running = count > 0;
+  runStartUs = micros();
+  nextIndex = 0;
+  activeTimed = false;
+  maxLateUs = 0;
+}
+
+void motionQueueCancel() {
+  running = false;
+}
+
+void motionQueueClear() {
+  if (running) stopAll();
+  running = false;
+  count = 0;
+}
+
+void motionQueueGetStatus(MotionQueueStatus &out) {
+  out.running = running;
+  out.count = count;
+  out.next = nextIndex;
+  out.elapsedMs = running ? (micros() - runStartUs) / 1000 : 0;
+  out.maxLateUs = maxLateUs;
+}
+
+// ---------------- Playback ----------------
+static void apply(const MotionPrimitive &p) {
+  switch (p.type) {
+    case MOTION_VEL:
+      setM1(p.a); setM3(p.a); setM2(p.b); setM4(p.b);
+      break;
+    case MOTION_TURN:
+      if (p.a >= 0) turnLeft(p.a);
+      else turnRight(-p.a);
+      break;
+    case MOTION_STOP:
+      stopAll();
+      break;
+  }
+}
+
+// Start and end times are taken from the schedule, not from when the
+// previous step actually ran, so a late pass never shifts later steps.
+// Q DONE <max late us> is sent when the last step has ended, with the
+// motors stopped: a last step without a duration has no next one to wait for.
+void processMotionQueue() {
+  if (!running) return;
+  unsigned long elapsedUs = micros() - runStartUs;
+
+  while (nextIndex < count && queue[nextIndex].startMs * 1000UL <= elapsedUs) {
+    const MotionPrimitive &p = queue[nextIndex++];
+    apply(p);
+    unsigned long late = elapsedUs - p.startMs * 1000UL;
+    if (late > maxLateUs) maxLateUs = late;
+    activeTimed = p.durationMs != 0;
+    activeEndMs = p.startMs + p.durationMs;
+  }
+
+  if (activeTimed && activeEndMs * 1000UL <= elapsedUs) {
+    stopAll();
+    activeTimed = false;
+  }
+
+  if (nextIndex >= count && !activeTimed) {
+    stopAll();
+    running = false;
+    RADIO_SERIAL.print(F("Q DONE "));
+    RADIO_SERIAL.println(maxLateUs);
+  }
+}
@@ -0,0 +1,246 @@
+#include "motor_calibration.h"
+#include "motor_control.h"
+#include "encoder.h"
+#include "config.h"
+#include <EEPROM.h>
+#include <stddef.h>
+
+// ---------------- Table ----------------
+const uint16_t CAL_MAGIC = 0xCA1B;
+
+static MotorCalTable table;
+static bool valid = false;
+static bool inUse = false;
+static uint8_t deadband[4][2];     // PWM where each wheel starts to turn
+static int16_t refMmps[2];         // speed a command of 255 asks for
+
+static uint8_t ladderPwm(uint8_t i) {
+  return (uint16_t)255 * (i + 1) / CAL_POINTS;
+}
+
+static uint16_t checksumOf(const MotorCalTable &t) {
+  const uint8_t *p = (const uint8_t *)&t;
+  uint16_t sum = 0;
+  for (size_t i = 0; i < offsetof(MotorCalTable, checksum); i++) {
+    sum = (uint16_t)((sum << 1) | (sum >> 15)) + p[i];
+  }
+  return sum;
+}
+
+// Makes each curve non-decreasing, finds the deadbands by extending the
+// line through the first two moving steps down to zero speed, and picks
+// the slowest wheel's top speed as the common full scale.
+static bool prepareTable() {
+  for (uint8_t d = 0; d < 2; d++) {
+    int16_t ref = 32767;
+    for (uint8_t w = 0; w < 4; w++) {
+      int16_t *s = table.mmps[w][d];
+      for (uint8_t i = 1; i < CAL_POINTS; i++) {
+        if (s[i] < s[i - 1]) s[i] = s[i - 1];
+      }
+      uint8_t first = 0;
+      while (first < CAL_POINTS && s[first] <= 0) first++;
+      if (first >= CAL_POINTS - 1) return false;     // barely moved at full PWM
+      int32_t p1 = ladderPwm(first), p2 = ladderPwm(first + 1);
+      int32_t v1 = s[first], v2 = s[first + 1];
+      int32_t lo = first ? ladderPwm(first - 1) : 0;
+      int32_t db = v2 > v1 ? p1 - v1 * (p2 - p1) / (v2 - v1) : lo;
+      deadband[w][d] = constrain(db, lo, p1);
+      if (s[CAL_POINTS - 1] < ref) ref = s[CAL_POINTS - 1];
+    }
+    refMmps[d] = ref;
+  }
+  return true;
+}
+
+// Inverse lookup: PWM for a speed, interpolating between ladder steps
+static int pwmFor(uint8_t w, uint8_t d, int32_t mmps) {
+  if (mmps <= 0) return 0;
+  const int16_t *s = table.mmps[w][d];
+  int32_t pwmLo = deadband[w][d], vLo = 0;
+  for (uint8_t i = 0; i < CAL_POINTS; i++) {
+    int32_t pwmHi = ladderPwm(i), vHi = s[i];
+    if (vHi <= vLo || pwmHi <= pwmLo) continue;
+    if (mmps <= vHi) return pwmLo + (pwmHi - pwmLo) * (mmps - vLo) / (vHi - vLo);
+    pwmLo = pwmHi;
+    vLo = vHi;
+  }
+  return 255;
+}
+
+void initializeMotorCalibration() {
+  EEPROM.get(CAL_EEPROM_ADDR, table);
+  valid = table.magic == CAL_MAGIC && table.points == CAL_POINTS &&
+          table.checksum == checksumOf(table) && prepareTable();
+  inUse = valid;
+}
+
+bool motorCalibrationValid() { return valid; }
+bool motorCalibrationInUse() { return inUse && valid; }
+void motorCalibrationUse(bool on) { inUse = on; }
+int motorCalibrationRefMmps(bool reverse) { return motorCalibrationInUse() ? refMmps[reverse] : 0; }
+
+// ---------------- Run-time mapping ----------------
+static bool sweeping = false;
+
+int motorLinearize(uint8_t wheel, int command) {
+  if (!inUse || !valid || sweeping || command == 0) return command;
+  uint8_t d = command < 0;
+  int32_t mag = command < 0 ? -command : command;
+  if (mag > 255) mag = 255;
+  int pwm = pwmFor(wheel, d, mag * refMmps[d] / 255);
+  return d ? -pwm : pwm;
+}
+
+int motorFeedForward(uint8_t wheel, int mmps) {
+  if (!valid || mmps == 0) return 0;
+  uint8_t d = mmps < 0;
+  int pwm = pwmFor(wheel, d, d ? -(int32_t)mmps : mmps);
+  return d ? -pwm : pwm;
+}
+
+// ---------------- Sweep ----------------
+// Each step drives all four wheels at one ladder PWM, waits for the speed
+// to settle, then times encoder edges: the window opens on the first edge
+// and closes on the last one seen once it holds CAL_MIN_TICKS and
+// CAL_WINDOW_MIN_MS, so the tick quantization doesn't land in the result.
+enum CalPhase : uint8_t { CAL_SETTLE, CAL_MEASURE };
+
+static CalPhase phase;
+static uint8_t calDir, calPoint;
+static unsigned long phaseStartMs;
+static long lastCount[4], windowCount[4];
+static unsigned long windowStartUs[4], lastEdgeUs[4];
+static bool windowOpen[4];
+
+static void readCounts(long c[4]) {
+  readEncoderCounts(c[0], c[1], c[2], c[3]);
+}
+
+static void driveStep() {
+  int pwm = ladderPwm(calPoint);
+  if (calDir) pwm = -pwm;
+  driveAll(pwm, pwm, pwm, pwm);
+  phase = CAL_SETTLE;
+  phaseStartMs = millis();
+}
+
+bool motorCalibrationStart() {
+  if (sweeping) return false;
+  sweeping = true;
+  valid = false;
+  table.magic = CAL_MAGIC;
+  table.points = CAL_POINTS;
+  table.reserved = 0;
+  calDir = 0;
+  calPoint = 0;
+  driveStep();
+  return true;
+}
+
+void motorCalibrationAbort() {
+  if (!sweeping) return;
+  sweeping = false;
+  stopAll();
+  initializeMotorCalibration();     // back to whatever EEPROM holds
+}
+
+bool motorCalibrationRunning() { return sweeping; }
+
+static void finishStep() {
+  for (uint8_t w = 0; w < 4; w++) {
+    long ticks = lastCount[w] - windowCount[w];
+    if (ticks < 0) ticks = -ticks;
+    unsigned long span = lastEdgeUs[w] - windowStartUs[w];
+    int32_t mmps = 0;
+    if (windowOpen[w] && ticks >= 2 && span > 0) {
+      mmps = (int32_t)(ticks * (DIST_PER_TICK * 1000.0) * 1e6 / span);
+    }
+    table.mmps[w][calDir][calPoint] = mmps;
+  }
+
+  if (++calPoint < CAL_POINTS) {
+    driveStep();
+    return;
+  }
+  calPoint = 0;
+  if (++calDir < 2) {
+    driveStep();
+    return;
+  }
+
+  sweeping = false;
+  stopAll();
+  if (prepareTable()) {
+    table.checksum = checksumOf(table);
+    EEPROM.put(CAL_EEPROM_ADDR, table);
+    valid = true;
+    RADIO_SERIAL.println(F("CAL DONE"));
+  } else {
+    RADIO_SERIAL.println(F("CAL FAIL"));
+    initializeMotorCalibration();
+  }
+  sendMotorCalibration(RADIO_SERIAL);
+}
+
+void processMotorCalibration() {
+  if (!sweeping) return;
+  unsigned long nowMs = millis();
+
+  if (phase == CAL_SETTLE) {
+    if (nowMs - phaseStartMs < CAL_SETTLE_MS) return;
+    readCounts(lastCount);
+    for (uint8_t w = 0; w < 4; w++) windowOpen[w] = false;
+    phase = CAL_MEASURE;
+    phaseStartMs = nowMs;
+    return;
+  }
+
+  unsigned long nowUs = micros();
+  long counts[4];
+  readCounts(counts);
+  bool ready = true;
+  for (uint8_t w = 0; w < 4; w++) {
+    if (counts[w] != lastCount[w]) {
+      if (!windowOpen[w]) {
+        windowOpen[w] = true;
+        windowCount[w] = counts[w];
+        windowStartUs[w] = nowUs;
+      }
+      lastEdgeUs[w] = nowUs;
+      lastCount[w] = counts[w];
+    }
+    long ticks = windowOpen[w] ? lastCount[w] - windowCount[w] : 0;
+    if (ticks < 0) ticks = -ticks;
+    if (!windowOpen[w] || ticks < CAL_MIN_TICKS ||
+        lastEdgeUs[w] - windowStartUs[w] < CAL_WINDOW_MIN_MS * 1000UL) {
+      ready = false;
+    }
+  }
+  if (ready || nowMs - phaseStartMs >= CAL_WINDOW_MAX_MS) finishStep();
+}
+
+// CAL <valid> <in use> <running> <full scale fwd mm/s> <full scale rev mm/s>
+// CALT <motor 1..4> <F|R> <deadband pwm> <mm/s at each ladder step>
+void sendMotorCalibration(Print &out) {
+  out.print(F("CAL "));
+  out.print(valid ? 1 : 0); out.print(' ');
+  out.print(motorCalibrationInUse() ? 1 : 0); out.print(' ');
+  out.print(sweeping ? 1 : 0); out.print(' ');
+  out.print(valid ? refMmps[0] : 0); out.print(' ');
+  out.println(valid ? refMmps[1] : 0);
+  if (!valid) return;
+  for (uint8_t w = 0; w < 4; w++) {
+    for (uint8_t d = 0; d < 2; d++) {
+      out.print(F("CALT "));
+      out.print(w + 1);
+      out.print(d ? F(" R ") : F(" F "));
+      out.print(deadband[w][d]);
+      for (uint8_t i = 0; i < CAL_POINTS; i++) {
+        out.print(' ');
+        out.print(table.mmps[w][d][i]);
+      }
+      out.println();
+    }
+  }
+}
@@ -1,4 +1,5 @@
 #include "motor_control.h"
+#include "motor_calibration.h"
 #include "config.h"
 
 // ---------------- Helpers ----------------
@@ -8,6 +9,103 @@ int clamp255(long v) {
   return (int)v;
 }
 
+// ---------------- Safety interlock ----------------
+// safety.cpp drives these from the sensor interrupts. Wheels in
+// inhibitMask are held at zero; while forwardBlocked, wheel-forward
+// commands are clamped to zero so the robot can still back away.
+static volatile uint8_t inhibitMask = 0;
+static volatile bool forwardBlocked = false;
+static volatile uint8_t forwardMask = 0;    // wheels last driven wheel-forward
+static volatile int16_t applied[4];          // PWM on the pins, wheel-forward positive; 0 when coasting
+static volatile unsigned long lastOutputUs = 0;   // micros() of the last setMx() pin write
+static bool enabled = false;                      // MOTOR_STBY high
+
+static const uint8_t dirPins[4][2] = {
+  {M1_IN1, M1_IN2}, {M2_IN1, M2_IN2}, {M3_IN1, M3_IN2}, {M4_IN1, M4_IN2}
+};
+
+#if defined(SIM_NATIVE)
+static inline void hwDirPinsInit() {}
+static inline void hwCoast(uint8_t wheel) {
+  digitalWrite(dirPins[wheel][0], LOW);
+  digitalWrite(dirPins[wheel][1], LOW);
+}
+#else
+// Both direction inputs low stops either driver (TB6612 and L298N). The
+// port and bit are looked up once so a cutoff is two read-modify-writes
+// per wheel instead of two digitalWrite() calls.
+static volatile uint8_t *dirPort[4][2];
+static uint8_t dirBit[4][2];
+
+static inline void hwDirPinsInit() {
+  for (uint8_t w = 0; w < 4; w++) {
+    for (uint8_t i = 0; i < 2; i++) {
+      dirPort[w][i] = portOutputRegister(digitalPinToPort(dirPins[w][i]));
+      dirBit[w][i] = digitalPinToBitMask(dirPins[w][i]);
+    }
+  }
+}
+static inline void hwCoast(uint8_t wheel) {
+  *dirPort[wheel][0] &= ~dirBit[wheel][0];
+  *dirPort[wheel][1] &= ~dirBit[wheel][1];
+}
+#endif
+
+static void coastWheels(uint8_t mask) {
+  for (uint8_t w = 0; w < 4; w++) {
+    if (mask & (1 << w)) {
+      hwCoast(w);
+      applied[w] = 0;
+    }
+  }
+}
+
+// Applies the interlock to a wheel-forward speed (before any mount
+// inversion). Callers hold interrupts off until the pins are written, so a
+// trip can't land between the check and the writes and be undone.
+static int interlock(uint8_t wheel, int speed) {
+  uint8_t bit = 1 << wheel;
+  if ((inhibitMask & bit) || (forwardBlocked && speed > 0)) speed = 0;
+  if (speed > 0) forwardMask |= bit;
+  else forwardMask &= ~bit;
+  return speed;
+}
+
+void motorInhibit(uint8_t wheelMask) {
+  inhibitMask |= wheelMask;
+  coastWheels(wheelMask);
+}
+
+void motorRelease(uint8_t wheelMask) {
+  inhibitMask &= ~wheelMask;
+}
+
+uint8_t motorInhibited() {
+  return inhibitMask;
+}
+
+void motorBlockForward(bool on) {
+  forwardBlocked = on;
+  if (on) coastWheels(forwardMask);
+}
+
+bool motorForwardBlocked() {
+  return forwardBlocked;
+}
+
+void motorGetOutputs(int16_t out[4]) {
+  noInterrupts();
+  for (uint8_t w = 0; w < 4; w++) out[w] = applied[w];
+  interrupts();
+}
+
+unsigned long motorLastOutputUs() {
+  noInterrupts();
+  unsigned long us = lastOutputUs;
+  interrupts();
+  return us;
+}
+
 // ---------------- Motor control ----------------
 void setMotorRaw(int pwmPin, int in1, int in2, int speed) {
   if (speed > 0) {
@@ -45,22 +143,42 @@ void setMotorL298N(int enPin, int in1, int in2, int speed) {
 // Individual motors
 void setM1(int speed) { 
   // Front Left - TB6612
-  setMotorRaw(M1_PWM, M1_IN1, M1_IN2, clamp255(speed)); 
+  int pwm = motorLinearize(0, speed);
+  noInterrupts();
+  applied[0] = clamp255(interlock(0, pwm));
+  setMotorRaw(M1_PWM, M1_IN1, M1_IN2, applied[0]);
+  lastOutputUs = micros();
+  interrupts();
 }
 
 void setM2(int speed) { 
   // Front Right - TB6612 - REVERSED
-  setMotorRaw(M2_PWM, M2_IN1, M2_IN2, clamp255(-speed)); 
+  int pwm = motorLinearize(1, speed);
+  noInterrupts();
+  applied[1] = clamp255(interlock(1, pwm));
+  setMotorRaw(M2_PWM, M2_IN1, M2_IN2, -applied[1]);
+  lastOutputUs = micros();
+  interrupts();
 }
 
 void setM3(int speed) { 
   // Rear Left - L298N Motor A (OUT1, OUT2)
-  setMotorL298N(M3_PWM, M3_IN1, M3_IN2, clamp255(speed)); 
+  int pwm = motorLinearize(2, speed);
+  noInterrupts();
+  applied[2] = clamp255(interlock(2, pwm));
+  setMotorL298N(M3_PWM, M3_IN1, M3_IN2, applied[2]);
+  lastOutputUs = micros();
+  interrupts();
 }
 
 void setM4(int speed) { 
   // Rear Right - L298N Motor B (OUT3, OUT4) - INVERTED
-  setMotorL298N(M4_PWM, M4_IN1, M4_IN2, clamp255(-speed)); 
+  int pwm = motorLinearize(3, speed);
+  noInterrupts();
+  applied[3] = clamp255(interlock(3, pwm));
+  setMotorL298N(M4_PWM, M4_IN1, M4_IN2, -applied[3]);
+  lastOutputUs = micros();
+  interrupts();
 }
 
 // Drive all four
@@ -94,13 +212,19 @@ void stopAll() {
 
 void enableMotors() {
   digitalWrite(MOTOR_STBY, HIGH);
+  enabled = true;
 }
 
 void disableMotors() {
   digitalWrite(MOTOR_STBY, LOW);
+  enabled = false;
 }
 
+bool motorsEnabled() { return enabled; }
+
 void initializeMotors() {
+  hwDirPinsInit();
+
   // Front motors (M1, M2) - TB6612 pins
   pinMode(M1_IN1, OUTPUT); 
   pinMode(M1_IN2, OUTPUT); 
@@ -119,7 +243,7 @@ void initializeMotors() {
 
   // TB6612 standby pin (front motors only)
   pinMode(MOTOR_STBY, OUTPUT);
-  digitalWrite(MOTOR_STBY, HIGH);
+  enableMotors();
   
   // L298N doesn't need standby - always enabled when powered
 }
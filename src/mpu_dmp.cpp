@@ -0,0 +1,363 @@
+#include "mpu_dmp.h"
+#include "twi_async.h"
+#include "config.h"
+
+#if defined(SIM_NATIVE)
+#include "sim.h"
+static inline bool intPinHigh() { return digitalRead(MPU_INT_PIN) == HIGH; }
+#else
+#include <avr/interrupt.h>
+// A8 = PK0 = PCINT16
+static inline bool intPinHigh() { return PINK & _BV(PK0); }
+ISR(PCINT2_vect) { mpuIntPinChanged(); }
+#endif
+
+// ---------------- MPU-6050 registers ----------------
+#define REG_SMPLRT_DIV    0x19
+#define REG_CONFIG        0x1A
+#define REG_GYRO_CONFIG   0x1B
+#define REG_ACCEL_CONFIG  0x1C
+#define REG_FIFO_EN       0x23
+#define REG_INT_PIN_CFG   0x37
+#define REG_INT_ENABLE    0x38
+#define REG_INT_STATUS    0x3A
+#define REG_USER_CTRL     0x6A
+#define REG_PWR_MGMT_1    0x6B
+#define REG_FIFO_COUNTH   0x72
+#define REG_FIFO_R_W      0x74
+#define REG_WHO_AM_I      0x75
+
+#define INT_DATA_RDY      0x01
+#define INT_FIFO_OFLOW    0x10
+#define USER_FIFO_EN      0x40
+#define USER_FIFO_RESET   0x04
+
+#define SAMPLE_BYTES      12      // accel XYZ + gyro XYZ, big-endian
+#define MAX_BURST         8       // samples per FIFO read
+#define FIFO_SIZE         1024
+#define RING_SIZE         16      // power of two
+#define BUS_TIMEOUT_US    20000       // per transfer; a 96-byte burst takes ~2.5 ms at 400 kHz
+#define MAX_GAP_US        1000000UL   // longer gaps are not bridged
+
+// +-500 dps full scale: 65.5 LSB per deg/s
+const float GYRO_RAD_PER_LSB = (PI_F / 180.0) / 65.5;
+const long YAW_Q24_PER_LSB_Q8 = (long)(GYRO_RAD_PER_LSB * 4294967296.0 + 0.5);   // Q16
+const uint8_t YAW_SUM_MAX = 128;   // full-scale samples still fit the sum
+const unsigned long SAMPLE_PERIOD_US = 1000000UL / IMU_SAMPLE_HZ;
+
+// ---------------- Sample ring (ISR -> loop) ----------------
+// Single producer (TWI interrupt), single consumer (loop). Each side only
+// writes its own index, and 8-bit index writes are atomic on the AVR. When
+// loop() falls behind, the reader leaves samples in the MPU's 1 KB FIFO
+// instead of dropping them, so the two buffers together cover ~0.5 s.
+static ImuSample ring[RING_SIZE];
+static volatile uint8_t ringHead = 0;
+static volatile uint8_t ringTail = 0;
+
+static volatile ImuStats stats;
+
+static uint8_t ringFree() {
+  return (ringTail - ringHead - 1) & (RING_SIZE - 1);
+}
+
+static void ringPush(const ImuSample &s) {
+  ring[ringHead] = s;
+  ringHead = (ringHead + 1) & (RING_SIZE - 1);
+}
+
+static bool imuPopSample(ImuSample &s) {
+  uint8_t tail = ringTail;
+  if (tail == ringHead) return false;
+  s = ring[tail];
+  ringTail = (tail + 1) & (RING_SIZE - 1);
+  return true;
+}
+
+// ---------------- FIFO read chain (interrupt context) ----------------
+enum MpuReadState : uint8_t {
+  MPU_IDLE,
+  MPU_READ_STATUS,
+  MPU_READ_COUNT,
+  MPU_READ_FIFO,
+  MPU_RESET_FIFO
+};
+
+static volatile uint8_t readState = MPU_IDLE;
+static volatile bool readPending = false;
+static volatile unsigned long transferStartedUs = 0;
+static uint8_t txBuf[2];
+static uint8_t rxBuf[MAX_BURST * SAMPLE_BYTES];
+static uint16_t fifoRemaining;
+static uint8_t burstSamples;
+static bool imuPresent = false;
+
+static void readStep(bool ok);
+
+static void startTransfer(uint8_t state, uint8_t txLen, uint8_t rxLen) {
+  readState = state;
+  transferStartedUs = micros();
+  if (!twiTransfer(MPU_I2C_ADDR, txBuf, txLen, rxBuf, rxLen, readStep)) {
+    stats.busErrors++;
+    readState = MPU_IDLE;
+  }
+}
+
+// Returns false when the ring has no room; the rest stays in the MPU FIFO
+static bool startFifoBurst() {
+  uint16_t available = fifoRemaining / SAMPLE_BYTES;
+  uint8_t room = ringFree();
+  if (room == 0) {
+    stats.ringStalls++;
+    return false;
+  }
+  if (available > room) available = room;
+  burstSamples = available > MAX_BURST ? MAX_BURST : available;
+  fifoRemaining -= burstSamples * SAMPLE_BYTES;
+  txBuf[0] = REG_FIFO_R_W;
+  startTransfer(MPU_READ_FIFO, 1, burstSamples * SAMPLE_BYTES);
+  return true;
+}
+
+static void startRead() {
+  if (readState != MPU_IDLE || twiBusy()) {
+    readPending = true;     // picked up when the current chain ends
+    return;
+  }
+  readPending = false;
+  txBuf[0] = REG_INT_STATUS;   // reading it also releases the latched INT pin
+  startTransfer(MPU_READ_STATUS, 1, 1);
+}
+
+static void resetFifo() {
+  stats.fifoOverflows++;
+  txBuf[0] = REG_USER_CTRL;
+  txBuf[1] = USER_FIFO_EN | USER_FIFO_RESET;
+  startTransfer(MPU_RESET_FIFO, 2, 0);
+}
+
+static inline int16_t be16(const uint8_t *p) {
+  return (int16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static void storeBurst() {
+  // The last sample in the burst is the newest except for what is still queued
+  unsigned long newestUs = micros() - (unsigned long)(fifoRemaining / SAMPLE_BYTES) * SAMPLE_PERIOD_US;
+  for (uint8_t i = 0; i < burstSamples; i++) {
+    const uint8_t *p = rxBuf + i * SAMPLE_BYTES;
+    ImuSample s;
+    s.timeUs = newestUs - (unsigned long)(burstSamples - 1 - i) * SAMPLE_PERIOD_US;
+    for (uint8_t k = 0; k < 3; k++) {
+      s.accel[k] = be16(p + 2 * k);
+      s.gyro[k] = be16(p + 6 + 2 * k);
+    }
+    ringPush(s);
+  }
+  stats.samples += burstSamples;
+  stats.busBytes += burstSamples * SAMPLE_BYTES;
+}
+
+// TWI completion callback: one step of status -> count -> FIFO bursts
+static void readStep(bool ok) {
+  if (!ok) {
+    stats.busErrors++;
+    readState = MPU_IDLE;
+    return;
+  }
+
+  switch (readState) {
+    case MPU_READ_STATUS:
+      if (rxBuf[0] & INT_FIFO_OFLOW) {
+        resetFifo();
+        return;
+      }
+      txBuf[0] = REG_FIFO_COUNTH;
+      startTransfer(MPU_READ_COUNT, 1, 2);
+      return;
+
+    case MPU_READ_COUNT:
+      fifoRemaining = ((uint16_t)rxBuf[0] << 8) | rxBuf[1];
+      // A count that is full or not whole samples means bytes were lost
+      if (fifoRemaining >= FIFO_SIZE || fifoRemaining % SAMPLE_BYTES != 0) {
+        resetFifo();
+        return;
+      }
+      if (fifoRemaining >= SAMPLE_BYTES && startFifoBurst()) return;
+      break;
+
+    case MPU_READ_FIFO:
+      storeBurst();
+      if (fifoRemaining >= SAMPLE_BYTES && startFifoBurst()) return;
+      break;
+
+    default:
+      break;
+  }
+
+  readState = MPU_IDLE;
+  if (readPending) startRead();
+}
+
+void mpuIntPinChanged() {
+  if (imuPresent && intPinHigh()) startRead();
+}
+
+// ---------------- Orientation (loop context) ----------------
+static float quat[4] = {1, 0, 0, 0};
+static float yawRate = 0;
+static long biasSum[3] = {0, 0, 0};
+static int biasCount = 0;
+static float gyroBias[3] = {0, 0, 0};
+static unsigned long lastSampleUs = 0;
+
+// Yaw rate for the fixed-point pose filter: bias-removed z samples in
+// 1/256 LSB, summed until imuTakeYawRate() takes their mean
+static long gyroBiasZQ8 = 0;
+static long yawSumQ8 = 0;
+static uint8_t yawSamples = 0;
+
+static bool writeReg(uint8_t reg, uint8_t value) {
+  uint8_t tx[2] = {reg, value};
+  return twiTransferBlocking(MPU_I2C_ADDR, tx, 2, NULL, 0);
+}
+
+static bool readReg(uint8_t reg, uint8_t &value) {
+  return twiTransferBlocking(MPU_I2C_ADDR, &reg, 1, &value, 1);
+}
+
+bool initializeImu() {
+  twiInit(I2C_CLOCK_HZ);
+
+  uint8_t who = 0;
+  if (!readReg(REG_WHO_AM_I, who) || who != 0x68) {
+    DEBUG_SERIAL.println(F("IMU not found"));
+    return false;
+  }
+
+  writeReg(REG_PWR_MGMT_1, 0x80);               // device reset
+  delay(100);
+  bool ok = writeReg(REG_PWR_MGMT_1, 0x01)      // wake, PLL on gyro X
+    && writeReg(REG_CONFIG, 0x03)               // DLPF 44 Hz, 1 kHz gyro rate
+    && writeReg(REG_SMPLRT_DIV, 1000 / IMU_SAMPLE_HZ - 1)
+    && writeReg(REG_GYRO_CONFIG, 0x08)          // +-500 dps
+    && writeReg(REG_ACCEL_CONFIG, 0x00)         // +-2 g
+    && writeReg(REG_INT_PIN_CFG, 0x20)          // latched, cleared by reading INT_STATUS
+    && writeReg(REG_USER_CTRL, USER_FIFO_RESET)
+    && writeReg(REG_USER_CTRL, USER_FIFO_EN)
+    && writeReg(REG_FIFO_EN, 0x78)              // gyro XYZ + accel
+    && writeReg(REG_INT_ENABLE, INT_DATA_RDY | INT_FIFO_OFLOW);
+  if (!ok) {
+    DEBUG_SERIAL.println(F("IMU setup failed"));
+    return false;
+  }
+
+  pinMode(MPU_INT_PIN, INPUT);
+#if defined(SIM_NATIVE)
+  simOnPinChange(MPU_INT_PIN, mpuIntPinChanged);
+#else
+  PCMSK2 |= _BV(PCINT16);
+  PCICR |= _BV(PCIE2);
+#endif
+  imuPresent = true;
+  DEBUG_SERIAL.println(F("IMU ready, calibrating gyro bias"));
+  return true;
+}
+
+static void integrate(const ImuSample &s) {
+  if (biasCount < IMU_BIAS_SAMPLES) {
+    for (uint8_t k = 0; k < 3; k++) biasSum[k] += s.gyro[k];
+    lastSampleUs = s.timeUs;
+    if (++biasCount == IMU_BIAS_SAMPLES) {
+      for (uint8_t k = 0; k < 3; k++) gyroBias[k] = (float)biasSum[k] / IMU_BIAS_SAMPLES;
+      gyroBiasZQ8 = (biasSum[2] << 8) / IMU_BIAS_SAMPLES;
+    }
+    return;
+  }
+
+  float gx = (s.gyro[0] - gyroBias[0]) * GYRO_RAD_PER_LSB;
+  float gy = (s.gyro[1] - gyroBias[1]) * GYRO_RAD_PER_LSB;
+  float gz = (s.gyro[2] - gyroBias[2]) * GYRO_RAD_PER_LSB;
+  yawRate = gz;
+  if (yawSamples < YAW_SUM_MAX) {
+    yawSumQ8 += ((long)s.gyro[2] << 8) - gyroBiasZQ8;
+    yawSamples++;
+  }
+
+  // Samples are evenly spaced by the MPU's clock. A larger gap in the read
+  // timestamps means a FIFO reset or missed interrupts; bridge it with the
+  // current rate rather than losing the rotation.
+  unsigned long spacingUs = s.timeUs - lastSampleUs;
+  lastSampleUs = s.timeUs;
+  if (spacingUs < 2 * SAMPLE_PERIOD_US || spacingUs > MAX_GAP_US) spacingUs = SAMPLE_PERIOD_US;
+
+  // q += 0.5 * q * (0, g) * dt, then renormalize
+  const float h = 0.5e-6f * spacingUs;
+  float w = quat[0], x = quat[1], y = quat[2], z = quat[3];
+  quat[0] += (-x * gx - y * gy - z * gz) * h;
+  quat[1] += ( w * gx + y * gz - z * gy) * h;
+  quat[2] += ( w * gy - x * gz + z * gx) * h;
+  quat[3] += ( w * gz + x * gy - y * gx) * h;
+  float inv = 1.0f / sqrt(quat[0] * quat[0] + quat[1] * quat[1] +
+                          quat[2] * quat[2] + quat[3] * quat[3]);
+  for (uint8_t k = 0; k < 4; k++) quat[k] *= inv;
+}
+
+void processImu() {
+  if (!imuPresent) return;
+
+  ImuSample s;
+  while (imuPopSample(s)) integrate(s);
+
+  // Recover from a stuck bus or a data-ready edge that slipped by
+  noInterrupts();
+  if (readState != MPU_IDLE && micros() - transferStartedUs > BUS_TIMEOUT_US) {
+    twiReset();
+    stats.busErrors++;
+    readState = MPU_IDLE;
+  }
+  if (readState == MPU_IDLE && intPinHigh()) startRead();
+  interrupts();
+}
+
+#if defined(BENCH)
+void imuBenchSample(const ImuSample &s) {
+  imuPresent = true;
+  biasCount = IMU_BIAS_SAMPLES;
+  integrate(s);
+}
+#endif
+
+bool imuReady() {
+  return imuPresent && biasCount >= IMU_BIAS_SAMPLES;
+}
+
+float imuYawRate() {
+  return yawRate;
+}
+
+bool imuTakeYawRate(int32_t &rateQ24) {
+  if (!yawSamples) return false;
+  long meanQ8 = yawSumQ8 / yawSamples;
+  rateQ24 = (int32_t)(((int64_t)meanQ8 * YAW_Q24_PER_LSB_Q8) >> 16);
+  yawSumQ8 = 0;
+  yawSamples = 0;
+  return true;
+}
+
+float imuHeading() {
+  return atan2(2.0f * (quat[0] * quat[3] + quat[1] * quat[2]),
+               1.0f - 2.0f * (quat[2] * quat[2] + quat[3] * quat[3]));
+}
+
+void imuGetQuaternion(float q[4]) {
+  for (uint8_t k = 0; k < 4; k++) q[k] = quat[k];
+}
+
+void imuGetStats(ImuStats &out) {
+  noInterrupts();
+  out.samples = stats.samples;
+  out.fifoOverflows = stats.fifoOverflows;
+  out.ringStalls = stats.ringStalls;
+  out.busErrors = stats.busErrors;
+  out.busBytes = stats.busBytes;
+  interrupts();
+}
@@ -1,12 +1,18 @@
 #include "odometry.h"
 #include "encoder.h"
+#include "pose_ekf.h"
+#include "sensor_manager.h"
 #include "config.h"
 
 // ---------------- Odometry ----------------
+// The fused pose from pose_ekf.cpp is appended after the original fields,
+// so readers that only parse the first ten keep working:
+// ODOM now dt d1 d2 d3 d4 distL distR vL vR x y theta v w slipMask
 void sendOdomPacket(unsigned long now, unsigned long dt,
                     long d1, long d2, long d3, long d4,
-                    float distL, float distR, float vL, float vR) {
-  RADIO_SERIAL.print("ODOM ");
+                    float distL, float distR, float vL, float vR,
+                    const PoseEstimate &pose) {
+  RADIO_SERIAL.print(F("ODOM "));
   RADIO_SERIAL.print(now); RADIO_SERIAL.print(' ');
   RADIO_SERIAL.print(dt); RADIO_SERIAL.print(' ');
   RADIO_SERIAL.print(d1); RADIO_SERIAL.print(' ');
@@ -16,7 +22,13 @@ void sendOdomPacket(unsigned long now, unsigned long dt,
   RADIO_SERIAL.print(distL, 6); RADIO_SERIAL.print(' ');
   RADIO_SERIAL.print(distR, 6); RADIO_SERIAL.print(' ');
   RADIO_SERIAL.print(vL, 6); RADIO_SERIAL.print(' ');
-  RADIO_SERIAL.println(vR, 6);
+  RADIO_SERIAL.print(vR, 6); RADIO_SERIAL.print(' ');
+  RADIO_SERIAL.print(pose.x, 4); RADIO_SERIAL.print(' ');
+  RADIO_SERIAL.print(pose.y, 4); RADIO_SERIAL.print(' ');
+  RADIO_SERIAL.print(pose.theta, 4); RADIO_SERIAL.print(' ');
+  RADIO_SERIAL.print(pose.v, 4); RADIO_SERIAL.print(' ');
+  RADIO_SERIAL.print(pose.w, 4); RADIO_SERIAL.print(' ');
+  RADIO_SERIAL.println(pose.slipMask);
 }
 
 void processOdometry(unsigned long &lastOdomMillis) {
@@ -24,8 +36,11 @@ void processOdometry(unsigned long &lastOdomMillis) {
   if (now - lastOdomMillis >= ODOM_MS) {
     unsigned long dt = now - lastOdomMillis;
     
-    long c1, c2, c3, c4;
-    resetEncoderCounts(c1, c2, c3, c4);
+    static long last1 = 0, last2 = 0, last3 = 0, last4 = 0;
+    long t1, t2, t3, t4;
+    readEncoderCounts(t1, t2, t3, t4);
+    long c1 = t1 - last1, c2 = t2 - last2, c3 = t3 - last3, c4 = t4 - last4;
+    last1 = t1; last2 = t2; last3 = t3; last4 = t4;
 
     float distL = (c1 + c3) * DIST_PER_TICK * 0.5;
     float distR = (c2 + c4) * DIST_PER_TICK * 0.5;
@@ -34,7 +49,10 @@ void processOdometry(unsigned long &lastOdomMillis) {
     float vL = distL / dt_s;
     float vR = distR / dt_s;
 
-    sendOdomPacket(now, dt, c1, c2, c3, c4, distL, distR, vL, vR);
+    PoseEstimate pose;
+    getPoseEstimate(pose);
+    sendOdomPacket(now, dt, c1, c2, c3, c4, distL, distR, vL, vR, pose);
+    sendSensorPacket(RADIO_SERIAL);
 
     lastOdomMillis = now;
   }
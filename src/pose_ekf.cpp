@@ -0,0 +1,262 @@
+#include "pose_ekf.h"
+#include "encoder.h"
+#include "mpu_dmp.h"
+#include "fixed_math.h"
+#include "config.h"
+
+// ---------------- Filter state ----------------
+// State and measurements are Q24 (+-128), covariance Q28 (+-8) and position
+// Q16 meters. There is one 64-bit divide per measurement and one per step,
+// and no float math in a step: the gyro comes in as the mean of its raw
+// samples (imuTakeYawRate()). Roughly 170 multiplies per step.
+enum { S_THETA, S_V, S_W, S_BIAS, S_COUNT };
+
+static fix state[S_COUNT];
+static fix P[S_COUNT][S_COUNT];
+static int32_t posX = 0, posY = 0;      // Q16 m
+static fix slipDist[4];                 // Q24 m, leaky sum of disagreement
+static uint8_t slipMask = 0;
+
+static fix rWheel, rGyro, rStill;
+static fix qSpeed, qRate, qBias;
+static fix halfTrack;
+
+static long lastCounts[4];
+static unsigned long lastStepUs = 0;
+static uint8_t stillSteps = 0;
+static uint8_t biasSteps = 0;
+
+static EkfStats stats;
+
+const fix S_MIN = Q28(1e-4);
+const fix THETA_VAR_MAX = Q28(4.0);
+const unsigned long STILL_MS = 300;
+const fix STILL_RATE = Q24(0.1);          // rad/s, well above the residual bias
+const unsigned long MAX_PREDICT_US = 10 * EKF_MS * 1000;
+
+void initializePoseEkf() {
+  memset(state, 0, sizeof(state));
+  memset(P, 0, sizeof(P));
+  P[S_V][S_V] = Q28(0.01);
+  P[S_W][S_W] = Q28(0.01);
+  P[S_BIAS][S_BIAS] = Q28(0.0025);      // +-3 deg/s left after boot calibration
+
+  float dt = EKF_MS / 1000.0;
+  float tickSpeed = DIST_PER_TICK / dt;
+  // Encoder quantization plus skid-steer scrub on each wheel
+  rWheel = Q28(tickSpeed * tickSpeed / 12.0 + 0.05 * 0.05);
+  rGyro = Q28(0.01 * 0.01);
+  rStill = Q28(0.002 * 0.002);
+  qSpeed = Q28((2.0 * dt) * (2.0 * dt));     // 2 m/s^2
+  qRate = Q28((6.0 * dt) * (6.0 * dt));      // 6 rad/s^2
+  qBias = Q28(2e-4 * 2e-4);                  // per second; added once a second
+  halfTrack = Q24(TRACK_WIDTH / 2);
+
+  readEncoderCounts(lastCounts[0], lastCounts[1], lastCounts[2], lastCounts[3]);
+  fix stale;
+  imuTakeYawRate(stale);
+  lastStepUs = micros();
+}
+
+// ---------------- Predict ----------------
+static void predict(fix dt, uint8_t steps) {
+  fix halfTurn = mulq(state[S_W], dt, 25);
+  fix dist = mulq(state[S_V], dt, 24);
+
+  // Position along the mid-step heading
+  uint16_t bam = angleToBam(wrapAngle(state[S_THETA] + halfTurn));
+  posX += (mulq(dist, cosBam(bam), 15) + 128) >> 8;
+  posY += (mulq(dist, sinBam(bam), 15) + 128) >> 8;
+  state[S_THETA] = wrapAngle(state[S_THETA] + 2 * halfTurn);
+
+  // P = F P F' + Q with F = I + dt at (theta, w)
+  fix pThetaW = P[S_THETA][S_W];
+  P[S_THETA][S_THETA] += 2 * mulq(dt, pThetaW, 24) + mulq(dt, mulq(dt, P[S_W][S_W], 24), 24);
+  for (uint8_t j = S_V; j < S_COUNT; j++) {
+    P[S_THETA][j] += mulq(dt, P[S_W][j], 24);
+    P[j][S_THETA] = P[S_THETA][j];
+  }
+  if (P[S_THETA][S_THETA] > THETA_VAR_MAX) P[S_THETA][S_THETA] = THETA_VAR_MAX;
+
+  P[S_V][S_V] += qSpeed * steps;
+  P[S_W][S_W] += qRate * steps;
+  biasSteps += steps;
+  if (biasSteps >= 1000 / EKF_MS) {
+    biasSteps = 0;
+    P[S_BIAS][S_BIAS] += qBias;
+  }
+}
+
+// ---------------- Update ----------------
+// Scalar measurement z = h . state with sparse h (Q24)
+static fix predicted(const fix h[S_COUNT]) {
+  fix z = 0;
+  for (uint8_t i = 0; i < S_COUNT; i++) {
+    if (h[i]) z += mulq(h[i], state[i], 24);
+  }
+  return z;
+}
+
+static void update(const fix h[S_COUNT], fix innovation, fix r) {
+  fix ph[S_COUNT];
+  fix s = r;
+  for (uint8_t i = 0; i < S_COUNT; i++) {
+    fix acc = 0;
+    for (uint8_t j = 0; j < S_COUNT; j++) {
+      if (h[j]) acc += mulq(P[i][j], h[j], 24);
+    }
+    ph[i] = acc;
+  }
+  for (uint8_t i = 0; i < S_COUNT; i++) {
+    if (h[i]) s += mulq(h[i], ph[i], 24);
+  }
+  if (s < S_MIN) s = S_MIN;
+  int32_t invS = (int32_t)(((int64_t)1 << 44) / s);   // Q16
+
+  fix k[S_COUNT];
+  for (uint8_t i = 0; i < S_COUNT; i++) {
+    k[i] = (fix)(((int64_t)ph[i] * invS) >> 20);
+    state[i] += mulq(k[i], innovation, 24);
+  }
+  state[S_THETA] = wrapAngle(state[S_THETA]);
+
+  for (uint8_t i = 0; i < S_COUNT; i++) {
+    for (uint8_t j = i; j < S_COUNT; j++) {
+      P[i][j] -= mulq(k[i], ph[j], 24);
+      P[j][i] = P[i][j];
+    }
+  }
+}
+
+// ---------------- Step ----------------
+static void wheelMeasurements(const long delta[4], fix tickScale, fix dt) {
+  // Wheels 0/2 are on the left, 1/3 on the right
+  fix h[4][S_COUNT];
+  fix innovation[4];
+  for (uint8_t i = 0; i < 4; i++) {
+    h[i][S_THETA] = 0;
+    h[i][S_V] = Q24(1.0);
+    h[i][S_W] = (i & 1) ? halfTrack : -halfTrack;
+    h[i][S_BIAS] = 0;
+    innovation[i] = (fix)delta[i] * tickScale - predicted(h[i]);
+  }
+
+  // A wheel disagreeing with the others: compare against the median
+  fix lo = innovation[0], hi = innovation[0], sum = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    if (innovation[i] < lo) lo = innovation[i];
+    if (innovation[i] > hi) hi = innovation[i];
+    sum += innovation[i] >> 2;
+  }
+  fix median = (sum - (lo >> 2) - (hi >> 2)) * 2;
+
+  for (uint8_t i = 0; i < 4; i++) {
+    slipDist[i] += mulq(innovation[i] - median, dt, 24) - (slipDist[i] >> 3);
+    fix dist = slipDist[i] < 0 ? -slipDist[i] : slipDist[i];
+    uint8_t bit = 1 << i;
+    if (!(slipMask & bit) && dist > Q24(EKF_SLIP_M)) {
+      slipMask |= bit;
+      stats.slipEvents++;
+    } else if ((slipMask & bit) && dist < Q24(EKF_SLIP_M / 2)) {
+      slipMask &= ~bit;
+    }
+  }
+
+  // Never drop more than two wheels: then nobody agrees and slip is moot
+  uint8_t used = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    if (!(slipMask & (1 << i))) used++;
+  }
+  for (uint8_t i = 0; i < 4; i++) {
+    if (used >= 2 && (slipMask & (1 << i))) continue;
+    update(h[i], (fix)delta[i] * tickScale - predicted(h[i]), rWheel);
+  }
+}
+
+static fix usToQ24(unsigned long us) {
+  return (fix)(((int64_t)us * 1099512) >> 16);   // us -> s
+}
+
+static void step(unsigned long elapsedUs) {
+  // A loop() stall is predicted across in pieces of at most MAX_PREDICT_US;
+  // the measurements below cover all of it
+  unsigned long left = elapsedUs;
+  while (left) {
+    unsigned long us = left > MAX_PREDICT_US ? MAX_PREDICT_US : left;
+    uint8_t steps = (us + EKF_MS * 500) / (EKF_MS * 1000);
+    predict(usToQ24(us), steps < 1 ? 1 : steps);
+    left -= us;
+  }
+  fix dt = usToQ24(elapsedUs);
+
+  long counts[4], delta[4];
+  readEncoderCounts(counts[0], counts[1], counts[2], counts[3]);
+  bool still = true;
+  for (uint8_t i = 0; i < 4; i++) {
+    delta[i] = counts[i] - lastCounts[i];
+    lastCounts[i] = counts[i];
+    if (delta[i] != 0) still = false;
+  }
+
+  // Gyro first: it pins the yaw rate the wheel checks are made against
+  bool gyroQuiet = true;
+  fix z;
+  if (imuReady() && imuTakeYawRate(z)) {
+    static const fix hGyro[S_COUNT] = {0, 0, Q24(1.0), Q24(1.0)};
+    fix rate = z - state[S_BIAS];
+    gyroQuiet = rate < STILL_RATE && rate > -STILL_RATE;
+    update(hGyro, z - predicted(hGyro), rGyro);
+  }
+
+  // No encoder edge for a while and hardly any rotation on the gyro: the
+  // body is standing still, which makes the gyro bias observable. Encoders
+  // are coarse, so a step or two without a tick says nothing on its own.
+  stillSteps = still ? (stillSteps < 255 ? stillSteps + 1 : 255) : 0;
+  if (stillSteps >= STILL_MS / EKF_MS && gyroQuiet) {
+    static const fix hRate[S_COUNT] = {0, 0, Q24(1.0), 0};
+    update(hRate, -state[S_W], rStill);
+  }
+
+  // Ticks -> m/s for this step: one divide instead of four
+  fix tickScale = (fix)(((int64_t)Q24(DIST_PER_TICK) * 1000000) / elapsedUs);
+  wheelMeasurements(delta, tickScale, dt);
+}
+
+bool updatePoseEkf() {
+  unsigned long now = micros();
+  unsigned long elapsed = now - lastStepUs;
+  if (elapsed < EKF_MS * 1000) return false;
+  lastStepUs = now;
+
+  step(elapsed);
+
+  unsigned long took = micros() - now;
+  stats.steps++;
+  if (took > stats.maxStepUs) stats.maxStepUs = took;
+  if (took > EKF_BUDGET_US) stats.overruns++;
+  return true;
+}
+
+void getPoseEstimate(PoseEstimate &out) {
+  out.x = posX / 65536.0;
+  out.y = posY / 65536.0;
+  out.theta = state[S_THETA] / 16777216.0;
+  out.v = state[S_V] / 16777216.0;
+  out.w = state[S_W] / 16777216.0;
+  out.slipMask = slipMask;
+}
+
+void getPoseFixed(int32_t &xQ16, int32_t &yQ16, int32_t &thetaQ24) {
+  xQ16 = posX;
+  yQ16 = posY;
+  thetaQ24 = state[S_THETA];
+}
+
+void getVelocityFixed(int32_t &vQ24, int32_t &wQ24) {
+  vQ24 = state[S_V];
+  wQ24 = state[S_W];
+}
+
+void getEkfStats(EkfStats &out) {
+  out = stats;
+}
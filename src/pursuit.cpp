@@ -0,0 +1,160 @@
+#include "pursuit.h"
+#include "pose_ekf.h"
+#include "motor_control.h"
+#include "fixed_math.h"
+#include "config.h"
+
+// ---------------- Waypoints ----------------
+static int16_t wpX[PURSUIT_MAX_WAYPOINTS], wpY[PURSUIT_MAX_WAYPOINTS];
+static uint8_t count = 0;
+
+static bool running = false;
+static uint8_t target = 0;
+static int cruise = 0;
+static int32_t lastDistMm = 0, lastCrossMm = 0;
+
+// Current segment, from where the robot started (or the previous waypoint)
+// to the target: origin and length in mm, unit direction in Q14.
+static int32_t segX, segY, segLen;
+static int32_t segUx, segUy;
+
+const int32_t TRACK_MM = (int32_t)(TRACK_WIDTH * 1000);
+const int32_t TURN_LIMIT = Q16(2.0);    // one wheel at most reversing at full speed
+
+// Length of (dx, dy) in mm; coarser beyond 30 m so the squares fit
+static int32_t length(int32_t dx, int32_t dy) {
+  uint8_t shift = 0;
+  while (abs(dx) > 30000 || abs(dy) > 30000) {
+    dx >>= 1;
+    dy >>= 1;
+    shift++;
+  }
+  return (int32_t)isqrt32((uint32_t)(dx * dx) + (uint32_t)(dy * dy)) << shift;
+}
+
+static void startSegment(int32_t x, int32_t y) {
+  int32_t dx = wpX[target] - x, dy = wpY[target] - y;
+  segX = x;
+  segY = y;
+  segLen = length(dx, dy);
+  segUx = segLen ? (dx << 14) / segLen : 0;
+  segUy = segLen ? (dy << 14) / segLen : 0;
+}
+
+bool pursuitAdd(int16_t xMm, int16_t yMm) {
+  if (count >= PURSUIT_MAX_WAYPOINTS) return false;
+  wpX[count] = xMm;
+  wpY[count] = yMm;
+  count++;
+  return true;
+}
+
+bool pursuitRun(int speed) {
+  if (!count) return false;
+  int32_t x, y, theta;
+  getPoseFixed(x, y, theta);
+  target = 0;
+  cruise = constrain(speed, PURSUIT_MIN_PWM, 255);
+  startSegment((x * 125) >> 13, (y * 125) >> 13);    // Q16 m -> mm
+  running = true;
+  return true;
+}
+
+void pursuitCancel() {
+  running = false;
+}
+
+void pursuitClear() {
+  if (running) stopAll();
+  running = false;
+  count = 0;
+}
+
+void pursuitGetStatus(PursuitStatus &out) {
+  out.running = running;
+  out.count = count;
+  out.target = target;
+  out.distMm = lastDistMm;
+  out.crossTrackMm = lastCrossMm;
+}
+
+// ---------------- Steering ----------------
+static void drive(int32_t left, int32_t right) {
+  int32_t big = abs(left) > abs(right) ? abs(left) : abs(right);
+  if (big > 255) {
+    left = left * 255 / big;
+    right = right * 255 / big;
+  }
+  setM1(left); setM3(left); setM2(right); setM4(right);
+}
+
+// Pure pursuit: the goal is the point one lookahead further along the
+// segment than the robot's projection onto it. The arc through the goal
+// has curvature 2*ly/L^2 in the robot frame, so the wheel speed split is
+// v*(1 -+ ly*W/L^2). Each step costs a 64-bit divide for the curvature and
+// an integer square root for the distance left. Slowing for the last
+// waypoint adds a 32-bit divide, a saturated side two more in drive(), and
+// a new segment two for its unit vector. The rest is shifts and 32x32
+// multiplies.
+//
+// WP REACHED <index>  passed a waypoint (within the lookahead of it)
+// WP DONE <mm>        stopped at the last one, <mm> away from it
+void processPursuit() {
+  if (!running) return;
+  int32_t xQ, yQ, theta;
+  getPoseFixed(xQ, yQ, theta);
+  int32_t px = (xQ * 125) >> 13, py = (yQ * 125) >> 13;
+
+  int32_t along, relX, relY;
+  bool last;
+  for (;;) {
+    relX = px - segX;
+    relY = py - segY;
+    along = (int32_t)(((int64_t)relX * segUx + (int64_t)relY * segUy) >> 14);
+    last = target == count - 1;
+    if (last || segLen - along >= PURSUIT_LOOKAHEAD_MM) break;
+    RADIO_SERIAL.print(F("WP REACHED "));
+    RADIO_SERIAL.println(target);
+    target++;
+    startSegment(wpX[target - 1], wpY[target - 1]);
+  }
+
+  int32_t dx = wpX[target] - px, dy = wpY[target] - py;
+  lastDistMm = length(dx, dy);
+  lastCrossMm = (int32_t)(((int64_t)relY * segUx - (int64_t)relX * segUy) >> 14);
+  if (last && (lastDistMm < PURSUIT_ARRIVE_MM || along >= segLen)) {
+    stopAll();
+    running = false;
+    RADIO_SERIAL.print(F("WP DONE "));
+    RADIO_SERIAL.println(lastDistMm);
+    return;
+  }
+
+  int32_t goalAlong = along + PURSUIT_LOOKAHEAD_MM;
+  if (goalAlong > segLen) goalAlong = segLen;
+  int32_t gx = segX + ((segUx * goalAlong) >> 14) - px;
+  int32_t gy = segY + ((segUy * goalAlong) >> 14) - py;
+
+  uint16_t bam = angleToBam(theta);
+  int32_t c = cosBam(bam), s = sinBam(bam);
+  int32_t lx = (int32_t)(((int64_t)gx * c + (int64_t)gy * s) >> 15);   // goal in the robot frame, mm
+  int32_t ly = (int32_t)(((int64_t)gy * c - (int64_t)gx * s) >> 15);
+
+  if (lx <= 0) {
+    // Goal behind: turn on the spot towards it
+    int32_t turn = ly >= 0 ? PURSUIT_TURN_PWM : -PURSUIT_TURN_PWM;
+    drive(-turn, turn);
+    return;
+  }
+
+  int32_t v = cruise;
+  int32_t remaining = segLen - along;
+  if (last && remaining < PURSUIT_SLOW_MM) {
+    v = PURSUIT_MIN_PWM + (cruise - PURSUIT_MIN_PWM) * remaining / PURSUIT_SLOW_MM;
+  }
+  int64_t l2 = (int64_t)lx * lx + (int64_t)ly * ly;
+  int32_t turn = (int32_t)((((int64_t)ly * TRACK_MM) << 16) / l2);   // Q16
+  turn = constrain(turn, -TURN_LIMIT, TURN_LIMIT);
+  int32_t split = (v * turn) >> 16;
+  drive(v - split, v + split);
+}
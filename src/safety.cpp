@@ -0,0 +1,150 @@
+#include "safety.h"
+#include "motor_control.h"
+#include "config.h"
+
+// ---------------- Limits ----------------
+// Kept in the units the interrupts compare against: millimetres for range,
+// ADC counts away from the ACS712 zero for current.
+static const uint16_t ADC_ZERO_AMPS = 512;    // 2.5 V
+
+static volatile uint16_t rangeLimitMm = SAFETY_RANGE_MM;
+static volatile uint16_t currentLimitCounts = 0;
+static volatile unsigned long currentTripUs = 0;
+static uint16_t currentLimitMa = 0;
+
+// ---------------- Trip state ----------------
+enum {
+  EVENT_OBSTACLE = 0x10,
+  EVENT_OBSTACLE_CLEAR = 0x20
+};
+
+static volatile uint8_t pendingEvents = 0;   // bits 0..3: current trip on that wheel
+static volatile uint16_t obstacleMm = 0;    // 0: tripped on missing echoes
+static volatile uint8_t noEchoRun = 0;       // readings in a row without an echo
+static volatile uint16_t tripRaw[4];
+static volatile uint8_t overMask = 0;        // wheels over the current limit right now
+static volatile unsigned long overSinceUs[4];
+static volatile unsigned long obstacleTrips = 0;
+static volatile unsigned long currentTrips = 0;
+
+static uint16_t countsForMa(uint16_t mA) {
+  return (uint16_t)(mA / 1000.0 * CURRENT_SENSE_V_PER_A * 1023 / 5.0 + 0.5);
+}
+
+static long maForCounts(uint16_t raw) {
+  return (long)(((int)raw - (int)ADC_ZERO_AMPS) * (5.0 / 1023.0) / CURRENT_SENSE_V_PER_A * 1000);
+}
+
+// ---------------- Interrupt-side checks ----------------
+// Both run inside the sensor ISRs and only compare and write port bits,
+// so a trip costs a few microseconds on top of the interrupt itself.
+// A ping without an echo fails closed: it never releases the block, and
+// SAFETY_RANGE_NO_ECHO of them in a row raise it. RANGE_CLEAR is an echo
+// from beyond the sensor's reach and releases like any far reading.
+void safetyCheckRange(uint16_t mm) {
+  uint16_t limit = rangeLimitMm;
+  if (mm) noEchoRun = 0;
+  else if (noEchoRun < SAFETY_RANGE_NO_ECHO) noEchoRun++;
+  bool tooClose = mm ? mm < limit : noEchoRun >= SAFETY_RANGE_NO_ECHO;
+  if (limit && tooClose) {
+    if (motorForwardBlocked()) return;
+    motorBlockForward(true);
+    obstacleMm = mm;
+    obstacleTrips++;
+    pendingEvents |= EVENT_OBSTACLE;
+  } else if (motorForwardBlocked() && (!limit || (mm && mm >= limit + SAFETY_RANGE_HYST_MM))) {
+    motorBlockForward(false);
+    pendingEvents |= EVENT_OBSTACLE_CLEAR;
+  }
+}
+
+void safetyCheckCurrent(uint8_t wheel, uint16_t raw) {
+  uint16_t limit = currentLimitCounts;
+  if (!limit) return;
+  uint8_t bit = 1 << wheel;
+  uint16_t excess = raw > ADC_ZERO_AMPS ? raw - ADC_ZERO_AMPS : ADC_ZERO_AMPS - raw;
+  if (excess <= limit) {
+    overMask &= ~bit;
+    return;
+  }
+  unsigned long now = micros();
+  if (!(overMask & bit)) {
+    overMask |= bit;
+    overSinceUs[wheel] = now;
+  }
+  if (now - overSinceUs[wheel] < currentTripUs || (motorInhibited() & bit)) return;
+  motorInhibit(bit);
+  tripRaw[wheel] = raw;
+  currentTrips++;
+  pendingEvents |= bit;
+}
+
+// ---------------- Configuration ----------------
+void initializeSafety() {
+  safetySetRangeLimit(SAFETY_RANGE_MM);
+  safetySetCurrentLimit(SAFETY_CURRENT_MA, SAFETY_CURRENT_MS);
+}
+
+void safetySetRangeLimit(uint16_t mm) {
+  rangeLimitMm = mm;     // a blocked robot is released by the next echo
+}
+
+void safetySetCurrentLimit(uint16_t mA, uint16_t tripMs) {
+  noInterrupts();
+  currentLimitMa = mA;
+  currentLimitCounts = countsForMa(mA);
+  currentTripUs = tripMs * 1000UL;
+  overMask = 0;
+  interrupts();
+}
+
+void safetyClear() {
+  noInterrupts();
+  overMask = 0;
+  motorRelease(0x0F);
+  interrupts();
+}
+
+void safetyGetStatus(SafetyStatus &out) {
+  noInterrupts();
+  out.rangeLimitMm = rangeLimitMm;
+  out.currentLimitMa = currentLimitMa;
+  out.currentTripMs = currentTripUs / 1000;
+  out.forwardBlocked = motorForwardBlocked();
+  out.inhibitMask = motorInhibited();
+  out.obstacleTrips = obstacleTrips;
+  out.currentTrips = currentTrips;
+  interrupts();
+}
+
+// ---------------- Reporting ----------------
+// TRIP OBSTACLE <range mm>    0: SAFETY_RANGE_NO_ECHO pings without an echo
+// TRIP OBSTACLE_CLEAR
+// TRIP CURRENT <motor 1..4> <mA>
+void processSafety() {
+  if (!pendingEvents) return;
+  noInterrupts();
+  uint8_t events = pendingEvents;
+  pendingEvents = 0;
+  uint16_t mm = obstacleMm;
+  uint16_t raw[4];
+  for (uint8_t w = 0; w < 4; w++) raw[w] = tripRaw[w];
+  interrupts();
+
+  // A clear and a new trip can both be pending; report them in the order
+  // that ends in the current state
+  bool blocked = motorForwardBlocked();
+  if ((events & EVENT_OBSTACLE_CLEAR) && blocked) RADIO_SERIAL.println(F("TRIP OBSTACLE_CLEAR"));
+  if (events & EVENT_OBSTACLE) {
+    RADIO_SERIAL.print(F("TRIP OBSTACLE "));
+    RADIO_SERIAL.println(mm);
+  }
+  if ((events & EVENT_OBSTACLE_CLEAR) && !blocked) RADIO_SERIAL.println(F("TRIP OBSTACLE_CLEAR"));
+  for (uint8_t w = 0; w < 4; w++) {
+    if (!(events & (1 << w))) continue;
+    RADIO_SERIAL.print(F("TRIP CURRENT "));
+    RADIO_SERIAL.print(w + 1);
+    RADIO_SERIAL.print(' ');
+    RADIO_SERIAL.println(maForCounts(raw[w]));
+  }
+}
@@ -0,0 +1,219 @@
+#include "sensor_manager.h"
+#include "safety.h"
+#include "config.h"
+
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+static void adcInterrupt();
+static void captureInterrupt();
+
+// ---------------- Hardware access ----------------
+#if defined(SIM_NATIVE)
+#include "sim_adc.h"
+#include "sim_capture.h"
+
+static inline void hwAdcSelect(uint8_t ch) { simAdcSelect(ch); }
+static inline void hwAdcStart() { simAdcStart(125000, adcInterrupt); }
+static inline uint16_t hwAdcResult() { return simAdcResult(); }
+static inline void hwCaptureStart() { simCaptureStart(US_ECHO_PIN, 2000000, captureInterrupt); }
+static inline void hwCaptureEdge(bool rising) { simCaptureEdge(rising); }
+static inline uint16_t hwCaptureTicks() { return simCaptureTicks(); }
+
+#else
+#include <avr/interrupt.h>
+
+static inline void hwAdcSelect(uint8_t ch) {
+  ADMUX = _BV(REFS0) | (ch & 0x07);               // AVcc reference
+  if (ch & 0x08) ADCSRB |= _BV(MUX5);
+  else ADCSRB &= ~_BV(MUX5);
+}
+// Free running, prescaler 128: 125 kHz ADC clock, ~9.6k conversions/s
+static inline void hwAdcStart() {
+  ADCSRB &= ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0));
+  ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) |
+           _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+static inline uint16_t hwAdcResult() { return ADC; }
+
+// Timer5 free running at 2 MHz (prescaler 8) with the noise canceler on
+static inline void hwCaptureStart() {
+  TCCR5A = 0;
+  TCCR5B = _BV(ICNC5) | _BV(ICES5) | _BV(CS51);
+  TIFR5 = _BV(ICF5);
+  TIMSK5 = _BV(ICIE5);
+}
+static inline void hwCaptureEdge(bool rising) {
+  if (rising) TCCR5B |= _BV(ICES5);
+  else TCCR5B &= ~_BV(ICES5);
+  TIFR5 = _BV(ICF5);       // changing the edge can set a false capture
+}
+static inline uint16_t hwCaptureTicks() { return ICR5; }
+
+ISR(ADC_vect) { adcInterrupt(); }
+ISR(TIMER5_CAPT_vect) { captureInterrupt(); }
+#endif
+
+// ---------------- Frames ----------------
+static const uint8_t adcPins[SENSOR_ADC_CHANNELS] = {
+  BATTERY_ADC_PIN, M1_CURRENT_PIN, M2_CURRENT_PIN, M3_CURRENT_PIN, M4_CURRENT_PIN
+};
+
+// The ADC interrupt fills the back buffer and then flips frontFrame. A
+// frame's seq is zeroed while it is being written, so a reader that was
+// preempted mid-copy sees the change and copies again.
+static SensorFrame frames[2];
+static volatile uint8_t frontFrame = 0;
+static uint8_t nextSeq = 1;
+static volatile unsigned long framesPublished = 0;
+
+static uint16_t adcSums[SENSOR_ADC_CHANNELS];
+static uint8_t adcPasses = 0;
+static volatile uint8_t adcConverting = 0;   // index of the conversion in progress
+static volatile uint8_t adcQueued = 0;       // index the mux is set to
+
+static volatile uint16_t rangeMm = 0;
+static volatile unsigned long rangeTimeUs = 0;
+
+static void publishFrame() {
+  uint8_t back = frontFrame ^ 1;
+  SensorFrame &f = frames[back];
+  f.seq = 0;
+  COMPILER_BARRIER();
+  f.timeUs = micros();
+  for (uint8_t i = 0; i < SENSOR_ADC_CHANNELS; i++) {
+    f.adc[i] = adcSums[i] / SENSOR_ADC_AVG;
+    adcSums[i] = 0;
+  }
+  f.rangeMm = rangeMm;
+  f.rangeTimeUs = rangeTimeUs;
+  COMPILER_BARRIER();
+  f.seq = nextSeq;
+  nextSeq = nextSeq == 255 ? 1 : nextSeq + 1;
+  frontFrame = back;
+  framesPublished++;
+}
+
+// ADC_vect body. In free-running mode the next conversion has already
+// started with the previous mux setting when this runs, so the result
+// belongs to adcConverting and the mux is set one conversion ahead.
+static void adcInterrupt() {
+  uint16_t value = hwAdcResult();
+  uint8_t done = adcConverting;
+  adcConverting = adcQueued;
+  adcQueued = adcQueued + 1 < SENSOR_ADC_CHANNELS ? adcQueued + 1 : 0;
+  hwAdcSelect(adcPins[adcQueued] - A0);
+
+  adcSums[done] += value;
+  if (done >= SENSOR_CURRENT_M1) safetyCheckCurrent(done - SENSOR_CURRENT_M1, value);
+  if (done == SENSOR_ADC_CHANNELS - 1 && ++adcPasses >= SENSOR_ADC_AVG) {
+    adcPasses = 0;
+    publishFrame();
+  }
+}
+
+bool sensorsGetFrame(SensorFrame &out) {
+  for (uint8_t tries = 0; tries < 4; tries++) {
+    const SensorFrame &f = frames[frontFrame];
+    uint8_t seq = *(volatile const uint8_t *)&f.seq;
+    COMPILER_BARRIER();
+    memcpy(&out, &f, sizeof(out));
+    COMPILER_BARRIER();
+    if (seq != 0 && seq == *(volatile const uint8_t *)&f.seq) return true;
+  }
+  return false;
+}
+
+unsigned long sensorFrameCount() {
+  noInterrupts();
+  unsigned long n = framesPublished;
+  interrupts();
+  return n;
+}
+
+// ---------------- Ultrasonic ----------------
+enum EchoState : uint8_t { ECHO_IDLE, ECHO_WAIT_RISE, ECHO_WAIT_FALL };
+
+const unsigned long RANGE_MAX_ECHO_US = 25000;   // ~4.3 m
+
+static volatile uint8_t echoState = ECHO_IDLE;
+static volatile uint16_t echoStart = 0;
+static volatile unsigned long echoStartUs = 0;
+static unsigned long lastPingMs = 0;
+
+// TIMER5_CAPT_vect body: time the echo pulse between its two edges. The
+// 16-bit capture wraps after 32 ms, and the sensor holds echo high for
+// ~38 ms when nothing answers, so long pulses are checked with micros().
+// Such a pulse is a clear path, not a missing echo.
+static void captureInterrupt() {
+  uint16_t ticks = hwCaptureTicks();
+  if (echoState == ECHO_WAIT_RISE) {
+    echoStart = ticks;
+    echoStartUs = micros();
+    echoState = ECHO_WAIT_FALL;
+    hwCaptureEdge(false);
+  } else if (echoState == ECHO_WAIT_FALL) {
+    uint16_t width = ticks - echoStart;               // 0.5 us ticks
+    unsigned long now = micros();
+    if (now - echoStartUs > RANGE_MAX_ECHO_US) rangeMm = RANGE_CLEAR;
+    else rangeMm = (uint16_t)(((uint32_t)width * 343) / 4000);   // 343 m/s, there and back
+    rangeTimeUs = now;
+    echoState = ECHO_IDLE;
+    hwCaptureEdge(true);
+    safetyCheckRange(rangeMm);
+  }
+}
+
+void processSensors() {
+  unsigned long now = millis();
+  if (now - lastPingMs < RANGE_PERIOD_MS) return;
+  lastPingMs = now;
+
+  noInterrupts();
+  if (echoState != ECHO_IDLE) {   // no echo edge, or one stuck high: a dead or missing sensor
+    rangeMm = 0;
+    safetyCheckRange(0);
+  }
+  echoState = ECHO_WAIT_RISE;
+  hwCaptureEdge(true);
+  interrupts();
+
+  digitalWrite(US_TRIG_PIN, HIGH);
+  delayMicroseconds(10);
+  digitalWrite(US_TRIG_PIN, LOW);
+}
+
+// ---------------- Setup and conversions ----------------
+void initializeSensors() {
+  pinMode(US_TRIG_PIN, OUTPUT);
+  digitalWrite(US_TRIG_PIN, LOW);
+  pinMode(US_ECHO_PIN, INPUT);
+  hwCaptureStart();
+
+  adcConverting = adcQueued = 0;
+  hwAdcSelect(adcPins[0] - A0);
+  hwAdcStart();
+}
+
+float sensorBatteryVolts(const SensorFrame &f) {
+  return f.adc[SENSOR_BATTERY] * (5.0 / 1023.0) * BATTERY_DIVIDER;
+}
+
+float sensorMotorAmps(const SensorFrame &f, uint8_t motor) {
+  if (motor < 1 || motor > 4) return 0;
+  float volts = f.adc[SENSOR_CURRENT_M1 + motor - 1] * (5.0 / 1023.0);
+  return (volts - 2.5) / CURRENT_SENSE_V_PER_A;
+}
+
+// SENS <battery mV> <M1 mA> <M2 mA> <M3 mA> <M4 mA> <range mm>
+void sendSensorPacket(Print &out) {
+  SensorFrame f;
+  if (!sensorsGetFrame(f)) return;
+  out.print(F("SENS "));
+  out.print((long)(sensorBatteryVolts(f) * 1000));
+  for (uint8_t m = 1; m <= 4; m++) {
+    out.print(' ');
+    out.print((long)(sensorMotorAmps(f, m) * 1000));
+  }
+  out.print(' ');
+  out.println(f.rangeMm);
+}
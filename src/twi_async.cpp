@@ -0,0 +1,151 @@
+#include "twi_async.h"
+
+// ---------------- Hardware access ----------------
+#if defined(SIM_NATIVE)
+#include "sim_twi.h"
+
+static unsigned long twiClockHz = 100000;
+
+static inline void hwInit(unsigned long clockHz) { twiClockHz = clockHz; simTwiInit(clockHz); }
+static inline void hwStart() { simTwiStart(); }
+static inline void hwStop() { simTwiStop(); }
+static inline void hwWrite(uint8_t b) { simTwiWrite(b); }
+static inline void hwRead(bool ack) { simTwiRead(ack); }
+static inline uint8_t hwData() { return simTwiData(); }
+static inline uint8_t hwStatus() { return simTwiStatus(); }
+static inline void hwDisable() { simTwiInit(twiClockHz); }
+static inline void hwWaitStop() {}
+
+#else
+#include <avr/interrupt.h>
+
+#define TWCR_RUN (_BV(TWEN) | _BV(TWIE) | _BV(TWINT))
+
+static inline void hwInit(unsigned long clockHz) {
+  TWSR = 0;                                       // prescaler 1
+  TWBR = (uint8_t)(((F_CPU / clockHz) - 16) / 2);
+  TWCR = _BV(TWEN);
+}
+static inline void hwStart() { TWCR = TWCR_RUN | _BV(TWSTA); }
+static inline void hwStop() { TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWSTO); }
+static inline void hwWrite(uint8_t b) { TWDR = b; TWCR = TWCR_RUN; }
+static inline void hwRead(bool ack) { TWCR = TWCR_RUN | (ack ? _BV(TWEA) : 0); }
+static inline uint8_t hwData() { return TWDR; }
+static inline uint8_t hwStatus() { return TWSR & 0xF8; }
+static inline void hwDisable() { TWCR = 0; TWCR = _BV(TWEN); }
+// A STOP takes a few bus bit times to go out before the next START
+static inline void hwWaitStop() {
+  uint8_t spins = 255;
+  while ((TWCR & _BV(TWSTO)) && --spins) {}
+}
+
+ISR(TWI_vect) { twiInterrupt(); }
+#endif
+
+// ---------------- Transfer state ----------------
+static volatile bool twiActive = false;
+static uint8_t twiAddr;
+static const uint8_t *twiTx;
+static uint8_t twiTxLen, twiTxIndex;
+static uint8_t *twiRx;
+static uint8_t twiRxLen, twiRxIndex;
+static TwiCallback twiDone;
+
+void twiInit(unsigned long clockHz) {
+  hwInit(clockHz);
+  twiActive = false;
+}
+
+bool twiBusy() {
+  return twiActive;
+}
+
+bool twiTransfer(uint8_t addr, const uint8_t *tx, uint8_t txLen,
+                 uint8_t *rx, uint8_t rxLen, TwiCallback done) {
+  if (twiActive || (txLen == 0 && rxLen == 0)) return false;
+  twiActive = true;
+  twiAddr = addr;
+  twiTx = tx;
+  twiTxLen = txLen;
+  twiTxIndex = 0;
+  twiRx = rx;
+  twiRxLen = rxLen;
+  twiRxIndex = 0;
+  twiDone = done;
+  hwWaitStop();
+  hwStart();
+  return true;
+}
+
+// For setup code only: spins until the interrupt-driven transfer finishes
+static volatile bool blockingOk;
+static void blockingDone(bool ok) { blockingOk = ok; }
+
+bool twiTransferBlocking(uint8_t addr, const uint8_t *tx, uint8_t txLen,
+                         uint8_t *rx, uint8_t rxLen) {
+  blockingOk = false;
+  if (!twiTransfer(addr, tx, txLen, rx, rxLen, blockingDone)) return false;
+  for (uint16_t waited = 0; twiActive; waited += 10) {
+    if (waited >= 5000) {
+      twiReset();
+      return false;
+    }
+    delayMicroseconds(10);
+  }
+  return blockingOk;
+}
+
+// Abandon the current transfer (bus watchdog); no callback is made
+void twiReset() {
+  hwStop();
+  hwDisable();
+  twiActive = false;
+}
+
+static void twiFinish(bool ok) {
+  hwStop();
+  twiActive = false;
+  // The callback may start the next transfer right away
+  if (twiDone) twiDone(ok);
+}
+
+// TWI_vect body: advances the transfer one bus event at a time
+void twiInterrupt() {
+  switch (hwStatus()) {
+    case TWI_ST_START:
+    case TWI_ST_REP_START:
+      // Write phase first if there is one, then address for reading
+      hwWrite((twiAddr << 1) | (twiTxIndex < twiTxLen ? 0 : 1));
+      break;
+
+    case TWI_ST_MT_SLA_ACK:
+    case TWI_ST_MT_DATA_ACK:
+      if (twiTxIndex < twiTxLen) {
+        hwWrite(twiTx[twiTxIndex++]);
+      } else if (twiRxLen > 0) {
+        hwStart();                 // repeated start into the read phase
+      } else {
+        twiFinish(true);
+      }
+      break;
+
+    case TWI_ST_MR_SLA_ACK:
+      hwRead(twiRxLen > 1);        // NACK the only byte
+      break;
+
+    case TWI_ST_MR_DATA_ACK:
+      twiRx[twiRxIndex++] = hwData();
+      hwRead(twiRxIndex < twiRxLen - 1);
+      break;
+
+    case TWI_ST_MR_DATA_NACK:
+      twiRx[twiRxIndex++] = hwData();
+      twiFinish(true);
+      break;
+
+    default:
+      // Address or data NACK, arbitration lost, bus error
+      twiFinish(false);
+      break;
+  }
+}
@@ -0,0 +1,133 @@
+#include "twist.h"
+#include "motor_control.h"
+#include "motor_calibration.h"
+#include "pose_ekf.h"
+#include "fixed_math.h"
+#include "config.h"
+
+// ---------------- Kinematics ----------------
+static bool running = false;
+static TwistMode mode = TWIST_OPEN_LOOP;
+static uint16_t trackMm = (uint16_t)(TRACK_WIDTH * 1000);
+static int16_t targetV = 0, targetW = 0;
+static WheelSpeeds lastWheels;
+
+// Closed loop: integrators in mm/s and mrad/s, Q8
+static int32_t integralV = 0, integralW = 0;
+
+const int32_t KP_Q8 = (int32_t)(TWIST_KP * 256);
+const int32_t KI_Q8 = (int32_t)(TWIST_KI * EKF_MS / 1000.0 * 256);   // per filter step
+
+void twistToWheels(int32_t vxMmps, int32_t wzMradps, uint16_t trackMm, int32_t limitMmps,
+                   WheelSpeeds &out) {
+  int32_t turn = wzMradps * (int32_t)trackMm / 2000;
+  int32_t left = vxMmps - turn, right = vxMmps + turn;
+  int32_t big = abs(left) > abs(right) ? abs(left) : abs(right);
+  out.saturated = big > limitMmps;
+  if (out.saturated) {
+    fix scale = (limitMmps << 16) / big;   // Q16, < 1; a 32 bit divide, limit < 32768
+    left = mulq(left, scale, 16);
+    right = mulq(right, scale, 16);
+  }
+  out.left = left;
+  out.right = right;
+}
+
+// Full scale of each direction: the calibrated reference speed, or the
+// nominal one. The limit is the smaller, so both directions can reach it.
+static int32_t fullScale(bool reverse) {
+  int ref = motorCalibrationRefMmps(reverse);
+  return ref > 0 ? ref : TWIST_FULL_SCALE_MMPS;
+}
+
+static int32_t limit() {
+  int32_t fwd = fullScale(false), rev = fullScale(true);
+  return fwd < rev ? fwd : rev;
+}
+
+static int toCommand(int32_t mmps) {
+  return (int)(mmps * 255 / fullScale(mmps < 0));
+}
+
+static void drive(int32_t vx, int32_t wz) {
+  twistToWheels(vx, wz, trackMm, limit(), lastWheels);
+  int left = toCommand(lastWheels.left), right = toCommand(lastWheels.right);
+  setM1(left); setM3(left); setM2(right); setM4(right);
+}
+
+static void measured(int32_t &vMmps, int32_t &wMradps) {
+  int32_t vQ24, wQ24;
+  getVelocityFixed(vQ24, wQ24);
+  vMmps = (int32_t)(((int64_t)vQ24 * 1000) >> 24);
+  wMradps = (int32_t)(((int64_t)wQ24 * 1000) >> 24);
+}
+
+// ---------------- Commands ----------------
+void twistSet(int vxMmps, int wzMradps) {
+  targetV = constrain(vxMmps, -4000, 4000);
+  targetW = constrain(wzMradps, -20000, 20000);
+  integralV = integralW = 0;
+  if (targetV == 0 && targetW == 0) {
+    stopAll();
+    running = false;
+    lastWheels = WheelSpeeds{0, 0, false};
+    return;
+  }
+  drive(targetV, targetW);
+  running = true;
+}
+
+bool twistSetTrack(uint16_t mm) {
+  if (mm < 50 || mm > 2000) return false;
+  trackMm = mm;
+  return true;
+}
+
+void twistSetMode(TwistMode m) {
+  mode = m;
+  integralV = integralW = 0;
+}
+
+void twistCancel() {
+  running = false;
+}
+
+void twistGetStatus(TwistStatus &out) {
+  int32_t v, w;
+  measured(v, w);
+  out.running = running;
+  out.mode = mode;
+  out.trackMm = trackMm;
+  out.fullScaleMmps = limit();
+  out.wheels = lastWheels;
+  out.vMmps = v;
+  out.wMradps = w;
+}
+
+// ---------------- Closed loop ----------------
+// The PI tracks the twist the wheels can give: the target scaled down like
+// the wheel speeds were, so it never fights the saturation. That twist is
+// also the feed-forward; the PI adds what the filter says is missing. The
+// integrators hold while the output is saturated, since more command
+// couldn't go anywhere.
+void processTwist() {
+  if (!running || mode != TWIST_CLOSED_LOOP) return;
+  int32_t full = limit();
+  WheelSpeeds feasible;
+  twistToWheels(targetV, targetW, trackMm, full, feasible);
+  int32_t v0 = ((int32_t)feasible.left + feasible.right) / 2;
+  int32_t w0 = ((int32_t)feasible.right - feasible.left) * 1000 / trackMm;
+
+  int32_t v, w;
+  measured(v, w);
+  int32_t errV = v0 - v, errW = w0 - w;
+  if (!lastWheels.saturated) {
+    // At most full scale: the speed, and the turn rate with the wheels at +-full
+    int32_t capV = full << 8;
+    int32_t capW = (full * 2000 / trackMm) << 8;
+    integralV = constrain(integralV + errV * KI_Q8, -capV, capV);
+    integralW = constrain(integralW + errW * KI_Q8, -capW, capW);
+  }
+  drive(v0 + ((errV * KP_Q8 + integralV) >> 8),
+        w0 + ((errW * KP_Q8 + integralW) >> 8));
+}